@@ -0,0 +1,130 @@
+#include "utest.h"
+#include "util.h"
+
+#include <aio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/event.h>
+#include <unistd.h>
+
+#define NREQS 4
+#define REQSIZE 4096
+
+static char wrbuf[NREQS][REQSIZE];
+static char rdbuf[NREQS][REQSIZE];
+
+static void fill_buffers(void) {
+  for (int i = 0; i < NREQS; i++)
+    memset(wrbuf[i], 'a' + i, REQSIZE);
+  memset(rdbuf, 0, sizeof(rdbuf));
+}
+
+static void init_aiocb(struct aiocb *cb, int fd, void *buf, int i) {
+  memset(cb, 0, sizeof(struct aiocb));
+  cb->aio_fildes = fd;
+  cb->aio_buf = buf;
+  cb->aio_nbytes = REQSIZE;
+  cb->aio_offset = i * REQSIZE;
+}
+
+static void wait_aio(struct aiocb *cb) {
+  const struct aiocb *list[1] = {cb};
+  while (aio_error(cb) == EINPROGRESS)
+    assert(aio_suspend(list, 1, NULL) == 0);
+}
+
+TEST_ADD(aio_rw, TF_TMPDIR) {
+  struct aiocb cb[NREQS];
+  struct aiocb *list[NREQS];
+  int fd = xopen("file", O_RDWR | O_CREAT, 0644);
+
+  fill_buffers();
+
+  /* Write at different offsets and wait for each request in turn. */
+  for (int i = 0; i < NREQS; i++) {
+    init_aiocb(&cb[i], fd, wrbuf[i], i);
+    assert(aio_write(&cb[i]) == 0);
+  }
+  for (int i = 0; i < NREQS; i++) {
+    wait_aio(&cb[i]);
+    assert(aio_error(&cb[i]) == 0);
+    assert(aio_return(&cb[i]) == REQSIZE);
+  }
+
+  /* Reaped request is forgotten by the kernel. */
+  syscall_fail(aio_error(&cb[0]), EINVAL);
+
+  /* File offset is not used. */
+  assert(lseek(fd, 0, SEEK_CUR) == 0);
+
+  /* Read the data back with a single call. */
+  for (int i = 0; i < NREQS; i++) {
+    init_aiocb(&cb[i], fd, rdbuf[i], i);
+    cb[i].aio_lio_opcode = LIO_READ;
+    list[i] = &cb[i];
+  }
+  assert(lio_listio(LIO_WAIT, list, NREQS, NULL) == 0);
+  for (int i = 0; i < NREQS; i++)
+    assert(aio_return(&cb[i]) == REQSIZE);
+  assert(memcmp(rdbuf, wrbuf, sizeof(wrbuf)) == 0);
+
+  /* Invalid requests are rejected upfront. */
+  init_aiocb(&cb[0], -1, rdbuf[0], 0);
+  syscall_fail(aio_read(&cb[0]), EBADF);
+  init_aiocb(&cb[0], fd, rdbuf[0], 0);
+  cb[0].aio_offset = -1;
+  syscall_fail(aio_read(&cb[0]), EINVAL);
+
+  xclose(fd);
+  return 0;
+}
+
+TEST_ADD(aio_kevent, TF_TMPDIR) {
+  struct aiocb cb[NREQS];
+  struct kevent kev[NREQS];
+  int fd = xopen("file", O_RDWR | O_CREAT, 0644);
+  int kq = kqueue();
+  assert(kq >= 0);
+
+  fill_buffers();
+  for (int i = 0; i < NREQS; i++)
+    assert(pwrite(fd, wrbuf[i], REQSIZE, i * REQSIZE) == REQSIZE);
+
+  /* Keep all requests in flight and collect completions from kqueue. */
+  for (int i = 0; i < NREQS; i++) {
+    init_aiocb(&cb[i], fd, rdbuf[i], i);
+    cb[i].aio_sigevent.sigev_notify = SIGEV_KEVENT;
+    cb[i].aio_sigevent.sigev_notify_kqueue = kq;
+    cb[i].aio_sigevent.sigev_value.sival_ptr = (void *)(intptr_t)i;
+    assert(aio_read(&cb[i]) == 0);
+  }
+
+  int done = 0;
+  while (done < NREQS) {
+    int n = kevent(kq, NULL, 0, kev, NREQS, NULL);
+    assert(n > 0);
+    for (int j = 0; j < n; j++) {
+      struct aiocb *cbp = (struct aiocb *)kev[j].ident;
+      int i = cbp - cb;
+      assert(kev[j].filter == EVFILT_AIO);
+      assert(i >= 0 && i < NREQS);
+      assert((intptr_t)kev[j].udata == i);
+      assert(aio_error(cbp) == 0);
+      /* Reaping the request removes its event from the queue. */
+      assert(aio_return(cbp) == REQSIZE);
+      assert(memcmp(rdbuf[i], wrbuf[i], REQSIZE) == 0);
+      done++;
+    }
+  }
+
+  /* EVFILT_AIO events can't be registered directly. */
+  EV_SET(&kev[0], (uintptr_t)&cb[0], EVFILT_AIO, EV_ADD, 0, 0, NULL);
+  assert(kevent(kq, kev, 1, kev, 1, NULL) == 1);
+  assert(kev[0].flags == EV_ERROR && kev[0].data == EINVAL);
+
+  xclose(kq);
+  xclose(fd);
+  return 0;
+}
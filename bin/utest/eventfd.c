@@ -0,0 +1,99 @@
+#include "utest.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/event.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+TEST_ADD(eventfd_counter, 0) {
+  eventfd_t value;
+
+  int fd = eventfd(3, EFD_NONBLOCK);
+  assert(fd >= 0);
+
+  /* Reading takes the whole counter. */
+  assert(eventfd_write(fd, 4) == 0);
+  assert(eventfd_read(fd, &value) == 0);
+  assert(value == 7);
+  syscall_fail(read(fd, &value, sizeof(value)), EAGAIN);
+
+  /* Values must be transferred as a whole. */
+  syscall_fail(read(fd, &value, sizeof(value) - 1), EINVAL);
+  syscall_fail(write(fd, &value, sizeof(value) - 1), EINVAL);
+
+  /* Counter can't overflow. */
+  value = (eventfd_t)-1;
+  syscall_fail(write(fd, &value, sizeof(value)), EINVAL);
+  assert(eventfd_write(fd, EVENTFD_MAX) == 0);
+  value = 1;
+  syscall_fail(write(fd, &value, sizeof(value)), EAGAIN);
+
+  xclose(fd);
+  syscall_fail(eventfd(0, O_APPEND), EINVAL);
+  return 0;
+}
+
+TEST_ADD(eventfd_semaphore, 0) {
+  eventfd_t value;
+
+  int fd = eventfd(2, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+  assert(fd >= 0);
+  assert(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+
+  /* Each read takes a single unit. */
+  for (int i = 0; i < 2; i++) {
+    assert(eventfd_read(fd, &value) == 0);
+    assert(value == 1);
+  }
+  syscall_fail(read(fd, &value, sizeof(value)), EAGAIN);
+
+  xclose(fd);
+  return 0;
+}
+
+TEST_ADD(eventfd_notify, 0) {
+  struct kevent kev;
+  struct timespec ts = {0, 0};
+  eventfd_t value;
+
+  int fd = eventfd(0, 0);
+  assert(fd >= 0);
+
+  int kq = kqueue();
+  assert(kq >= 0);
+  EV_SET(&kev, fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  assert(kevent(kq, NULL, 0, &kev, 1, &ts) == 0);
+
+  /* Child process rings the doorbell while parent is waiting. */
+  pid_t pid = xfork();
+  if (pid == 0) {
+    for (int i = 0; i < 10; i++)
+      assert(eventfd_write(fd, 1) == 0);
+    exit(0);
+  }
+
+  /* Blocking read returns as soon as the counter is non-zero. */
+  value = 0;
+  while (value < 10) {
+    eventfd_t n;
+    assert(eventfd_read(fd, &n) == 0);
+    assert(n > 0);
+    value += n;
+  }
+  assert(value == 10);
+  wait_child_finished(pid);
+
+  /* The counter is now zero, so it's not readable. */
+  assert(kevent(kq, NULL, 0, &kev, 1, &ts) == 0);
+  assert(eventfd_write(fd, 5) == 0);
+  assert(kevent(kq, NULL, 0, &kev, 1, &ts) == 1);
+  assert(kev.ident == (uintptr_t)fd && kev.data == 5);
+
+  xclose(kq);
+  xclose(fd);
+  return 0;
+}
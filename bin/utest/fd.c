@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
+#include <sys/sendfile.h>
 #include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -264,6 +265,98 @@ TEST_ADD(fd_writev, 0) {
   return 0;
 }
 
+TEST_ADD(fd_pread, 0) {
+  struct iovec iov[10];
+  int fd = FD_OFFSET;
+  int pfd[2];
+
+  for (size_t i = 0; i < sizeof(buf); i++)
+    buf[i] = (char)i;
+
+  assert_open_ok(0, "/tmp/file", 0, O_RDWR | O_CREAT);
+
+  /* Positional I/O does not move the file offset. */
+  assert(pwrite(fd, buf, 60, 10) == 60);
+  assert(lseek(fd, 0, SEEK_CUR) == 0);
+  init_iovec(buf, iov, 10, 20, 30);
+  assert(pwritev(fd, iov, 3, 70) == 60);
+  assert(lseek(fd, 0, SEEK_CUR) == 0);
+
+  memset(buf, 0, sizeof(buf));
+  assert(pread(fd, buf, 30, 20) == 30);
+  for (size_t i = 0; i < 30; i++)
+    assert(buf[i] == (char)(i + 10));
+
+  memset(buf, 0, sizeof(buf));
+  init_iovec(buf, iov, 10, 20, 30);
+  assert(preadv(fd, iov, 3, 70) == 60);
+  for (size_t i = 0; i < 60; i++)
+    assert(buf[i] == (char)i);
+
+  /* Reading past the end of file returns no data. */
+  assert(pread(fd, buf, 10, 200) == 0);
+  syscall_fail(pread(fd, buf, 10, -1), EINVAL);
+  assert_close_ok(0);
+  unlink("/tmp/file");
+
+  /* Pipes are not seekable. */
+  xpipe(pfd);
+  syscall_fail(pwrite(pfd[1], buf, 1, 0), ESPIPE);
+  syscall_fail(pread(pfd[0], buf, 1, 0), ESPIPE);
+  xclose(pfd[0]);
+  xclose(pfd[1]);
+  return 0;
+}
+
+TEST_ADD(fd_sendfile, 0) {
+  int fd = FD_OFFSET;
+  int pfd[2];
+  off_t off;
+
+  for (size_t i = 0; i < sizeof(buf); i++)
+    buf[i] = (char)i;
+
+  assert_open_ok(0, "/tmp/file", 0, O_RDWR | O_CREAT);
+  assert(write(fd, buf, 80) == 80);
+  assert(lseek(fd, 10, SEEK_SET) == 10);
+  xpipe(pfd);
+
+  /* Without offset pointer the file offset is used and advanced. */
+  assert(sendfile(pfd[1], fd, NULL, 20) == 20);
+  assert(lseek(fd, 0, SEEK_CUR) == 30);
+
+  /* With offset pointer the file offset stays intact. */
+  off = 60;
+  assert(sendfile(pfd[1], fd, &off, 100) == 20);
+  assert(off == 80);
+  assert(lseek(fd, 0, SEEK_CUR) == 30);
+
+  memset(buf, 0, sizeof(buf));
+  assert(read(pfd[0], buf, 40) == 40);
+  for (size_t i = 0; i < 20; i++) {
+    assert(buf[i] == (char)(i + 10));
+    assert(buf[i + 20] == (char)(i + 60));
+  }
+
+  /* Input must be a regular file for sendfile, but not for splice. */
+  syscall_fail(sendfile(fd, pfd[0], NULL, 10), EINVAL);
+  assert(write(pfd[1], str, strlen(str)) == (ssize_t)strlen(str));
+  off = 0;
+  assert(splice(pfd[0], NULL, fd, &off, 100, 0) == (ssize_t)strlen(str));
+  assert(off == (off_t)strlen(str));
+  syscall_fail(splice(pfd[0], &off, fd, NULL, 10, 0), ESPIPE);
+
+  memset(buf, 0, sizeof(buf));
+  assert(pread(fd, buf, strlen(str), 0) == (ssize_t)strlen(str));
+  assert(strncmp(buf, str, strlen(str)) == 0);
+
+  xclose(pfd[0]);
+  xclose(pfd[1]);
+  assert_close_ok(0);
+  unlink("/tmp/file");
+  return 0;
+}
+
 /* Tests below do not use std* file descriptors */
 #undef FD_OFFSET
 #define FD_OFFSET 0
@@ -297,6 +390,8 @@ TEST_ADD(fd_all, 0) {
   test_fd_read();
   test_fd_readv();
   test_fd_writev();
+  test_fd_pread();
+  test_fd_sendfile();
   test_fd_devnull();
   test_fd_multidesc();
   test_fd_readwrite();
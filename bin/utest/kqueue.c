@@ -0,0 +1,333 @@
+#include "utest.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/event.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static struct timespec nowait = {0, 0};
+
+static int kq_pipe(int pipe_fd[2], uint32_t flags) {
+  struct kevent kev;
+  int kq = kqueue1(O_CLOEXEC);
+  assert(kq >= 0);
+
+  assert(pipe2(pipe_fd, 0) == 0);
+
+  EV_SET(&kev, pipe_fd[0], EVFILT_READ, EV_ADD | flags, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  return kq;
+}
+
+static int kq_wait(int kq, struct kevent *kev) {
+  return kevent(kq, NULL, 0, kev, 1, &nowait);
+}
+
+TEST_ADD(kevent_level, 0) {
+  int pipe_fd[2];
+  struct kevent kev;
+  int kq = kq_pipe(pipe_fd, 0);
+
+  assert(kq_wait(kq, &kev) == 0);
+
+  /* Event is reported as long as there is data in the pipe. */
+  assert(xwrite(pipe_fd[1], "ab", 2) == 2);
+  assert(kq_wait(kq, &kev) == 1);
+  assert(kev.ident == (uintptr_t)pipe_fd[0] && kev.data == 2);
+  assert(kq_wait(kq, &kev) == 1);
+
+  char buf[2];
+  assert(xread(pipe_fd[0], buf, 2) == 2);
+  assert(kq_wait(kq, &kev) == 0);
+
+  xclose(pipe_fd[0]);
+  xclose(pipe_fd[1]);
+  xclose(kq);
+  return 0;
+}
+
+TEST_ADD(kevent_clear, 0) {
+  int pipe_fd[2];
+  struct kevent kev;
+  int kq = kq_pipe(pipe_fd, EV_CLEAR);
+
+  /* Event is reported once per write, even if data wasn't consumed. */
+  assert(xwrite(pipe_fd[1], "a", 1) == 1);
+  assert(kq_wait(kq, &kev) == 1);
+  assert(kev.flags & EV_CLEAR);
+  assert(kq_wait(kq, &kev) == 0);
+
+  assert(xwrite(pipe_fd[1], "b", 1) == 1);
+  assert(kq_wait(kq, &kev) == 1);
+  assert(kev.data == 2);
+  assert(kq_wait(kq, &kev) == 0);
+
+  xclose(pipe_fd[0]);
+  xclose(pipe_fd[1]);
+  xclose(kq);
+  return 0;
+}
+
+TEST_ADD(kevent_oneshot, 0) {
+  int pipe_fd[2];
+  struct kevent kev;
+  int kq = kq_pipe(pipe_fd, EV_ONESHOT);
+
+  assert(xwrite(pipe_fd[1], "a", 1) == 1);
+  assert(kq_wait(kq, &kev) == 1);
+  assert(kq_wait(kq, &kev) == 0);
+
+  /* The knote is gone after it has been reported. */
+  EV_SET(&kev, pipe_fd[0], EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, &kev, 1, &nowait) == 1);
+  assert(kev.flags == EV_ERROR && kev.data == ENOENT);
+
+  xclose(pipe_fd[0]);
+  xclose(pipe_fd[1]);
+  xclose(kq);
+  return 0;
+}
+
+TEST_ADD(kevent_dispatch, 0) {
+  int pipe_fd[2];
+  struct kevent kev;
+  int kq = kq_pipe(pipe_fd, EV_DISPATCH);
+
+  assert(xwrite(pipe_fd[1], "a", 1) == 1);
+  assert(kq_wait(kq, &kev) == 1);
+
+  /* The knote is disabled after it has been reported. */
+  assert(xwrite(pipe_fd[1], "b", 1) == 1);
+  assert(kq_wait(kq, &kev) == 0);
+
+  /* Pending event is reported once the knote is enabled again. */
+  EV_SET(&kev, pipe_fd[0], EVFILT_READ, EV_ENABLE, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  assert(kq_wait(kq, &kev) == 1);
+  assert(kev.data == 2);
+
+  xclose(pipe_fd[0]);
+  xclose(pipe_fd[1]);
+  xclose(kq);
+  return 0;
+}
+
+TEST_ADD(kevent_disable, 0) {
+  int pipe_fd[2];
+  struct kevent kev;
+  int kq = kq_pipe(pipe_fd, EV_DISABLE);
+
+  assert(xwrite(pipe_fd[1], "a", 1) == 1);
+  assert(kq_wait(kq, &kev) == 0);
+
+  EV_SET(&kev, pipe_fd[0], EVFILT_READ, EV_ENABLE, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  assert(kq_wait(kq, &kev) == 1);
+
+  /* Disabling the knote removes its event from the queue. */
+  EV_SET(&kev, pipe_fd[0], EVFILT_READ, EV_DISABLE, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  assert(kq_wait(kq, &kev) == 0);
+
+  xclose(pipe_fd[0]);
+  xclose(pipe_fd[1]);
+  xclose(kq);
+  return 0;
+}
+
+TEST_ADD(kevent_many, 0) {
+  int pipe_fd[16][2];
+  struct kevent kev[16];
+  int kq = kqueue1(O_CLOEXEC);
+  assert(kq >= 0);
+
+  /* Exceed the initial size of the hash table and the size of a batch
+   * processed by a single scan. */
+  for (int i = 0; i < 16; i++) {
+    assert(pipe2(pipe_fd[i], 0) == 0);
+    EV_SET(&kev[0], pipe_fd[i][1], EVFILT_WRITE, EV_ADD, 0, 0,
+           (void *)(intptr_t)i);
+    EV_SET(&kev[1], pipe_fd[i][0], EVFILT_READ, EV_ADD, 0, 0,
+           (void *)(intptr_t)i);
+    assert(kevent(kq, kev, 2, NULL, 0, NULL) == 0);
+  }
+
+  /* All pipes are writable, none is readable. */
+  assert(kevent(kq, NULL, 0, kev, 16, &nowait) == 16);
+  for (int i = 0; i < 16; i++)
+    assert(kev[i].filter == EVFILT_WRITE);
+
+  /* Events that don't fit into the event list are reported by the next call.
+   * Every event is reported once per call. */
+  assert(kevent(kq, NULL, 0, kev, 10, &nowait) == 10);
+  assert(kevent(kq, NULL, 0, kev, 16, &nowait) == 16);
+
+  for (int i = 0; i < 16; i++) {
+    xclose(pipe_fd[i][0]);
+    xclose(pipe_fd[i][1]);
+  }
+  xclose(kq);
+  return 0;
+}
+
+TEST_ADD(kevent_timer, 0) {
+  struct kevent kev;
+  int kq = kqueue1(O_CLOEXEC);
+  assert(kq >= 0);
+
+  /* Periodic timer reports number of expirations since the last call. */
+  EV_SET(&kev, 1, EVFILT_TIMER, EV_ADD, 0, 10, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  assert(kevent(kq, NULL, 0, &kev, 1, NULL) == 1);
+  assert(kev.ident == 1 && kev.filter == EVFILT_TIMER && kev.data >= 1);
+
+  usleep(50000);
+  assert(kevent(kq, NULL, 0, &kev, 1, NULL) == 1);
+  assert(kev.data > 1);
+
+  EV_SET(&kev, 1, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+
+  /* One-shot timer fires once and then it's gone. */
+  EV_SET(&kev, 2, EVFILT_TIMER, EV_ADD | EV_ONESHOT, NOTE_USECONDS, 10000,
+         NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  assert(kevent(kq, NULL, 0, &kev, 1, NULL) == 1);
+  assert(kev.ident == 2 && kev.data == 1);
+  assert(kevent(kq, NULL, 0, &kev, 1, &nowait) == 0);
+
+  EV_SET(&kev, 2, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, &kev, 1, &nowait) == 1);
+  assert(kev.flags == EV_ERROR && kev.data == ENOENT);
+
+  xclose(kq);
+  return 0;
+}
+
+TEST_ADD(kevent_proc, 0) {
+  struct kevent kev;
+  int kq = kqueue1(O_CLOEXEC);
+  assert(kq >= 0);
+
+  int pipe_fd[2];
+  assert(pipe2(pipe_fd, 0) == 0);
+
+  pid_t pid = xfork();
+  if (pid == 0) {
+    char c;
+    xclose(pipe_fd[1]);
+    /* Wait until the parent starts watching us. */
+    assert(xread(pipe_fd[0], &c, 1) == 1);
+    exit(42);
+  }
+  xclose(pipe_fd[0]);
+
+  EV_SET(&kev, pid, EVFILT_PROC, EV_ADD, NOTE_EXIT, 0, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  assert(xwrite(pipe_fd[1], "x", 1) == 1);
+
+  assert(kevent(kq, NULL, 0, &kev, 1, NULL) == 1);
+  assert(kev.ident == (uintptr_t)pid && kev.filter == EVFILT_PROC);
+  assert(kev.fflags == NOTE_EXIT);
+  assert(kev.flags & EV_EOF);
+  assert(WIFEXITED(kev.data) && WEXITSTATUS(kev.data) == 42);
+
+  /* The child is a zombie at this point, so its exit is reported at once. */
+  EV_SET(&kev, pid, EVFILT_PROC, EV_ADD, NOTE_EXIT, 0, NULL);
+  assert(kevent(kq, &kev, 1, &kev, 1, &nowait) == 1);
+  assert(kev.ident == (uintptr_t)pid && kev.fflags == NOTE_EXIT);
+  assert(WIFEXITED(kev.data) && WEXITSTATUS(kev.data) == 42);
+
+  int status;
+  assert(waitpid(pid, &status, WNOHANG) == pid);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 42);
+
+  /* Reaped process can't be watched. */
+  EV_SET(&kev, pid, EVFILT_PROC, EV_ADD, NOTE_EXIT, 0, NULL);
+  assert(kevent(kq, &kev, 1, &kev, 1, &nowait) == 1);
+  assert(kev.flags == EV_ERROR && kev.data == ESRCH);
+
+  xclose(pipe_fd[1]);
+  xclose(kq);
+  return 0;
+}
+
+TEST_ADD(kevent_signal, 0) {
+  struct kevent kev;
+  int kq = kqueue1(O_CLOEXEC);
+  assert(kq >= 0);
+
+  /* Ignored signals are recorded too. */
+  signal(SIGUSR1, SIG_IGN);
+
+  EV_SET(&kev, SIGUSR1, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+
+  xkill(getpid(), SIGUSR1);
+  xkill(getpid(), SIGUSR1);
+
+  assert(kevent(kq, NULL, 0, &kev, 1, &nowait) == 1);
+  assert(kev.ident == SIGUSR1 && kev.filter == EVFILT_SIGNAL);
+  assert(kev.data == 2);
+  assert(kevent(kq, NULL, 0, &kev, 1, &nowait) == 0);
+
+  signal(SIGUSR1, SIG_DFL);
+  xclose(kq);
+  return 0;
+}
+
+#define NTIMERS 48 /* more than kqueue scans in a single batch */
+#define NROUNDS 200
+
+static void *kevent_scanner(void *arg) {
+  int kq = (intptr_t)arg;
+  struct timespec ts = {0, 1000000};
+  struct kevent events[NTIMERS];
+
+  for (int i = 0; i < NROUNDS; i++)
+    assert(kevent(kq, NULL, 0, events, NTIMERS, &ts) >= 0);
+  return NULL;
+}
+
+/* Knotes are deleted, disabled and added while another thread scans them. */
+TEST_ADD(kevent_delete_while_scan, 0) {
+  struct kevent kev;
+  pthread_t td;
+  int kq = kqueue1(O_CLOEXEC);
+  assert(kq >= 0);
+
+  /* Odd timers are dropped by the scanner once they're reported. */
+  for (int i = 0; i < NTIMERS; i++) {
+    EV_SET(&kev, i, EVFILT_TIMER, EV_ADD | ((i & 1) ? EV_ONESHOT : 0), 0, 1,
+           NULL);
+    assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  }
+
+  assert(pthread_create(&td, NULL, kevent_scanner, (void *)(intptr_t)kq) == 0);
+
+  for (int n = 0; n < NROUNDS; n++) {
+    for (int i = 0; i < NTIMERS; i++) {
+      int flags = (i & 1) ? EV_ONESHOT : 0;
+
+      /* One-shot timer may have been dropped by the scanner already. */
+      EV_SET(&kev, i, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+      if (kevent(kq, &kev, 1, NULL, 0, NULL) < 0)
+        assert((i & 1) && errno == ENOENT);
+
+      EV_SET(&kev, i, EVFILT_TIMER, EV_ADD | EV_DISABLE | flags, 0, 1, NULL);
+      assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+      EV_SET(&kev, i, EVFILT_TIMER, EV_ENABLE, 0, 1, NULL);
+      assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+    }
+  }
+
+  assert(pthread_join(td, NULL) == 0);
+  xclose(kq);
+  return 0;
+}
@@ -8,6 +8,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
+#include <sys/poll.h>
+#include <sys/select.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -302,3 +305,142 @@ TEST_ADD(pipe_read_return_zero, 0) {
   wait_child_finished(child_pid);
   return 0;
 }
+
+TEST_ADD(pipe_poll, 0) {
+  int pipe_fd[2];
+  struct pollfd fds[2];
+  char buf[PIPE_BUF];
+
+  assert(pipe2(pipe_fd, 0) == 0);
+
+  fds[0] = (struct pollfd){.fd = pipe_fd[0], .events = POLLIN};
+  fds[1] = (struct pollfd){.fd = pipe_fd[1], .events = POLLOUT};
+
+  /* Empty pipe is writable, but not readable. */
+  assert(poll(fds, 2, 0) == 1);
+  assert(fds[0].revents == 0);
+  assert(fds[1].revents == POLLOUT);
+
+  /* Wait for data written by the child. */
+  pid_t child_pid = xfork();
+  if (child_pid == 0) {
+    xclose(pipe_fd[0]);
+    memset(buf, 'x', sizeof(buf));
+    assert(xwrite(pipe_fd[1], buf, sizeof(buf)) == sizeof(buf));
+    exit(EXIT_SUCCESS);
+  }
+
+  assert(poll(fds, 1, -1) == 1);
+  assert(fds[0].revents == POLLIN);
+  wait_child_finished(child_pid);
+  assert(xread(pipe_fd[0], buf, sizeof(buf)) == sizeof(buf));
+
+  /* Closed descriptor is reported as invalid. */
+  xclose(pipe_fd[1]);
+  assert(poll(fds, 2, 0) == 2);
+  assert(fds[0].revents == POLLIN); /* end-of-file */
+  assert(fds[1].revents == POLLNVAL);
+
+  xclose(pipe_fd[0]);
+  return 0;
+}
+
+TEST_ADD(pipe_select, 0) {
+  int pipe_fd[2];
+  fd_set rfds, wfds;
+  struct timeval tv = {.tv_sec = 0, .tv_usec = 10000};
+
+  assert(pipe2(pipe_fd, 0) == 0);
+  int nfds = MAX(pipe_fd[0], pipe_fd[1]) + 1;
+
+  /* Empty pipe times out when waiting for reading. */
+  FD_ZERO(&rfds);
+  FD_SET(pipe_fd[0], &rfds);
+  assert(select(nfds, &rfds, NULL, NULL, &tv) == 0);
+  assert(!FD_ISSET(pipe_fd[0], &rfds));
+
+  assert(xwrite(pipe_fd[1], "a", 1) == 1);
+
+  FD_ZERO(&rfds);
+  FD_ZERO(&wfds);
+  FD_SET(pipe_fd[0], &rfds);
+  FD_SET(pipe_fd[1], &wfds);
+  assert(select(nfds, &rfds, &wfds, NULL, NULL) == 2);
+  assert(FD_ISSET(pipe_fd[0], &rfds));
+  assert(FD_ISSET(pipe_fd[1], &wfds));
+
+  /* Descriptor that is not open makes select fail. */
+  xclose(pipe_fd[1]);
+  FD_ZERO(&wfds);
+  FD_SET(pipe_fd[1], &wfds);
+  syscall_fail(select(nfds, NULL, &wfds, NULL, NULL), EBADF);
+
+  xclose(pipe_fd[0]);
+  return 0;
+}
+
+#define BIGDATA_SIZE (256 * 1024)
+
+TEST_ADD(pipe_big_write, 0) {
+  int pipe_fd[2];
+  char buf[3000];
+
+  assert(pipe2(pipe_fd, 0) == 0);
+
+  /* Large write is transferred straight from writer's pages. */
+  pid_t child_pid = xfork();
+  if (child_pid == 0) {
+    xclose(pipe_fd[0]);
+    char *data = malloc(BIGDATA_SIZE);
+    for (int i = 0; i < BIGDATA_SIZE; i++)
+      data[i] = i % 251;
+    /* Start in the middle of a page. */
+    assert(xwrite(pipe_fd[1], data + 100, BIGDATA_SIZE - 100) ==
+           BIGDATA_SIZE - 100);
+    free(data);
+    exit(EXIT_SUCCESS);
+  }
+
+  xclose(pipe_fd[1]);
+
+  /* Read back with chunks that do not match page boundaries. */
+  int total = 100;
+  ssize_t n;
+  while ((n = xread(pipe_fd[0], buf, sizeof(buf))) > 0) {
+    for (int i = 0; i < n; i++)
+      assert(buf[i] == (char)((total + i) % 251));
+    total += n;
+  }
+  assert(total == BIGDATA_SIZE);
+
+  wait_child_finished(child_pid);
+  xclose(pipe_fd[0]);
+  return 0;
+}
+
+TEST_ADD(pipe_atomic_write, 0) {
+  int pipe_fd[2];
+  char buf[PIPE_BUF];
+  char *data = malloc(BIGDATA_SIZE);
+
+  assert(pipe2(pipe_fd, O_NONBLOCK) == 0);
+
+  /* Fill the pipe up, until it stops growing. */
+  while (write(pipe_fd[1], data, BIGDATA_SIZE) > 0)
+    continue;
+  assert(errno == EAGAIN);
+
+  /* Small writes are never split, even if there is some space left. */
+  syscall_fail(write(pipe_fd[1], buf, PIPE_BUF), EAGAIN);
+  assert(xread(pipe_fd[0], buf, 1) == 1);
+  syscall_fail(write(pipe_fd[1], buf, PIPE_BUF), EAGAIN);
+  assert(xwrite(pipe_fd[1], buf, 1) == 1);
+
+  /* Data can be read without blocking. */
+  assert(xread(pipe_fd[0], buf, PIPE_BUF) == PIPE_BUF);
+
+  xclose(pipe_fd[0]);
+  xclose(pipe_fd[1]);
+  free(data);
+  return 0;
+}
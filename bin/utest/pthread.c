@@ -0,0 +1,136 @@
+#include "utest.h"
+#include "util.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define NTHREADS 4
+#define NLOOPS 1000
+
+static pthread_mutex_t counter_lock = PTHREAD_MUTEX_INITIALIZER;
+static int counter;
+
+static void *counter_inc(void *arg) {
+  for (int i = 0; i < NLOOPS; i++) {
+    pthread_mutex_lock(&counter_lock);
+    counter++;
+    pthread_mutex_unlock(&counter_lock);
+  }
+  return arg;
+}
+
+/* ======= pthread_mutex ======= */
+TEST_ADD(pthread_mutex, 0) {
+  pthread_t td[NTHREADS];
+
+  counter = 0;
+
+  for (long i = 0; i < NTHREADS; i++)
+    assert(pthread_create(&td[i], NULL, counter_inc, (void *)i) == 0);
+
+  for (long i = 0; i < NTHREADS; i++) {
+    void *retval;
+    assert(pthread_join(td[i], &retval) == 0);
+    assert(retval == (void *)i);
+  }
+
+  assert(counter == NTHREADS * NLOOPS);
+  return 0;
+}
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_nonempty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_nonfull = PTHREAD_COND_INITIALIZER;
+static int queue_items;
+
+static void *consumer(void *arg) {
+  for (int i = 0; i < NLOOPS; i++) {
+    pthread_mutex_lock(&queue_lock);
+    while (queue_items == 0)
+      pthread_cond_wait(&queue_nonempty, &queue_lock);
+    queue_items--;
+    pthread_cond_signal(&queue_nonfull);
+    pthread_mutex_unlock(&queue_lock);
+  }
+  return NULL;
+}
+
+/* ======= pthread_cond ======= */
+TEST_ADD(pthread_cond, 0) {
+  pthread_t td;
+
+  queue_items = 0;
+  assert(pthread_create(&td, NULL, consumer, NULL) == 0);
+
+  for (int i = 0; i < NLOOPS; i++) {
+    pthread_mutex_lock(&queue_lock);
+    while (queue_items == 2)
+      pthread_cond_wait(&queue_nonfull, &queue_lock);
+    queue_items++;
+    pthread_cond_signal(&queue_nonempty);
+    pthread_mutex_unlock(&queue_lock);
+  }
+
+  assert(pthread_join(td, NULL) == 0);
+  assert(queue_items == 0);
+  return 0;
+}
+
+static void *spin_forever(void *arg) {
+  for (;;)
+    sched_yield();
+  return NULL;
+}
+
+/* ======= pthread_exit_process ======= */
+TEST_ADD(pthread_exit_process, 0) {
+  pid_t pid = xfork();
+  if (pid == 0) {
+    pthread_t td;
+    /* Threads that are still running must not keep the process alive. */
+    for (int i = 0; i < NTHREADS; i++)
+      assert(pthread_create(&td, NULL, spin_forever, NULL) == 0);
+    exit(0);
+  }
+  wait_child_finished(pid);
+  return 0;
+}
+
+static volatile int errno_stage;
+
+static void wait_stage(int stage) {
+  while (errno_stage != stage)
+    sched_yield();
+}
+
+static void *errno_worker(void *arg) {
+  wait_stage(1);
+  assert(close(-1) == -1 && errno == EBADF);
+  errno_stage = 2;
+  wait_stage(3);
+  assert(errno == EBADF);
+  return NULL;
+}
+
+/* ======= pthread_errno ======= */
+TEST_ADD(pthread_errno, 0) {
+  pthread_t td;
+
+  errno_stage = 0;
+  assert(pthread_create(&td, NULL, errno_worker, NULL) == 0);
+
+  /* Each thread sees only errors of its own system calls. */
+  errno = ENOENT;
+  errno_stage = 1;
+  wait_stage(2);
+  assert(errno == ENOENT);
+  errno = EINTR;
+  errno_stage = 3;
+
+  assert(pthread_join(td, NULL) == 0);
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include "utest.h"
+#include "util.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NITEMS 1000
+
+static sem_t items, slots;
+static int produced;
+
+static void *producer(void *arg) {
+  for (int i = 0; i < NITEMS; i++) {
+    assert(sem_wait(&slots) == 0);
+    produced++;
+    assert(sem_post(&items) == 0);
+  }
+  return NULL;
+}
+
+TEST_ADD(sem_threads, 0) {
+  pthread_t td;
+  int value;
+
+  assert(sem_init(&items, 0, 0) == 0);
+  assert(sem_init(&slots, 0, 1) == 0);
+  produced = 0;
+
+  assert(pthread_create(&td, NULL, producer, NULL) == 0);
+  for (int i = 0; i < NITEMS; i++) {
+    assert(sem_wait(&items) == 0);
+    assert(produced == i + 1);
+    assert(sem_post(&slots) == 0);
+  }
+  assert(pthread_join(td, NULL) == 0);
+
+  assert(sem_getvalue(&items, &value) == 0 && value == 0);
+  syscall_fail(sem_trywait(&items), EAGAIN);
+
+  assert(sem_destroy(&items) == 0);
+  assert(sem_destroy(&slots) == 0);
+  return 0;
+}
+
+TEST_ADD(sem_timedwait, 0) {
+  struct timespec ts;
+  sem_t sem;
+
+  assert(sem_init(&sem, 0, 1) == 0);
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 10000000;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+
+  assert(sem_timedwait(&sem, &ts) == 0);
+  syscall_fail(sem_timedwait(&sem, &ts), ETIMEDOUT);
+
+  ts.tv_nsec = -1;
+  syscall_fail(sem_timedwait(&sem, &ts), EINVAL);
+
+  assert(sem_destroy(&sem) == 0);
+  return 0;
+}
+
+TEST_ADD(sem_pshared, 0) {
+  size_t pgsz = getpagesize();
+
+  /* Semaphores live in memory shared with the child process. */
+  sem_t *sem = mmap(NULL, pgsz, PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED,
+                    -1, 0);
+  assert(sem != MAP_FAILED);
+  volatile int *counter = (volatile int *)&sem[2];
+
+  assert(sem_init(&sem[0], 1, 0) == 0);
+  assert(sem_init(&sem[1], 1, 0) == 0);
+
+  pid_t pid = xfork();
+  if (pid == 0) {
+    for (int i = 0; i < NITEMS; i++) {
+      assert(sem_wait(&sem[0]) == 0);
+      (*counter)++;
+      assert(sem_post(&sem[1]) == 0);
+    }
+    exit(0);
+  }
+
+  /* Ping-pong between processes forces them to sleep on each other. */
+  for (int i = 0; i < NITEMS; i++) {
+    assert(sem_post(&sem[0]) == 0);
+    assert(sem_wait(&sem[1]) == 0);
+    assert(*counter == i + 1);
+  }
+
+  wait_child_finished(pid);
+  xmunmap(sem, pgsz);
+  return 0;
+}
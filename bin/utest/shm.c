@@ -0,0 +1,184 @@
+#include "utest.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NPAGES 4
+
+static char shm_name[32];
+
+static const char *unique_name(const char *prefix) {
+  snprintf(shm_name, sizeof(shm_name), "/%s.%d", prefix, getpid());
+  return shm_name;
+}
+
+TEST_ADD(shm_share, 0) {
+  const char *name = unique_name("shm_share");
+  size_t pgsz = getpagesize();
+  size_t size = NPAGES * pgsz;
+  struct stat sb;
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  assert(fd >= 0);
+  assert(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+  syscall_fail(shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600), EEXIST);
+
+  /* New object is empty and must be sized before it's mapped. */
+  xfstat(fd, &sb);
+  assert(S_ISREG(sb.st_mode) && sb.st_size == 0);
+  assert(mmap(NULL, pgsz, PROT_READ, MAP_SHARED, fd, 0) == MAP_FAILED);
+  assert(errno == ENXIO);
+  assert(ftruncate(fd, size) == 0);
+  xfstat(fd, &sb);
+  assert(sb.st_size == (off_t)size);
+
+  char *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(p != MAP_FAILED);
+  assert(p[0] == 0 && p[size - 1] == 0);
+
+  /* Unrelated process can find the object by name. */
+  pid_t pid = xfork();
+  if (pid == 0) {
+    int cfd = shm_open(name, O_RDWR, 0);
+    assert(cfd >= 0);
+    char *q = mmap(NULL, pgsz, PROT_READ | PROT_WRITE, MAP_SHARED, cfd, pgsz);
+    assert(q != MAP_FAILED);
+    strcpy(q, "hello");
+    exit(0);
+  }
+  wait_child_finished(pid);
+  string_eq(p + pgsz, "hello");
+
+  /* Another mapping of the object refers to the same pages. */
+  char *r = mmap(NULL, pgsz, PROT_READ, MAP_SHARED, fd, pgsz);
+  assert(r != MAP_FAILED);
+  string_eq(r, "hello");
+  xmunmap(r, pgsz);
+
+  /* Object can't shrink while it's mapped. */
+  syscall_fail(ftruncate(fd, pgsz), EBUSY);
+
+  /* Pages stay accessible after the object is unlinked and closed. */
+  xclose(fd);
+  assert(shm_unlink(name) == 0);
+  syscall_fail(shm_open(name, O_RDWR, 0), ENOENT);
+  syscall_fail(shm_unlink(name), ENOENT);
+  string_eq(p + pgsz, "hello");
+  xmunmap(p, size);
+  return 0;
+}
+
+TEST_ADD(shm_private, 0) {
+  const char *name = unique_name("shm_private");
+  size_t pgsz = getpagesize();
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  assert(fd >= 0);
+  assert(ftruncate(fd, pgsz) == 0);
+  assert(shm_unlink(name) == 0);
+
+  char *p = mmap(NULL, pgsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  char *q = mmap(NULL, pgsz, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  assert(p != MAP_FAILED && q != MAP_FAILED);
+
+  strcpy(p, "shared");
+  string_eq(q, "shared");
+
+  /* Writes to private mapping are not visible in the object. */
+  strcpy(q, "private");
+  string_eq(p, "shared");
+
+  xmunmap(q, pgsz);
+  xmunmap(p, pgsz);
+  xclose(fd);
+  return 0;
+}
+
+TEST_ADD(shm_truncate, 0) {
+  const char *name = unique_name("shm_truncate");
+  size_t pgsz = getpagesize();
+  char buf[16];
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  assert(fd >= 0);
+  assert(ftruncate(fd, pgsz) == 0);
+
+  char *p = mmap(NULL, pgsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(p != MAP_FAILED);
+  memset(p, 'x', pgsz);
+  xmunmap(p, pgsz);
+
+  /* Data cut off by truncation is gone when the object grows back. */
+  assert(ftruncate(fd, 8) == 0);
+  assert(ftruncate(fd, 2 * pgsz) == 0);
+  p = mmap(NULL, 2 * pgsz, PROT_READ, MAP_SHARED, fd, 0);
+  assert(p != MAP_FAILED);
+  memset(buf, 'x', sizeof(buf));
+  assert(memcmp(p, buf, 8) == 0);
+  memset(buf, 0, sizeof(buf));
+  assert(memcmp(p + 8, buf, sizeof(buf)) == 0);
+  assert(p[pgsz] == 0);
+  xmunmap(p, 2 * pgsz);
+
+  /* O_TRUNC empties the object. */
+  int fd2 = shm_open(name, O_RDWR | O_TRUNC, 0);
+  assert(fd2 >= 0);
+  struct stat sb;
+  xfstat(fd, &sb);
+  assert(sb.st_size == 0);
+
+  xclose(fd2);
+  xclose(fd);
+  assert(shm_unlink(name) == 0);
+  return 0;
+}
+
+TEST_ADD(shm_errors, 0) {
+  const char *name = unique_name("shm_errors");
+  size_t pgsz = getpagesize();
+
+  syscall_fail(shm_open("noslash", O_RDWR | O_CREAT, 0600), EINVAL);
+  syscall_fail(shm_open("/a/b", O_RDWR | O_CREAT, 0600), EINVAL);
+  syscall_fail(shm_open(name, O_WRONLY | O_CREAT, 0600), EINVAL);
+  syscall_fail(shm_open(name, O_RDONLY, 0), ENOENT);
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  assert(fd >= 0);
+  assert(ftruncate(fd, pgsz) == 0);
+
+  /* Read-only descriptor can't be used to modify the object. */
+  int rofd = shm_open(name, O_RDONLY, 0);
+  assert(rofd >= 0);
+  syscall_fail(ftruncate(rofd, 0), EBADF);
+  assert(mmap(NULL, pgsz, PROT_WRITE, MAP_SHARED, rofd, 0) == MAP_FAILED);
+  assert(errno == EACCES);
+  char *p = mmap(NULL, pgsz, PROT_READ | PROT_WRITE, MAP_PRIVATE, rofd, 0);
+  assert(p != MAP_FAILED);
+  xmunmap(p, pgsz);
+
+  /* Mapping must fit within the object and start on page boundary. */
+  assert(mmap(NULL, 2 * pgsz, PROT_READ, MAP_SHARED, fd, 0) == MAP_FAILED);
+  assert(errno == ENXIO);
+  assert(mmap(NULL, pgsz, PROT_READ, MAP_SHARED, fd, 1) == MAP_FAILED);
+  assert(errno == EINVAL);
+
+  /* Only shared memory objects can be mapped. */
+  int fds[2];
+  xpipe(fds);
+  assert(mmap(NULL, pgsz, PROT_READ, MAP_SHARED, fds[0], 0) == MAP_FAILED);
+  assert(errno == ENODEV);
+  xclose(fds[0]);
+  xclose(fds[1]);
+
+  xclose(rofd);
+  xclose(fd);
+  assert(shm_unlink(name) == 0);
+  return 0;
+}
@@ -0,0 +1,300 @@
+#include "utest.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/event.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SOCKPATH "socket"
+
+static void set_addr(struct sockaddr_un *sun, const char *path) {
+  memset(sun, 0, sizeof(struct sockaddr_un));
+  sun->sun_family = AF_UNIX;
+  strlcpy(sun->sun_path, path, sizeof(sun->sun_path));
+  sun->sun_len = SUN_LEN(sun);
+}
+
+static void send_fd(int s, int fd, const void *buf, size_t len) {
+  char control[CMSG_SPACE(sizeof(int))];
+  struct iovec iov = {.iov_base = (void *)buf, .iov_len = len};
+  struct msghdr msg = {.msg_iov = &iov,
+                       .msg_iovlen = 1,
+                       .msg_control = control,
+                       .msg_controllen = sizeof(control)};
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  assert(sendmsg(s, &msg, 0) == (ssize_t)len);
+}
+
+static int recv_fd(int s, void *buf, size_t len) {
+  char control[CMSG_SPACE(sizeof(int))];
+  struct iovec iov = {.iov_base = buf, .iov_len = len};
+  struct msghdr msg = {.msg_iov = &iov,
+                       .msg_iovlen = 1,
+                       .msg_control = control,
+                       .msg_controllen = sizeof(control)};
+  struct cmsghdr *cmsg;
+  int fd;
+
+  assert(recvmsg(s, &msg, 0) == (ssize_t)len);
+  assert((msg.msg_flags & MSG_CTRUNC) == 0);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  assert(cmsg != NULL);
+  assert(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS);
+  assert(cmsg->cmsg_len == CMSG_LEN(sizeof(int)));
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
+
+TEST_ADD(socket_pair, 0) {
+  char buf[16];
+  int sv[2];
+
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+  /* Stream sockets don't preserve message boundaries. */
+  assert(write(sv[0], "foo", 3) == 3);
+  assert(write(sv[0], "bar", 3) == 3);
+  assert(read(sv[1], buf, sizeof(buf)) == 6);
+  assert(memcmp(buf, "foobar", 6) == 0);
+
+  /* Data flows in both directions. */
+  assert(send(sv[1], "baz", 3, 0) == 3);
+  assert(recv(sv[0], buf, sizeof(buf), 0) == 3);
+  assert(memcmp(buf, "baz", 3) == 0);
+
+  /* Nothing to read on non-blocking socket. */
+  assert(fcntl(sv[1], F_SETFL, O_NONBLOCK) == 0);
+  syscall_fail(read(sv[1], buf, sizeof(buf)), EAGAIN);
+
+  /* Shutting down write side yields end-of-file on the peer. */
+  assert(shutdown(sv[0], SHUT_WR) == 0);
+  assert(read(sv[1], buf, sizeof(buf)) == 0);
+  syscall_fail(send(sv[0], "x", 1, MSG_NOSIGNAL), EPIPE);
+
+  /* Closed peer yields end-of-file as well. */
+  xclose(sv[1]);
+  assert(read(sv[0], buf, sizeof(buf)) == 0);
+  xclose(sv[0]);
+
+  syscall_fail(socketpair(AF_UNSPEC, SOCK_STREAM, 0, sv), EAFNOSUPPORT);
+  return 0;
+}
+
+TEST_ADD(socket_seqpacket, 0) {
+  char buf[16];
+  int sv[2];
+
+  assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+
+  /* Each record is received separately. */
+  assert(write(sv[0], "foo", 3) == 3);
+  assert(write(sv[0], "barbaz", 6) == 6);
+  assert(read(sv[1], buf, sizeof(buf)) == 3);
+  assert(memcmp(buf, "foo", 3) == 0);
+
+  /* Remainder of a record that didn't fit is discarded. */
+  struct iovec iov = {.iov_base = buf, .iov_len = 3};
+  struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+  assert(recvmsg(sv[1], &msg, 0) == 3);
+  assert(msg.msg_flags & MSG_TRUNC);
+  assert(memcmp(buf, "bar", 3) == 0);
+
+  assert(write(sv[0], "qux", 3) == 3);
+  assert(read(sv[1], buf, sizeof(buf)) == 3);
+  assert(memcmp(buf, "qux", 3) == 0);
+
+  xclose(sv[0]);
+  xclose(sv[1]);
+  return 0;
+}
+
+TEST_ADD(socket_stream, TF_TMPDIR) {
+  struct sockaddr_un addr, peer;
+  socklen_t len;
+  struct stat sb;
+  char buf[16];
+  int ls, cs, as;
+
+  set_addr(&addr, SOCKPATH);
+
+  assert((ls = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0);
+  /* Listening requires a bound socket. */
+  syscall_fail(listen(ls, 1), EINVAL);
+  assert(bind(ls, (struct sockaddr *)&addr, addr.sun_len) == 0);
+  assert(listen(ls, 1) == 0);
+
+  /* Binding creates a socket file in the file system. */
+  assert(stat(SOCKPATH, &sb) == 0);
+  assert(S_ISSOCK(sb.st_mode));
+  syscall_fail(open(SOCKPATH, O_RDWR), EOPNOTSUPP);
+
+  /* The name can't be bound twice. */
+  assert((cs = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0);
+  syscall_fail(bind(cs, (struct sockaddr *)&addr, addr.sun_len), EADDRINUSE);
+
+  /* Connection is queued until it gets accepted. */
+  assert(connect(cs, (struct sockaddr *)&addr, addr.sun_len) == 0);
+  len = sizeof(peer);
+  assert((as = accept(ls, (struct sockaddr *)&peer, &len)) >= 0);
+  assert(peer.sun_family == AF_UNIX);
+
+  assert(write(cs, "hello", 5) == 5);
+  assert(read(as, buf, sizeof(buf)) == 5);
+  assert(memcmp(buf, "hello", 5) == 0);
+  assert(write(as, "world", 5) == 5);
+  assert(read(cs, buf, sizeof(buf)) == 5);
+  assert(memcmp(buf, "world", 5) == 0);
+
+  xclose(as);
+  xclose(cs);
+  xclose(ls);
+
+  /* Nobody listens on the socket anymore. */
+  assert((cs = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0);
+  syscall_fail(connect(cs, (struct sockaddr *)&addr, addr.sun_len),
+               ECONNREFUSED);
+  xclose(cs);
+
+  /* Connecting to a regular file is not possible. */
+  xclose(xopen("file", O_CREAT | O_RDWR, 0644));
+  set_addr(&addr, "file");
+  assert((cs = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0);
+  syscall_fail(connect(cs, (struct sockaddr *)&addr, addr.sun_len), ENOTSOCK);
+  xclose(cs);
+
+  xunlink(SOCKPATH);
+  xunlink("file");
+  return 0;
+}
+
+TEST_ADD(socket_dgram, TF_TMPDIR) {
+  struct sockaddr_un addr, caddr, from;
+  socklen_t len;
+  char buf[16];
+  int s, c;
+
+  set_addr(&addr, SOCKPATH);
+  set_addr(&caddr, "client");
+
+  assert((s = socket(AF_UNIX, SOCK_DGRAM, 0)) >= 0);
+  assert(bind(s, (struct sockaddr *)&addr, addr.sun_len) == 0);
+  assert((c = socket(AF_UNIX, SOCK_DGRAM, 0)) >= 0);
+  assert(bind(c, (struct sockaddr *)&caddr, caddr.sun_len) == 0);
+
+  /* Datagrams keep their boundaries and the sender's address. */
+  assert(sendto(c, "ping", 4, 0, (struct sockaddr *)&addr, addr.sun_len) == 4);
+  assert(sendto(c, "pong", 4, 0, (struct sockaddr *)&addr, addr.sun_len) == 4);
+  len = sizeof(from);
+  assert(recvfrom(s, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len) ==
+         4);
+  assert(memcmp(buf, "ping", 4) == 0);
+  string_eq(from.sun_path, "client");
+  assert(recv(s, buf, sizeof(buf), 0) == 4);
+  assert(memcmp(buf, "pong", 4) == 0);
+
+  /* Reply to the sender using default destination. */
+  assert(connect(s, (struct sockaddr *)&caddr, caddr.sun_len) == 0);
+  assert(send(s, "ack", 3, 0) == 3);
+  assert(recv(c, buf, sizeof(buf), 0) == 3);
+  assert(memcmp(buf, "ack", 3) == 0);
+
+  /* Unconnected socket must be given a destination. */
+  syscall_fail(send(c, "x", 1, 0), EDESTADDRREQ);
+
+  xclose(s);
+  syscall_fail(
+    sendto(c, "x", 1, 0, (struct sockaddr *)&addr, addr.sun_len), ECONNREFUSED);
+  xclose(c);
+
+  xunlink(SOCKPATH);
+  xunlink("client");
+  return 0;
+}
+
+TEST_ADD(socket_rights, 0) {
+  char buf[16];
+  int sv[2], fds[2];
+  int fd;
+
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+  assert(pipe(fds) == 0);
+
+  /* Pass read end of a pipe and close our copy. */
+  send_fd(sv[0], fds[0], "x", 1);
+  xclose(fds[0]);
+
+  fd = recv_fd(sv[1], buf, 1);
+  assert(buf[0] == 'x');
+  assert(fd != fds[1]);
+
+  /* Received descriptor refers to the same pipe. */
+  assert(write(fds[1], "data", 4) == 4);
+  assert(read(fd, buf, sizeof(buf)) == 4);
+  assert(memcmp(buf, "data", 4) == 0);
+
+  /* Descriptors sent over a closed connection are discarded. */
+  send_fd(sv[0], fd, "y", 1);
+  xclose(sv[1]);
+  xclose(sv[0]);
+
+  xclose(fd);
+  xclose(fds[1]);
+  return 0;
+}
+
+TEST_ADD(socket_kevent, TF_TMPDIR) {
+  struct sockaddr_un addr;
+  struct kevent kev;
+  struct timespec ts = {0, 0};
+  int ls, cs, as, kq;
+
+  set_addr(&addr, SOCKPATH);
+
+  assert((ls = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0);
+  assert(bind(ls, (struct sockaddr *)&addr, addr.sun_len) == 0);
+  assert(listen(ls, 1) == 0);
+
+  assert((kq = kqueue()) >= 0);
+  EV_SET(&kev, ls, EVFILT_READ, EV_ADD, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  assert(kevent(kq, NULL, 0, &kev, 1, &ts) == 0);
+
+  /* Pending connection makes listening socket readable. */
+  assert((cs = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0);
+  assert(connect(cs, (struct sockaddr *)&addr, addr.sun_len) == 0);
+  assert(kevent(kq, NULL, 0, &kev, 1, &ts) == 1);
+  assert(kev.ident == (uintptr_t)ls && kev.data == 1);
+  assert((as = accept(ls, NULL, NULL)) >= 0);
+
+  /* Incoming data makes the connected socket readable. */
+  EV_SET(&kev, as, EVFILT_READ, EV_ADD, 0, 0, NULL);
+  assert(kevent(kq, &kev, 1, NULL, 0, NULL) == 0);
+  assert(write(cs, "abc", 3) == 3);
+  assert(kevent(kq, NULL, 0, &kev, 1, &ts) == 1);
+  assert(kev.ident == (uintptr_t)as && kev.data == 3);
+
+  /* Closing the peer makes the socket readable without any data. */
+  char buf[3];
+  assert(read(as, buf, 3) == 3);
+  assert(kevent(kq, NULL, 0, &kev, 1, &ts) == 0);
+  xclose(cs);
+  assert(kevent(kq, NULL, 0, &kev, 1, &ts) == 1);
+  assert(kev.ident == (uintptr_t)as && kev.data == 0);
+
+  xclose(kq);
+  xclose(as);
+  xclose(ls);
+  xunlink(SOCKPATH);
+  return 0;
+}
@@ -1,12 +1,14 @@
 #include "utest.h"
 #include "util.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <unistd.h>
 
 /* Shift used fds by 3 so std{in,out,err} are not affected. */
@@ -108,6 +110,43 @@ TEST_ADD(vfs_trunc, TF_TMPDIR) {
   return 0;
 }
 
+TEST_ADD(vfs_sparse, TF_TMPDIR) {
+  const off_t hole = 1 << 20;
+  struct statvfs before, after;
+  struct stat sb;
+  char buf[512];
+
+  int fd = xopen("file", O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+
+  /* Seek past the end of file and write one byte. */
+  assert(lseek(fd, hole, SEEK_SET) == hole);
+  assert(xwrite(fd, "x", 1) == 1);
+  xfstat(fd, &sb);
+  assert(sb.st_size == hole + 1);
+
+  /* The hole reads as zeros. */
+  assert(lseek(fd, hole / 2, SEEK_SET) == hole / 2);
+  assert(xread(fd, buf, sizeof(buf)) == sizeof(buf));
+  for (size_t i = 0; i < sizeof(buf); i++)
+    assert(buf[i] == 0);
+
+  assert(lseek(fd, 0, SEEK_HOLE) == 0);
+  assert(lseek(fd, 0, SEEK_DATA) == hole);
+  assert(lseek(fd, hole, SEEK_DATA) == hole);
+  assert(lseek(fd, hole, SEEK_HOLE) == hole + 1);
+  syscall_fail(lseek(fd, hole + 1, SEEK_DATA), ENXIO);
+
+  /* Extending a file with ftruncate must not allocate memory. */
+  NOFAIL_NR(fstatvfs, fd, &before);
+  NOFAIL_NR(ftruncate, fd, 256 << 20);
+  NOFAIL_NR(fstatvfs, fd, &after);
+  assert(before.f_bfree - after.f_bfree < 16);
+
+  xclose(fd);
+  xunlink("file");
+  return 0;
+}
+
 TEST_ADD(vfs_dir, TF_TMPDIR) {
   syscall_fail(mkdir("/", 0), EEXIST);
   xmkdir("test", 0);
@@ -387,3 +426,57 @@ TEST_ADD(vfs_chmod, TF_TMPDIR) {
 
   return 0;
 }
+
+#define BIGDIR_NFILES 300
+
+static void bigdir_name(char *buf, int i) {
+  /* Names are long on purpose to exercise variable-length entries. */
+  snprintf(buf, NAME_MAX + 1, "%0200d", i);
+}
+
+TEST_ADD(vfs_bigdir, TF_TMPDIR) {
+  char name[NAME_MAX + 1];
+  static char seen[BIGDIR_NFILES];
+
+  xmkdir("dir", 0700);
+  xchdir("dir");
+
+  for (int i = 0; i < BIGDIR_NFILES; i++) {
+    bigdir_name(name, i);
+    xclose(xopen(name, O_RDWR | O_CREAT, 0600));
+  }
+
+  for (int i = 0; i < BIGDIR_NFILES; i++) {
+    bigdir_name(name, i);
+    xaccess(name, F_OK);
+  }
+
+  /* Remove entries while reading the directory. Each one must be returned
+   * exactly once. */
+  DIR *dirp = opendir(".");
+  assert(dirp != NULL);
+
+  struct dirent *de;
+  int n = 0;
+  while ((de = readdir(dirp))) {
+    if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+      continue;
+    int i = atoi(de->d_name);
+    assert(i >= 0 && i < BIGDIR_NFILES);
+    assert(!seen[i]);
+    seen[i] = 1;
+    xunlink(de->d_name);
+    n++;
+  }
+  closedir(dirp);
+  assert(n == BIGDIR_NFILES);
+
+  memset(name, 'x', NAME_MAX + 1);
+  name[NAME_MAX] = '\0';
+  xclose(xopen(name, O_RDWR | O_CREAT, 0600));
+  xunlink(name);
+
+  xchdir("..");
+  xrmdir("dir");
+  return 0;
+}
@@ -8,7 +8,9 @@ include $(TOPDIR)/build/flags.mk
 
 CFLAGS   += -fno-builtin -nostdinc -nostdlib -ffreestanding
 CPPFLAGS += -I$(TOPDIR)/include -I$(TOPDIR)/sys/contrib -D_KERNEL
-CPPFLAGS += -DLOCKDEP=$(LOCKDEP) -DKASAN=$(KASAN) -DKCSAN=$(KCSAN) -DKFI=$(KFI)
+CPPFLAGS += -DLOCKDEP=$(LOCKDEP) -DLOCKSTAT=$(LOCKSTAT)
+CPPFLAGS += -DKLATENCY=$(KLATENCY)
+CPPFLAGS += -DKASAN=$(KASAN) -DKCSAN=$(KCSAN) -DKFI=$(KFI)
 LDFLAGS  += -nostdlib
 
 ifeq ($(KCSAN), 1)
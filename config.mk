@@ -4,7 +4,7 @@
 # build system for given platform.
 #
 
-CONFIG_OPTS := KASAN LOCKDEP KGPROF MIPS AARCH64 RISCV KCSAN KFTRACE
+CONFIG_OPTS := KASAN LOCKDEP LOCKSTAT KLATENCY KGPROF MIPS AARCH64 RISCV KCSAN KFTRACE
 
 BOARD ?= rpi3
 
@@ -39,6 +39,8 @@ endif
 VERBOSE ?= 0
 LLVM ?= 1
 LOCKDEP ?= 0
+LOCKSTAT ?= 0
+KLATENCY ?= 0
 KASAN ?= 0
 KCSAN ?= 0
 # Kernel function instrumentation options: ftrace, gprof
@@ -0,0 +1,5 @@
+/*
+ * POSIX asynchronous I/O. Definitions live in <sys/aio.h>, since they are
+ * shared with the kernel.
+ */
+#include <sys/aio.h>
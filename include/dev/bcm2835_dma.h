@@ -0,0 +1,57 @@
+#ifndef _DEV_BCM2835_DMA_H_
+#define _DEV_BCM2835_DMA_H_
+
+#include <sys/types.h>
+#include <sys/bus.h>
+
+typedef struct bcmdma_chan bcmdma_chan_t;
+
+/* Memory written by the engine must not share cache lines with other data,
+ * since these lines are invalidated when the transfer is done. */
+#define BCMDMA_ALIGN 64
+
+typedef enum {
+  BCMDMA_DEV_TO_MEM, /* peripheral FIFO -> memory */
+  BCMDMA_MEM_TO_DEV, /* memory -> peripheral FIFO */
+} bcmdma_dir_t;
+
+/* Physically contiguous piece of memory taking part in a transfer. */
+typedef struct bcmdma_seg {
+  paddr_t ds_addr;
+  size_t ds_len;
+} bcmdma_seg_t;
+
+/*
+ * Allocate a DMA channel for transfers paced by peripheral `dreq`
+ * (see BCMDMA_DREQ_* in <dev/bcm2835_dmareg.h>).
+ *
+ * Returns NULL if DMA controller is not present or all channels are taken.
+ */
+bcmdma_chan_t *bcmdma_chan_alloc(unsigned dreq);
+
+/* Return a channel obtained with `bcmdma_chan_alloc`. */
+void bcmdma_chan_free(bcmdma_chan_t *chan);
+
+/*
+ * Describe kernel buffer `buf` of `len` bytes as a list of physically
+ * contiguous segments. At most `*nsegsp` segments are stored in `segs`.
+ *
+ * Returns the number of bytes covered by the segments and stores the number
+ * of used segments in `*nsegsp`.
+ */
+size_t bcmdma_load(bcmdma_seg_t *segs, int *nsegsp, const void *buf,
+                   size_t len);
+
+/*
+ * Move data between memory segments and peripheral FIFO register located
+ * at `fifo` bus address. The memory is scatter-gathered by a chain
+ * of control blocks, and the thread sleeps until the last one is done.
+ * Caches are maintained for the segments.
+ *
+ * Returns 0 on success, EIO if the channel reported an error and ETIMEDOUT
+ * if the peripheral stopped requesting data.
+ */
+int bcmdma_transfer(bcmdma_chan_t *chan, bcmdma_dir_t dir, bus_addr_t fifo,
+                    const bcmdma_seg_t *segs, int nsegs);
+
+#endif /* !_DEV_BCM2835_DMA_H_ */
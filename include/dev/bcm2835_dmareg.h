@@ -0,0 +1,73 @@
+#ifndef _BCM2835_DMAREG_H_
+#define _BCM2835_DMAREG_H_
+
+/* For detailed information on the DMA engine, please refer to chapter 4 of:
+ * https://cs140e.sergio.bz/docs/BCM2837-ARM-Peripherals.pdf
+ */
+
+/* Number of channels available to the ARM core. */
+#define BCMDMA_NCHANS 15
+/* Channels starting from 7 are DMA LITE ones (shorter transfers). */
+#define BCMDMA_NFULLCHANS 7
+
+/* Per-channel registers */
+#define BCMDMA_CHAN(n) ((n)*0x100)
+#define BCMDMA_CS 0x0000
+#define BCMDMA_CONBLK_AD 0x0004
+#define BCMDMA_TI 0x0008
+#define BCMDMA_SOURCE_AD 0x000C
+#define BCMDMA_DEST_AD 0x0010
+#define BCMDMA_TXFR_LEN 0x0014
+#define BCMDMA_STRIDE 0x0018
+#define BCMDMA_NEXTCONBK 0x001C
+#define BCMDMA_DEBUG 0x0020
+
+/* Global registers */
+#define BCMDMA_INT_STATUS 0x0FE0
+#define BCMDMA_ENABLE 0x0FF0
+
+/* CS register fields */
+#define CS_ACTIVE 0x00000001    /* Channel is running */
+#define CS_END 0x00000002       /* Transfer is complete (write 1 to clear) */
+#define CS_INT 0x00000004       /* Interrupt status (write 1 to clear) */
+#define CS_DREQ 0x00000008      /* Peripheral requests data */
+#define CS_PAUSED 0x00000010    /* Channel is paused */
+#define CS_ERROR 0x00000100     /* Error is reported in DEBUG register */
+#define CS_PRIORITY(x) (((x)&0xf) << 16)
+#define CS_PANIC_PRIORITY(x) (((x)&0xf) << 20)
+#define CS_WAIT_FOR_WRITES 0x10000000 /* Wait for outstanding writes */
+#define CS_DISDEBUG 0x20000000        /* Ignore debug pause signal */
+#define CS_ABORT 0x40000000           /* Abort current control block */
+#define CS_RESET 0x80000000           /* Reset the channel */
+
+/* TI register and control block `cb_ti` fields */
+#define TI_INTEN 0x00000001      /* Interrupt at the end of this block */
+#define TI_TDMODE 0x00000002     /* 2D mode */
+#define TI_WAIT_RESP 0x00000008  /* Wait for write response */
+#define TI_DEST_INC 0x00000010   /* Increment destination address */
+#define TI_DEST_WIDTH 0x00000020 /* 128-bit destination writes */
+#define TI_DEST_DREQ 0x00000040  /* Destination paces the transfer */
+#define TI_DEST_IGNORE 0x00000080
+#define TI_SRC_INC 0x00000100   /* Increment source address */
+#define TI_SRC_WIDTH 0x00000200 /* 128-bit source reads */
+#define TI_SRC_DREQ 0x00000400  /* Source paces the transfer */
+#define TI_SRC_IGNORE 0x00000800
+#define TI_BURST_LENGTH(x) (((x)&0xf) << 12)
+#define TI_PERMAP(x) (((x)&0x1f) << 16)
+#define TI_WAITS(x) (((x)&0x1f) << 21)
+#define TI_NO_WIDE_BURSTS 0x04000000
+
+/* DEBUG register fields */
+#define DEBUG_READ_LAST_NOT_SET 0x00000001
+#define DEBUG_FIFO_ERROR 0x00000002
+#define DEBUG_READ_ERROR 0x00000004
+#define DEBUG_ERROR_MASK 0x00000007
+
+/* Peripheral DREQ signals used to pace transfers (`TI_PERMAP`) */
+#define BCMDMA_DREQ_NONE 0
+#define BCMDMA_DREQ_EMMC 11
+
+/* Maximum length of a single control block transfer */
+#define BCMDMA_MAXLEN 0x3fffffff
+
+#endif /* !_BCM2835_DMAREG_H_ */
@@ -340,10 +340,14 @@ typedef void (*usb_control_transfer_t)(device_t *dev, usb_buf_t *buf,
 typedef void (*usb_data_transfer_t)(device_t *dev, usb_buf_t *buf, void *data,
                                     uint16_t size, usb_transfer_t transfer,
                                     usb_direction_t dir);
+typedef uint16_t (*usb_data_transfer_max_t)(device_t *dev,
+                                            usb_transfer_t transfer,
+                                            usb_direction_t dir);
 
 typedef struct usb_methods {
   usb_control_transfer_t control_transfer;
   usb_data_transfer_t data_transfer;
+  usb_data_transfer_max_t data_transfer_max;
 } usb_methods_t;
 
 static inline usb_methods_t *usb_methods(device_t *dev) {
@@ -387,6 +391,22 @@ static inline void usb_data_transfer(device_t *dev, usb_buf_t *buf, void *data,
   usb_methods(dev->parent)->data_transfer(dev, buf, data, size, transfer, dir);
 }
 
+/*
+ * Returns the max. size of a single data stage only transfer.
+ *
+ * Larger amounts of data have to be split into a sequence of transfers.
+ *
+ * Arguments:
+ *  - `dev`: device requesting the transfer
+ *  - `transfer`: `USB_TFR_INTERRUPT` or `USB_TFR_BULK`
+ *  - `dir`: transfer direction
+ */
+static inline uint16_t usb_data_transfer_max(device_t *dev,
+                                             usb_transfer_t transfer,
+                                             usb_direction_t dir) {
+  return usb_methods(dev->parent)->data_transfer_max(dev, transfer, dir);
+}
+
 /*
  * USB standard requests.
  *
@@ -17,6 +17,7 @@ typedef void (*usbhc_control_transfer_t)(device_t *hcdev, device_t *dev,
                                          usb_direction_t status_dir);
 typedef void (*usbhc_data_transfer_t)(device_t *hcdev, device_t *dev,
                                       usb_buf_t *buf);
+typedef uint16_t (*usbhc_transfer_max_t)(device_t *hcdev, usb_endpt_t *endpt);
 
 typedef struct usbhc_methods {
   usbhc_number_of_ports_t number_of_ports;
@@ -25,6 +26,7 @@ typedef struct usbhc_methods {
   usbhc_reset_port_t reset_port;
   usbhc_control_transfer_t control_transfer;
   usbhc_data_transfer_t data_transfer;
+  usbhc_transfer_max_t transfer_max;
 } usbhc_methods_t;
 
 static inline usbhc_methods_t *usbhc_methods(device_t *dev) {
@@ -117,4 +119,15 @@ static inline void usbhc_data_transfer(device_t *dev, usb_buf_t *buf) {
   usbhc_methods(hcdev)->data_transfer(hcdev, dev, buf);
 }
 
+/*! \brief Returns the max. number of bytes that can be moved by a single
+ * data stage only transfer through the specified endpoint.
+ *
+ * \param dev USB device
+ * \param endpt endpoint of the device
+ */
+static inline uint16_t usbhc_transfer_max(device_t *dev, usb_endpt_t *endpt) {
+  device_t *hcdev = USBHC_METHOD_PROVIDER(dev, transfer_max);
+  return usbhc_methods(hcdev)->transfer_max(hcdev, endpt);
+}
+
 #endif /* _DEV_USBHC_H_ */
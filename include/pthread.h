@@ -0,0 +1,92 @@
+#ifndef _PTHREAD_H_
+#define _PTHREAD_H_
+
+#include <sys/types.h>
+#include <sys/sigtypes.h>
+
+/*
+ * Minimal POSIX threads library built on top of thr_new(2) and futex(2).
+ *
+ * Only a subset of the interface is provided: thread creation and joining,
+ * normal (non-recursive) mutexes, condition variables and one-time
+ * initialization. All synchronization objects are private to a process.
+ */
+
+typedef struct pthread *pthread_t;
+
+typedef struct {
+  size_t pta_stacksize;
+  int pta_detachstate;
+} pthread_attr_t;
+
+#define PTHREAD_CREATE_JOINABLE 0
+#define PTHREAD_CREATE_DETACHED 1
+
+#define PTHREAD_STACK_MIN 4096
+
+typedef struct {
+  volatile int ptm_lock; /* 0: unlocked, 1: locked, 2: locked with waiters */
+} pthread_mutex_t;
+
+typedef struct {
+  int ptma_type;
+} pthread_mutexattr_t;
+
+#define PTHREAD_MUTEX_INITIALIZER                                              \
+  { 0 }
+
+typedef struct {
+  volatile int ptc_seq; /* bumped on each signal & broadcast */
+} pthread_cond_t;
+
+typedef struct {
+  int ptca_clock;
+} pthread_condattr_t;
+
+#define PTHREAD_COND_INITIALIZER                                               \
+  { 0 }
+
+typedef struct {
+  volatile int pto_state; /* 0: not done, 1: in progress, 2: done */
+} pthread_once_t;
+
+#define PTHREAD_ONCE_INIT                                                      \
+  { 0 }
+
+struct timespec;
+
+__BEGIN_DECLS
+int pthread_create(pthread_t *, const pthread_attr_t *, void *(*)(void *),
+                   void *);
+int pthread_join(pthread_t, void **);
+int pthread_detach(pthread_t);
+__noreturn void pthread_exit(void *);
+pthread_t pthread_self(void);
+int pthread_equal(pthread_t, pthread_t);
+int pthread_kill(pthread_t, int);
+int pthread_sigmask(int, const sigset_t *, sigset_t *);
+int pthread_once(pthread_once_t *, void (*)(void));
+
+int pthread_attr_init(pthread_attr_t *);
+int pthread_attr_destroy(pthread_attr_t *);
+int pthread_attr_getstacksize(const pthread_attr_t *, size_t *);
+int pthread_attr_setstacksize(pthread_attr_t *, size_t);
+int pthread_attr_getdetachstate(const pthread_attr_t *, int *);
+int pthread_attr_setdetachstate(pthread_attr_t *, int);
+
+int pthread_mutex_init(pthread_mutex_t *, const pthread_mutexattr_t *);
+int pthread_mutex_destroy(pthread_mutex_t *);
+int pthread_mutex_lock(pthread_mutex_t *);
+int pthread_mutex_trylock(pthread_mutex_t *);
+int pthread_mutex_unlock(pthread_mutex_t *);
+
+int pthread_cond_init(pthread_cond_t *, const pthread_condattr_t *);
+int pthread_cond_destroy(pthread_cond_t *);
+int pthread_cond_wait(pthread_cond_t *, pthread_mutex_t *);
+int pthread_cond_timedwait(pthread_cond_t *, pthread_mutex_t *,
+                           const struct timespec *);
+int pthread_cond_signal(pthread_cond_t *);
+int pthread_cond_broadcast(pthread_cond_t *);
+__END_DECLS
+
+#endif /* !_PTHREAD_H_ */
@@ -0,0 +1,34 @@
+#ifndef _SEMAPHORE_H_
+#define _SEMAPHORE_H_
+
+#include <sys/types.h>
+
+/*
+ * Unnamed POSIX semaphores built on top of futex(2).
+ *
+ * A semaphore initialized with non-zero `pshared` may be placed in memory
+ * shared by many processes, e.g. in an object created with shm_open(3) and
+ * mapped with MAP_SHARED. Named semaphores are not supported.
+ */
+
+typedef struct {
+  volatile int sem_value;   /* number of available units */
+  volatile int sem_waiters; /* number of threads that may be sleeping */
+  int sem_flags;            /* extra flags for futex operations */
+} sem_t;
+
+#define SEM_VALUE_MAX 0x7fffffff
+
+struct timespec;
+
+__BEGIN_DECLS
+int sem_init(sem_t *, int, unsigned int);
+int sem_destroy(sem_t *);
+int sem_wait(sem_t *);
+int sem_trywait(sem_t *);
+int sem_timedwait(sem_t *, const struct timespec *);
+int sem_post(sem_t *);
+int sem_getvalue(sem_t *, int *);
+__END_DECLS
+
+#endif /* !_SEMAPHORE_H_ */
@@ -0,0 +1,73 @@
+#ifndef _SYS_AIO_H_
+#define _SYS_AIO_H_
+
+#include <sys/types.h>
+#include <sys/signal.h>
+
+/*
+ * Asynchronous I/O control block. Kernel identifies a request by the address
+ * of its control block, so the block must not be moved or reused until
+ * `aio_return` is called for the request.
+ */
+struct aiocb {
+  off_t aio_offset;             /* file offset */
+  volatile void *aio_buf;       /* I/O buffer in process space */
+  size_t aio_nbytes;            /* length of transfer */
+  int aio_fildes;               /* file descriptor */
+  int aio_lio_opcode;           /* LIO opcode */
+  int aio_reqprio;              /* request priority offset (ignored) */
+  struct sigevent aio_sigevent; /* completion notification */
+};
+
+/* Operations for `aio_lio_opcode`. */
+#define LIO_NOP 0
+#define LIO_WRITE 1
+#define LIO_READ 2
+
+/* Modes of `lio_listio`. */
+#define LIO_NOWAIT 0
+#define LIO_WAIT 1
+
+#ifdef _KERNEL
+
+typedef struct proc proc_t;
+typedef struct filterops filterops_t;
+typedef struct timespec timespec_t;
+
+/* Filter operations for EVFILT_AIO. */
+extern filterops_t aio_filtops;
+
+void init_aio(void);
+
+/* Cancels queued requests of the process, waits for the ones in progress to
+ * finish and frees all of them. Called on exit and exec. */
+void aio_proc_drain(proc_t *p);
+
+/*
+ * Request identified by `ucb` is described by `cb`, which is a copy of
+ * the control block in kernel memory. `ucb` is never dereferenced.
+ */
+int do_aio_submit(proc_t *p, struct aiocb *ucb, struct aiocb *cb);
+int do_aio_error(proc_t *p, struct aiocb *ucb, int *errorp);
+int do_aio_return(proc_t *p, struct aiocb *ucb, ssize_t *resultp);
+int do_aio_suspend(proc_t *p, struct aiocb **ucbs, int nent,
+                   timespec_t *timeout);
+int do_lio_listio(proc_t *p, int mode, struct aiocb **ucbs, struct aiocb *cbs,
+                  int nent, struct sigevent *sig);
+
+#else /* !_KERNEL */
+
+struct timespec;
+
+__BEGIN_DECLS
+int aio_read(struct aiocb *);
+int aio_write(struct aiocb *);
+int aio_error(const struct aiocb *);
+ssize_t aio_return(struct aiocb *);
+int aio_suspend(const struct aiocb *const[], int, const struct timespec *);
+int lio_listio(int, struct aiocb *const[], int, struct sigevent *);
+__END_DECLS
+
+#endif /* !_KERNEL */
+
+#endif /* !_SYS_AIO_H_ */
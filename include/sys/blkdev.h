@@ -0,0 +1,87 @@
+#ifndef _SYS_BLKDEV_H_
+#define _SYS_BLKDEV_H_
+
+#include <sys/types.h>
+#include <sys/mutex.h>
+#include <sys/condvar.h>
+
+typedef struct blkdev blkdev_t;
+typedef struct devnode devnode_t;
+typedef struct vnode vnode_t;
+
+/*
+ * Block device is a common interface for disk drivers (SD card, USB mass
+ * storage, etc.). A driver only needs to provide routines that transfer
+ * whole device blocks. All other users (device nodes, filesystems) access
+ * the device through the buffer cache (see <sys/buf.h>).
+ */
+
+/*
+ * Transfer `nblks` device blocks starting from block `blkno` to or from
+ * memory area `data`. The area is at least `bd_blksize` aligned.
+ *
+ * Block device layer guarantees that routines are never called concurrently
+ * for the same block device.
+ */
+typedef int (*blkdev_read_t)(blkdev_t *bd, uint64_t blkno, void *data,
+                             size_t nblks);
+typedef int (*blkdev_write_t)(blkdev_t *bd, uint64_t blkno, const void *data,
+                              size_t nblks);
+
+typedef struct blkdev_ops {
+  blkdev_read_t bd_read;   /* read blocks from the device */
+  blkdev_write_t bd_write; /* write blocks to the device */
+} blkdev_ops_t;
+
+struct blkdev {
+  blkdev_ops_t *bd_ops; /* (!) driver routines */
+  void *bd_data;        /* (!) driver private data */
+  size_t bd_blksize;    /* (!) size of device block in bytes */
+  uint64_t bd_nblocks;  /* (!) capacity of the device in blocks */
+  size_t bd_bufsize;    /* (!) size of buffer cache block in bytes */
+  mtx_t bd_lock;        /* guards `bd_busy` and `bd_mounted` */
+  condvar_t bd_cv;      /* (l) wait here for device to become idle */
+  bool bd_busy;         /* (l) some thread is inside bd_ops routine */
+  bool bd_mounted;      /* (l) a filesystem resides on the device */
+  uint64_t bd_lastblk;  /* (c) last buffer read, to detect sequential access */
+  devnode_t *bd_node;   /* (!) device node in devfs */
+};
+
+/*! \brief Register block device and create device node named \a name.
+ *
+ * Fields `bd_ops`, `bd_data`, `bd_blksize` and `bd_nblocks` must be set by the
+ * driver beforehand. */
+int blkdev_register(blkdev_t *bd, const char *name);
+
+/*! \brief Remove device node of block device \a bd.
+ *
+ * Cached blocks of the device are written back and invalidated. The device
+ * must not be used anymore.
+ *
+ * \returns EBUSY if a filesystem is mounted on the device */
+int blkdev_unregister(blkdev_t *bd);
+
+/*! \brief Mark block device \a bd as used by a mounted filesystem.
+ *
+ * \returns EBUSY if the device is already mounted */
+int blkdev_mount(blkdev_t *bd);
+
+/*! \brief Clear the mark set by `blkdev_mount`. */
+void blkdev_unmount(blkdev_t *bd);
+
+/*! \brief Find block device that backs device node \a vn.
+ *
+ * \returns NULL if the vnode is not a block device node. */
+blkdev_t *blkdev_of(vnode_t *vn);
+
+/*! \brief Transfer buffer cache block(s) to or from the device.
+ *
+ * Used by the buffer cache. \a blkno is in units of `bd_bufsize`.
+ * Transfers are truncated at the end of the device. */
+int blkdev_read(blkdev_t *bd, uint64_t blkno, void *data, size_t size);
+int blkdev_write(blkdev_t *bd, uint64_t blkno, const void *data, size_t size);
+
+/*! \brief Size in bytes of buffer \a blkno truncated at the end of device. */
+size_t blkdev_bufsize(blkdev_t *bd, uint64_t blkno);
+
+#endif /* !_SYS_BLKDEV_H_ */
@@ -0,0 +1,78 @@
+#ifndef _SYS_BUF_H_
+#define _SYS_BUF_H_
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/condvar.h>
+
+typedef struct blkdev blkdev_t;
+
+/*
+ * Buffer cache keeps recently used blocks of block devices in memory.
+ * Buffers are identified by (device, block number), where block number is
+ * expressed in units of device's `bd_bufsize`.
+ *
+ * A buffer returned by `bread` or `getblk` is busy, i.e. owned exclusively by
+ * the caller until it's released with one of `brelse`, `bwrite` or `bdwrite`.
+ * Delayed writes are flushed periodically by the syncer thread, on `bsync`
+ * and when the buffer is reclaimed.
+ */
+
+typedef enum {
+  B_BUSY = 1,   /* owned by some thread */
+  B_VALID = 2,  /* contains data read from or destined to the device */
+  B_DELWRI = 4, /* delayed write, i.e. must be written out before reuse */
+  B_WANTED = 8, /* some thread waits for the buffer to become free */
+} buf_flags_t;
+
+typedef struct buf {
+  LIST_ENTRY(buf) b_hash;   /* (c) link on hash chain */
+  TAILQ_ENTRY(buf) b_lru;   /* (c) link on LRU list if not busy */
+  blkdev_t *b_dev;          /* (c) device the buffer belongs to */
+  uint64_t b_blkno;         /* (c) block number in units of `bd_bufsize` */
+  buf_flags_t b_flags;      /* (c) B_* flags */
+  systime_t b_dirtied;      /* (c) time the buffer became dirty */
+  condvar_t b_cv;           /* (c) for threads waiting on busy buffer */
+  void *b_data;             /* (b) contents of the buffer */
+  size_t b_bufsize;         /* (b) size of allocated `b_data` */
+  size_t b_bcount;          /* (b) number of valid bytes */
+} buf_t;
+
+/*! \brief Initialize buffer cache and start syncer thread. */
+void init_bio(void);
+
+/*! \brief Get buffer for block \a blkno without reading it from device.
+ *
+ * The buffer may already contain valid data, which is indicated by B_VALID. */
+buf_t *getblk(blkdev_t *bd, uint64_t blkno);
+
+/*! \brief Get buffer for block \a blkno with valid data in it. */
+int bread(blkdev_t *bd, uint64_t blkno, buf_t **bpp);
+
+/*! \brief Synchronously write the buffer to the device and release it. */
+int bwrite(buf_t *bp);
+
+/*! \brief Mark buffer dirty and release it. The data will be written back
+ * by the syncer thread. */
+void bdwrite(buf_t *bp);
+
+/*! \brief Release buffer without writing it. */
+void brelse(buf_t *bp);
+
+/*! \brief Write back all delayed-write buffers of \a bd (or all devices if
+ * \a bd is NULL). */
+int bsync(blkdev_t *bd);
+
+/*! \brief Discard all buffers of \a bd writing back dirty ones.
+ *
+ * Buffers that are in use are waited for. Pending read-ahead requests for
+ * \a bd are cancelled. */
+int binval(blkdev_t *bd);
+
+/*! \brief Write back dirty buffers of \a bd from \a first to \a last
+ * (inclusive) and discard them all if \a inval is set.
+ *
+ * Used before transfers that bypass the buffer cache. */
+int bsync_range(blkdev_t *bd, uint64_t first, uint64_t last, bool inval);
+
+#endif /* !_SYS_BUF_H_ */
@@ -44,6 +44,12 @@ void cv_wait(condvar_t *cv, mtx_t *m);
  */
 int cv_wait_timed(condvar_t *cv, mtx_t *m, systime_t timeout);
 
+/*! \brief Wait on a conditional variable with timeout, with possibility of
+ * being interrupted.
+ *
+ * \returns same values as `cv_wait_timed` */
+int cv_wait_timed_intr(condvar_t *cv, mtx_t *m, systime_t timeout);
+
 /*! \brief Wake a single thread waiting on a conditional variable.
  *
  * If there are multiple waiting threads then the one with the highest priority
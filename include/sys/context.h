@@ -31,6 +31,13 @@ void mcontext_copy(mcontext_t *to, mcontext_t *from);
 /*! \brief Prepare ctx to jump into a user-space program. */
 void mcontext_init(mcontext_t *ctx, void *pc, void *sp);
 
+/*! \brief Prepare user ctx to call a procedure at pc with a single argument.
+ *
+ * Stack pointer is set to sp and the return address is cleared. Remaining
+ * registers are left intact, so ctx should be a copy of a valid user context.
+ */
+void mcontext_setup_call(mcontext_t *ctx, void *pc, void *sp, register_t arg);
+
 /*! \brief Set a return value within the ctx and advance the program counter.
  *
  * Useful for returning values from syscalls. */
@@ -154,6 +154,9 @@ int devfs_makedev(devfs_node_t *parent, const char *name, vnodeops_t *vops,
 /* TODO: remove it after rewriting drivers. */
 void *devfs_node_data(vnode_t *vnode);
 
+/* Returns device node of a devfs vnode or NULL if it's not a device file. */
+devnode_t *devfs_devnode(vnode_t *vnode);
+
 /*
  * Remove a node from the devfs tree.
  *
@@ -164,6 +167,9 @@ void *devfs_node_data(vnode_t *vnode);
  */
 int devfs_unlink(devfs_node_t *dn);
 
+/* As above, for a node created with `devfs_makedev_new`. */
+int devfs_unlink_dev(devnode_t *dev);
+
 /* TODO: remove it after rewriting drivers. */
 void devfs_free(devfs_node_t *dn);
 
@@ -20,7 +20,11 @@
 /* Filter types */
 #define EVFILT_READ 0U
 #define EVFILT_WRITE 1U
-#define EVFILT_SYSCOUNT 2U /* number of filters */
+#define EVFILT_AIO 2U      /* attached to aio requests */
+#define EVFILT_PROC 4U     /* attached to struct proc */
+#define EVFILT_SIGNAL 5U   /* attached to struct proc */
+#define EVFILT_TIMER 6U    /* arbitrary timer (in ms) */
+#define EVFILT_SYSCOUNT 7U /* number of filters */
 
 struct kevent {
   uintptr_t ident; /* identifier for this event */
@@ -42,11 +46,43 @@ struct kevent {
   };
 
 /* actions */
-#define EV_ADD 0x0001U    /* add event to kq */
-#define EV_DELETE 0x0002U /* delete event from kq */
+#define EV_ADD 0x0001U     /* add event to kq */
+#define EV_DELETE 0x0002U  /* delete event from kq */
+#define EV_ENABLE 0x0004U  /* enable event */
+#define EV_DISABLE 0x0008U /* disable event (not reported) */
+
+/* flags */
+#define EV_ONESHOT 0x0010U  /* only report one occurrence */
+#define EV_CLEAR 0x0020U    /* clear event state after reporting */
+#define EV_DISPATCH 0x0080U /* disable event after reporting */
 
 /* returned values */
 #define EV_ERROR 0x4000U /* error, data contains errno */
+#define EV_EOF 0x8000U   /* EOF detected */
+
+/*
+ * data/hint flags for EVFILT_PROC
+ */
+#define NOTE_EXIT 0x80000000U /* process exited */
+#define NOTE_FORK 0x40000000U /* process forked */
+#define NOTE_EXEC 0x20000000U /* process exec'd */
+
+#define NOTE_PCTRLMASK 0xf0000000U /* mask for hint bits */
+#define NOTE_PDATAMASK 0x000fffffU /* mask for pid or exit status */
+
+/*
+ * hint flag for EVFILT_SIGNAL (used only in the kernel)
+ */
+#define NOTE_SIGNAL 0x08000000U
+
+/*
+ * data/hint flags for EVFILT_TIMER
+ */
+#define NOTE_MSECONDS 0x00000000U /* data is milliseconds (default) */
+#define NOTE_SECONDS 0x00000001U  /* data is seconds */
+#define NOTE_USECONDS 0x00000002U /* data is microseconds */
+#define NOTE_NSECONDS 0x00000003U /* data is nanoseconds */
+#define NOTE_TIMER_UNITMASK 0x00000003U
 
 #ifdef _KERNEL
 
@@ -56,6 +92,8 @@ struct kevent {
 typedef struct knote knote_t;
 typedef struct kevent kevent_t;
 typedef struct kqueue kqueue_t;
+typedef struct file file_t;
+typedef struct proc proc_t;
 typedef struct mtx mtx_t;
 
 typedef int filt_attach_t(knote_t *kn);
@@ -76,7 +114,13 @@ typedef struct filterops {
 typedef SLIST_HEAD(, knote) knlist_t;
 
 /* Status of knote. */
-#define KN_QUEUED 0x01U /* event is on queue */
+#define KN_QUEUED 0x01U    /* event is on queue */
+#define KN_TRANSIENT 0x02U /* not allocated from pool (poll & select) */
+#define KN_DISABLED 0x04U  /* event is disabled */
+#define KN_ACTIVE 0x08U    /* event has fired since last scan */
+#define KN_SCANNING 0x10U  /* taken off the queue by `kqueue_scan` */
+#define KN_INFLUX 0x20U    /* being modified or dropped by some thread */
+#define KN_DROPPING 0x40U  /* removed from kqueue, waits to be freed */
 
 /*
  * Field locking:
@@ -94,9 +138,11 @@ typedef struct knote {
   void *kn_obj;                   /* (!) monitored object */
   uint32_t kn_status;             /* (q) flags above */
 
-  /* (o) only applies to `fflags`, `data`, `udata`. The rest should remain
-   * unmodified. */
+  /* (o) only applies to `fflags`, `data`, `udata` and `flags` (which can be
+   * changed only by the filter). The rest should remain unmodified. */
   kevent_t kn_kevent;
+  uint32_t kn_sfflags; /* (!) `fflags` requested when the knote was added */
+  int64_t kn_sdata;    /* (!) `data` requested when the knote was added */
 
   /* Following fields should be only set in the filt_attach function and aren't
    * protected by any lock. */
@@ -112,6 +158,37 @@ typedef struct knote {
  */
 void knote(knlist_t *knlist, long hint);
 
+/*
+ * Report process events (NOTE_FORK, NOTE_EXEC, NOTE_SIGNAL) to knotes
+ * attached to the process. The process must be alive.
+ */
+void proc_knote(proc_t *p, long hint);
+
+/*
+ * Report NOTE_EXIT and detach all knotes from the process.
+ * Called once the process has become a zombie.
+ */
+void proc_knote_exit(proc_t *p);
+
+/*
+ * Attach a knote for object `obj` to kqueue `kqfd` of process `p`.
+ * Used by filters whose knotes are not created by kevent(2) directly,
+ * e.g. EVFILT_AIO.
+ */
+int kqueue_attach(proc_t *p, int kqfd, kevent_t *kev, void *obj);
+
+/*
+ * Remove all knotes from the list, e.g. when the object is destroyed.
+ * The caller's object lock must NOT be held.
+ */
+void knlist_clear(knlist_t *knlist);
+
+/*
+ * File kqfilter for objects that are always ready for reading and writing,
+ * e.g. regular files.
+ */
+int seltrue_kqfilter(file_t *f, knote_t *kn);
+
 int do_kqueue1(proc_t *p, int flags, int *fd);
 int do_kevent(proc_t *p, int kq, kevent_t *changelist, size_t nchanges,
               kevent_t *eventlist, size_t nevents, timespec_t *timeout,
@@ -0,0 +1,42 @@
+#ifndef _SYS_EVENTFD_H_
+#define _SYS_EVENTFD_H_
+
+#include <sys/fcntl.h>
+#include <sys/types.h>
+
+/*
+ * Event counter - a descriptor for lightweight notifications.
+ *
+ * Writing an 8-byte value adds it to the counter. Reading returns the counter
+ * and resets it to zero, or decrements it by one if the counter was created
+ * with EFD_SEMAPHORE. Read blocks while the counter is zero and write blocks
+ * if the counter would exceed EVENTFD_MAX. The descriptor can be monitored
+ * with kqueue and poll.
+ */
+
+typedef uint64_t eventfd_t;
+
+#define EVENTFD_MAX ((eventfd_t)-2)
+
+/* EFD_SEMAPHORE takes a bit not used by any of open(2) flags. */
+#define EFD_SEMAPHORE 0x00080000
+#define EFD_CLOEXEC O_CLOEXEC
+#define EFD_NONBLOCK O_NONBLOCK
+
+#ifdef _KERNEL
+
+typedef struct proc proc_t;
+
+int do_eventfd(proc_t *p, unsigned initval, int flags, int *fdp);
+
+#else /* !_KERNEL */
+
+__BEGIN_DECLS
+int eventfd(unsigned int, int);
+int eventfd_read(int, eventfd_t *);
+int eventfd_write(int, eventfd_t);
+__END_DECLS
+
+#endif /* !_KERNEL */
+
+#endif /* !_SYS_EVENTFD_H_ */
@@ -0,0 +1,151 @@
+#ifndef _SYS_EXT2FS_H_
+#define _SYS_EXT2FS_H_
+
+#include <sys/types.h>
+
+/*
+ * On-disk format of the second extended filesystem. All multi-byte fields are
+ * stored in little-endian byte order. Block numbers are 32-bit and refer to
+ * filesystem blocks of size (1024 << s_log_block_size) bytes.
+ */
+
+#define EXT2_SBLOCK_OFF 1024 /* offset of superblock from start of device */
+#define EXT2_MAGIC 0xef53
+#define EXT2_ROOTINO 2 /* inode number of the root directory */
+
+#define EXT2_GOOD_OLD_REV 0 /* original format */
+#define EXT2_DYNAMIC_REV 1  /* format with variable inode sizes */
+#define EXT2_GOOD_OLD_INODE_SIZE 128
+#define EXT2_GOOD_OLD_FIRST_INO 11
+
+/* Filesystem states (s_state). */
+#define EXT2_VALID_FS 1 /* cleanly unmounted */
+#define EXT2_ERROR_FS 2 /* errors detected */
+
+/* Features that must be supported to mount the filesystem at all. */
+#define EXT2F_INCOMPAT_FILETYPE 0x0002 /* file type is stored in dirents */
+
+/* Features that must be supported to mount the filesystem read-write. */
+#define EXT2F_ROCOMPAT_SPARSESUPER 0x0001 /* superblock backups are sparse */
+#define EXT2F_ROCOMPAT_LARGEFILE 0x0002   /* file sizes over 2GiB */
+
+#define EXT2_NDADDR 12 /* number of direct block pointers */
+#define EXT2_NIADDR 3  /* number of indirect block pointers */
+#define EXT2_NBLOCKS (EXT2_NDADDR + EXT2_NIADDR)
+
+/* Symbolic links shorter than that are stored in place of block pointers. */
+#define EXT2_MAXSYMLINKLEN (EXT2_NBLOCKS * sizeof(uint32_t))
+
+#define EXT2_SECTOR_SIZE 512 /* unit of i_blocks */
+
+#define EXT2_NAME_LEN 255
+#define EXT2_LINK_MAX 32000
+
+/* Inode flags (i_flags). */
+#define EXT2_INDEX_FL 0x00001000 /* directory has hashed index */
+
+typedef struct ext2_superblock {
+  uint32_t s_inodes_count;      /* number of inodes */
+  uint32_t s_blocks_count;      /* number of blocks */
+  uint32_t s_r_blocks_count;    /* number of blocks reserved for root */
+  uint32_t s_free_blocks_count; /* number of free blocks */
+  uint32_t s_free_inodes_count; /* number of free inodes */
+  uint32_t s_first_data_block;  /* block containing the superblock */
+  uint32_t s_log_block_size;    /* block size is 1024 << s_log_block_size */
+  uint32_t s_log_frag_size;     /* fragment size (unused) */
+  uint32_t s_blocks_per_group;  /* number of blocks per group */
+  uint32_t s_frags_per_group;   /* number of fragments per group (unused) */
+  uint32_t s_inodes_per_group;  /* number of inodes per group */
+  uint32_t s_mtime;             /* time of last mount */
+  uint32_t s_wtime;             /* time of last write */
+  uint16_t s_mnt_count;         /* number of mounts since last check */
+  uint16_t s_max_mnt_count;     /* number of mounts before check is forced */
+  uint16_t s_magic;             /* EXT2_MAGIC */
+  uint16_t s_state;             /* EXT2_VALID_FS or EXT2_ERROR_FS */
+  uint16_t s_errors;            /* behaviour when detecting errors */
+  uint16_t s_minor_rev_level;   /* minor revision level */
+  uint32_t s_lastcheck;         /* time of last check */
+  uint32_t s_checkinterval;     /* max. time between checks */
+  uint32_t s_creator_os;        /* OS that created the filesystem */
+  uint32_t s_rev_level;         /* EXT2_GOOD_OLD_REV or EXT2_DYNAMIC_REV */
+  uint16_t s_def_resuid;        /* default uid for reserved blocks */
+  uint16_t s_def_resgid;        /* default gid for reserved blocks */
+  /* Fields below are valid only for EXT2_DYNAMIC_REV. */
+  uint32_t s_first_ino;              /* first non-reserved inode */
+  uint16_t s_inode_size;             /* size of on-disk inode */
+  uint16_t s_block_group_nr;         /* block group of this superblock */
+  uint32_t s_feature_compat;         /* compatible features */
+  uint32_t s_feature_incompat;       /* incompatible features */
+  uint32_t s_feature_ro_compat;      /* read-only compatible features */
+  uint8_t s_uuid[16];                /* volume identifier */
+  char s_volume_name[16];            /* volume name */
+  char s_last_mounted[64];           /* directory where last mounted */
+  uint32_t s_algorithm_usage_bitmap; /* compression (unused) */
+  uint8_t s_prealloc_blocks;         /* blocks to preallocate for files */
+  uint8_t s_prealloc_dir_blocks;     /* blocks to preallocate for dirs */
+  uint16_t s_padding;
+  uint8_t s_reserved[816];
+} ext2_superblock_t;
+
+typedef struct ext2_gd {
+  uint32_t bg_block_bitmap;      /* block with block usage bitmap */
+  uint32_t bg_inode_bitmap;      /* block with inode usage bitmap */
+  uint32_t bg_inode_table;       /* first block of inode table */
+  uint16_t bg_free_blocks_count; /* number of free blocks */
+  uint16_t bg_free_inodes_count; /* number of free inodes */
+  uint16_t bg_used_dirs_count;   /* number of directories */
+  uint16_t bg_pad;
+  uint32_t bg_reserved[3];
+} ext2_gd_t;
+
+typedef struct ext2_dinode {
+  uint16_t i_mode;                /* file type and access mode */
+  uint16_t i_uid;                 /* low 16 bits of owner id */
+  uint32_t i_size;                /* size in bytes */
+  uint32_t i_atime;               /* time of last access */
+  uint32_t i_ctime;               /* time of last inode change */
+  uint32_t i_mtime;               /* time of last data modification */
+  uint32_t i_dtime;               /* time of deletion */
+  uint16_t i_gid;                 /* low 16 bits of group id */
+  uint16_t i_links_count;         /* number of hard links */
+  uint32_t i_blocks;              /* number of sectors used */
+  uint32_t i_flags;               /* EXT2_*_FL flags */
+  uint32_t i_osd1;                /* OS dependent */
+  uint32_t i_block[EXT2_NBLOCKS]; /* block pointers */
+  uint32_t i_generation;          /* file version (used by NFS) */
+  uint32_t i_file_acl;            /* block with extended attributes */
+  uint32_t i_size_high;           /* high 32 bits of size of regular file */
+  uint32_t i_faddr;               /* fragment address (unused) */
+  uint8_t i_frag;                 /* fragment number (unused) */
+  uint8_t i_fsize;                /* fragment size (unused) */
+  uint16_t i_blocks_high;         /* high 16 bits of i_blocks */
+  uint16_t i_uid_high;            /* high 16 bits of owner id */
+  uint16_t i_gid_high;            /* high 16 bits of group id */
+  uint32_t i_reserved;
+} ext2_dinode_t;
+
+/* File types stored in directory entries (d_type). */
+#define EXT2_FT_UNKNOWN 0
+#define EXT2_FT_REG_FILE 1
+#define EXT2_FT_DIR 2
+#define EXT2_FT_CHRDEV 3
+#define EXT2_FT_BLKDEV 4
+#define EXT2_FT_FIFO 5
+#define EXT2_FT_SOCK 6
+#define EXT2_FT_SYMLINK 7
+
+/* Directory entries never cross block boundary. The last entry in a block
+ * takes up the space left to the end of the block. */
+typedef struct ext2_dirent {
+  uint32_t d_ino;    /* inode number or 0 if the entry is unused */
+  uint16_t d_reclen; /* length of the whole entry */
+  uint8_t d_namelen; /* length of the name */
+  uint8_t d_type;    /* EXT2_FT_* if EXT2F_INCOMPAT_FILETYPE is set */
+  char d_name[];     /* name (not NUL-terminated) */
+} ext2_dirent_t;
+
+/* Minimum length of directory entry for name of length `namelen`. */
+#define EXT2_DIRENT_SIZE(namelen)                                              \
+  ((sizeof(ext2_dirent_t) + (namelen) + 3) & ~3)
+
+#endif /* !_SYS_EXT2FS_H_ */
@@ -40,10 +40,13 @@ int nowrite(file_t *f, uio_t *uio);
 int noseek(file_t *f, off_t offset, int whence, off_t *newoffp);
 
 typedef enum filetype {
-  FT_VNODE = 1,  /* regular file */
-  FT_PIPE = 2,   /* pipe */
-  FT_PTY = 3,    /* master side of a pseudoterminal */
-  FT_KQUEUE = 4, /* kqueue */
+  FT_VNODE = 1,   /* regular file */
+  FT_PIPE = 2,    /* pipe */
+  FT_PTY = 3,     /* master side of a pseudoterminal */
+  FT_KQUEUE = 4,  /* kqueue */
+  FT_SOCKET = 5,  /* socket */
+  FT_SHM = 6,     /* shared memory object */
+  FT_EVENTFD = 7, /* event counter */
 } filetype_t;
 
 #define FF_READ 1  /* file can be read from */
@@ -54,6 +57,10 @@ typedef enum filetype {
 #define IO_NONBLOCK 8 /* read & write return EAGAIN instead of blocking */
 #define IO_MASK (IO_APPEND | IO_NONBLOCK)
 
+/* Positional I/O (pread & pwrite): `uio_offset` is given by the caller and
+ * file offset is neither used nor updated. Never set in `f_flags`. */
+#define IO_OFFSET 16
+
 typedef struct file {
   void *f_data; /* File specific data */
   fileops_t *f_ops;
@@ -88,6 +95,9 @@ int do_fcntl(proc_t *p, int fd, int cmd, int arg, int *resp);
 int do_ioctl(proc_t *p, int fd, u_long cmd, void *data);
 int do_umask(proc_t *p, int newmask, int *oldmaskp);
 
+/* Raises SIGPIPE if `error` is EPIPE. */
+void file_sigpipe(proc_t *p, int error);
+
 #endif /* !_KERNEL */
 
 #endif /* !_SYS_FILE_H_ */
@@ -43,6 +43,8 @@
 #include <sys/ioccom.h>
 
 /* Generic file-descriptor ioctl's. */
-#define FIONREAD _IOR('f', 127, int) /* get # bytes to read */
+#define FIONREAD _IOR('f', 127, int)       /* get # bytes to read */
+#define FIOSEEKDATA _IOWR('f', 97, off_t) /* SEEK_DATA */
+#define FIOSEEKHOLE _IOWR('f', 98, off_t) /* SEEK_HOLE */
 
 #endif /* !_SYS_FILIO_H_ */
@@ -0,0 +1,47 @@
+#ifndef _SYS_FUTEX_H_
+#define _SYS_FUTEX_H_
+
+#include <sys/types.h>
+
+/*
+ * Fast userspace mutex - a minimal subset of Linux futex(2).
+ *
+ * FUTEX_WAIT puts the caller to sleep if the word pointed by uaddr still holds
+ * val. The sleep may be bounded by a relative timeout. FUTEX_WAKE wakes up at
+ * most val threads waiting on the word and returns how many have been woken.
+ *
+ * Futexes are identified by address space and virtual address, so they work
+ * only among threads of a single process. With FUTEX_SHARED or'ed into the
+ * operation the word is identified by the physical page it resides in, which
+ * lets processes synchronize on a word in shared memory.
+ */
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+#define FUTEX_SHARED 128 /* word may be mapped by many processes */
+#define FUTEX_CMD_MASK (~FUTEX_SHARED)
+
+#ifdef _KERNEL
+
+#include <sys/time.h>
+
+typedef struct proc proc_t;
+
+void init_futex(void);
+
+int do_futex_wait(proc_t *p, int *uaddr, int flags, int val,
+                  const timespec_t *timeout);
+int do_futex_wake(proc_t *p, int *uaddr, int flags, int val, int *nwokenp);
+
+#else /* !_KERNEL */
+
+struct timespec;
+
+__BEGIN_DECLS
+int futex(int *, int, int, const struct timespec *);
+__END_DECLS
+
+#endif /* !_KERNEL */
+
+#endif /* !_SYS_FUTEX_H_ */
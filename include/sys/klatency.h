@@ -0,0 +1,64 @@
+#ifndef _SYS_KLATENCY_H_
+#define _SYS_KLATENCY_H_
+
+#include <sys/types.h>
+
+/*
+ * Interrupts-off and preemption-off latency tracer.
+ *
+ * The tracer measures windows during which the processor runs with interrupts
+ * or preemption disabled, i.e. the time between transition of current thread's
+ * td_idnest (or td_pdnest) from 0 to 1 and back to 0. Since a context switch
+ * always happens with interrupts disabled, windows are tracked per processor
+ * rather than per thread. For each kind of window the tracer keeps the worst
+ * KLAT_WORST windows together with program counters where the window was
+ * opened and closed.
+ *
+ * To enable, compile the kernel with KLATENCY=1 flag. Windows can be read from
+ * /dev/klatency as an array of klat_window_t records, which can be analyzed
+ * with kftlib. Write anything to the device file to reset the statistics.
+ *
+ * Timestamps and durations are expressed in ticks of the same counter that is
+ * used by kftrace.
+ */
+
+typedef enum klat_type {
+  KLAT_INTR = 0,    /* interrupts disabled */
+  KLAT_PREEMPT = 1, /* preemption disabled */
+  KLAT_NTYPES
+} klat_type_t;
+
+#define KLAT_WORST 16
+
+typedef struct klat_window {
+  uint32_t kw_type;     /* klat_type_t */
+  uint32_t kw_tid;      /* thread that opened the window */
+  uint64_t kw_start;    /* timestamp when the window was opened */
+  uint64_t kw_duration; /* window length */
+  uint64_t kw_start_pc; /* where the window was opened */
+  uint64_t kw_end_pc;   /* where the window was closed */
+} klat_window_t;
+
+#ifdef _KERNEL
+
+typedef struct thread thread_t;
+
+#if KLATENCY
+/*! \brief Called when current processor enters a window of \a type. */
+void klat_start(klat_type_t type, const void *pc);
+/*! \brief Called when current processor leaves a window of \a type. */
+void klat_stop(klat_type_t type, const void *pc);
+/*! \brief Attributes a window that has just been opened to \a pc. */
+void klat_setpc(klat_type_t type, const void *pc);
+/*! \brief Called just before context switch to thread \a newtd. */
+void klat_switch(thread_t *newtd);
+#else
+#define klat_start(type, pc) __nothing
+#define klat_stop(type, pc) __nothing
+#define klat_setpc(type, pc) __nothing
+#define klat_switch(newtd) __nothing
+#endif
+
+#endif /* !_KERNEL */
+
+#endif /* !_SYS_KLATENCY_H_ */
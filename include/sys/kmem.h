@@ -32,6 +32,14 @@ vaddr_t kmem_alloc_contig(paddr_t *pap, size_t size,
  * Returns kernel virtual address where the memory is mapped. */
 vaddr_t kmem_map_contig(paddr_t pa, size_t size, unsigned flags) __warn_unused;
 
+/* Map `npages` possibly scattered pages at consecutive kernel virtual
+ * addresses. The pages are not owned by the mapping, i.e. `kmem_unmap_pages`
+ * does not free them.
+ *
+ * Returns kernel virtual address where the first page is mapped. */
+vaddr_t kmem_map_pages(vm_page_t **pages, size_t npages) __warn_unused;
+void kmem_unmap_pages(vaddr_t va, size_t npages);
+
 /*
  * Kernel virtual address space allocator.
  */
@@ -34,6 +34,7 @@
 #define LOCKDEP_MAX_HELD_LOCKS 16
 
 typedef struct lock_class lock_class_t;
+typedef struct lockstat_class lockstat_class_t;
 typedef uintptr_t lock_class_key_t;
 
 /* A struct which is part of every lock object. */
@@ -41,6 +42,11 @@ typedef struct lock_class_mapping {
   lock_class_key_t *key;
   const char *name;
   lock_class_t *lock_class;
+#if LOCKSTAT
+  lockstat_class_t *lock_stat; /* statistics of the class (see lockstat.h) */
+  uint64_t acquired;           /* when the lock was acquired [ns] */
+  const void *waitpt;          /* where the lock was acquired */
+#endif
 } lock_class_mapping_t;
 
 #define LOCKDEP_MAPPING_INITIALIZER(lockname)                                  \
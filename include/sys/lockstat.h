@@ -0,0 +1,55 @@
+#ifndef _SYS_LOCKSTAT_H_
+#define _SYS_LOCKSTAT_H_
+
+#include <sys/types.h>
+
+/*
+ * Lock contention profiler gathers statistics about lock usage per lock class
+ * (see lockdep.h for the definition of lock class). For each class it counts
+ * acquisitions, acquisitions that found the lock already owned, iterations
+ * spent spinning on spin locks, time spent blocked on turnstile and time spent
+ * holding the lock. The longest hold is accompanied by the program counter
+ * where the lock was acquired.
+ *
+ * To enable, compile the kernel with LOCKSTAT=1 flag. Statistics can be read
+ * from /dev/lockstat as an array of lockstat_info_t records. Write anything to
+ * the device file to reset the statistics.
+ *
+ * All times are expressed in nanoseconds.
+ */
+
+#define LOCKSTAT_NAME_MAX 32
+
+typedef struct lockstat_info {
+  char ls_name[LOCKSTAT_NAME_MAX]; /* lock class name */
+  uint64_t ls_acquired;            /* number of acquisitions */
+  uint64_t ls_contended;           /* acquisitions that found lock owned */
+  uint64_t ls_spins;               /* spin iterations (spin locks only) */
+  uint64_t ls_blocked;             /* total time blocked on turnstile */
+  uint64_t ls_held;                /* total hold time */
+  uint64_t ls_maxheld;             /* maximum hold time */
+  uint64_t ls_maxheld_pc;          /* where the longest hold started */
+} lockstat_info_t;
+
+#ifdef _KERNEL
+
+typedef struct lock_class_mapping lock_class_mapping_t;
+
+/*! \brief Returns time in nanoseconds used for lock profiling. */
+uint64_t lockstat_now(void);
+
+/*! \brief Called after the lock has been acquired.
+ *
+ * \param waitpt where the lock is being acquired
+ * \param contended true if the lock was owned by someone else at first attempt
+ * \param spins number of iterations spent on spinning
+ * \param blocked time spent blocked on turnstile */
+void lockstat_acquire(lock_class_mapping_t *lock, const void *waitpt,
+                      bool contended, unsigned spins, uint64_t blocked);
+
+/*! \brief Called just before the lock is released. */
+void lockstat_release(lock_class_mapping_t *lock);
+
+#endif /* !_KERNEL */
+
+#endif /* !_SYS_LOCKSTAT_H_ */
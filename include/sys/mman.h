@@ -37,6 +37,25 @@ void *mmap(void *addr, size_t length, int prot, int flags, int fd,
 int munmap(void *addr, size_t len);
 int mprotect(void *addr, size_t len, int prot);
 int madvise(void *addr, size_t len, int advice);
+int shm_open(const char *name, int oflag, mode_t mode);
+int shm_unlink(const char *name);
+
+#else /* _KERNEL */
+
+typedef struct proc proc_t;
+typedef struct file file_t;
+typedef struct vm_aref vm_aref_t;
+
+/* Shared memory objects. */
+int do_shm_open(proc_t *p, const char *name, int flags, mode_t mode, int *fdp);
+int do_shm_unlink(proc_t *p, const char *name);
+
+/* Changes the size of shared memory object opened as `f`. */
+int shm_truncate(file_t *f, off_t length);
+
+/* Takes reference to pages backing range of shared memory object opened as
+ * `f`, starting at page-aligned offset `pos`. */
+int shm_mmap(file_t *f, off_t pos, size_t length, vm_aref_t *arefp);
 
 #endif /* !_KERNEL */
 
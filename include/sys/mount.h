@@ -32,6 +32,7 @@ typedef struct mount mount_t;
 typedef struct vnode vnode_t;
 typedef struct vfsconf vfsconf_t;
 typedef struct statvfs statvfs_t;
+typedef struct blkdev blkdev_t;
 
 /* VFS operations */
 typedef int vfs_mount_t(mount_t *m);
@@ -71,6 +72,7 @@ typedef struct mount {
   vfsops_t *mnt_vfsops;      /* Filesystem operations */
   vfsconf_t *mnt_vfc;        /* Link to filesystem info */
   vnode_t *mnt_vnodecovered; /* The vnode covered by this mount */
+  blkdev_t *mnt_dev;         /* Device backing the filesystem (if any) */
 
   refcnt_t mnt_refcnt; /* Reference count */
   mtx_t mnt_mtx;
@@ -105,9 +107,15 @@ vfsconf_t *vfs_get_by_name(const char *name);
  * list. */
 mount_t *vfs_mount_alloc(vnode_t *v, vfsconf_t *vfc);
 
-/* Mount a new instance of the filesystem vfc at the vnode v. Does not support
- * remounting. TODO: Additional filesystem-specific arguments. */
-int vfs_domount(vfsconf_t *vfc, vnode_t *v);
+/* Mount a new instance of the filesystem vfc at the vnode v. Disk-based
+ * filesystems need block device dev, pseudo-filesystems take NULL. Does not
+ * support remounting. TODO: Additional filesystem-specific arguments. */
+int vfs_domount(vfsconf_t *vfc, vnode_t *v, blkdev_t *dev);
+
+/* Mount a new instance of the filesystem vfc as the root filesystem in place
+ * of the current one. The old root filesystem stays in memory, since there
+ * may be vnodes that still refer to it. */
+int vfs_mountroot(vfsconf_t *vfc, blkdev_t *dev);
 
 #else /* !_KERNEL */
 #include <sys/cdefs.h>
@@ -115,7 +123,7 @@ int vfs_domount(vfsconf_t *vfc, vnode_t *v);
 
 __BEGIN_DECLS
 int unmount(const char *, int);
-int mount(const char *, const char *, int, void *, size_t);
+int mount(const char *, const char *, const char *);
 __END_DECLS
 
 #endif /* _KERNEL */
@@ -33,7 +33,7 @@ typedef struct thread thread_t;
 typedef struct mtx {
   atomic_intptr_t m_owner; /*!< stores address of the owner */
 
-#if LOCKDEP
+#if LOCKDEP || LOCKSTAT
   lock_class_mapping_t m_lockmap;
 #endif
 } mtx_t;
@@ -45,7 +45,7 @@ typedef struct mtx {
 #define MTX_CONTESTED 4
 #define MTX_FLAGMASK 7
 
-#if LOCKDEP
+#if LOCKDEP || LOCKSTAT
 #define MTX_INITIALIZER(mutexname, type)                                       \
   (mtx_t) {                                                                    \
     .m_owner = (type), .m_lockmap = LOCKDEP_MAPPING_INITIALIZER(mutexname)     \
@@ -5,8 +5,14 @@
 
 #include <machine/vm_param.h>
 
-/* size of pipe buffer */
+/* initial and minimal size of pipe buffer */
 #define PIPE_SIZE PAGESIZE
+/* pipe buffer grows up to this size under sustained load */
+#define PIPE_MAX_SIZE (64 * 1024)
+/* writes at least this long copy directly from writer's pages */
+#define PIPE_DIRECT_MIN (8 * 1024)
+/* maximum number of writer's pages loaned to the reader at once */
+#define PIPE_DIRECT_PAGES 16
 
 typedef struct proc proc_t;
 
@@ -60,8 +60,32 @@ struct pollfd {
 
 #include <sys/cdefs.h>
 
+#ifdef _KERNEL
+
+#include <sys/sigtypes.h>
+#include <sys/time.h>
+
+typedef struct proc proc_t;
+
+/*
+ * Waits for events on file descriptors using knotes attached to a transient
+ * kqueue. If `tsp` is NULL the call waits indefinitely. If `mask` is not NULL
+ * it replaces the signal mask for the duration of the call.
+ */
+int do_poll(proc_t *p, struct pollfd *fds, nfds_t nfds, timespec_t *tsp,
+            const sigset_t *mask, int *retval);
+
+#else /* !_KERNEL */
+
+#include <sys/sigtypes.h>
+
+struct timespec;
+
 __BEGIN_DECLS
 int poll(struct pollfd *, nfds_t, int);
+int pollts(struct pollfd *, nfds_t, const struct timespec *, const sigset_t *);
 __END_DECLS
 
+#endif /* !_KERNEL */
+
 #endif /* !_SYS_POLL_H_ */
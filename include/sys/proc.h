@@ -11,6 +11,7 @@
 #include <sys/syslimits.h>
 #include <sys/uio.h>
 #include <sys/time.h>
+#include <sys/event.h>
 
 typedef struct thread thread_t;
 typedef struct proc proc_t;
@@ -86,6 +87,8 @@ typedef enum {
  *  (~) always safe to access
  *  ($) use only from the same process/thread
  *  (*) safe to dereference from owner process
+ *  (q) aio_lock (see kern/aio.c)
+ *  (k) proc_knote_lock (see kern/event.c)
  *  When two locks are specified (see p_parent), either one suffices
  *  for reading, but both must be held for writing.
  *  NOTE: You can acquire the parent's p_lock while holding the child's p_lock,
@@ -97,7 +100,9 @@ struct proc {
   TAILQ_ENTRY(proc) p_zombie; /* (a) link on zombie process list */
   TAILQ_ENTRY(proc) p_child;  /* (a) link on parent's children list */
   TAILQ_ENTRY(proc) p_hash;   /* (a) link on pid hash chain */
-  thread_t *p_thread;         /* (@) the only thread running in this process */
+  TAILQ_HEAD(, thread) p_threads; /* (@) threads running in this process */
+  int p_nthreads;                 /* (@) number of threads on p_threads */
+  condvar_t p_threadcv;           /* (@) waiting for other threads to exit */
   pid_t p_pid;                /* (!) Process ID */
   cred_t p_cred;              /* (@, *) Process credentials */
   char *p_elfpath;            /* (!) path of loaded elf file */
@@ -117,6 +122,8 @@ struct proc {
   vnode_t *p_cwd;                 /* ($) current working directory */
   mode_t p_cmask;                 /* ($) mask for file creation */
   kitimer_t p_itimer;             /* (@) interval timer state  */
+  TAILQ_HEAD(, aiojob) p_aiojobs; /* (q) asynchronous I/O requests */
+  knlist_t p_klist;               /* (k) knotes attached to this process */
   /* program segments */
   vm_map_entry_t *p_sbrk; /* ($) The entry where brk segment resides in. */
   vaddr_t p_sbrk_end;     /* ($) Current end of brk segment. */
@@ -150,6 +157,11 @@ void proc_add(proc_t *p);
  * \returns locked process or NULL if not found */
 proc_t *proc_find(pid_t pid);
 
+/*! \brief Searches for a process with the given PID in any state.
+ * Unlike \a proc_find it returns dying and zombie processes as well.
+ * \returns locked process or NULL if not found */
+proc_t *proc_find_any(pid_t pid);
+
 /*! \brief Sends signal to process group or process.
  * Signal is send on behalf of the current process. Performs privilege checks.
  * (pid > 0) sends signal to the process with the ID specified by pid.
@@ -161,9 +173,35 @@ int proc_sendsig(pid_t pid, signo_t sig);
 int proc_getpgid(pid_t pid, pgid_t *pgidp);
 
 /*! \brief Called by a processes that wishes to terminate its life.
+ *
+ * All other threads of the process are terminated first.
  * \note Exit status shoud be created using MAKE_STATUS macros from wait.h */
 __noreturn void proc_exit(int exitstatus);
 
+/*! \brief Makes thread \a td a member of process \a p.
+ *
+ * Must be called with p::p_lock held. */
+void proc_add_thread(proc_t *p, thread_t *td);
+
+/*! \brief Called by a thread that wishes to leave its process.
+ *
+ * If the calling thread is the last one in the process, then the whole
+ * process exits with \a exitstatus.
+ *
+ * Must be called with current process's p_lock held. */
+__noreturn void proc_thread_exit(int exitstatus);
+
+/*! \brief Terminates all threads of the current process except the caller.
+ *
+ * Other threads are woken up if needed and exit on their way back to user
+ * space. The function waits until all of them are gone. Used by exit & exec.
+ *
+ * Must be called with current process's p_lock held, which may be released
+ * and reacquired.
+ *
+ * \returns EINTR if the caller itself has been requested to exit */
+int proc_single_thread(proc_t *p);
+
 /*! \brief Moves process with pid target to the process group with ID specified
  * by pgid. If such process group does not exist then it creates one. */
 int pgrp_enter(proc_t *curp, pid_t target, pgid_t pgid);
@@ -194,6 +232,13 @@ void proc_wakeup_parent(proc_t *parent);
  * Must be called with the current process's p_lock held. */
 void proc_stop(signo_t sig);
 
+/*! \brief Stop the current thread if its process has been stopped.
+ *
+ * Used by threads other than the one that stopped the process.
+ *
+ * Must be called with the current process's p_lock held. */
+void proc_stop_thread(proc_t *p);
+
 /*! \brief Continue a stopped process.
  *
  * Must be called with p::p_lock held. */
@@ -119,6 +119,11 @@ void sched_maybe_switch(void);
 /*! \brief Turns calling thread into idle thread. */
 __noreturn void sched_run(void);
 
+/*! \brief Fetch scheduler statistics of thread \a td.
+ *
+ * If \a td is NULL then system-wide statistics are returned. */
+void sched_getstats(thread_t *td, schedstat_t *ss);
+
 #endif /* _KERNEL */
 
 #endif /* !_SYS_SCHED_H_ */
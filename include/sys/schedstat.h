@@ -0,0 +1,48 @@
+#ifndef _SYS_SCHEDSTAT_H_
+#define _SYS_SCHEDSTAT_H_
+
+#include <sys/types.h>
+
+/*
+ * Scheduler statistics are kept per thread and system-wide. Intervals are
+ * recorded in log2 histograms with microsecond resolution:
+ *  - latency: time spent in ready state waiting for the processor, measured
+ *    from wakeup or preemption until the thread is chosen to run,
+ *  - slice: time spent running until the thread is switched out.
+ *
+ * Bucket 0 counts intervals shorter than 1us, bucket i > 0 counts intervals
+ * in [2^(i-1), 2^i) microseconds range. The last bucket also counts all longer
+ * intervals.
+ *
+ * Reading /dev/schedstat returns an array of schedstat_t records. The first
+ * record describes the whole system, the rest describe all threads.
+ */
+
+#define SCHEDSTAT_NBUCKETS 32
+
+typedef struct schedstat_hist {
+  uint32_t h_count[SCHEDSTAT_NBUCKETS];
+} schedstat_hist_t;
+
+#define SCHEDSTAT_NAME_MAX 32
+
+typedef struct schedstat {
+  tid_t ss_tid;                      /* thread identifier */
+  char ss_name[SCHEDSTAT_NAME_MAX];  /* thread name */
+  uint32_t ss_nctxsw;                /* number of context switches */
+  uint32_t ss_npreempt;              /* number of involuntary switches */
+  uint64_t ss_maxlatency;            /* longest wakeup-to-run latency [us] */
+  schedstat_hist_t ss_latency;       /* wakeup-to-run latency */
+  schedstat_hist_t ss_slice;         /* slice usage */
+} schedstat_t;
+
+#ifdef _KERNEL
+
+#include <sys/time.h>
+
+/*! \brief Records interval \a bt in histogram \a h. */
+void schedstat_hist_add(schedstat_hist_t *h, bintime_t bt);
+
+#endif /* !_KERNEL */
+
+#endif /* !_SYS_SCHEDSTAT_H_ */
@@ -38,11 +38,28 @@
 #include <sys/fd_set.h>
 
 #include <sys/sigtypes.h>
+
+#ifdef _KERNEL
+
+#include <sys/time.h>
+
+typedef struct proc proc_t;
+
+int do_pselect(proc_t *p, int nfds, fd_set *readfds, fd_set *writefds,
+               fd_set *exceptfds, timespec_t *tsp, const sigset_t *mask,
+               int *retval);
+
+#else /* !_KERNEL */
+
 #include <time.h>
 
 __BEGIN_DECLS
+int pselect(int, fd_set *__restrict, fd_set *__restrict, fd_set *__restrict,
+            const struct timespec *__restrict, const sigset_t *__restrict);
 int select(int, fd_set *__restrict, fd_set *__restrict, fd_set *__restrict,
            struct timeval *__restrict);
 __END_DECLS
 
+#endif /* !_KERNEL */
+
 #endif /* !_SYS_SELECT_H_ */
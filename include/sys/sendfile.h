@@ -0,0 +1,38 @@
+#ifndef _SYS_SENDFILE_H_
+#define _SYS_SENDFILE_H_
+
+#include <sys/types.h>
+
+/*
+ * In-kernel data transfer between file descriptors - a subset of Linux
+ * sendfile(2) and splice(2).
+ *
+ * Both move up to `count` bytes from `infd` to `outfd` without passing data
+ * through user memory. sendfile requires `infd` to refer to a regular file,
+ * while splice accepts any readable file, e.g. a pipe. If an offset pointer
+ * is given, data is read (written) at that offset, which is then advanced,
+ * and the file offset is left unchanged. Otherwise the file offset is used.
+ *
+ * A single call transfers at most one chunk of data from a file that is not
+ * seekable, so it doesn't block when some data has already been moved.
+ */
+
+#ifdef _KERNEL
+
+typedef struct proc proc_t;
+
+int do_sendfile(proc_t *p, int outfd, int infd, off_t *offp, size_t count,
+                size_t *donep);
+int do_splice(proc_t *p, int infd, off_t *inoffp, int outfd, off_t *outoffp,
+              size_t count, size_t *donep);
+
+#else /* !_KERNEL */
+
+__BEGIN_DECLS
+ssize_t sendfile(int, int, off_t *, size_t);
+ssize_t splice(int, off_t *, int, off_t *, size_t, unsigned);
+__END_DECLS
+
+#endif /* !_KERNEL */
+
+#endif /* !_SYS_SENDFILE_H_ */
@@ -57,6 +57,26 @@ typedef struct sigaction {
 #define SA_NOCLDWAIT 0x0020 /* do not generate zombies on unwaited child */
 #define SA_SIGINFO 0x0040   /* take sa_sigaction handler */
 
+/* Value passed along with an asynchronous event notification. */
+union sigval {
+  int sival_int;
+  void *sival_ptr;
+};
+
+/* Asynchronous event notification, e.g. completion of an I/O request. */
+struct sigevent {
+  int sigev_notify;         /* notification type */
+  int sigev_signo;          /* signal number or kqueue descriptor */
+  union sigval sigev_value; /* value passed along with notification */
+};
+
+#define sigev_notify_kqueue sigev_signo
+
+/* Values for sigev_notify: */
+#define SIGEV_NONE 0   /* no notification */
+#define SIGEV_SIGNAL 1 /* send `sigev_signo` signal to the process */
+#define SIGEV_KEVENT 3 /* post an event to `sigev_notify_kqueue` */
+
 /* Flags for sigprocmask(): */
 #define SIG_BLOCK 1   /* block specified signal set */
 #define SIG_UNBLOCK 2 /* unblock specified signal set */
@@ -144,6 +164,21 @@ void sig_child(proc_t *p, int code);
  */
 void sig_kill(proc_t *p, ksiginfo_t *ksi);
 
+/*! \brief Signal a thread.
+ *
+ * Same as \a sig_kill, but the signal is directed to thread \a td rather than
+ * to any thread of the process that does not block it.
+ *
+ * \note Must be called with td::td_proc::p_lock held.
+ */
+void sig_kill_thread(thread_t *td, ksiginfo_t *ksi);
+
+/*! \brief Redirect signals pending on exiting thread \a td to process \a p.
+ *
+ * \note Must be called with p::p_lock held, after \a td left the process.
+ */
+void sig_forward(proc_t *p, thread_t *td);
+
 /*! \brief Signal all processes in a process group.
  *
  * \note Must be called with pg::pg_lock held. Returns with pg::pg_lock held.
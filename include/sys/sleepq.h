@@ -33,17 +33,22 @@ void sleepq_wait(void *wchan, const void *waitpt, mtx_t *mtx);
 #define sleepq_wait_intr(wchan, waitpt, mtx)                                   \
   sleepq_wait_timed((wchan), (waitpt), (mtx), 0)
 
-/*! \brief Performs interruptible sleep with timeout.
+/*! \brief Performs sleep with timeout.
  *
- * Timed sleep is also interruptible. The only guarantee about timeout is that
- * the thread's sleep will not timeout before the given time passes. It may
- * happen any time after that point.
+ * Timed sleep is not interruptible, while sleep without timeout is. The only
+ * guarantee about timeout is that the thread's sleep will not timeout before
+ * the given time passes. It may happen any time after that point.
  *
  * \param timeout in system ticks, if 0 waits indefinitely
  * \returns how the thread was actually woken up */
 int sleepq_wait_timed(void *wchan, const void *waitpt, mtx_t *mtx,
                       systime_t timeout);
 
+/*! \brief Same as \a sleepq_wait_timed but the sleep can be interrupted
+ * even if timeout is given. */
+int sleepq_wait_timed_intr(void *wchan, const void *waitpt, mtx_t *mtx,
+                           systime_t timeout);
+
 /*! \brief Wakes up highest priority thread waiting on \a wchan.
  *
  * \param wchan unique sleep queue identifier
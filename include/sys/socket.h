@@ -64,14 +64,28 @@
 #define _SYS_SOCKET_H_
 
 #include <sys/cdefs.h>
+#include <sys/types.h>
+
+typedef uint8_t sa_family_t;
+typedef unsigned int socklen_t;
+
+struct iovec;
 
 /*
  * Socket types.
  */
-#define SOCK_STREAM 1 /* stream socket */
-#define SOCK_DGRAM 2  /* datagram socket */
+#define SOCK_STREAM 1    /* stream socket */
+#define SOCK_DGRAM 2     /* datagram socket */
+#define SOCK_SEQPACKET 5 /* sequenced packet stream */
+
+#define SOCK_CLOEXEC 0x10000000  /* set close on exec on socket */
+#define SOCK_NONBLOCK 0x20000000 /* set non blocking i/o socket */
+#define SOCK_FLAGS_MASK (SOCK_CLOEXEC | SOCK_NONBLOCK)
 
-#define SOCK_CLOEXEC 0x10000000 /* set close on exec on socket */
+/*
+ * Level number for (get/set)sockopt() to apply to socket itself.
+ */
+#define SOL_SOCKET 0xffff /* options for socket level */
 
 /*
  * Address families.
@@ -80,14 +94,146 @@
 #define AF_LOCAL 1       /* local to host */
 #define AF_UNIX AF_LOCAL /* backward compatibility */
 
+/*
+ * Structure used by kernel to store most addresses.
+ */
+struct sockaddr {
+  uint8_t sa_len;        /* total length */
+  sa_family_t sa_family; /* address family */
+  char sa_data[14];      /* actually longer; address value */
+};
+
+/*
+ * Protocol families, same as address families for now.
+ */
+#define PF_UNSPEC AF_UNSPEC
+#define PF_LOCAL AF_LOCAL
+#define PF_UNIX PF_LOCAL /* backward compatibility */
+
+/*
+ * Maximum queue length specifiable by listen(2).
+ */
+#define SOMAXCONN 128
+
+/*
+ * Message header for recvmsg and sendmsg calls.
+ * Used value-result for recvmsg, value only for sendmsg.
+ */
+struct msghdr {
+  void *msg_name;           /* optional address */
+  socklen_t msg_namelen;    /* size of address */
+  struct iovec *msg_iov;    /* scatter/gather array */
+  int msg_iovlen;           /* # elements in msg_iov */
+  void *msg_control;        /* ancillary data, see below */
+  socklen_t msg_controllen; /* ancillary data buffer len */
+  int msg_flags;            /* flags on received message */
+};
+
+#define MSG_EOR 0x0008      /* data completes record */
+#define MSG_TRUNC 0x0010    /* data discarded before delivery */
+#define MSG_CTRUNC 0x0020   /* control data lost before delivery */
+#define MSG_DONTWAIT 0x0080 /* this message should be nonblocking */
+#define MSG_NOSIGNAL 0x0400 /* do not generate SIGPIPE on EOF */
+
+/*
+ * Header for ancillary data objects in msg_control buffer.
+ * Used for additional information with/about a datagram
+ * not expressible by flags.  The format is a sequence
+ * of message elements headed by cmsghdr structures.
+ */
+struct cmsghdr {
+  socklen_t cmsg_len; /* data byte count, including hdr */
+  int cmsg_level;     /* originating protocol */
+  int cmsg_type;      /* protocol-specific type */
+  /* followed by u_char cmsg_data[]; */
+};
+
+/*
+ * Alignment requirement for CMSG struct manipulation.
+ * This basically behaves the same as ALIGN() ARCH/include/param.h.
+ */
+#define __CMSG_ALIGN(n) (((n) + sizeof(long) - 1) & ~(sizeof(long) - 1))
+
+/* given pointer to struct cmsghdr, return pointer to data */
+#define CMSG_DATA(cmsg)                                                        \
+  ((u_char *)(void *)(cmsg) + __CMSG_ALIGN(sizeof(struct cmsghdr)))
+
+/* given pointer to struct cmsghdr, return pointer to next cmsghdr */
+#define CMSG_NXTHDR(mhdr, cmsg)                                                \
+  (((char *)(cmsg) + __CMSG_ALIGN((cmsg)->cmsg_len) +                          \
+      __CMSG_ALIGN(sizeof(struct cmsghdr)) >                                   \
+    (((char *)(mhdr)->msg_control) + (mhdr)->msg_controllen))                  \
+     ? (struct cmsghdr *)0                                                     \
+     : (struct cmsghdr *)(void *)((char *)(cmsg) +                             \
+                                  __CMSG_ALIGN((cmsg)->cmsg_len)))
+
+/*
+ * RFC 2292 requires to check msg_controllen, in case that the kernel returns
+ * an empty list for some reasons.
+ */
+#define CMSG_FIRSTHDR(mhdr)                                                    \
+  ((mhdr)->msg_controllen >= sizeof(struct cmsghdr)                            \
+     ? (struct cmsghdr *)(mhdr)->msg_control                                   \
+     : (struct cmsghdr *)0)
+
+#define CMSG_SPACE(l) (__CMSG_ALIGN(sizeof(struct cmsghdr)) + __CMSG_ALIGN(l))
+#define CMSG_LEN(l) (__CMSG_ALIGN(sizeof(struct cmsghdr)) + (l))
+
+/* "Socket"-level control message types: */
+#define SCM_RIGHTS 0x01 /* access rights (array of int) */
+
+/*
+ * Types of socket shutdown(2).
+ */
+#define SHUT_RD 0   /* Disallow further receives. */
+#define SHUT_WR 1   /* Disallow further sends. */
+#define SHUT_RDWR 2 /* Disallow further sends/receives. */
+
 #ifndef _KERNEL
 
 __BEGIN_DECLS
 
+int accept(int, struct sockaddr *__restrict, socklen_t *__restrict);
+int bind(int, const struct sockaddr *, socklen_t);
+int connect(int, const struct sockaddr *, socklen_t);
+int listen(int, int);
+ssize_t recv(int, void *, size_t, int);
+ssize_t recvfrom(int, void *__restrict, size_t, int,
+                 struct sockaddr *__restrict, socklen_t *__restrict);
+ssize_t recvmsg(int, struct msghdr *, int);
+ssize_t send(int, const void *, size_t, int);
+ssize_t sendto(int, const void *, size_t, int, const struct sockaddr *,
+               socklen_t);
+ssize_t sendmsg(int, const struct msghdr *, int);
+int shutdown(int, int);
+int socket(int, int, int);
 int socketpair(int, int, int, int *);
 
 __END_DECLS
 
+#else /* !_KERNEL */
+
+typedef struct proc proc_t;
+typedef struct uio uio_t;
+
+#define SCM_MAXFDS 64      /* max. descriptors passed in a single message */
+#define MAXCONTROLLEN 1024 /* max. length of ancillary data */
+
+/* Procedures called by system calls implementation. Socket addresses and
+ * ancillary data passed to these functions reside in kernel memory. */
+int do_socket(proc_t *p, int domain, int type, int protocol, int *fdp);
+int do_socketpair(proc_t *p, int domain, int type, int protocol, int *sv);
+int do_bind(proc_t *p, int s, struct sockaddr *sa, socklen_t len);
+int do_listen(proc_t *p, int s, int backlog);
+int do_accept(proc_t *p, int s, struct sockaddr *sa, socklen_t *lenp,
+              int *fdp);
+int do_connect(proc_t *p, int s, struct sockaddr *sa, socklen_t len);
+int do_sendmsg(proc_t *p, int s, struct msghdr *msg, uio_t *uio, int flags);
+int do_recvmsg(proc_t *p, int s, struct msghdr *msg, uio_t *uio, int flags);
+/* Closes descriptors installed by `do_recvmsg` if they can't be passed on. */
+void sock_close_rights(proc_t *p, struct msghdr *msg);
+int do_shutdown(proc_t *p, int s, int how);
+
 #endif /* _KERNEL */
 
 #endif /* !_SYS_SOCKET_H_ */
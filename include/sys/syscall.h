@@ -94,6 +94,37 @@
 #define SYS_sigtimedwait 86
 #define SYS_clock_settime 87
 #define SYS_pathconf 88
-#define SYS_MAXSYSCALL 89
+#define SYS_thr_new 89
+#define SYS_thr_exit 90
+#define SYS_thr_self 91
+#define SYS_thr_kill 92
+#define SYS_futex 93
+#define SYS_pread 94
+#define SYS_pwrite 95
+#define SYS_preadv 96
+#define SYS_pwritev 97
+#define SYS_sendfile 98
+#define SYS_splice 99
+#define SYS_aio_read 100
+#define SYS_aio_write 101
+#define SYS_aio_error 102
+#define SYS_aio_return 103
+#define SYS_aio_suspend 104
+#define SYS_lio_listio 105
+#define SYS_pollts 106
+#define SYS_pselect 107
+#define SYS_socket 108
+#define SYS_socketpair 109
+#define SYS_bind 110
+#define SYS_listen 111
+#define SYS_accept 112
+#define SYS_connect 113
+#define SYS_sendmsg 114
+#define SYS_recvmsg 115
+#define SYS_shutdown 116
+#define SYS_shm_open 117
+#define SYS_shm_unlink 118
+#define SYS_eventfd 119
+#define SYS_MAXSYSCALL 120
 
 #define SYS_MAXSYSARGS 6
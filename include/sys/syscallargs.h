@@ -81,6 +81,7 @@ typedef struct {
 typedef struct {
   SYSCALLARG(const char *) type;
   SYSCALLARG(const char *) path;
+  SYSCALLARG(const char *) from;
 } mount_args_t;
 
 typedef struct {
@@ -452,3 +453,181 @@ typedef struct {
   SYSCALLARG(const char *) path;
   SYSCALLARG(int) name;
 } pathconf_args_t;
+
+typedef struct {
+  SYSCALLARG(struct thr_param *) param;
+  SYSCALLARG(size_t) param_size;
+} thr_new_args_t;
+
+typedef struct {
+  SYSCALLARG(int *) state;
+} thr_exit_args_t;
+
+typedef struct {
+  SYSCALLARG(tid_t) tid;
+  SYSCALLARG(int) sig;
+} thr_kill_args_t;
+
+typedef struct {
+  SYSCALLARG(int *) uaddr;
+  SYSCALLARG(int) op;
+  SYSCALLARG(int) val;
+  SYSCALLARG(const struct timespec *) timeout;
+} futex_args_t;
+
+typedef struct {
+  SYSCALLARG(int) fd;
+  SYSCALLARG(void *) buf;
+  SYSCALLARG(size_t) nbyte;
+  SYSCALLARG(off_t) offset;
+} pread_args_t;
+
+typedef struct {
+  SYSCALLARG(int) fd;
+  SYSCALLARG(const void *) buf;
+  SYSCALLARG(size_t) nbyte;
+  SYSCALLARG(off_t) offset;
+} pwrite_args_t;
+
+typedef struct {
+  SYSCALLARG(int) fd;
+  SYSCALLARG(const struct iovec *) iov;
+  SYSCALLARG(int) iovcnt;
+  SYSCALLARG(off_t) offset;
+} preadv_args_t;
+
+typedef struct {
+  SYSCALLARG(int) fd;
+  SYSCALLARG(const struct iovec *) iov;
+  SYSCALLARG(int) iovcnt;
+  SYSCALLARG(off_t) offset;
+} pwritev_args_t;
+
+typedef struct {
+  SYSCALLARG(int) outfd;
+  SYSCALLARG(int) infd;
+  SYSCALLARG(off_t *) offset;
+  SYSCALLARG(size_t) count;
+} sendfile_args_t;
+
+typedef struct {
+  SYSCALLARG(int) infd;
+  SYSCALLARG(off_t *) inoff;
+  SYSCALLARG(int) outfd;
+  SYSCALLARG(off_t *) outoff;
+  SYSCALLARG(size_t) count;
+  SYSCALLARG(unsigned) flags;
+} splice_args_t;
+
+typedef struct {
+  SYSCALLARG(struct aiocb *) aiocbp;
+} aio_read_args_t;
+
+typedef struct {
+  SYSCALLARG(struct aiocb *) aiocbp;
+} aio_write_args_t;
+
+typedef struct {
+  SYSCALLARG(const struct aiocb *) aiocbp;
+} aio_error_args_t;
+
+typedef struct {
+  SYSCALLARG(struct aiocb *) aiocbp;
+} aio_return_args_t;
+
+typedef struct {
+  SYSCALLARG(const struct aiocb *const *) list;
+  SYSCALLARG(int) nent;
+  SYSCALLARG(const struct timespec *) timeout;
+} aio_suspend_args_t;
+
+typedef struct {
+  SYSCALLARG(int) mode;
+  SYSCALLARG(struct aiocb *const *) list;
+  SYSCALLARG(int) nent;
+  SYSCALLARG(struct sigevent *) sig;
+} lio_listio_args_t;
+
+typedef struct {
+  SYSCALLARG(struct pollfd *) fds;
+  SYSCALLARG(u_int) nfds;
+  SYSCALLARG(const struct timespec *) ts;
+  SYSCALLARG(const sigset_t *) mask;
+} pollts_args_t;
+
+typedef struct {
+  SYSCALLARG(int) nd;
+  SYSCALLARG(struct fd_set *) in;
+  SYSCALLARG(struct fd_set *) ou;
+  SYSCALLARG(struct fd_set *) ex;
+  SYSCALLARG(const struct timespec *) ts;
+  SYSCALLARG(const sigset_t *) mask;
+} pselect_args_t;
+
+typedef struct {
+  SYSCALLARG(int) domain;
+  SYSCALLARG(int) type;
+  SYSCALLARG(int) protocol;
+} socket_args_t;
+
+typedef struct {
+  SYSCALLARG(int) domain;
+  SYSCALLARG(int) type;
+  SYSCALLARG(int) protocol;
+  SYSCALLARG(int *) rsv;
+} socketpair_args_t;
+
+typedef struct {
+  SYSCALLARG(int) s;
+  SYSCALLARG(const struct sockaddr *) name;
+  SYSCALLARG(u_int) namelen;
+} bind_args_t;
+
+typedef struct {
+  SYSCALLARG(int) s;
+  SYSCALLARG(int) backlog;
+} listen_args_t;
+
+typedef struct {
+  SYSCALLARG(int) s;
+  SYSCALLARG(struct sockaddr *) name;
+  SYSCALLARG(u_int *) anamelen;
+} accept_args_t;
+
+typedef struct {
+  SYSCALLARG(int) s;
+  SYSCALLARG(const struct sockaddr *) name;
+  SYSCALLARG(u_int) namelen;
+} connect_args_t;
+
+typedef struct {
+  SYSCALLARG(int) s;
+  SYSCALLARG(const struct msghdr *) msg;
+  SYSCALLARG(int) flags;
+} sendmsg_args_t;
+
+typedef struct {
+  SYSCALLARG(int) s;
+  SYSCALLARG(struct msghdr *) msg;
+  SYSCALLARG(int) flags;
+} recvmsg_args_t;
+
+typedef struct {
+  SYSCALLARG(int) s;
+  SYSCALLARG(int) how;
+} shutdown_args_t;
+
+typedef struct {
+  SYSCALLARG(const char *) name;
+  SYSCALLARG(int) flags;
+  SYSCALLARG(mode_t) mode;
+} shm_open_args_t;
+
+typedef struct {
+  SYSCALLARG(const char *) name;
+} shm_unlink_args_t;
+
+typedef struct {
+  SYSCALLARG(u_int) initval;
+  SYSCALLARG(int) flags;
+} eventfd_args_t;
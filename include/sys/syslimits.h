@@ -56,6 +56,9 @@
 #define IOV_MAX 1024  /* max elements in i/o vector */
 #define PARGS_MAX 100 /* max length of stored process arguments */
 
+#define AIO_LISTIO_MAX 16 /* max requests in a single lio_listio call */
+#define AIO_MAX 64        /* max outstanding async requests per process */
+
 #define BC_BASE_MAX 99     /* max ibase/obase values in bc(1) */
 #define BC_DIM_MAX 2048    /* max array elements in bc(1) */
 #define BC_SCALE_MAX 99    /* max scale value in bc(1) */
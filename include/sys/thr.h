@@ -0,0 +1,40 @@
+#ifndef _SYS_THR_H_
+#define _SYS_THR_H_
+
+#include <sys/types.h>
+
+/*
+ * Low-level interface for creating threads within a process. The interface is
+ * modeled after FreeBSD's thr_new(2). It's not meant to be used directly by
+ * user programs, please use pthread(3) instead.
+ */
+
+struct thr_param {
+  void (*start_func)(void *); /* thread entry function */
+  void *arg;                  /* argument for entry function */
+  char *stack_base;           /* stack base address */
+  size_t stack_size;          /* stack size */
+  tid_t *child_tid;           /* address to store new thread identifier */
+  tid_t *parent_tid;          /* parent's address to store new thread id */
+};
+
+#ifdef _KERNEL
+
+typedef struct proc proc_t;
+
+int do_thr_new(proc_t *p, struct thr_param *param, tid_t *tidp);
+__noreturn void do_thr_exit(proc_t *p, int *state);
+int do_thr_kill(proc_t *p, tid_t tid, int sig);
+
+#else /* !_KERNEL */
+
+__BEGIN_DECLS
+int thr_new(struct thr_param *, size_t);
+tid_t thr_self(void);
+__noreturn void thr_exit(int *);
+int thr_kill(tid_t, int);
+__END_DECLS
+
+#endif /* !_KERNEL */
+
+#endif /* !_SYS_THR_H_ */
@@ -13,6 +13,7 @@
 #include <sys/sigtypes.h>
 #include <sys/kstack.h>
 #include <sys/lockdep.h>
+#include <sys/schedstat.h>
 
 /*! \file thread.h */
 
@@ -27,6 +28,9 @@ typedef void (*entry_fn_t)(void *);
 
 #define TD_NAME_MAX 32
 
+/* Default limit of thread shells kept in the cache for reuse. */
+#define THREAD_CACHE_MAX 32
+
 /*! \brief Possible thread states.
  *
  * Possible state transitions look as follows:
@@ -64,6 +68,7 @@ typedef enum {
   TDF_NEEDSIGCHK = 0x0004, /* signals were posted for delivery */
   TDF_STOPPING = 0x0008,   /* thread is about to stop */
   TDF_BORROWING = 0x0010,  /* priority propagation */
+  TDF_EXITING = 0x0020,    /* must exit before returning to user space */
   /* TDF_SLP* flags are used internally by sleep queue */
   TDF_SLPINTR = 0x0040,  /* sleep is interruptible */
   TDF_SLPTIMED = 0x0080, /* sleep with timeout */
@@ -106,10 +111,12 @@ typedef struct thread {
   TAILQ_ENTRY(thread) td_sleepq;   /* ($) link on sleep queue */
   TAILQ_ENTRY(thread) td_blockedq; /* (#) link on turnstile blocked queue */
   TAILQ_ENTRY(thread) td_zombieq;  /* (a) link on zombie queue */
+  TAILQ_ENTRY(thread) td_procq;    /* (p) link on process threads list */
   /* Properties */
-  proc_t *td_proc; /*!< (t) parent process (NULL for kernel threads) */
-  char *td_name;   /*!< (@) name of thread */
-  tid_t td_tid;    /*!< (@) thread identifier */
+  proc_t *td_proc;     /*!< (t) parent process (NULL for kernel threads) */
+  vm_map_t *td_uspace; /*!< (*) user space borrowed by kernel thread */
+  char *td_name;       /*!< (@) name of thread */
+  tid_t td_tid;        /*!< (@) thread identifier */
   /* thread state */
   thread_state_t td_state;        /*!< (t) thread state */
   volatile td_flags_t td_flags;   /*!< (t) TDF_* flags */
@@ -135,11 +142,16 @@ typedef struct thread {
   prio_t td_prio;      /*!< ($) active priority */
   int td_slice;        /*!< ($) time slice length in system ticks */
   /* thread statistics */
-  bintime_t td_rtime;        /*!< (*) time spent running */
-  bintime_t td_last_rtime;   /*!< (*) time of last switch to running state */
-  bintime_t td_slptime;      /*!< (*) time spent sleeping */
-  bintime_t td_last_slptime; /*!< (*) time of last switch to sleep state */
-  unsigned td_nctxsw;        /*!< (*) total number of context switches */
+  bintime_t td_rtime;          /*!< (*) time spent running */
+  bintime_t td_last_rtime;     /*!< (*) time of last switch to running state */
+  bintime_t td_slptime;        /*!< (*) time spent sleeping */
+  bintime_t td_last_slptime;   /*!< (*) time of last switch to sleep state */
+  unsigned td_nctxsw;          /*!< (*) total number of context switches */
+  unsigned td_npreempt;        /*!< ($) number of involuntary switches */
+  bintime_t td_last_readytime; /*!< ($) time of last switch to ready state */
+  uint64_t td_maxlatency;      /*!< ($) longest wakeup-to-run latency [us] */
+  schedstat_hist_t td_latency; /*!< ($) histogram of wakeup-to-run latency */
+  schedstat_hist_t td_runtime; /*!< ($) histogram of slice usage */
   /* signal handling */
   sigpend_t td_sigpend;   /*!< (p) Pending signals for this thread. */
   sigset_t td_sigmask;    /*!< (p) Signal mask */
@@ -152,6 +164,17 @@ typedef struct thread {
 #endif
 } thread_t;
 
+typedef TAILQ_HEAD(, thread) thread_list_t;
+
+extern mtx_t threads_lock;
+extern thread_list_t all_threads; /* (a) all threads in the system */
+
+/* Tunables of the thread cache, which can be overridden with
+ * `thread-cache-max` and `thread-cache-zero` kernel environment variables. */
+extern unsigned thread_cache_max; /* max. number of cached thread shells */
+extern bool thread_cache_zero;    /* zero kernel stack of a reused shell */
+extern unsigned thread_cache_hits; /* number of shells taken from the cache */
+
 thread_t *thread_self(void) __no_profile;
 
 /*! \brief Initialize first thread in the system. */
@@ -66,6 +66,11 @@ static __no_profile inline void bt2tv(const bintime_t *bt, timeval_t *tv) {
   tv->tv_usec = (1000000ULL * (uint32_t)(bt->frac >> 32)) >> 32;
 }
 
+static __no_profile inline uint64_t bt2us(const bintime_t *bt) {
+  return bt->sec * 1000000ULL +
+         ((1000000ULL * (uint32_t)(bt->frac >> 32)) >> 32);
+}
+
 /* Operations on timevals. */
 #define timerclear(tvp) (tvp)->tv_sec = (tvp)->tv_usec = 0L
 #define timerisset(tvp) ((tvp)->tv_sec || (tvp)->tv_usec)
@@ -6,6 +6,8 @@
 #define SEEK_SET 0
 #define SEEK_CUR 1
 #define SEEK_END 2
+#define SEEK_DATA 3 /* set file offset to next data past offset */
+#define SEEK_HOLE 4 /* set file offset to next hole past offset */
 
 #define F_OK 0 /* test for existence of file */
 #define X_OK 1 /* test for execute or search permission */
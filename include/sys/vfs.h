@@ -83,6 +83,7 @@ int do_openat(proc_t *p, int fdat, char *pathname, int flags, mode_t mode,
 int do_unlinkat(proc_t *p, int fd, char *path, int flag);
 int do_mkdirat(proc_t *p, int fd, char *path, mode_t mode);
 int do_ftruncate(proc_t *p, int fd, off_t length);
+int do_fsync(proc_t *p, int fd);
 int do_faccessat(proc_t *p, int fd, char *path, int mode, int flags);
 int do_chown(proc_t *p, char *path, int uid, int gid);
 int do_utimes(proc_t *p, char *path, timeval_t *tptr);
@@ -106,7 +107,8 @@ int do_utimensat(proc_t *p, int fd, char *path, timespec_t *times, int flag);
 int do_pathconf(proc_t *p, char *path, int name, register_t *res);
 
 /* Mount a new instance of the filesystem named fs at the requested path. */
-int do_mount(proc_t *p, const char *fs, const char *path);
+int do_mount(proc_t *p, const char *fs, const char *path, const char *from);
+int do_mountroot(proc_t *p, const char *fs, const char *from);
 int do_getdents(proc_t *p, int fd, uio_t *uio);
 int do_statvfs(proc_t *p, char *path, statvfs_t *buf);
 int do_fstatvfs(proc_t *p, int fd, statvfs_t *buf);
@@ -123,6 +125,10 @@ int vfs_nameresolve(vnrstate_t *vs);
  * Increases use count on returned vnode. */
 int vfs_namelookup(const char *path, vnode_t **vp, cred_t *cred);
 
+/* Creates socket node at given path for bind(2).
+ * Increases use count on returned vnode. */
+int vfs_mksock(proc_t *p, const char *path, mode_t mode, vnode_t **vp);
+
 /* Uncovers mountpoint if node is mounted.
  * Given vnode should be locked. The returned vnode is also locked. */
 void vfs_maybe_ascend(vnode_t **vp);
@@ -58,7 +58,8 @@ struct vm_page {
   uint32_t size;                  /* (P) size of page in PAGESIZE units */
 };
 
-int do_mmap(vaddr_t *addr_p, size_t length, int u_prot, int u_flags);
+int do_mmap(vaddr_t *addr_p, size_t length, int u_prot, int u_flags, int fd,
+            off_t pos);
 int do_munmap(vaddr_t addr, size_t length);
 int do_mprotect(vaddr_t start, size_t length, int u_prot);
 
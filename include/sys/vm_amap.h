@@ -34,6 +34,13 @@ struct vm_aref {
  */
 vm_amap_t *vm_amap_alloc(size_t slots);
 
+/** Make room for at least `slots` anons in amap.
+ *
+ * Existing anons keep their positions, so all the entries that share the amap
+ * remain valid.
+ */
+void vm_amap_extend(vm_amap_t *amap, size_t slots);
+
 /** Copy amap when it is needed.
  *
  * Amap is actually copied if referenced by more then one vm_map_entries.
@@ -84,8 +91,14 @@ vm_anon_t *vm_anon_copy(vm_anon_t *src);
  */
 vm_anon_t *vm_amap_find_anon(vm_aref_t aref, size_t offset);
 
-/** Insert anon into amap */
-void vm_amap_insert_anon(vm_aref_t aref, vm_anon_t *anon, size_t offset);
+/** Insert anon into amap.
+ *
+ * If the slot is already occupied by another anon, then `anon` is dropped.
+ *
+ * @returns The anon that resides in the slot.
+ */
+vm_anon_t *vm_amap_insert_anon(vm_aref_t aref, vm_anon_t *anon,
+                               size_t offset);
 
 /** Bump the ref counter to record that anon is used by one more amap. */
 void vm_anon_hold(vm_anon_t *anon);
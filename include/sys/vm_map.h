@@ -38,6 +38,9 @@ DEFINE_CLEANUP_FUNCTION(vm_map_t *, vm_map_unlock);
 void vm_map_activate(vm_map_t *map);
 void vm_map_switch(thread_t *td);
 
+/* Makes kernel thread operate on user space `map`, or release it if NULL. */
+void vm_map_borrow(vm_map_t *map);
+
 vm_map_t *vm_map_user(void);
 
 vm_map_t *vm_map_new(void);
@@ -73,6 +76,14 @@ int vm_map_alloc_entry(vm_map_t *map, vaddr_t addr, size_t length,
                        vm_prot_t prot, vm_flags_t flags,
                        vm_map_entry_t **ent_p);
 
+/*! \brief Allocates entry that maps pages of an existing amap.
+ *
+ * The entry takes over the reference to \a aref amap, even on failure.
+ * With VM_PRIVATE in \a flags the pages are copied on write. */
+int vm_map_alloc_entry_amap(vm_map_t *map, vaddr_t addr, size_t length,
+                            vm_prot_t prot, vm_flags_t flags, vm_aref_t aref,
+                            vm_map_entry_t **ent_p);
+
 /* Tries to resize an entry, by moving its end if there
    are no other mappings in the way. On success, returns 0. */
 int vm_map_entry_resize(vm_map_t *map, vm_map_entry_t *ent, vaddr_t new_end);
@@ -83,4 +94,11 @@ vm_map_t *vm_map_clone(vm_map_t *map);
 
 int vm_page_fault(vm_map_t *map, vaddr_t fault_addr, vm_prot_t fault_type);
 
+/* Lends the page at `va` to the caller by taking a reference to its anon, so
+ * that the page contents can be accessed without accessing `map`. The page is
+ * faulted in if necessary. If `access` includes VM_PROT_WRITE, the page is not
+ * shared with copy-on-write mappings. Release it with vm_anon_drop(). */
+int vm_map_loan(vm_map_t *map, vaddr_t va, vm_prot_t access,
+                vm_anon_t **anonp);
+
 #endif /* !_SYS_VM_MAP_H_ */
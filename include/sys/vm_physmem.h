@@ -29,4 +29,7 @@ vm_page_t *vm_page_find(paddr_t pa);
 /* Returns vm_page to physical memory manager. */
 void vm_page_free(vm_page_t *page);
 
+/* Returns number of free pages. */
+size_t vm_physmem_nfree(void);
+
 #endif /* !_SYS_VM_PHYSMEM_H_ */
@@ -19,6 +19,8 @@ typedef struct dirent dirent_t;
 typedef struct stat stat_t;
 typedef struct componentname componentname_t;
 typedef struct cred cred_t;
+typedef struct knote knote_t;
+typedef struct socket socket_t;
 
 /* Indicates that given field of vattr structure does not hold a value.
  * vnodeops should not modify attributes set to VNOVAL. */
@@ -33,7 +35,7 @@ typedef enum {
  * VADMIN - owner of file (root has VADMIN to all files) */
 typedef enum { VEXEC = 1, VWRITE = 2, VREAD = 4, VADMIN = 8 } accmode_t;
 
-typedef enum { V_NONE, V_REG, V_DIR, V_DEV, V_LNK } vnodetype_t;
+typedef enum { V_NONE, V_REG, V_DIR, V_DEV, V_LNK, V_SOCK } vnodetype_t;
 
 typedef int vnode_lookup_t(vnode_t *dv, componentname_t *cn, vnode_t **vp);
 typedef int vnode_readdir_t(vnode_t *dv, uio_t *uio);
@@ -46,6 +48,8 @@ typedef int vnode_getattr_t(vnode_t *v, vattr_t *va);
 typedef int vnode_setattr_t(vnode_t *v, vattr_t *va, cred_t *cred);
 typedef int vnode_create_t(vnode_t *dv, componentname_t *cn, vattr_t *va,
                            vnode_t **vp);
+typedef int vnode_mknod_t(vnode_t *dv, componentname_t *cn, vattr_t *va,
+                          vnode_t **vp);
 typedef int vnode_remove_t(vnode_t *dv, vnode_t *v, componentname_t *cn);
 typedef int vnode_mkdir_t(vnode_t *dv, componentname_t *cn, vattr_t *va,
                           vnode_t **vp);
@@ -70,6 +74,7 @@ typedef struct vnodeops {
   vnode_getattr_t *v_getattr;
   vnode_setattr_t *v_setattr;
   vnode_create_t *v_create;
+  vnode_mknod_t *v_mknod;
   vnode_remove_t *v_remove;
   vnode_mkdir_t *v_mkdir;
   vnode_rmdir_t *v_rmdir;
@@ -86,15 +91,29 @@ typedef struct vnodeops {
 void vnodeops_init(vnodeops_t *vops);
 
 typedef struct {
-  bool vl_locked;
+  bool vl_locked;     /* held exclusively */
+  unsigned vl_shared; /* number of shared holders */
+  unsigned vl_xwait;  /* number of threads waiting for exclusive access */
   condvar_t vl_cv;
   mtx_t vl_interlock;
 } vnlock_t;
 
+/* Flags for vnode:v_vflags, all protected by vnode cache lock. */
+typedef enum {
+  VV_CACHED = 1,  /* vnode is entered into vnode cache */
+  VV_LOADING = 2, /* vnode is being filled in by the filesystem */
+  VV_FREE = 4,    /* vnode is unused and sits on the free list */
+} vv_flags_t;
+
 typedef struct vnode {
   vnodetype_t v_type;        /* Vnode type, see above */
   TAILQ_ENTRY(vnode) v_list; /* Entry on the mount vnodes list */
 
+  uint32_t v_ino;                /* Inode number (if cached) */
+  vv_flags_t v_vflags;           /* Vnode cache flags */
+  LIST_ENTRY(vnode) v_hashlink;  /* Entry on vnode cache hash chain */
+  TAILQ_ENTRY(vnode) v_freelist; /* Entry on free vnodes list */
+
   vnodeops_t *v_ops; /* Vnode operations */
   void *v_data;      /* Filesystem-specific arbitrary data */
 
@@ -102,15 +121,19 @@ typedef struct vnode {
 
   /* Type-specific fields */
   union {
-    mount_t *v_mountedhere; /* The mount covering this vnode */
+    mount_t *v_mountedhere; /* The mount covering this vnode (V_DIR) */
+    socket_t *v_socket;     /* The socket bound to this vnode (V_SOCK) */
   };
 
   refcnt_t v_usecnt;
   vnlock_t v_lock;
+
+  LIST_HEAD(, namecache) v_ncsrc; /* Name cache entries for this directory */
+  LIST_HEAD(, namecache) v_ncdst; /* Name cache entries pointing to us */
 } vnode_t;
 
 static inline bool is_mountpoint(vnode_t *v) {
-  return v->v_mountedhere != NULL;
+  return v->v_type == V_DIR && v->v_mountedhere != NULL;
 }
 
 typedef struct vattr {
@@ -129,6 +152,53 @@ typedef struct vattr {
 void vattr_null(vattr_t *va);
 void vattr_convert(vattr_t *va, stat_t *sb);
 
+/* Name lookup cache statistics. */
+typedef struct namecache_stats {
+  unsigned ncs_hits;    /* positive hits */
+  unsigned ncs_neghits; /* negative hits */
+  unsigned ncs_misses;  /* name not found in the cache */
+  unsigned ncs_long;    /* name too long to be cached */
+  unsigned ncs_enters;  /* number of entries added */
+  unsigned ncs_evicts;  /* number of LRU entries thrown away */
+} namecache_stats_t;
+
+extern namecache_stats_t namecache_stats;
+
+/*! \brief Look up name \a cn in directory \a dv in the name cache.
+ *
+ * \returns true if the name was found, in which case *vp is set to the vnode
+ * with usecnt incremented, or NULL if the name is known not to exist. */
+bool namecache_lookup(vnode_t *dv, componentname_t *cn, vnode_t **vp);
+
+/*! \brief Record result of VOP_LOOKUP in the name cache.
+ *
+ * \a v is NULL if the name does not exist in \a dv (negative entry). */
+void namecache_enter(vnode_t *dv, componentname_t *cn, vnode_t *v);
+
+/*! \brief Remove entry for name \a cn in directory \a dv. */
+void namecache_remove(vnode_t *dv, componentname_t *cn);
+
+/*! \brief Remove all entries that refer to \a v either as directory or
+ * as a result of lookup. */
+void namecache_purge(vnode_t *v);
+
+/* Vnode cache statistics. */
+typedef struct vnode_stats {
+  unsigned vs_vnodes;   /* number of allocated vnodes */
+  unsigned vs_free;     /* number of unused vnodes on the free list */
+  unsigned vs_hits;     /* vnode found in the cache */
+  unsigned vs_reused;   /* hits that took a vnode off the free list */
+  unsigned vs_misses;   /* vnode had to be loaded by the filesystem */
+  unsigned vs_recycled; /* unused vnodes reclaimed to make room */
+} vnode_stats_t;
+
+extern vnode_stats_t vnode_stats;
+
+/* Maximum number of vnodes kept in memory. Once the limit is exceeded, least
+ * recently used vnodes from the free list get reclaimed. Can be set with
+ * `maxvnodes` kernel environment variable. */
+extern unsigned maxvnodes;
+
 #define VOP_CALL(op, v, ...)                                                   \
   ((v)->v_ops->v_##op) ? ((v)->v_ops->v_##op(v, ##__VA_ARGS__)) : ENOTSUP
 
@@ -169,22 +239,46 @@ static inline int VOP_SETATTR(vnode_t *v, vattr_t *va, cred_t *cred) {
   return VOP_CALL(setattr, v, va, cred);
 }
 
+/* Operations that modify a directory invalidate name cache entries they make
+ * stale. Both negative and positive entries are simply removed. */
+
 static inline int VOP_CREATE(vnode_t *dv, componentname_t *cn, vattr_t *va,
                              vnode_t **vp) {
-  return VOP_CALL(create, dv, cn, va, vp);
+  int error = VOP_CALL(create, dv, cn, va, vp);
+  if (!error)
+    namecache_remove(dv, cn);
+  return error;
+}
+
+/* Creates a special file, whose type is given by `va_mode`. */
+static inline int VOP_MKNOD(vnode_t *dv, componentname_t *cn, vattr_t *va,
+                            vnode_t **vp) {
+  int error = VOP_CALL(mknod, dv, cn, va, vp);
+  if (!error)
+    namecache_remove(dv, cn);
+  return error;
 }
 
 static inline int VOP_REMOVE(vnode_t *dv, vnode_t *v, componentname_t *cn) {
-  return VOP_CALL(remove, dv, v, cn);
+  int error = VOP_CALL(remove, dv, v, cn);
+  if (!error)
+    namecache_remove(dv, cn);
+  return error;
 }
 
 static inline int VOP_MKDIR(vnode_t *dv, componentname_t *cn, vattr_t *va,
                             vnode_t **vp) {
-  return VOP_CALL(mkdir, dv, cn, va, vp);
+  int error = VOP_CALL(mkdir, dv, cn, va, vp);
+  if (!error)
+    namecache_remove(dv, cn);
+  return error;
 }
 
 static inline int VOP_RMDIR(vnode_t *dv, vnode_t *v, componentname_t *cn) {
-  return VOP_CALL(rmdir, dv, v, cn);
+  int error = VOP_CALL(rmdir, dv, v, cn);
+  if (!error)
+    namecache_purge(v);
+  return error;
 }
 
 static inline int VOP_ACCESS(vnode_t *v, mode_t mode, cred_t *cred) {
@@ -205,11 +299,17 @@ static inline int VOP_READLINK(vnode_t *v, uio_t *uio) {
 
 static inline int VOP_SYMLINK(vnode_t *dv, componentname_t *cn, vattr_t *va,
                               char *target, vnode_t **vp) {
-  return VOP_CALL(symlink, dv, cn, va, target, vp);
+  int error = VOP_CALL(symlink, dv, cn, va, target, vp);
+  if (!error)
+    namecache_remove(dv, cn);
+  return error;
 }
 
 static inline int VOP_LINK(vnode_t *dv, vnode_t *v, componentname_t *cn) {
-  return VOP_CALL(link, dv, v, cn);
+  int error = VOP_CALL(link, dv, v, cn);
+  if (!error)
+    namecache_remove(dv, cn);
+  return error;
 }
 
 static inline int VOP_PATHCONF(vnode_t *v, int name, register_t *res) {
@@ -221,16 +321,65 @@ static inline int VOP_PATHCONF(vnode_t *v, int name, register_t *res) {
 /* Allocates and initializes a new vnode */
 vnode_t *vnode_new(vnodetype_t type, vnodeops_t *ops, void *data);
 
+/*
+ * Vnode cache keeps vnodes of filesystems with inode numbers in a system-wide
+ * hash table keyed by (mount, inode number). When the last reference to
+ * a cached vnode is dropped, the vnode is not destroyed, but put at the end of
+ * free list, from which it's either revived by a subsequent lookup or taken
+ * away and reclaimed when there are too many vnodes in the system.
+ */
+
+void init_vcache(void);
+
+/* Called by vcache_get to fill in a freshly allocated vnode (type, operations
+ * and filesystem-specific data) for the inode. `v_mount` and `v_ino` are
+ * already set. May sleep. */
+typedef int vnode_load_t(vnode_t *v, void *arg);
+
+/*! \brief Get vnode for inode `ino` of mount `mp` with usecnt incremented.
+ *
+ * If the vnode is not in the cache, a new one is allocated and `load` is
+ * called with `arg` to fill it in. Must not be called with filesystem locks
+ * taken by `load` or VOP_RECLAIM held.
+ *
+ * \returns ENOENT if the vnode is not cached and `load` is NULL */
+int vcache_get(mount_t *mp, uint32_t ino, vnode_load_t *load, void *arg,
+               vnode_t **vp);
+
+/*! \brief Enter vnode `v` of a newly created inode `ino` into the cache.
+ *
+ * Unlike vcache_get it never sleeps, hence can be used with filesystem locks
+ * held. `v_mount` must be set by the caller. */
+void vcache_new(vnode_t *v, uint32_t ino);
+
+/*! \brief Remove vnode from the cache, so it's reclaimed as soon as the last
+ * reference is dropped. Used for files that were removed from filesystem. */
+void vcache_remove(vnode_t *v);
+
+/*! \brief Reclaim up to `count` least recently used vnodes from free list.
+ *
+ * \returns number of reclaimed vnodes */
+unsigned vcache_recycle(unsigned count);
+
 /* Lock and unlock vnode's mutex.
  * Call vnode_lock whenever you're about to use vnode's contents. */
 void vnode_lock(vnode_t *v);
 void vnode_unlock(vnode_t *v);
 
+/* Lock the vnode for reading contents only. Many threads can hold the lock
+ * in shared mode at once. Released with vnode_unlock. */
+void vnode_lock_shared(vnode_t *v);
+
 /* Increase and decrease the use counter.
- * Call vnode_ref if you don't want the vnode to be recycled. */
+ * Call vnode_hold if you don't want the vnode to be recycled. The caller of
+ * vnode_hold must already have a reference to the vnode. */
 void vnode_hold(vnode_t *v);
 void vnode_drop(vnode_t *v);
 
+/* Increase the use counter unless the vnode is being freed right now.
+ * Unused vnode from the cache free list is brought back to life. */
+bool vnode_tryhold(vnode_t *v);
+
 /* Increment reference counter and lock the vnode. */
 void vnode_get(vnode_t *v);
 
@@ -254,6 +403,7 @@ int default_vnclose(file_t *f);
 int default_vnstat(file_t *f, stat_t *sb);
 int default_vnseek(file_t *f, off_t offset, int whence, off_t *newoffp);
 int default_vnioctl(file_t *f, u_long cmd, void *data);
+int default_vnkqfilter(file_t *f, knote_t *kn);
 
 uint8_t vt2dt(vnodetype_t v_type);
 
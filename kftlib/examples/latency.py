@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+
+"""
+Print the longest interrupts-off and preemption-off windows recorded by
+the kernel compiled with KLATENCY=1.
+"""
+
+import argparse
+
+from kftlib.elf import Elf
+from kftlib.latency import inspect_klatency_file, SymbolResolver
+
+from pathlib import Path
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Show latency windows read from /dev/klatency.")
+    parser.add_argument("klatency_dump",
+                        type=Path,
+                        default=Path("dump.klat"),
+                        help="Copy of /dev/klatency to process")
+    parser.add_argument("-e", "--elf-file",
+                        type=Path,
+                        default=Path("sys/mimiker.elf"),
+                        help="Path to mimiker.elf")
+    args = parser.parse_args()
+
+    elf = Elf.inspect_elf_file(args.elf_file)
+    resolver = SymbolResolver(elf)
+    windows = inspect_klatency_file(args.klatency_dump)
+
+    print(f"{'type':>7} {'tid':>4} {'ticks':>10}  start -> end")
+    for w in windows:
+        start = resolver.resolve(w.start_pc) or f"{w.start_pc:#x}"
+        end = resolver.resolve(w.end_pc) or f"{w.end_pc:#x}"
+        print(f"{w.type:>7} {w.tid:>4} {w.duration:>10}  {start} -> {end}")
+
+
+if __name__ == "__main__":
+    main()
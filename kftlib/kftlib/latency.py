@@ -0,0 +1,67 @@
+from __future__ import annotations
+
+import struct
+
+from bisect import bisect_right
+from dataclasses import dataclass
+from pathlib import Path
+from typing import List, Optional
+
+from kftlib.elf import Elf
+
+# Must match `klat_window_t` from include/sys/klatency.h
+KLAT_WINDOW = struct.Struct('<IIQQQQ')
+KLAT_TYPES = ['intr', 'preempt']
+
+
+@dataclass
+class LatencyWindow:
+    """
+    Window during which interrupts or preemption were disabled.
+    """
+    type: str
+    tid: int
+    start: int
+    duration: int
+    start_pc: int
+    end_pc: int
+
+
+def inspect_klatency_file(path: Path) -> List[LatencyWindow]:
+    """
+    Read dump of /dev/klatency and return windows sorted by duration.
+
+    Arguments:
+        path -- path to the dump
+
+    Returns:
+        list of windows, the longest first
+    """
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    windows = []
+    for fields in KLAT_WINDOW.iter_unpack(data):
+        type, tid, start, duration, start_pc, end_pc = fields
+        windows.append(LatencyWindow(KLAT_TYPES[type], tid, start, duration,
+                                     start_pc, end_pc))
+
+    windows.sort(key=lambda w: w.duration, reverse=True)
+    return windows
+
+
+class SymbolResolver():
+    """
+    Maps program counters to functions that contain them.
+    """
+
+    def __init__(self, elf: Elf):
+        self._pcs = sorted(elf.pc2fun.keys())
+        self._elf = elf
+
+    def resolve(self, pc: int) -> Optional[str]:
+        i = bisect_right(self._pcs, pc)
+        if i == 0:
+            return None
+        fn_pc = self._pcs[i - 1]
+        return f'{self._elf.pc2fun[fn_pc]}+{pc - fn_pc:#x}'
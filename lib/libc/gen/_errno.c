@@ -30,20 +30,22 @@
  */
 
 #include <sys/cdefs.h>
-#include "reentrant.h"
 #include <errno.h>
 #include <stdlib.h>
 
 #undef errno
 extern int errno;
 
-int *__errno(void) {
-#ifdef _REENTRANT
-  if (__isthreaded == 0)
-    return &errno;
+int *__libc_thr_errno_stub(void);
 
-  return thr_errno();
-#else
+/* libpthread overrides this with a routine that returns errno of the calling
+ * thread. Single-threaded programs use the global variable. */
+int *__libc_thr_errno_stub(void) {
   return &errno;
-#endif
+}
+
+__weak_alias(__libc_thr_errno_stub, __libc_thr_errno);
+
+int *__errno(void) {
+  return __libc_thr_errno();
 }
@@ -0,0 +1,6 @@
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+int eventfd_read(int fd, eventfd_t *value) {
+  return read(fd, value, sizeof(eventfd_t)) == sizeof(eventfd_t) ? 0 : -1;
+}
@@ -0,0 +1,6 @@
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+int eventfd_write(int fd, eventfd_t value) {
+  return write(fd, &value, sizeof(eventfd_t)) == sizeof(eventfd_t) ? 0 : -1;
+}
@@ -0,0 +1,16 @@
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+ssize_t recvfrom(int s, void *restrict buf, size_t len, int flags,
+                 struct sockaddr *restrict from, socklen_t *restrict fromlen) {
+  struct iovec iov = {.iov_base = buf, .iov_len = len};
+  struct msghdr mh = {.msg_name = from,
+                      .msg_namelen = from ? *fromlen : 0,
+                      .msg_iov = &iov,
+                      .msg_iovlen = 1};
+  ssize_t n;
+
+  if ((n = recvmsg(s, &mh, flags)) >= 0 && from)
+    *fromlen = mh.msg_namelen;
+  return n;
+}
@@ -0,0 +1,13 @@
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+ssize_t sendto(int s, const void *msg, size_t len, int flags,
+               const struct sockaddr *to, socklen_t tolen) {
+  struct iovec iov = {.iov_base = (void *)msg, .iov_len = len};
+  struct msghdr mh = {.msg_name = (void *)to,
+                      .msg_namelen = tolen,
+                      .msg_iov = &iov,
+                      .msg_iovlen = 1};
+
+  return sendmsg(s, &mh, flags);
+}
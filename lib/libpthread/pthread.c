@@ -0,0 +1,191 @@
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/futex.h>
+#include <sys/mman.h>
+#include <sys/thr.h>
+
+#include "pthread_impl.h"
+
+static TAILQ_HEAD(, pthread) threads = TAILQ_HEAD_INITIALIZER(threads);
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The main thread wasn't created by pthread_create. */
+static struct pthread main_thread;
+
+static void pthread_free(pthread_t t) {
+  if (t->pt_slot)
+    pthread_slot_free(t->pt_slot);
+  munmap(t->pt_stack, t->pt_stacksize);
+  free(t);
+}
+
+/* Release resources of detached threads that have already finished.
+ * Must be called with threads_lock held. */
+static void pthread_reap(void) {
+  pthread_t t, next;
+
+  TAILQ_FOREACH_SAFE (t, &threads, pt_link, next) {
+    if (t->pt_detached && atomic_load(&t->pt_exited)) {
+      TAILQ_REMOVE(&threads, t, pt_link);
+      pthread_free(t);
+    }
+  }
+}
+
+static void pthread_start(void *arg) {
+  pthread_t self = arg;
+  pthread_exit(self->pt_start(self->pt_arg));
+}
+
+int pthread_create(pthread_t *tp, const pthread_attr_t *attr,
+                   void *(*start)(void *), void *arg) {
+  pthread_attr_t defattr;
+  pthread_t t;
+  int error = 0;
+
+  if (attr == NULL) {
+    pthread_attr_init(&defattr);
+    attr = &defattr;
+  }
+
+  if ((t = calloc(1, sizeof(struct pthread))) == NULL)
+    return EAGAIN;
+
+  t->pt_start = start;
+  t->pt_arg = arg;
+  t->pt_detached = (attr->pta_detachstate == PTHREAD_CREATE_DETACHED);
+  t->pt_stacksize = attr->pta_stacksize;
+  t->pt_stack = mmap(NULL, t->pt_stacksize, PROT_READ | PROT_WRITE,
+                     MAP_ANON | MAP_PRIVATE, -1, 0);
+  if (t->pt_stack == MAP_FAILED) {
+    free(t);
+    return EAGAIN;
+  }
+
+  struct thr_param param = {
+    .start_func = pthread_start,
+    .arg = t,
+    .stack_base = t->pt_stack,
+    .stack_size = t->pt_stacksize,
+    .child_tid = &t->pt_tid,
+  };
+
+  pthread_mutex_lock(&threads_lock);
+  pthread_reap();
+  if ((t->pt_slot = pthread_slot_alloc()) == NULL) {
+    error = EAGAIN;
+  } else {
+    /* The kernel stores thread identifier before the thread starts, so the
+     * new thread finds its errno slot right away. It cannot look itself up
+     * in pthread_self until we drop the lock. */
+    param.parent_tid = (tid_t *)&t->pt_slot->ps_tid;
+    TAILQ_INSERT_TAIL(&threads, t, pt_link);
+    if (thr_new(&param, sizeof(param)) < 0) {
+      error = errno;
+      TAILQ_REMOVE(&threads, t, pt_link);
+    }
+  }
+  pthread_mutex_unlock(&threads_lock);
+
+  if (error) {
+    pthread_free(t);
+    return error;
+  }
+
+  *tp = t;
+  return 0;
+}
+
+int pthread_join(pthread_t t, void **retvalp) {
+  int exited;
+
+  if (t == pthread_self())
+    return EDEADLK;
+  if (t->pt_detached)
+    return EINVAL;
+
+  while (!(exited = atomic_load(&t->pt_exited)))
+    futex((int *)&t->pt_exited, FUTEX_WAIT, exited, NULL);
+
+  if (retvalp)
+    *retvalp = t->pt_retval;
+
+  if (t != &main_thread) {
+    pthread_mutex_lock(&threads_lock);
+    TAILQ_REMOVE(&threads, t, pt_link);
+    pthread_mutex_unlock(&threads_lock);
+    pthread_free(t);
+  }
+  return 0;
+}
+
+int pthread_detach(pthread_t t) {
+  if (t->pt_detached)
+    return EINVAL;
+  pthread_mutex_lock(&threads_lock);
+  t->pt_detached = 1;
+  pthread_reap();
+  pthread_mutex_unlock(&threads_lock);
+  return 0;
+}
+
+__noreturn void pthread_exit(void *retval) {
+  pthread_t self = pthread_self();
+  self->pt_retval = retval;
+  /* The kernel sets pt_exited and wakes up joining threads when our stack is
+   * not used anymore. */
+  thr_exit((int *)&self->pt_exited);
+}
+
+pthread_t pthread_self(void) {
+  tid_t tid = thr_self();
+  pthread_t t;
+
+  pthread_mutex_lock(&threads_lock);
+  TAILQ_FOREACH (t, &threads, pt_link)
+    if (t->pt_tid == tid)
+      break;
+  pthread_mutex_unlock(&threads_lock);
+
+  if (t == NULL) {
+    t = &main_thread;
+    t->pt_tid = tid;
+  }
+  return t;
+}
+
+int pthread_equal(pthread_t t1, pthread_t t2) {
+  return t1 == t2;
+}
+
+int pthread_kill(pthread_t t, int sig) {
+  if (thr_kill(t->pt_tid, sig) < 0)
+    return errno;
+  return 0;
+}
+
+int pthread_sigmask(int how, const sigset_t *set, sigset_t *oset) {
+  /* Signal mask is maintained by the kernel on per-thread basis. */
+  if (sigprocmask(how, set, oset) < 0)
+    return errno;
+  return 0;
+}
+
+int pthread_once(pthread_once_t *once, void (*func)(void)) {
+  int state = atomic_cas(&once->pto_state, 0, 1);
+
+  if (state == 0) {
+    func();
+    atomic_store(&once->pto_state, 2);
+    futex((int *)&once->pto_state, FUTEX_WAKE, INT_MAX, NULL);
+    return 0;
+  }
+
+  /* Someone else is running the initializer, wait for it to finish. */
+  while ((state = atomic_load(&once->pto_state)) != 2)
+    futex((int *)&once->pto_state, FUTEX_WAIT, state, NULL);
+  return 0;
+}
@@ -0,0 +1,38 @@
+#include <errno.h>
+#include <pthread.h>
+
+#include "pthread_impl.h"
+
+int pthread_attr_init(pthread_attr_t *attr) {
+  attr->pta_stacksize = PTHREAD_STACK_DEFAULT;
+  attr->pta_detachstate = PTHREAD_CREATE_JOINABLE;
+  return 0;
+}
+
+int pthread_attr_destroy(pthread_attr_t *attr) {
+  return 0;
+}
+
+int pthread_attr_getstacksize(const pthread_attr_t *attr, size_t *sizep) {
+  *sizep = attr->pta_stacksize;
+  return 0;
+}
+
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t size) {
+  if (size < PTHREAD_STACK_MIN)
+    return EINVAL;
+  attr->pta_stacksize = size;
+  return 0;
+}
+
+int pthread_attr_getdetachstate(const pthread_attr_t *attr, int *statep) {
+  *statep = attr->pta_detachstate;
+  return 0;
+}
+
+int pthread_attr_setdetachstate(pthread_attr_t *attr, int state) {
+  if (state != PTHREAD_CREATE_JOINABLE && state != PTHREAD_CREATE_DETACHED)
+    return EINVAL;
+  attr->pta_detachstate = state;
+  return 0;
+}
@@ -0,0 +1,74 @@
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/futex.h>
+#include <time.h>
+
+#include "pthread_impl.h"
+
+/*
+ * Condition variable is a sequence counter. A waiter samples the counter
+ * before releasing the mutex and sleeps only if nobody has signalled the
+ * condition in the meantime. Spurious wakeups are allowed by POSIX.
+ */
+
+int pthread_cond_init(pthread_cond_t *cv, const pthread_condattr_t *attr) {
+  cv->ptc_seq = 0;
+  return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cv) {
+  return 0;
+}
+
+static int cond_wait(pthread_cond_t *cv, pthread_mutex_t *m,
+                     const struct timespec *timeout) {
+  int seq = atomic_load(&cv->ptc_seq);
+  int error = 0;
+
+  pthread_mutex_unlock(m);
+  if (futex((int *)&cv->ptc_seq, FUTEX_WAIT, seq, timeout) < 0 &&
+      errno == ETIMEDOUT)
+    error = ETIMEDOUT;
+  /* Other threads may be sleeping on the mutex, so we must not clear
+   * the contested state, hence we lock it as if it was contested. */
+  while (atomic_swap(&m->ptm_lock, 2) != 0)
+    futex((int *)&m->ptm_lock, FUTEX_WAIT, 2, NULL);
+  return error;
+}
+
+int pthread_cond_wait(pthread_cond_t *cv, pthread_mutex_t *m) {
+  return cond_wait(cv, m, NULL);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cv, pthread_mutex_t *m,
+                           const struct timespec *abstime) {
+  struct timespec now, rel;
+
+  if (abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000L)
+    return EINVAL;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  rel.tv_sec = abstime->tv_sec - now.tv_sec;
+  rel.tv_nsec = abstime->tv_nsec - now.tv_nsec;
+  if (rel.tv_nsec < 0) {
+    rel.tv_sec--;
+    rel.tv_nsec += 1000000000L;
+  }
+  if (rel.tv_sec < 0)
+    return ETIMEDOUT;
+
+  return cond_wait(cv, m, &rel);
+}
+
+int pthread_cond_signal(pthread_cond_t *cv) {
+  atomic_fetch_add(&cv->ptc_seq, 1);
+  futex((int *)&cv->ptc_seq, FUTEX_WAKE, 1, NULL);
+  return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cv) {
+  atomic_fetch_add(&cv->ptc_seq, 1);
+  futex((int *)&cv->ptc_seq, FUTEX_WAKE, INT_MAX, NULL);
+  return 0;
+}
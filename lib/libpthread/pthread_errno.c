@@ -0,0 +1,54 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/thr.h>
+
+#include "pthread_impl.h"
+
+#undef errno
+extern int errno;
+
+/*
+ * Each thread created by pthread_create gets its own errno slot, which is
+ * found by kernel thread identifier. Locking routines set errno when their
+ * system calls fail, so the list of slots must be traversed without taking
+ * any locks. Therefore slots are never freed, but reused once their owner
+ * is gone. The main thread keeps using the global errno variable.
+ */
+static struct pthread_slot *volatile slots;
+
+struct pthread_slot *pthread_slot_alloc(void) {
+  struct pthread_slot *s;
+
+  for (s = atomic_load(&slots); s; s = s->ps_next) {
+    if (atomic_load(&s->ps_tid) == 0) {
+      s->ps_errno = 0;
+      return s;
+    }
+  }
+
+  if ((s = calloc(1, sizeof(struct pthread_slot))) == NULL)
+    return NULL;
+
+  s->ps_next = slots;
+  atomic_store(&slots, s);
+  return s;
+}
+
+void pthread_slot_free(struct pthread_slot *s) {
+  atomic_store(&s->ps_tid, 0);
+}
+
+/* Overrides the routine used by libc to implement errno. */
+int *__libc_thr_errno(void) {
+  struct pthread_slot *s = atomic_load(&slots);
+
+  /* Avoid the system call if no threads have been created yet. */
+  if (s == NULL)
+    return &errno;
+
+  tid_t tid = thr_self();
+  for (; s; s = s->ps_next)
+    if (atomic_load(&s->ps_tid) == tid)
+      return &s->ps_errno;
+  return &errno;
+}
@@ -0,0 +1,46 @@
+#ifndef _PTHREAD_IMPL_H_
+#define _PTHREAD_IMPL_H_
+
+#include <sys/queue.h>
+#include <pthread.h>
+
+#define PTHREAD_STACK_DEFAULT (64 * 1024)
+
+/* Storage for errno of a thread (see pthread_errno.c). */
+struct pthread_slot {
+  struct pthread_slot *ps_next; /* next slot, set before slot is published */
+  volatile tid_t ps_tid;        /* owner thread or 0 if the slot is free */
+  int ps_errno;                 /* errno of the owner thread */
+};
+
+struct pthread {
+  TAILQ_ENTRY(pthread) pt_link; /* link on list of all threads */
+  tid_t pt_tid;                 /* kernel thread identifier */
+  void *(*pt_start)(void *);    /* entry function */
+  void *pt_arg;                 /* argument for entry function */
+  void *pt_retval;              /* value passed to pthread_exit */
+  void *pt_stack;               /* stack allocated with mmap */
+  size_t pt_stacksize;          /* size of the stack */
+  volatile int pt_exited;       /* set to 1 by the kernel on thread exit */
+  int pt_detached;              /* nobody is going to join the thread */
+  struct pthread_slot *pt_slot; /* per-thread errno */
+};
+
+/* Atomic operations on futex words. */
+#define atomic_load(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_swap(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_fetch_add(p, v) __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_fetch_sub(p, v) __atomic_fetch_sub((p), (v), __ATOMIC_SEQ_CST)
+
+static inline int atomic_cas(volatile int *p, int old, int new) {
+  __atomic_compare_exchange_n(p, &old, new, 0, __ATOMIC_SEQ_CST,
+                              __ATOMIC_SEQ_CST);
+  return old;
+}
+
+/* Get a free errno slot. Must be called with lock of thread list held. */
+struct pthread_slot *pthread_slot_alloc(void);
+void pthread_slot_free(struct pthread_slot *s);
+
+#endif /* !_PTHREAD_IMPL_H_ */
@@ -0,0 +1,46 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sys/futex.h>
+
+#include "pthread_impl.h"
+
+/*
+ * Mutex implementation follows "Futexes Are Tricky" by Ulrich Drepper.
+ * Lock word states: 0 - unlocked, 1 - locked, 2 - locked & possibly contested.
+ */
+
+int pthread_mutex_init(pthread_mutex_t *m, const pthread_mutexattr_t *attr) {
+  m->ptm_lock = 0;
+  return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *m) {
+  return m->ptm_lock ? EBUSY : 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *m) {
+  return atomic_cas(&m->ptm_lock, 0, 1) ? EBUSY : 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t *m) {
+  int c = atomic_cas(&m->ptm_lock, 0, 1);
+  if (c == 0)
+    return 0;
+
+  /* Mark the mutex as contested, then sleep until it's released. */
+  if (c != 2)
+    c = atomic_swap(&m->ptm_lock, 2);
+  while (c != 0) {
+    futex((int *)&m->ptm_lock, FUTEX_WAIT, 2, NULL);
+    c = atomic_swap(&m->ptm_lock, 2);
+  }
+  return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *m) {
+  if (atomic_fetch_sub(&m->ptm_lock, 1) != 1) {
+    atomic_store(&m->ptm_lock, 0);
+    futex((int *)&m->ptm_lock, FUTEX_WAKE, 1, NULL);
+  }
+  return 0;
+}
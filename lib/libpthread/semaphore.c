@@ -0,0 +1,134 @@
+#include <errno.h>
+#include <semaphore.h>
+#include <sys/futex.h>
+#include <time.h>
+
+#include "pthread_impl.h"
+
+/*
+ * Semaphore value is the futex word, so a waiter goes to sleep only if no
+ * unit has been posted since it looked at the value. Waiters announce
+ * themselves, so that sem_post can skip the system call if nobody sleeps.
+ * Process-shared semaphores use shared futexes, which are identified by
+ * physical page rather than by virtual address.
+ */
+
+int sem_init(sem_t *sem, int pshared, unsigned int value) {
+  if (value > SEM_VALUE_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  sem->sem_value = value;
+  sem->sem_waiters = 0;
+  sem->sem_flags = pshared ? FUTEX_SHARED : 0;
+  return 0;
+}
+
+int sem_destroy(sem_t *sem) {
+  if (atomic_load(&sem->sem_waiters)) {
+    errno = EBUSY;
+    return -1;
+  }
+  return 0;
+}
+
+/* Takes a unit if there's one available. */
+static int sem_take(sem_t *sem) {
+  int value = atomic_load(&sem->sem_value);
+  while (value > 0) {
+    int old = atomic_cas(&sem->sem_value, value, value - 1);
+    if (old == value)
+      return 1;
+    value = old;
+  }
+  return 0;
+}
+
+/* Converts absolute timeout into relative one. */
+static int sem_timeout(const struct timespec *abstime, struct timespec *rel) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  rel->tv_sec = abstime->tv_sec - now.tv_sec;
+  rel->tv_nsec = abstime->tv_nsec - now.tv_nsec;
+  if (rel->tv_nsec < 0) {
+    rel->tv_sec--;
+    rel->tv_nsec += 1000000000L;
+  }
+  return rel->tv_sec < 0 ? ETIMEDOUT : 0;
+}
+
+static int sem_sleep(sem_t *sem, const struct timespec *abstime) {
+  struct timespec rel;
+  int error = 0;
+
+  while (!sem_take(sem)) {
+    if (abstime && (error = sem_timeout(abstime, &rel)))
+      break;
+
+    atomic_fetch_add(&sem->sem_waiters, 1);
+    if (futex((int *)&sem->sem_value, FUTEX_WAIT | sem->sem_flags, 0,
+              abstime ? &rel : NULL) < 0 &&
+        errno != EAGAIN)
+      error = errno;
+    atomic_fetch_sub(&sem->sem_waiters, 1);
+
+    if (error == ETIMEDOUT || error == EINTR)
+      break;
+    error = 0;
+  }
+
+  if (error) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+int sem_wait(sem_t *sem) {
+  return sem_sleep(sem, NULL);
+}
+
+int sem_trywait(sem_t *sem) {
+  if (!sem_take(sem)) {
+    errno = EAGAIN;
+    return -1;
+  }
+  return 0;
+}
+
+int sem_timedwait(sem_t *sem, const struct timespec *abstime) {
+  /* The timeout is not checked if there's no need to wait. */
+  if (sem_take(sem))
+    return 0;
+
+  if (abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000L) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return sem_sleep(sem, abstime);
+}
+
+int sem_post(sem_t *sem) {
+  int value = atomic_load(&sem->sem_value);
+  for (;;) {
+    if (value == SEM_VALUE_MAX) {
+      errno = EOVERFLOW;
+      return -1;
+    }
+    int old = atomic_cas(&sem->sem_value, value, value + 1);
+    if (old == value)
+      break;
+    value = old;
+  }
+
+  if (atomic_load(&sem->sem_waiters))
+    futex((int *)&sem->sem_value, FUTEX_WAKE | sem->sem_flags, 1, NULL);
+  return 0;
+}
+
+int sem_getvalue(sem_t *sem, int *sval) {
+  *sval = atomic_load(&sem->sem_value);
+  return 0;
+}
@@ -41,6 +41,13 @@ void mcontext_init(mcontext_t *ctx, void *pc, void *sp) {
   _REG(ctx, SP) = (register_t)sp;
 }
 
+void mcontext_setup_call(mcontext_t *ctx, void *pc, void *sp, register_t arg) {
+  _REG(ctx, PC) = (register_t)pc;
+  _REG(ctx, SP) = (register_t)sp;
+  _REG(ctx, LR) = 0;
+  _REG(ctx, X0) = arg;
+}
+
 void mcontext_set_retval(mcontext_t *ctx, register_t value, register_t error) {
   _REG(ctx, X0) = value;
   _REG(ctx, X1) = error;
@@ -11,7 +11,7 @@ class Process(metaclass=GdbStructMeta):
     __ctype__ = 'struct proc'
     __cast__ = {'p_pid': int,
                 'p_lock': Mutex,
-                'p_thread': Thread,
+                'p_nthreads': int,
                 'p_state': enum}
 
     @staticmethod
@@ -32,6 +32,9 @@ class Process(metaclass=GdbStructMeta):
         dead = TailQueue(global_var('zombie_list'), 'p_all')
         return map(cls, list(alive) + list(dead))
 
+    def threads(self):
+        return map(Thread, TailQueue(self._obj['p_threads'], 'td_procq'))
+
     def __repr__(self):
         return 'proc{pid=%d}' % self.p_pid
 
@@ -48,11 +51,11 @@ class Kprocess(SimpleCommand):
                       'Main lock state'])
         for p in Process.list_all():
             if p.p_state == 'PS_ZOMBIE':
-                td, sigpend, sigmask = None, 0, 0
-            else:
-                td = p.p_thread
-                sigpend, sigmask = td.td_sigpend, td.td_sigmask
-            table.add_row([p.p_pid, td, p.p_state, sigpend, sigmask, p.p_lock])
+                table.add_row([p.p_pid, None, p.p_state, 0, 0, p.p_lock])
+                continue
+            for td in p.threads():
+                table.add_row([p.p_pid, td, p.p_state, td.td_sigpend,
+                               td.td_sigmask, p.p_lock])
         print(table)
 
 
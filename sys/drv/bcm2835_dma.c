@@ -0,0 +1,336 @@
+#define KL_LOG KL_DEV
+
+/* For detailed information on the controller, please refer to:
+ * https://cs140e.sergio.bz/docs/BCM2837-ARM-Peripherals.pdf
+ */
+
+#include <sys/mimiker.h>
+#include <sys/devclass.h>
+#include <sys/klog.h>
+#include <sys/device.h>
+#include <sys/bus.h>
+#include <sys/condvar.h>
+#include <sys/errno.h>
+#include <sys/fdt.h>
+#include <sys/interrupt.h>
+#include <sys/kmem.h>
+#include <sys/mutex.h>
+#include <sys/param.h>
+#include <sys/pmap.h>
+#include <sys/time.h>
+#include <aarch64/armreg.h>
+#include <dev/bcm2835reg.h>
+#include <dev/bcm2835_dma.h>
+#include <dev/bcm2835_dmareg.h>
+
+#define __dsb(x) __asm__ volatile("DSB " x)
+
+/* Control block as seen by the DMA engine. Must be 32-byte aligned. */
+typedef struct bcmdma_cb {
+  uint32_t cb_ti;        /* transfer information */
+  uint32_t cb_source_ad; /* source bus address */
+  uint32_t cb_dest_ad;   /* destination bus address */
+  uint32_t cb_txfr_len;  /* transfer length in bytes */
+  uint32_t cb_stride;    /* 2D mode stride */
+  uint32_t cb_nextconbk; /* bus address of next control block or 0 */
+  uint32_t cb_pad[2];
+} bcmdma_cb_t;
+
+/* Control blocks of a channel fill exactly one page. */
+#define BCMDMA_NCBS ((int)(PAGESIZE / sizeof(bcmdma_cb_t)))
+
+/* Timeout when awaiting transfer completion */
+#define BCMDMA_TIMEOUT 10000
+
+struct bcmdma_chan {
+  struct bcmdma_state *ch_dma; /* DMA controller the channel belongs to */
+  unsigned ch_num;             /* channel number */
+  resource_t *ch_irq;          /* channel completion interrupt */
+  bool ch_used;                /* (@) channel has been handed out */
+  unsigned ch_dreq;            /* peripheral pacing the transfers */
+  bcmdma_cb_t *ch_cbs;         /* uncached control blocks */
+  paddr_t ch_cbs_pa;           /* physical address of `ch_cbs` */
+  mtx_t ch_lock;               /* covers `ch_cs` and `ch_done` */
+  condvar_t ch_done;           /* wakes up a thread awaiting a transfer */
+  volatile uint32_t ch_cs;     /* CS register read by ISR, 0 while running */
+};
+
+typedef struct bcmdma_state {
+  resource_t *regs;                       /* DMA controller registers */
+  uint32_t chanmask;                      /* channels usable by the kernel */
+  bcmdma_chan_t chans[BCMDMA_NFULLCHANS]; /* channel descriptors */
+} bcmdma_state_t;
+
+/* There's only one DMA controller in BCM2835. */
+static bcmdma_state_t *bcmdma;
+/* Covers `ch_used` of every channel. */
+static MTX_DEFINE(bcmdma_lock, 0);
+
+#define b_in bus_read_4
+#define b_out bus_write_4
+
+#define ch_in(ch, reg)                                                         \
+  b_in((ch)->ch_dma->regs, BCMDMA_CHAN((ch)->ch_num) + (reg))
+#define ch_out(ch, reg, v)                                                     \
+  b_out((ch)->ch_dma->regs, BCMDMA_CHAN((ch)->ch_num) + (reg), (v))
+
+/* Translate physical memory address into an address seen by the DMA engine.
+ * Cache coherent alias is not used, since caches are maintained by software. */
+static uint32_t bcmdma_busaddr(paddr_t pa) {
+  assert(pa < BCM2835_PERIPHERALS_BASE);
+  return (uint32_t)pa | BCM2835_BUSADDR_CACHE_DIRECT;
+}
+
+/* Write back and invalidate data cache lines covering given memory range. */
+static void bcmdma_cache_wbinv(paddr_t pa, size_t len) {
+  size_t line = CTR_DLINE_SIZE(READ_SPECIALREG(ctr_el0));
+  vaddr_t va = (vaddr_t)phys_to_dmap(pa);
+
+  for (vaddr_t p = rounddown2(va, line); p < va + len; p += line)
+    __asm__ volatile("dc civac, %0" ::"r"(p) : "memory");
+  __dsb("sy");
+}
+
+static void bcmdma_chan_reset(bcmdma_chan_t *chan) {
+  ch_out(chan, BCMDMA_CS, CS_ABORT);
+  ch_out(chan, BCMDMA_CS, CS_RESET);
+  ch_out(chan, BCMDMA_DEBUG, DEBUG_ERROR_MASK);
+  ch_out(chan, BCMDMA_CONBLK_AD, 0);
+}
+
+static intr_filter_t bcmdma_intr_filter(void *data) {
+  bcmdma_chan_t *chan = data;
+  uint32_t cs = ch_in(chan, BCMDMA_CS);
+
+  if (!(cs & CS_INT))
+    return IF_STRAY;
+
+  /* Both flags are cleared by writing ones. */
+  ch_out(chan, BCMDMA_CS, CS_INT | CS_END);
+
+  WITH_MTX_LOCK (&chan->ch_lock) {
+    chan->ch_cs = cs;
+    cv_signal(&chan->ch_done);
+  }
+  return IF_FILTERED;
+}
+
+bcmdma_chan_t *bcmdma_chan_alloc(unsigned dreq) {
+  bcmdma_state_t *state = bcmdma;
+
+  if (state == NULL)
+    return NULL;
+
+  SCOPED_MTX_LOCK(&bcmdma_lock);
+
+  for (int i = 0; i < BCMDMA_NFULLCHANS; i++) {
+    bcmdma_chan_t *chan = &state->chans[i];
+    if (!(state->chanmask & (1 << i)) || chan->ch_used)
+      continue;
+    chan->ch_used = true;
+    chan->ch_dreq = dreq;
+    return chan;
+  }
+
+  return NULL;
+}
+
+void bcmdma_chan_free(bcmdma_chan_t *chan) {
+  SCOPED_MTX_LOCK(&bcmdma_lock);
+  assert(chan->ch_used);
+  chan->ch_used = false;
+}
+
+size_t bcmdma_load(bcmdma_seg_t *segs, int *nsegsp, const void *buf,
+                   size_t len) {
+  vaddr_t va = (vaddr_t)buf;
+  size_t done = 0;
+  int n = 0;
+
+  while (done < len) {
+    paddr_t pa;
+    if (!pmap_kextract(va, &pa))
+      panic("Buffer %p is not mapped!", (void *)va);
+
+    size_t chunk = min(len - done, PAGESIZE - (va & (PAGESIZE - 1)));
+    bcmdma_seg_t *last = n > 0 ? &segs[n - 1] : NULL;
+
+    /* Merge physically adjacent pages into a single segment. */
+    if (last && last->ds_addr + last->ds_len == pa &&
+        last->ds_len + chunk <= BCMDMA_MAXLEN) {
+      last->ds_len += chunk;
+    } else {
+      if (n == *nsegsp)
+        break;
+      segs[n++] = (bcmdma_seg_t){.ds_addr = pa, .ds_len = chunk};
+    }
+
+    va += chunk;
+    done += chunk;
+  }
+
+  *nsegsp = n;
+  return done;
+}
+
+/* Run a chain of at most `BCMDMA_NCBS` control blocks. */
+static int bcmdma_run(bcmdma_chan_t *chan, bcmdma_dir_t dir, bus_addr_t fifo,
+                      const bcmdma_seg_t *segs, int nsegs) {
+  uint32_t ti = TI_PERMAP(chan->ch_dreq) | TI_WAIT_RESP;
+  int error = 0;
+
+  assert(nsegs > 0 && nsegs <= BCMDMA_NCBS);
+
+  if (dir == BCMDMA_DEV_TO_MEM)
+    ti |= TI_SRC_DREQ | TI_DEST_INC;
+  else
+    ti |= TI_DEST_DREQ | TI_SRC_INC;
+
+  for (int i = 0; i < nsegs; i++) {
+    const bcmdma_seg_t *seg = &segs[i];
+    bcmdma_cb_t *cb = &chan->ch_cbs[i];
+    bool last = (i == nsegs - 1);
+    uint32_t mem = bcmdma_busaddr(seg->ds_addr);
+
+    assert(seg->ds_len > 0 && seg->ds_len <= BCMDMA_MAXLEN);
+
+    /* Dirty lines must not be evicted on top of data written by the engine,
+     * nor can the engine read stale memory. */
+    bcmdma_cache_wbinv(seg->ds_addr, seg->ds_len);
+
+    cb->cb_ti = ti | (last ? TI_INTEN : 0);
+    cb->cb_source_ad = (dir == BCMDMA_DEV_TO_MEM) ? fifo : mem;
+    cb->cb_dest_ad = (dir == BCMDMA_DEV_TO_MEM) ? mem : fifo;
+    cb->cb_txfr_len = seg->ds_len;
+    cb->cb_stride = 0;
+    cb->cb_nextconbk =
+      last ? 0 : bcmdma_busaddr(chan->ch_cbs_pa + (i + 1) * sizeof(*cb));
+  }
+  __dsb("sy");
+
+  WITH_MTX_LOCK (&chan->ch_lock)
+    chan->ch_cs = 0;
+
+  ch_out(chan, BCMDMA_CONBLK_AD, bcmdma_busaddr(chan->ch_cbs_pa));
+  ch_out(chan, BCMDMA_CS, CS_ACTIVE | CS_WAIT_FOR_WRITES);
+
+  systime_t deadline = getsystime() + BCMDMA_TIMEOUT;
+
+  WITH_MTX_LOCK (&chan->ch_lock) {
+    /* Only running out of time means the transfer got stuck, so keep
+     * waiting for the rest of it if the sleep ended for other reason. */
+    while (!chan->ch_cs) {
+      systime_t now = getsystime();
+      if ((int)(deadline - now) <= 0) {
+        error = ETIMEDOUT;
+        break;
+      }
+      (void)cv_wait_timed(&chan->ch_done, &chan->ch_lock, deadline - now);
+    }
+  }
+
+  uint32_t cs = error ? ch_in(chan, BCMDMA_CS) : chan->ch_cs;
+  if (cs & CS_ERROR) {
+    klog("DMA: channel %d error (debug 0x%x)", chan->ch_num,
+         ch_in(chan, BCMDMA_DEBUG) & DEBUG_ERROR_MASK);
+    error = EIO;
+  }
+
+  if (error) {
+    bcmdma_chan_reset(chan);
+    return error;
+  }
+
+  /* Drop lines that could have been speculatively fetched in the meantime. */
+  if (dir == BCMDMA_DEV_TO_MEM)
+    for (int i = 0; i < nsegs; i++)
+      bcmdma_cache_wbinv(segs[i].ds_addr, segs[i].ds_len);
+
+  return 0;
+}
+
+int bcmdma_transfer(bcmdma_chan_t *chan, bcmdma_dir_t dir, bus_addr_t fifo,
+                    const bcmdma_seg_t *segs, int nsegs) {
+  assert(chan->ch_used);
+
+  while (nsegs > 0) {
+    int n = min(nsegs, BCMDMA_NCBS);
+    int error = bcmdma_run(chan, dir, fifo, segs, n);
+    if (error)
+      return error;
+    segs += n;
+    nsegs -= n;
+  }
+
+  return 0;
+}
+
+static int bcmdma_probe(device_t *dev) {
+  return FDT_is_compatible(dev->node, "brcm,bcm2835-dma");
+}
+
+static int bcmdma_attach(device_t *dev) {
+  bcmdma_state_t *state = (bcmdma_state_t *)dev->state;
+  pcell_t mask;
+  int err;
+
+  state->regs = device_take_memory(dev, 0);
+  assert(state->regs);
+
+  if ((err = bus_map_resource(dev, state->regs)))
+    return err;
+
+  /* Some channels are used by the VideoCore firmware. */
+  if (FDT_getencprop(dev->node, "brcm,dma-channel-mask", &mask,
+                     sizeof(pcell_t)) != sizeof(pcell_t))
+    return ENXIO;
+
+  /* DMA LITE channels are not used, since their transfers are short. */
+  state->chanmask = mask & ((1 << BCMDMA_NFULLCHANS) - 1);
+
+  for (int i = 0; i < BCMDMA_NFULLCHANS; i++) {
+    bcmdma_chan_t *chan = &state->chans[i];
+
+    if (!(state->chanmask & (1 << i)))
+      continue;
+
+    /* `interrupts` property lists completion interrupts of all channels. */
+    chan->ch_irq = device_take_irq(dev, i);
+    if (chan->ch_irq == NULL) {
+      state->chanmask &= ~(1 << i);
+      continue;
+    }
+
+    chan->ch_dma = state;
+    chan->ch_num = i;
+    chan->ch_cbs = (void *)kmem_alloc_contig(&chan->ch_cbs_pa, PAGESIZE,
+                                             PMAP_NOCACHE);
+    mtx_init(&chan->ch_lock, MTX_SPIN);
+    cv_init(&chan->ch_done, "DMA transfer completion");
+
+    bcmdma_chan_reset(chan);
+    pic_setup_intr(dev, chan->ch_irq, bcmdma_intr_filter, NULL, chan,
+                   "DMA channel interrupt");
+  }
+
+  if (!state->chanmask)
+    return ENXIO;
+
+  b_out(state->regs, BCMDMA_ENABLE,
+        b_in(state->regs, BCMDMA_ENABLE) | state->chanmask);
+
+  klog("DMA: channels 0x%x available", state->chanmask);
+
+  bcmdma = state;
+  return 0;
+}
+
+static driver_t bcmdma_driver = {
+  .desc = "BCM2835 DMA controller driver",
+  .size = sizeof(bcmdma_state_t),
+  .pass = SECOND_PASS,
+  .probe = bcmdma_probe,
+  .attach = bcmdma_attach,
+};
+
+DEVCLASS_ENTRY(root, bcmdma_driver);
@@ -19,6 +19,9 @@
 #include <sys/errno.h>
 #include <sys/bitops.h>
 #include <dev/bcm2835_emmcreg.h>
+#include <dev/bcm2835reg.h>
+#include <dev/bcm2835_dma.h>
+#include <dev/bcm2835_dmareg.h>
 #include <sys/fdt.h>
 
 typedef struct bcmemmc_state {
@@ -32,6 +35,8 @@ typedef struct bcmemmc_state {
   emmc_error_t errors;         /* Error flags */
   emmc_error_t ignored_errors; /* Error flags that do not cause invalidation of
                                 * current state */
+  bcmdma_chan_t *dma;          /* DMA channel or NULL if PIO is used */
+  bus_addr_t data_busaddr;     /* DATA register address seen by DMA engine */
 } bcmemmc_state_t;
 
 #define b_in bus_read_4
@@ -485,6 +490,47 @@ static emmc_error_t bcmemmc_send_cmd(device_t *cdev, emmc_cmd_t cmd,
   return bcmemmc_cmd_code(cdev->parent, code, arg, resp);
 }
 
+/* Number of DMA segments described at once */
+#define BCMEMMC_DMA_NSEGS 16
+
+/* Can a transfer of `len` bytes from/to `buf` be performed by DMA engine? */
+static bool bcmemmc_use_dma(bcmemmc_state_t *state, const void *buf,
+                            size_t len) {
+  return state->dma && len >= MAXBLKSIZE &&
+         is_aligned(buf, BCMDMA_ALIGN) && is_aligned(len, BCMDMA_ALIGN);
+}
+
+/* Move data between the caller's pages and DATA register using DMA engine.
+ * The transfer is paced by the controller, so it can be split into many
+ * chains of control blocks. */
+static emmc_error_t bcmemmc_dma(bcmemmc_state_t *state, bcmdma_dir_t dir,
+                                const void *buf, size_t len) {
+  bcmdma_seg_t segs[BCMEMMC_DMA_NSEGS];
+  const uint8_t *data = buf;
+
+  while (len > 0) {
+    int nsegs = BCMEMMC_DMA_NSEGS;
+    size_t n = bcmdma_load(segs, &nsegs, data, len);
+    int error =
+      bcmdma_transfer(state->dma, dir, state->data_busaddr, segs, nsegs);
+    if (error) {
+      klog("e.MMC: DMA transfer failed (error %d)", error);
+      return bcmemmc_set_error(state, (error == ETIMEDOUT)
+                                        ? EMMC_ERROR_TIMEOUT
+                                        : EMMC_ERROR_INTERNAL);
+    }
+    data += n;
+    len -= n;
+  }
+
+  /* Data port readiness has been signaled for every block, but these
+   * interrupts were consumed by the DMA engine. */
+  WITH_MTX_LOCK (&state->lock)
+    state->pending &= ~(INT_READ_RDY | INT_WRITE_RDY);
+
+  return 0;
+}
+
 static emmc_error_t bcmemmc_read(device_t *cdev, void *buf, size_t len,
                                  size_t *read) {
   device_t *emmcdev = cdev->parent;
@@ -497,9 +543,14 @@ static emmc_error_t bcmemmc_read(device_t *cdev, void *buf, size_t len,
   if (bcmemmc_invalid_state(state))
     return bcmemmc_set_error(state, EMMC_ERROR_INVALID_STATE);
 
-  /* A very simple transfer (should be replaced with DMA in the future) */
-  for (size_t i = 0; i < len / sizeof(uint32_t); i++)
-    data[i] = b_in(emmc, BCMEMMC_DATA);
+  if (bcmemmc_use_dma(state, buf, len)) {
+    emmc_error_t error = bcmemmc_dma(state, BCMDMA_DEV_TO_MEM, buf, len);
+    if (error)
+      return error;
+  } else {
+    for (size_t i = 0; i < len / sizeof(uint32_t); i++)
+      data[i] = b_in(emmc, BCMEMMC_DATA);
+  }
 
   if (read)
     *read = len;
@@ -518,9 +569,14 @@ static emmc_error_t bcmemmc_write(device_t *cdev, const void *buf, size_t len,
   if (bcmemmc_invalid_state(state))
     return bcmemmc_set_error(state, EMMC_ERROR_INVALID_STATE);
 
-  /* A very simple transfer (should be replaced with DMA in the future) */
-  for (size_t i = 0; i < len / sizeof(uint32_t); i++)
-    b_out(emmc, BCMEMMC_DATA, data[i]);
+  if (bcmemmc_use_dma(state, buf, len)) {
+    emmc_error_t error = bcmemmc_dma(state, BCMDMA_MEM_TO_DEV, buf, len);
+    if (error)
+      return error;
+  } else {
+    for (size_t i = 0; i < len / sizeof(uint32_t); i++)
+      b_out(emmc, BCMEMMC_DATA, data[i]);
+  }
 
   if (wrote)
     *wrote = len;
@@ -606,6 +662,13 @@ static int bcmemmc_attach(device_t *dev) {
     return ENXIO;
   }
 
+  /* Data transfers fall back to PIO if there's no DMA channel available. */
+  state->dma = bcmdma_chan_alloc(BCMDMA_DREQ_EMMC);
+  state->data_busaddr =
+    BCM2835_PERIPHERALS_PHYS_TO_BUS(state->emmc->r_start + BCMEMMC_DATA);
+  if (state->dma == NULL)
+    klog("e.MMC: no DMA channel available, using PIO transfers.");
+
   /* This is not a legitimate bus in a sense that it implements `DIF_BUS`, but
    * it should work nevertheless */
   device_t *child = device_add_child(dev, 0);
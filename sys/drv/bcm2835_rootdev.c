@@ -136,6 +136,9 @@ static int rootdev_attach(device_t *bus) {
          simplebus_add_child(bus, "/soc/serial", unit++, bcm2835_pic, NULL)))
     return err;
 
+  if ((err = simplebus_add_child(bus, "/soc/dma", unit++, bcm2835_pic, NULL)))
+    return err;
+
   if ((err = simplebus_add_child(bus, "/soc/emmc", unit++, bcm2835_pic, &emmc)))
     return err;
   emmc->devclass = &DEVCLASS(emmc);
@@ -14,16 +14,16 @@
 #include <sys/device.h>
 #include <sys/devclass.h>
 #include <sys/klog.h>
-#include <sys/vnode.h>
-#include <sys/devfs.h>
+#include <sys/errno.h>
+#include <sys/blkdev.h>
 #include <dev/sd.h>
 #include <sys/fdt.h>
 
 typedef struct sd_state {
   sd_props_t props; /* SD Card's flags */
-  void *block_buf;  /* A buffer for reading data into */
   uint64_t csd[2];  /* Card-Specific Data register's content */
   uint16_t rca;     /* Relative Card Address */
+  blkdev_t blkdev;  /* Block device interface */
 } sd_state_t;
 
 static int sd_probe(device_t *dev) {
@@ -209,12 +209,25 @@ static int sd_init(device_t *dev) {
   return err;
 }
 
-/* Data read routine for CCS-enabled cards (SDHC/SDSC) */
-static int sd_read_block_ccs(device_t *dev, uint32_t lba, void *buffer,
-                             uint32_t num, size_t *read) {
-  int err = 0;
+/* Address of block `lba` as expected by data transfer commands. */
+static uint32_t sd_blk_addr(sd_state_t *state, uint32_t lba) {
+  /* See note no. 10 at page 222 of the specs. */
+  if (!(state->props & SD_SUPP_CCS))
+    return lba * DEFAULT_BLKSIZE;
+  return lba;
+}
+
+/* Read blocks from sd card. Returns 0 on success. */
+static int sd_read_blk(device_t *dev, uint32_t lba, void *buffer, uint32_t num,
+                       size_t *read) {
   sd_state_t *state = (sd_state_t *)dev->state;
-  uint32_t *buf = (uint32_t *)buffer;
+  int err = 0;
+
+  if (num < 1)
+    return EINVAL;
+
+  if (read)
+    *read = 0;
 
   emmc_set_prop(dev, EMMC_PROP_RW_BLKCNT, num);
   emmc_set_prop(dev, EMMC_PROP_RW_BLKSIZE, DEFAULT_BLKSIZE);
@@ -226,13 +239,14 @@ static int sd_read_block_ccs(device_t *dev, uint32_t lba, void *buffer,
 
   emmc_cmd_t read_blocks_cmd =
     (num > 1) ? EMMC_CMD(READ_MULTIPLE_BLOCKS) : EMMC_CMD(READ_BLOCK);
-  emmc_send_cmd(dev, read_blocks_cmd, lba, NULL);
+  emmc_send_cmd(dev, read_blocks_cmd, sd_blk_addr(state, lba), NULL);
   emmc_wait(dev, EMMC_I_READ_READY);
 
   if ((err = sd_sanity_check(dev)))
     return err;
 
-  if ((err = emmc_read(dev, buf, num * DEFAULT_BLKSIZE, NULL)))
+  /* All blocks are read at once, so the controller can stream them by DMA. */
+  if ((err = emmc_read(dev, buffer, num * DEFAULT_BLKSIZE, NULL)))
     return err;
   if ((num == 1) || (state->props & SD_SUPP_BLKCNT)) {
     emmc_wait(dev, EMMC_I_DATA_DONE);
@@ -249,57 +263,6 @@ static int sd_read_block_ccs(device_t *dev, uint32_t lba, void *buffer,
   return sd_sanity_check(dev);
 }
 
-/* Data read routine for CCS-disabled cards (SDSC) */
-static int sd_read_block_noccs(device_t *dev, uint32_t lba, void *buffer,
-                               uint32_t num, size_t *read) {
-  int err = 0;
-  uint32_t *buf = (uint32_t *)buffer;
-
-  for (uint32_t c = 0; c < num; c++) {
-    /* See note no. 10 at page 222 of the specs. */
-    emmc_send_cmd(dev, EMMC_CMD(READ_BLOCK), (lba + c) * DEFAULT_BLKSIZE, NULL);
-
-    if ((err = sd_sanity_check(dev)))
-      return err;
-
-    if ((err = emmc_read(dev, buf, DEFAULT_BLKSIZE, NULL)))
-      return err;
-    emmc_wait(dev, EMMC_I_DATA_DONE);
-    buf += DEFAULT_BLKSIZE / sizeof(uint32_t);
-    if (read)
-      *read = *read + DEFAULT_BLKSIZE;
-  }
-
-  return sd_sanity_check(dev);
-}
-
-/* Read blocks from sd card. Returns 0 on success. */
-static int sd_read_blk(device_t *dev, uint32_t lba, void *buffer, uint32_t num,
-                       size_t *read) {
-  sd_state_t *state = (sd_state_t *)dev->state;
-
-  if (num < 1)
-    return EINVAL;
-
-  int err = 0;
-
-  if (read)
-    *read = 0;
-
-  emmc_set_prop(dev, EMMC_PROP_RW_BLKCNT, num);
-  emmc_set_prop(dev, EMMC_PROP_RW_BLKSIZE, DEFAULT_BLKSIZE);
-
-  if (state->props & SD_SUPP_CCS) {
-    if ((err = sd_read_block_ccs(dev, lba, buffer, num, read)))
-      return err;
-  } else {
-    if ((err = sd_read_block_noccs(dev, lba, buffer, num, read)))
-      return err;
-  }
-
-  return err;
-}
-
 static int sd_write_blk(device_t *dev, uint32_t lba, void *buffer, uint32_t num,
                         size_t *wrote) {
   sd_state_t *state = (sd_state_t *)dev->state;
@@ -322,27 +285,21 @@ static int sd_write_blk(device_t *dev, uint32_t lba, void *buffer, uint32_t num,
   emmc_cmd_t write_blocks_cmd =
     (num > 1) ? EMMC_CMD(WRITE_MULTIPLE_BLOCKS) : EMMC_CMD(WRITE_BLOCK);
 
-  uint32_t addr = lba;
-  /* See note no. 10 at page 222 of
-   * SD Physical Layer Simplified Specification V6.0 */
-  if (!(state->props & SD_SUPP_CCS))
-    addr *= DEFAULT_BLKSIZE;
-  emmc_send_cmd(dev, write_blocks_cmd, addr, NULL);
+  emmc_send_cmd(dev, write_blocks_cmd, sd_blk_addr(state, lba), NULL);
   emmc_wait(dev, EMMC_I_WRITE_READY);
 
-  for (uint32_t c = 0; c < num; c++) {
-    if ((err = sd_sanity_check(dev)))
-      return err;
+  if ((err = sd_sanity_check(dev)))
+    return err;
 
-    if ((err = emmc_write(dev, buf, DEFAULT_BLKSIZE, NULL)))
-      return err;
-    buf += DEFAULT_BLKSIZE / sizeof(uint32_t);
-    if (wrote)
-      *wrote = *wrote + DEFAULT_BLKSIZE;
-  }
+  /* Pass all blocks at once, so the controller can stream them by DMA. */
+  if ((err = emmc_write(dev, buf, num * DEFAULT_BLKSIZE, NULL)))
+    return err;
+  if (wrote)
+    *wrote = num * DEFAULT_BLKSIZE;
 
   emmc_wait(dev, EMMC_I_DATA_DONE);
-  if (num > 1) {
+  /* Transfer of a preset number of blocks ends by itself. */
+  if ((num > 1) && !(state->props & SD_SUPP_BLKCNT)) {
     emmc_send_cmd(dev, EMMC_CMD(STOP_TRANSMISSION), 0, NULL);
   }
 
@@ -350,98 +307,39 @@ static int sd_write_blk(device_t *dev, uint32_t lba, void *buffer, uint32_t num,
   return err;
 }
 
-static inline int sd_check_uio(device_t *dev, uio_t *uio) {
-  sd_state_t *state = (sd_state_t *)dev->state;
-  if ((uint64_t)uio->uio_offset >= sd_capacity(state))
-    return EINVAL;
-  return 0;
-}
-
-static int sd_dop_uio(devnode_t *d, uio_t *uio) {
-  device_t *dev = d->data;
-  sd_state_t *state = (sd_state_t *)dev->state;
-  int err;
-
-  if ((err = sd_check_uio(dev, uio)))
-    return err;
-
-  uint32_t lba = uio->uio_offset / DEFAULT_BLKSIZE;
-  uint32_t read_offset = lba * DEFAULT_BLKSIZE;
-  uint32_t copy_offset = uio->uio_offset - read_offset;
-  uint32_t blk_cnt = (uio->uio_resid) / DEFAULT_BLKSIZE;
-  /* XXX: If there's a offset that causes the transfer to overlap with next
-   * block, we need to read that extra block as well. */
-  if (blk_cnt * DEFAULT_BLKSIZE < copy_offset + uio->uio_resid)
-    blk_cnt++;
-
-  uint32_t blocks_left = blk_cnt;
-  while (uio->uio_resid) {
-    /* We move from internal buffer, soe we need to change the offset to reflect
-     * that from our internal buffer */
-    uio->uio_offset = copy_offset;
-    uint32_t num = min(blocks_left, (uint32_t)SD_KERNEL_BLOCKS);
-    uint32_t bytes_to_transfer =
-      min(uio->uio_resid, num * DEFAULT_BLKSIZE - copy_offset);
-
-    if (uio->uio_op == UIO_READ) {
-      if ((err = sd_read_blk(dev, lba, state->block_buf, num, NULL)))
-        return err;
-      if ((err = uiomove_frombuf(state->block_buf,
-                                 SD_KERNEL_BLOCKS * DEFAULT_BLKSIZE, uio)))
-        return err;
-    } else {
-      if (bytes_to_transfer % DEFAULT_BLKSIZE != 0) {
-        if ((err = sd_read_blk(dev, lba, state->block_buf, num, NULL)))
-          return err;
-      }
-      if ((err = uiomove_frombuf(state->block_buf,
-                                 SD_KERNEL_BLOCKS * DEFAULT_BLKSIZE, uio)))
-        return err;
-      if ((err = sd_write_blk(dev, lba, state->block_buf, num, NULL)))
-        return err;
-    }
-    copy_offset = 0;
-    blocks_left -= num;
-    lba += num;
-  }
+/*
+ * Block device interface.
+ */
 
-  return 0;
+static int sd_bd_read(blkdev_t *bd, uint64_t blkno, void *data, size_t nblks) {
+  return sd_read_blk(bd->bd_data, blkno, data, nblks, NULL);
 }
 
-static int sd_open(devnode_t *d, file_t *fp, int oflags) {
-  device_t *dev = d->data;
-  sd_state_t *state = (sd_state_t *)dev->state;
-
-  d->size = sd_capacity(state);
-
-  return 0;
+static int sd_bd_write(blkdev_t *bd, uint64_t blkno, const void *data,
+                       size_t nblks) {
+  return sd_write_blk(bd->bd_data, blkno, (void *)data, nblks, NULL);
 }
 
-static devops_t sd_devops = {
-  .d_type = DT_SEEKABLE,
-  .d_open = sd_open,
-  .d_read = sd_dop_uio,
-  .d_write = sd_dop_uio,
+static blkdev_ops_t sd_blkdev_ops = {
+  .bd_read = sd_bd_read,
+  .bd_write = sd_bd_write,
 };
 
 static int sd_attach(device_t *dev) {
-  int err = 0;
   sd_state_t *state = (sd_state_t *)dev->state;
-
-  state->block_buf = kmalloc(M_DEV, SD_KERNEL_BLOCKS * DEFAULT_BLKSIZE, 0);
+  int err;
 
   if ((err = sd_init(dev)))
-    goto sd_attach_fail;
-
-  if ((err = devfs_makedev_new(NULL, "sd_card", &sd_devops, dev, NULL)))
-    goto sd_attach_fail;
-
-  return err;
+    return err;
 
-sd_attach_fail:
-  kfree(M_DEV, state->block_buf);
+  state->blkdev = (blkdev_t){
+    .bd_ops = &sd_blkdev_ops,
+    .bd_data = dev,
+    .bd_blksize = DEFAULT_BLKSIZE,
+    .bd_nblocks = sd_capacity(state) / DEFAULT_BLKSIZE,
+  };
 
-  return err;
+  return blkdev_register(&state->blkdev, "sd_card");
 }
 
 static driver_t sd_block_device_driver = {
@@ -51,14 +51,17 @@ typedef struct uhci_state {
  * - `P_DATA` - memory buffers for I/O data to transfer.
  */
 
-#define UHCI_DATA_BUF_SIZE 512UL
+/* A page of data lets bulk transfers move many packets at once. */
+#define UHCI_DATA_BUF_SIZE 4096UL
 
-/* Control transfer: SETUP + (device request + actual data) + STATUS. */
-#define UHCI_TFR_CTRL_MAX_TDS                                                  \
-  (2 + (UHCI_DATA_BUF_SIZE - sizeof(usb_dev_req_t)) / USB_MAX_IPACKET)
+/* Max. number of DATA packets in a single transfer. */
+#define UHCI_TFR_MAX_PKTS 64
+
+/* Control transfer: SETUP + actual data + STATUS. */
+#define UHCI_TFR_CTRL_MAX_TDS (2 + UHCI_TFR_MAX_PKTS)
 
 /* DATA transfer: actual data. */
-#define UHCI_TFR_DATA_MAX_TDS (UHCI_DATA_BUF_SIZE / USB_MAX_IPACKET)
+#define UHCI_TFR_DATA_MAX_TDS UHCI_TFR_MAX_PKTS
 
 #define UHCI_TFR_MAX_TDS max(UHCI_TFR_CTRL_MAX_TDS, UHCI_TFR_DATA_MAX_TDS)
 #define UHCI_TFR_BUF_SIZE                                                      \
@@ -631,6 +634,7 @@ static void uhci_control_transfer(device_t *hcdev, device_t *dev,
                                   usb_buf_t *buf, usb_dev_req_t *req,
                                   usb_direction_t status_dir) {
   assert(buf->transfer_size + sizeof(usb_dev_req_t) <= UHCI_DATA_BUF_SIZE);
+  assert(howmany(buf->transfer_size, buf->endpt->maxpkt) <= UHCI_TFR_MAX_PKTS);
 
   uhci_state_t *uhci = hcdev->state;
   usb_device_t *udev = usb_device_of(dev);
@@ -654,9 +658,14 @@ static void uhci_control_transfer(device_t *hcdev, device_t *dev,
   uhci_schedule(uhci, qh, 0);
 }
 
+/* Data stage is limited by size of data buffer and number of TDs. */
+static uint16_t uhci_transfer_max(device_t *hcdev, usb_endpt_t *endpt) {
+  return min(UHCI_DATA_BUF_SIZE, (size_t)UHCI_TFR_MAX_PKTS * endpt->maxpkt);
+}
+
 /* Issue a data stage only transfer. */
 static void uhci_data_transfer(device_t *hcdev, device_t *dev, usb_buf_t *buf) {
-  assert(buf->transfer_size <= UHCI_DATA_BUF_SIZE);
+  assert(buf->transfer_size <= uhci_transfer_max(hcdev, buf->endpt));
 
   uhci_state_t *uhci = hcdev->state;
   usb_device_t *udev = usb_device_of(dev);
@@ -874,6 +883,7 @@ static usbhc_methods_t uhci_usbhc_if = {
   .reset_port = uhci_reset_port,
   .control_transfer = uhci_control_transfer,
   .data_transfer = uhci_data_transfer,
+  .transfer_max = uhci_transfer_max,
 };
 
 static driver_t uhci = {
@@ -12,27 +12,41 @@
  *     https://manuals.plus/wp-content/sideloads/seagate-scsi-commands-reference-manual-optimized.pdf
  */
 #define KL_LOG KL_DEV
+#include <sys/blkdev.h>
 #include <sys/devclass.h>
-#include <sys/devfs.h>
 #include <sys/device.h>
 #include <sys/endian.h>
+#include <sys/errno.h>
 #include <sys/klog.h>
 #include <sys/libkern.h>
 #include <dev/scsi.h>
 #include <dev/usb.h>
 #include <dev/umass.h>
-#include <sys/vnode.h>
 
 /* We assume that block size >= 512. */
 #define UMASS_MIN_BLOCK_SIZE 512
 
+/* Max. number of bytes transferred by a single READ (10) or WRITE (10)
+ * command. Larger requests are split, so that the cost of command and status
+ * phases is amortized over many data packets. */
+#define UMASS_MAX_XFER_SIZE (64 * 1024)
+
+/* Commands are issued one at a time: the block device layer serializes
+ * transfers, and during attachment there's nobody else to talk to. */
 typedef struct umass_state {
   uint32_t next_tag;                    /* next CBS tag to grant */
   uint32_t nblocks;                     /* number of available blocks */
   uint32_t block_size;                  /* size of a single block */
+  uint32_t max_xfer_blks;               /* max. blocks per R/W command */
+  usb_buf_t *cmd_buf;                   /* buffer for the command phase */
+  usb_buf_t *data_buf;                  /* buffer for the data phase */
+  usb_buf_t *sts_buf;                   /* buffer for the status phase */
+  umass_bbb_cbw_t cbw;                  /* last command issued */
+  umass_bbb_csw_t csw;                  /* status of the last command */
   char vendor[SID_VENDOR_SIZE + 1];     /* vandor string */
   char product[SID_PRODUCT_SIZE + 1];   /* product string */
   char revision[SID_REVISION_SIZE + 1]; /* revision string */
+  blkdev_t blkdev;                      /* block device interface */
 } umass_state_t;
 
 /*
@@ -141,35 +155,44 @@ static inline bool csw_valid_p(umass_bbb_csw_t *csw, uint32_t expected_tag) {
   return csw->dCSWSignature == CSWSIGNATURE && csw->dCSWTag == expected_tag;
 }
 
-/* Status transport is described in (1) 5.3.3. */
-static int csw_receive(device_t *dev, uint32_t expected_tag, usb_buf_t *buf) {
-  umass_bbb_csw_t csw;
+/* Schedule reception of a CSW without waiting for it. */
+static void csw_request(device_t *dev) {
+  umass_state_t *umass = dev->state;
+
+  usb_data_transfer(dev, umass->sts_buf, &umass->csw, sizeof(umass_bbb_csw_t),
+                    USB_TFR_BULK, USB_DIR_INPUT);
+}
+
+/* Status transport is described in (1) 5.3.3.
+ * If `requested` is set, the CSW has already been requested by the caller. */
+static int csw_receive(device_t *dev, uint32_t expected_tag, bool requested) {
+  umass_state_t *umass = dev->state;
+  umass_bbb_csw_t *csw = &umass->csw;
   int error = 0;
 
-  usb_data_transfer(dev, buf, &csw, sizeof(umass_bbb_csw_t), USB_TFR_BULK,
-                    USB_DIR_INPUT);
-  if ((error = usb_buf_wait(buf))) {
+  if (!requested)
+    csw_request(dev);
+  if ((error = usb_buf_wait(umass->sts_buf))) {
     /* Clear the STALL condition. */
     if ((error = usb_unhalt_endpt(dev, USB_TFR_BULK, USB_DIR_INPUT)))
       goto bad;
 
-    usb_data_transfer(dev, buf, &csw, sizeof(umass_bbb_csw_t), USB_TFR_BULK,
-                      USB_DIR_INPUT);
-    if ((error = usb_buf_wait(buf)))
+    csw_request(dev);
+    if ((error = usb_buf_wait(umass->sts_buf)))
       goto bad;
   }
 
-  if (!csw_valid_p(&csw, expected_tag)) {
+  if (!csw_valid_p(csw, expected_tag)) {
     error = EIO;
     goto bad;
   }
 
-  if (csw.bCSWStatus == CSWSTATUS_PHASE) {
+  if (csw->bCSWStatus == CSWSTATUS_PHASE) {
     error = EIO;
     goto bad;
   }
 
-  return (csw.bCSWStatus == CSWSTATUS_GOOD) ? 0 : EIO;
+  return (csw->bCSWStatus == CSWSTATUS_GOOD) ? 0 : EIO;
 
 bad:
   umass_reset_recovery(dev);
@@ -185,7 +208,7 @@ static int umass_transfer(device_t *dev, void *cmd, uint8_t cmdsize,
                           usb_direction_t dir, void *data, uint32_t size) {
 
   umass_state_t *umass = dev->state;
-  usb_buf_t *buf = usb_buf_alloc();
+  bool csw_requested = false;
   int csw_error = 0;
   int error = 0;
 
@@ -193,22 +216,36 @@ static int umass_transfer(device_t *dev, void *cmd, uint8_t cmdsize,
    * Command Block Wrapper phase.
    */
 
-  umass_bbb_cbw_t cbw;
   uint32_t tag = umass->next_tag++;
-  cbw_setup(&cbw, tag, size, cbw_flags(dir), cmd, cmdsize);
-  if ((error = cbw_send(dev, &cbw, buf)))
-    goto end;
+  cbw_setup(&umass->cbw, tag, size, cbw_flags(dir), cmd, cmdsize);
+  if ((error = cbw_send(dev, &umass->cbw, umass->cmd_buf)))
+    return error;
 
   /*
    * Data transfer phase.
    */
 
-  /* Transfer data using block size units. */
+  /* Move as much data as the host controller can take at once. Pieces are
+   * sent one by one, since transfers queued on the same endpoint could be
+   * serviced out of order. */
+  uint32_t maxsize = usb_data_transfer_max(dev, USB_TFR_BULK, dir);
+
   for (uint32_t nbytes = 0; nbytes != size;) {
-    uint32_t tfrsize = min(size, umass->block_size);
+    uint32_t tfrsize = min(size - nbytes, maxsize);
+
+    usb_data_transfer(dev, umass->data_buf, data, tfrsize, USB_TFR_BULK, dir);
+
+    /* CSW arrives through the input endpoint, so it may be scheduled while
+     * the last piece of data is still being sent. This way the device can
+     * report the status as soon as it's done with the command.
+     * (1) 5.3 forbids sending the next CBW before the CSW is received,
+     * hence no command is queued ahead. */
+    if (dir == USB_DIR_OUTPUT && nbytes + tfrsize == size) {
+      csw_request(dev);
+      csw_requested = true;
+    }
 
-    usb_data_transfer(dev, buf, data, tfrsize, USB_TFR_BULK, dir);
-    if ((error = usb_buf_wait(buf))) {
+    if ((error = usb_buf_wait(umass->data_buf))) {
       /* If we encounter an error in the data phase,
        * we still need to receive a CSW. */
       break;
@@ -222,10 +259,8 @@ static int umass_transfer(device_t *dev, void *cmd, uint8_t cmdsize,
    * Command Status Block phase.
    */
 
-  csw_error = csw_receive(dev, tag, buf);
+  csw_error = csw_receive(dev, tag, csw_requested);
 
-end:
-  usb_buf_free(buf);
   return error ? error : csw_error;
 }
 
@@ -322,68 +357,53 @@ static int umass_read_capacity(device_t *dev) {
 }
 
 /*
- * Device node interface.
+ * Block device interface.
  */
 
-static inline usb_direction_t uioop_to_usbdir(uio_op_t op) {
-  switch (op) {
-    case UIO_READ:
-      return USB_DIR_INPUT;
-    case UIO_WRITE:
-      return USB_DIR_OUTPUT;
-    default:
-      panic("Invalid UIO operation!");
-  }
-}
-
-static int umass_op(devnode_t *node, uio_t *uio) {
-  device_t *dev = node->data;
+static int umass_rw(blkdev_t *bd, uint64_t blkno, void *data, size_t nblks,
+                    usb_direction_t dir) {
+  device_t *dev = bd->bd_data;
   umass_state_t *umass = dev->state;
-  usb_direction_t dir = uioop_to_usbdir(uio->uio_op);
-  uint32_t block_size = umass->block_size;
-  int error = 0;
-
-  if (!is_aligned(uio->uio_offset, block_size))
-    return EINVAL;
-  if (!is_aligned(uio->uio_resid, block_size))
-    return EINVAL;
+  int error;
 
-  uint32_t start = uio->uio_offset / block_size;
-  uint32_t nblocks = uio->uio_resid / block_size;
-  uint32_t size = nblocks * block_size;
-
-  /* NOTE: we assume that number of blocks to read is <= `UINT16_MAX`. */
-  if (nblocks > UINT16_MAX)
+  if (blkno + nblks > umass->nblocks)
     return EINVAL;
 
-  void *buf = kmalloc(M_DEV, size, M_WAITOK);
+  /* Large requests are issued as a sequence of commands. */
+  while (nblks > 0) {
+    uint32_t n = min(nblks, (size_t)umass->max_xfer_blks);
+    uint32_t size = n * umass->block_size;
+
+    scsi_rw_10_t rw10 = (scsi_rw_10_t){
+      .opcode = (dir == USB_DIR_INPUT) ? READ_10 : WRITE_10,
+      .addr = htobe32(blkno),
+      .length = htobe16(n),
+    };
+    if ((error = umass_transfer(dev, &rw10, sizeof(scsi_rw_10_t), dir, data,
+                                size)))
+      return error;
 
-  if (dir == USB_DIR_OUTPUT) {
-    if ((error = uiomove(buf, uio->uio_resid, uio)))
-      goto end;
+    blkno += n;
+    nblks -= n;
+    data += size;
   }
 
-  scsi_rw_10_t rw10 = (scsi_rw_10_t){
-    .opcode = (dir == USB_DIR_INPUT) ? READ_10 : WRITE_10,
-    .addr = htobe32(start),
-    .length = htobe16(nblocks),
-  };
-  error = umass_transfer(dev, &rw10, sizeof(scsi_rw_10_t), dir, buf, size);
-  if (error)
-    goto end;
+  return 0;
+}
 
-  if (dir == USB_DIR_INPUT)
-    error = uiomove_frombuf(buf, size, uio);
+static int umass_bd_read(blkdev_t *bd, uint64_t blkno, void *data,
+                         size_t nblks) {
+  return umass_rw(bd, blkno, data, nblks, USB_DIR_INPUT);
+}
 
-end:
-  kfree(M_DEV, buf);
-  return error;
+static int umass_bd_write(blkdev_t *bd, uint64_t blkno, const void *data,
+                          size_t nblks) {
+  return umass_rw(bd, blkno, (void *)data, nblks, USB_DIR_OUTPUT);
 }
 
-static devops_t umass_devops = {
-  .d_type = DT_SEEKABLE, /* TODO: should be `DT_DISK`. */
-  .d_read = umass_op,
-  .d_write = umass_op,
+static blkdev_ops_t umass_blkdev_ops = {
+  .bd_read = umass_bd_read,
+  .bd_write = umass_bd_write,
 };
 
 /*
@@ -421,9 +441,14 @@ static int umass_attach(device_t *dev) {
   umass_state_t *umass = dev->state;
   umass->block_size = UMASS_MIN_BLOCK_SIZE;
 
+  /* USB buffers are reused by all commands. */
+  umass->cmd_buf = usb_buf_alloc();
+  umass->data_buf = usb_buf_alloc();
+  umass->sts_buf = usb_buf_alloc();
+
   /* Identify the connected device. */
   if ((error = umass_inquiry(dev)))
-    return ENXIO;
+    goto bad;
 
   /*
    * After receiving a successful inquiry transfer,
@@ -432,14 +457,27 @@ static int umass_attach(device_t *dev) {
 
   /* Obtain the number and length of the logical blocks. */
   if ((error = umass_read_capacity(dev)))
-    return ENXIO;
+    goto bad;
+
+  umass->max_xfer_blks = max(UMASS_MAX_XFER_SIZE / umass->block_size, 1U);
 
   umass_print(dev);
 
   /* Prepare /dev/umass interface. */
-  devfs_makedev_new(NULL, "umass", &umass_devops, dev, NULL);
+  umass->blkdev = (blkdev_t){
+    .bd_ops = &umass_blkdev_ops,
+    .bd_data = dev,
+    .bd_blksize = umass->block_size,
+    .bd_nblocks = umass->nblocks,
+  };
 
-  return 0;
+  return blkdev_register(&umass->blkdev, "umass");
+
+bad:
+  usb_buf_free(umass->cmd_buf);
+  usb_buf_free(umass->data_buf);
+  usb_buf_free(umass->sts_buf);
+  return ENXIO;
 }
 
 static driver_t umass_driver = {
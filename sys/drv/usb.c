@@ -78,7 +78,8 @@ bool usb_buf_periodic(usb_buf_t *buf) {
 }
 
 void usb_buf_free(usb_buf_t *buf) {
-  if (usb_buf_periodic(buf)) {
+  /* The buffer may have never been used for a transfer. */
+  if (buf->endpt && usb_buf_periodic(buf)) {
     assert(buf->priv);
     kfree(M_DEV, buf->priv);
   }
@@ -262,6 +263,15 @@ static void _usb_data_transfer(device_t *dev, usb_buf_t *buf, void *data,
   usbhc_data_transfer(dev, buf);
 }
 
+static uint16_t _usb_data_transfer_max(device_t *dev, usb_transfer_t transfer,
+                                       usb_direction_t dir) {
+  usb_device_t *udev = usb_device_of(dev);
+  usb_endpt_t *endpt = usb_dev_endpt(udev, transfer, dir);
+  assert(endpt);
+
+  return usbhc_transfer_max(dev, endpt);
+}
+
 /*
  * USB standard requests.
  */
@@ -983,6 +993,7 @@ static int usb_attach(device_t *busdev) {
 static usb_methods_t usb_if = {
   .control_transfer = _usb_control_transfer,
   .data_transfer = _usb_data_transfer,
+  .data_transfer_max = _usb_data_transfer_max,
 };
 
 static driver_t usb_bus = {
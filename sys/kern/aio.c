@@ -0,0 +1,520 @@
+#define KL_LOG KL_FILE
+#include <sys/aio.h>
+#include <sys/condvar.h>
+#include <sys/errno.h>
+#include <sys/event.h>
+#include <sys/file.h>
+#include <sys/filedesc.h>
+#include <sys/kenv.h>
+#include <sys/klog.h>
+#include <sys/libkern.h>
+#include <sys/malloc.h>
+#include <sys/mimiker.h>
+#include <sys/mutex.h>
+#include <sys/pool.h>
+#include <sys/proc.h>
+#include <sys/sched.h>
+#include <sys/signal.h>
+#include <sys/sleepq.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/vm_map.h>
+
+/*
+ * Asynchronous I/O requests are serviced by a pool of kernel worker threads.
+ * A worker borrows the address space of the process that issued the request,
+ * so data is transferred directly between the file and the user buffer.
+ *
+ * Requests live on the `p_aiojobs` list of the issuing process until they
+ * are reaped with `aio_return`. Upon completion a request can post an event
+ * to a kqueue (EVFILT_AIO), send a signal or do nothing.
+ *
+ * Field markings and the corresponding locks:
+ *  (a) aio_lock
+ *  (!) read-only access after the request was queued
+ */
+
+#define AIO_WORKERS 4
+
+typedef enum {
+  AJ_QUEUED,  /* waiting on `aio_queue` for a worker */
+  AJ_RUNNING, /* I/O performed by `aj_worker` */
+  AJ_DONE,    /* completed, `aj_error` and `aj_result` are valid */
+} aj_state_t;
+
+/* Requests submitted together by `lio_listio`. */
+typedef struct aiolio {
+  int al_refcnt;          /* (a) pending requests + waiter */
+  int al_pending;         /* (a) requests that have not completed yet */
+  bool al_failed;         /* (a) some request completed with an error */
+  struct sigevent al_sig; /* (!) notification when all requests are done */
+  proc_t *al_proc;        /* (!) process that issued the requests */
+} aiolio_t;
+
+typedef struct aiojob {
+  TAILQ_ENTRY(aiojob) aj_link;     /* (a) link on `aio_queue` */
+  TAILQ_ENTRY(aiojob) aj_proclink; /* (a) link on `p_aiojobs` */
+  proc_t *aj_proc;                 /* (!) process that issued the request */
+  struct aiocb *aj_ucb;            /* (!) identifies the request */
+  struct aiocb aj_cb;              /* (!) kernel copy of control block */
+  file_t *aj_file;                 /* (!) file to perform I/O on */
+  vm_map_t *aj_uspace;             /* (!) address space of `aio_buf` */
+  aiolio_t *aj_lio;                /* (!) list the request belongs to */
+  thread_t *aj_worker;             /* (a) worker servicing the request */
+  aj_state_t aj_state;             /* (a) request state */
+  int aj_error;                    /* (a) errno of completed request */
+  ssize_t aj_result;               /* (a) bytes transferred */
+  knlist_t aj_knlist;              /* (a) EVFILT_AIO knotes */
+} aiojob_t;
+
+static POOL_DEFINE(P_AIOJOB, "aio job", sizeof(aiojob_t));
+static KMALLOC_DEFINE(M_AIO, "aio");
+
+static MTX_DEFINE(aio_lock, 0);
+static TAILQ_HEAD(, aiojob) aio_queue = TAILQ_HEAD_INITIALIZER(aio_queue);
+static condvar_t aio_workcv; /* new requests were queued */
+static condvar_t aio_donecv; /* some requests were completed */
+
+static int filt_aioattach(knote_t *kn) {
+  aiojob_t *job = kn->kn_obj;
+
+  kn->kn_objlock = &aio_lock;
+
+  WITH_MTX_LOCK (&aio_lock) {
+    SLIST_INSERT_HEAD(&job->aj_knlist, kn, kn_objlink);
+  }
+
+  return 0;
+}
+
+static void filt_aiodetach(knote_t *kn) {
+  aiojob_t *job = kn->kn_obj;
+
+  WITH_MTX_LOCK (&aio_lock) {
+    SLIST_REMOVE(&job->aj_knlist, kn, knote, kn_objlink);
+  }
+}
+
+static int filt_aioevent(knote_t *kn, long hint) {
+  aiojob_t *job = kn->kn_obj;
+  assert(mtx_owned(&aio_lock));
+
+  return job->aj_state == AJ_DONE;
+}
+
+filterops_t aio_filtops = {
+  .filt_attach = filt_aioattach,
+  .filt_detach = filt_aiodetach,
+  .filt_event = filt_aioevent,
+};
+
+static void aio_signal(proc_t *p, struct sigevent *sig) {
+  assert(mtx_owned(&aio_lock));
+
+  if (sig->sigev_notify != SIGEV_SIGNAL)
+    return;
+
+  WITH_PROC_LOCK(p) {
+    if (p->p_state == PS_NORMAL || p->p_state == PS_STOPPED)
+      sig_kill(p, &DEF_KSI_RAW(sig->sigev_signo));
+  }
+}
+
+static void aio_lio_release(aiolio_t *lio) {
+  assert(mtx_owned(&aio_lock));
+
+  if (--lio->al_refcnt == 0)
+    kfree(M_AIO, lio);
+}
+
+/* Marks request as completed and delivers notifications. */
+static void aio_complete(aiojob_t *job, int error, ssize_t result) {
+  assert(mtx_owned(&aio_lock));
+
+  job->aj_state = AJ_DONE;
+  job->aj_worker = NULL;
+  job->aj_error = error;
+  job->aj_result = error ? -1 : result;
+
+  knote(&job->aj_knlist, 0);
+  aio_signal(job->aj_proc, &job->aj_cb.aio_sigevent);
+
+  aiolio_t *lio = job->aj_lio;
+  if (lio) {
+    if (error)
+      lio->al_failed = true;
+    if (--lio->al_pending == 0)
+      aio_signal(lio->al_proc, &lio->al_sig);
+    aio_lio_release(lio);
+    job->aj_lio = NULL;
+  }
+
+  cv_broadcast(&aio_donecv);
+}
+
+static bool aio_seekable(file_t *f) {
+  return f->f_type == FT_VNODE && f->f_ops->fo_seek != noseek;
+}
+
+static int aio_perform(aiojob_t *job, ssize_t *resultp) {
+  struct aiocb *cb = &job->aj_cb;
+  file_t *f = job->aj_file;
+  uio_op_t op = (cb->aio_lio_opcode == LIO_READ) ? UIO_READ : UIO_WRITE;
+  int error;
+
+  uio_t uio = UIO_SINGLE(op, job->aj_uspace, 0, __UNVOLATILE(cb->aio_buf),
+                         cb->aio_nbytes);
+  uio.uio_ioflags = f->f_flags & IO_MASK;
+  if (aio_seekable(f)) {
+    uio.uio_offset = cb->aio_offset;
+    uio.uio_ioflags |= IO_OFFSET;
+  }
+
+  vm_map_borrow(job->aj_uspace);
+  if (op == UIO_READ)
+    error = f->f_ops->fo_read(f, &uio);
+  else
+    error = f->f_ops->fo_write(f, &uio);
+  vm_map_borrow(NULL);
+
+  *resultp = cb->aio_nbytes - uio.uio_resid;
+  return error;
+}
+
+static void aio_worker(void *arg) {
+  thread_t *td = thread_self();
+
+  for (;;) {
+    aiojob_t *job;
+
+    WITH_MTX_LOCK (&aio_lock) {
+      while (TAILQ_EMPTY(&aio_queue))
+        cv_wait(&aio_workcv, &aio_lock);
+      job = TAILQ_FIRST(&aio_queue);
+      TAILQ_REMOVE(&aio_queue, job, aj_link);
+      job->aj_state = AJ_RUNNING;
+      job->aj_worker = td;
+      /* Forget about cancellation of previously serviced request. */
+      WITH_MTX_LOCK (td->td_lock)
+        td->td_flags &= ~TDF_NEEDSIGCHK;
+    }
+
+    ssize_t result;
+    int error = aio_perform(job, &result);
+
+    WITH_MTX_LOCK (&aio_lock)
+      aio_complete(job, error, result);
+  }
+}
+
+/* Interrupts a request that is being serviced, as if a signal was delivered to
+ * the worker. Only interruptible sleeps are aborted. */
+static void aio_interrupt(aiojob_t *job) {
+  assert(mtx_owned(&aio_lock));
+
+  thread_t *td = job->aj_worker;
+
+  WITH_MTX_LOCK (td->td_lock) {
+    td->td_flags |= TDF_NEEDSIGCHK;
+    if (td_is_interruptible(td)) {
+      mtx_unlock(td->td_lock);
+      sleepq_abort(td); /* Locks & unlocks td_lock */
+      mtx_lock(td->td_lock);
+    }
+  }
+}
+
+static aiojob_t *aio_find(proc_t *p, struct aiocb *ucb) {
+  assert(mtx_owned(&aio_lock));
+
+  aiojob_t *job;
+  TAILQ_FOREACH (job, &p->p_aiojobs, aj_proclink) {
+    if (job->aj_ucb == ucb)
+      return job;
+  }
+  return NULL;
+}
+
+/* Frees a completed request that was removed from `p_aiojobs`. */
+static void aio_free(aiojob_t *job) {
+  assert(job->aj_state == AJ_DONE);
+
+  knlist_clear(&job->aj_knlist);
+  if (job->aj_file)
+    file_drop(job->aj_file);
+  pool_free(P_AIOJOB, job);
+}
+
+static int aio_count(proc_t *p) {
+  assert(mtx_owned(&aio_lock));
+
+  aiojob_t *job;
+  int n = 0;
+  TAILQ_FOREACH (job, &p->p_aiojobs, aj_proclink)
+    n++;
+  return n;
+}
+
+static int aio_check_sigevent(struct sigevent *sig) {
+  switch (sig->sigev_notify) {
+    case SIGEV_NONE:
+    case SIGEV_KEVENT:
+      return 0;
+    case SIGEV_SIGNAL:
+      if (sig->sigev_signo <= 0 || sig->sigev_signo >= NSIG)
+        return EINVAL;
+      return 0;
+    default:
+      return EINVAL;
+  }
+}
+
+/* Creates a request and queues it for workers. */
+static int aio_queue_job(proc_t *p, struct aiocb *ucb, struct aiocb *cb,
+                         aiolio_t *lio) {
+  int opcode = cb->aio_lio_opcode;
+  file_t *f;
+  int error;
+
+  if ((opcode != LIO_READ && opcode != LIO_WRITE) || cb->aio_nbytes > SSIZE_MAX)
+    return EINVAL;
+
+  if ((error = aio_check_sigevent(&cb->aio_sigevent)))
+    return error;
+
+  if ((error = fdtab_get_file(p->p_fdtable, cb->aio_fildes,
+                              opcode == LIO_READ ? FF_READ : FF_WRITE, &f)))
+    return error;
+
+  if (aio_seekable(f) && cb->aio_offset < 0) {
+    file_drop(f);
+    return EINVAL;
+  }
+
+  aiojob_t *job = pool_alloc(P_AIOJOB, M_ZERO);
+  job->aj_proc = p;
+  job->aj_ucb = ucb;
+  job->aj_cb = *cb;
+  job->aj_file = f;
+  job->aj_uspace = p->p_uspace;
+  job->aj_state = AJ_QUEUED;
+  job->aj_error = EINPROGRESS;
+  SLIST_INIT(&job->aj_knlist);
+
+  struct sigevent *sig = &cb->aio_sigevent;
+  if (sig->sigev_notify == SIGEV_KEVENT) {
+    kevent_t kev;
+    EV_SET(&kev, (uintptr_t)ucb, EVFILT_AIO, EV_ADD, 0, 0,
+           sig->sigev_value.sival_ptr);
+    if ((error = kqueue_attach(p, sig->sigev_notify_kqueue, &kev, job))) {
+      file_drop(f);
+      pool_free(P_AIOJOB, job);
+      return error;
+    }
+  }
+
+  WITH_MTX_LOCK (&aio_lock) {
+    if (aio_find(p, ucb)) {
+      error = EINVAL;
+    } else if (aio_count(p) >= AIO_MAX) {
+      error = EAGAIN;
+    } else {
+      if (lio) {
+        lio->al_refcnt++;
+        lio->al_pending++;
+        job->aj_lio = lio;
+      }
+      TAILQ_INSERT_TAIL(&p->p_aiojobs, job, aj_proclink);
+      TAILQ_INSERT_TAIL(&aio_queue, job, aj_link);
+      cv_signal(&aio_workcv);
+    }
+  }
+
+  if (error) {
+    job->aj_state = AJ_DONE;
+    aio_free(job);
+  }
+
+  return error;
+}
+
+int do_aio_submit(proc_t *p, struct aiocb *ucb, struct aiocb *cb) {
+  return aio_queue_job(p, ucb, cb, NULL);
+}
+
+int do_aio_error(proc_t *p, struct aiocb *ucb, int *errorp) {
+  SCOPED_MTX_LOCK(&aio_lock);
+
+  aiojob_t *job = aio_find(p, ucb);
+  if (job == NULL)
+    return EINVAL;
+
+  *errorp = job->aj_error;
+  return 0;
+}
+
+int do_aio_return(proc_t *p, struct aiocb *ucb, ssize_t *resultp) {
+  aiojob_t *job;
+  int error;
+
+  WITH_MTX_LOCK (&aio_lock) {
+    if (!(job = aio_find(p, ucb)))
+      return EINVAL;
+    if (job->aj_state != AJ_DONE)
+      return EINPROGRESS;
+    TAILQ_REMOVE(&p->p_aiojobs, job, aj_proclink);
+  }
+
+  error = job->aj_error;
+  *resultp = job->aj_result;
+  aio_free(job);
+  return error;
+}
+
+/* Returns true if any of the requests is complete. */
+static bool aio_any_done(proc_t *p, struct aiocb **ucbs, int nent) {
+  assert(mtx_owned(&aio_lock));
+
+  for (int i = 0; i < nent; i++) {
+    if (ucbs[i] == NULL)
+      continue;
+    aiojob_t *job = aio_find(p, ucbs[i]);
+    if (job == NULL || job->aj_state == AJ_DONE)
+      return true;
+  }
+  return false;
+}
+
+int do_aio_suspend(proc_t *p, struct aiocb **ucbs, int nent,
+                   timespec_t *tsp) {
+  systime_t timeout = 0, deadline = 0;
+  int error = 0;
+
+  if (tsp) {
+    timeout = ts2hz(tsp);
+    deadline = getsystime() + timeout;
+  }
+
+  SCOPED_MTX_LOCK(&aio_lock);
+
+  while (!aio_any_done(p, ucbs, nent)) {
+    if (tsp) {
+      systime_t now = getsystime();
+      if ((int)(deadline - now) <= 0)
+        return EAGAIN;
+      timeout = deadline - now;
+    }
+    error = cv_wait_timed_intr(&aio_donecv, &aio_lock, timeout);
+    if (error == ETIMEDOUT)
+      return EAGAIN;
+    if (error)
+      return error;
+  }
+
+  return 0;
+}
+
+int do_lio_listio(proc_t *p, int mode, struct aiocb **ucbs, struct aiocb *cbs,
+                  int nent, struct sigevent *sig) {
+  struct sigevent none = {.sigev_notify = SIGEV_NONE};
+  aiolio_t *lio;
+  int error = 0;
+
+  if ((mode != LIO_WAIT && mode != LIO_NOWAIT) || nent < 0 ||
+      nent > AIO_LISTIO_MAX)
+    return EINVAL;
+
+  if (mode == LIO_WAIT || sig == NULL) {
+    sig = &none;
+  } else if (sig->sigev_notify == SIGEV_KEVENT) {
+    /* Only individual requests may post kqueue events. */
+    return EINVAL;
+  } else if ((error = aio_check_sigevent(sig))) {
+    return error;
+  }
+
+  /* The list is held, and won't be considered complete, until all requests
+   * are queued. */
+  lio = kmalloc(M_AIO, sizeof(aiolio_t), M_WAITOK | M_ZERO);
+  lio->al_refcnt = 1;
+  lio->al_pending = 1;
+  lio->al_sig = *sig;
+  lio->al_proc = p;
+
+  for (int i = 0; i < nent; i++) {
+    if (ucbs[i] == NULL || cbs[i].aio_lio_opcode == LIO_NOP)
+      continue;
+    int qerror = aio_queue_job(p, ucbs[i], &cbs[i], lio);
+    if (qerror) {
+      klog("lio_listio: request %d failed with error %d", i, qerror);
+      error = (qerror == EAGAIN) ? EAGAIN : EIO;
+    }
+  }
+
+  WITH_MTX_LOCK (&aio_lock) {
+    if (--lio->al_pending == 0)
+      aio_signal(p, &lio->al_sig);
+    if (mode == LIO_WAIT) {
+      while (lio->al_pending > 0) {
+        if (cv_wait_intr(&aio_donecv, &aio_lock)) {
+          error = EINTR;
+          break;
+        }
+      }
+      if (!error && lio->al_failed)
+        error = EIO;
+    }
+    aio_lio_release(lio);
+  }
+
+  return error;
+}
+
+void aio_proc_drain(proc_t *p) {
+  TAILQ_HEAD(, aiojob) done = TAILQ_HEAD_INITIALIZER(done);
+  aiojob_t *job;
+
+  WITH_MTX_LOCK (&aio_lock) {
+    for (;;) {
+      bool running = false;
+
+      TAILQ_FOREACH (job, &p->p_aiojobs, aj_proclink) {
+        if (job->aj_state == AJ_QUEUED) {
+          TAILQ_REMOVE(&aio_queue, job, aj_link);
+          aio_complete(job, ECANCELED, 0);
+        } else if (job->aj_state == AJ_RUNNING) {
+          aio_interrupt(job);
+          running = true;
+        }
+      }
+
+      if (!running)
+        break;
+
+      cv_wait(&aio_donecv, &aio_lock);
+    }
+
+    TAILQ_CONCAT(&done, &p->p_aiojobs, aj_proclink);
+  }
+
+  while ((job = TAILQ_FIRST(&done))) {
+    TAILQ_REMOVE(&done, job, aj_proclink);
+    aio_free(job);
+  }
+}
+
+void init_aio(void) {
+  cv_init(&aio_workcv, "aio requests");
+  cv_init(&aio_donecv, "aio completions");
+
+  unsigned nworkers = AIO_WORKERS;
+  const char *s = kenv_get("aio-workers");
+  if (s)
+    nworkers = max(strtoul(s, NULL, 10), 1UL);
+
+  for (unsigned i = 0; i < nworkers; i++) {
+    thread_t *td = thread_create("aio", aio_worker, NULL, prio_kthread(0));
+    sched_add(td);
+  }
+}
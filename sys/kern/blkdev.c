@@ -0,0 +1,302 @@
+#define KL_LOG KL_DEV
+#include <sys/klog.h>
+#include <sys/blkdev.h>
+#include <sys/buf.h>
+#include <sys/devfs.h>
+#include <sys/errno.h>
+#include <sys/kmem.h>
+#include <sys/libkern.h>
+#include <sys/mimiker.h>
+#include <sys/param.h>
+#include <sys/uio.h>
+#include <sys/vm_amap.h>
+#include <sys/vm_map.h>
+#include <sys/vnode.h>
+
+/* Default size of buffer cache block. */
+#define BLKDEV_BUFSIZE 4096
+
+/* Max. number of pages transferred at once bypassing the buffer cache. */
+#define BLKDEV_DIRECT_PAGES 32
+
+/* Block device drivers may sleep while waiting for completion of a transfer,
+ * so a mutex cannot be held across calls to `bd_ops`. */
+static void blkdev_lock(blkdev_t *bd) {
+  WITH_MTX_LOCK (&bd->bd_lock) {
+    while (bd->bd_busy)
+      cv_wait(&bd->bd_cv, &bd->bd_lock);
+    bd->bd_busy = true;
+  }
+}
+
+static void blkdev_unlock(blkdev_t *bd) {
+  WITH_MTX_LOCK (&bd->bd_lock) {
+    bd->bd_busy = false;
+    cv_signal(&bd->bd_cv);
+  }
+}
+
+size_t blkdev_bufsize(blkdev_t *bd, uint64_t blkno) {
+  uint64_t start = blkno * bd->bd_bufsize;
+  uint64_t devsize = bd->bd_nblocks * bd->bd_blksize;
+  if (start >= devsize)
+    return 0;
+  return min(devsize - start, (uint64_t)bd->bd_bufsize);
+}
+
+/* Transfer `nblks` device blocks starting from block `first`. */
+static int blkdev_transfer(blkdev_t *bd, uio_op_t op, uint64_t first,
+                           void *data, size_t nblks) {
+  int error;
+
+  if (nblks == 0 || first + nblks > bd->bd_nblocks)
+    return EINVAL;
+
+  blkdev_lock(bd);
+  if (op == UIO_READ)
+    error = bd->bd_ops->bd_read(bd, first, data, nblks);
+  else
+    error = bd->bd_ops->bd_write(bd, first, data, nblks);
+  blkdev_unlock(bd);
+  return error;
+}
+
+int blkdev_read(blkdev_t *bd, uint64_t blkno, void *data, size_t size) {
+  uint64_t first = blkno * (bd->bd_bufsize / bd->bd_blksize);
+
+  assert(is_aligned(size, bd->bd_blksize));
+  return blkdev_transfer(bd, UIO_READ, first, data, size / bd->bd_blksize);
+}
+
+int blkdev_write(blkdev_t *bd, uint64_t blkno, const void *data, size_t size) {
+  uint64_t first = blkno * (bd->bd_bufsize / bd->bd_blksize);
+
+  assert(is_aligned(size, bd->bd_blksize));
+  return blkdev_transfer(bd, UIO_WRITE, first, (void *)data,
+                         size / bd->bd_blksize);
+}
+
+/*
+ * Device node interface. Neither offset nor length need to be aligned
+ * to device block size. Pieces of the request that are block aligned both
+ * on the device and in memory are transferred directly between caller's
+ * pages and the device. The rest goes through the buffer cache.
+ */
+
+/* Skip io vectors that have been entirely consumed. */
+static void blkdev_uio_advance(uio_t *uio) {
+  while (uio->uio_iovoff == uio->uio_iov->iov_len && uio->uio_iovcnt > 1) {
+    uio->uio_iov++;
+    uio->uio_iovcnt--;
+    uio->uio_iovoff = 0;
+  }
+}
+
+/* Memory address corresponding to current position of `uio`. */
+static vaddr_t blkdev_uio_addr(uio_t *uio) {
+  return (vaddr_t)uio->uio_iov->iov_base + uio->uio_iovoff;
+}
+
+/* Can the device and memory positions be block aligned at the same time? */
+static bool blkdev_direct_aligned(blkdev_t *bd, uio_t *uio) {
+  vaddr_t va = blkdev_uio_addr(uio);
+  return bd->bd_blksize <= PAGESIZE &&
+         is_aligned(va - uio->uio_offset, bd->bd_blksize);
+}
+
+/* Is there at least one block to be transferred directly? */
+static bool blkdev_direct_ok(blkdev_t *bd, uio_t *uio, uint64_t devsize) {
+  iovec_t *iov = uio->uio_iov;
+  size_t blksize = bd->bd_blksize;
+
+  return blkdev_direct_aligned(bd, uio) &&
+         is_aligned(uio->uio_offset, blksize) &&
+         min(iov->iov_len - uio->uio_iovoff, uio->uio_resid) >= blksize &&
+         devsize - uio->uio_offset >= blksize;
+}
+
+/* Transfer block aligned part of current io vector bypassing the cache.
+ * User pages are wired for the time of transfer and mapped into kernel
+ * virtual address space, so that the driver can access them directly. */
+static int blkdev_direct(blkdev_t *bd, uio_t *uio, uint64_t devsize) {
+  iovec_t *iov = uio->uio_iov;
+  vaddr_t va = blkdev_uio_addr(uio);
+  size_t offset = va & (PAGESIZE - 1);
+  vm_anon_t *anons[BLKDEV_DIRECT_PAGES];
+  vm_page_t *pages[BLKDEV_DIRECT_PAGES];
+  size_t npages = 0;
+  vaddr_t kva = 0;
+  int error;
+
+  size_t len = min(iov->iov_len - uio->uio_iovoff, uio->uio_resid);
+  len = min(len, devsize - uio->uio_offset);
+  len = min(len, BLKDEV_DIRECT_PAGES * PAGESIZE - offset);
+  len = rounddown(len, bd->bd_blksize);
+
+  /* Cached copies of the blocks must not be newer than the device contents,
+   * and they become stale when the device is written. */
+  uint64_t firstbuf = uio->uio_offset / bd->bd_bufsize;
+  uint64_t lastbuf = (uio->uio_offset + len - 1) / bd->bd_bufsize;
+  if ((error = bsync_range(bd, firstbuf, lastbuf, uio->uio_op == UIO_WRITE)))
+    return error;
+
+  void *data = (void *)va;
+
+  if (uio->uio_vmspace) {
+    /* Device read stores data into the pages. */
+    vm_prot_t access =
+      (uio->uio_op == UIO_READ) ? VM_PROT_WRITE : VM_PROT_READ;
+    size_t n = howmany(offset + len, PAGESIZE);
+
+    for (; npages < n; npages++) {
+      vaddr_t page = va - offset + npages * PAGESIZE;
+      if ((error = vm_map_loan(uio->uio_vmspace, page, access,
+                               &anons[npages])))
+        goto end;
+      pages[npages] = anons[npages]->page;
+    }
+
+    kva = kmem_map_pages(pages, npages);
+    data = (void *)(kva + offset);
+  }
+
+  error = blkdev_transfer(bd, uio->uio_op, uio->uio_offset / bd->bd_blksize,
+                          data, len / bd->bd_blksize);
+
+  /* The blocks could have been read into the cache again while the transfer
+   * was in progress, so drop them once it's finished. */
+  if (!error && uio->uio_op == UIO_WRITE)
+    error = bsync_range(bd, firstbuf, lastbuf, true);
+
+  if (!error) {
+    uio->uio_iovoff += len;
+    uio->uio_resid -= len;
+    uio->uio_offset += len;
+  }
+
+end:
+  if (kva)
+    kmem_unmap_pages(kva, npages);
+  for (size_t i = 0; i < npages; i++)
+    vm_anon_drop(anons[i]);
+  return error;
+}
+
+static int blkdev_uio(devnode_t *dev, uio_t *uio) {
+  blkdev_t *bd = dev->data;
+  uint64_t devsize = bd->bd_nblocks * bd->bd_blksize;
+  int error = 0;
+
+  if (uio->uio_offset < 0)
+    return EINVAL;
+
+  if ((uint64_t)uio->uio_offset >= devsize && uio->uio_resid > 0)
+    return (uio->uio_op == UIO_READ) ? 0 : ENOSPC;
+
+  while (uio->uio_resid > 0 && (uint64_t)uio->uio_offset < devsize) {
+    blkdev_uio_advance(uio);
+
+    if (blkdev_direct_ok(bd, uio, devsize)) {
+      if ((error = blkdev_direct(bd, uio, devsize)))
+        return error;
+      continue;
+    }
+
+    uint64_t blkno = uio->uio_offset / bd->bd_bufsize;
+    size_t bufsize = blkdev_bufsize(bd, blkno);
+    size_t offset = uio->uio_offset % bd->bd_bufsize;
+    size_t len = min(uio->uio_resid, bufsize - offset);
+    buf_t *bp;
+
+    /* Only the unaligned head of the request goes through the cache, the
+     * blocks following it can be transferred directly. */
+    if (blkdev_direct_aligned(bd, uio)) {
+      size_t head = bd->bd_blksize - uio->uio_offset % bd->bd_blksize;
+      len = min(len, head);
+    }
+
+    /* Whole buffer is going to be overwritten, so don't bother reading it. */
+    if (uio->uio_op == UIO_WRITE && len == bufsize) {
+      bp = getblk(bd, blkno);
+    } else if ((error = bread(bd, blkno, &bp))) {
+      return error;
+    }
+
+    error = uiomove(bp->b_data + offset, len, uio);
+
+    /* If the buffer was valid, then it's been (maybe partially) modified. */
+    if (uio->uio_op == UIO_WRITE && (!error || (bp->b_flags & B_VALID)))
+      bdwrite(bp);
+    else
+      brelse(bp);
+
+    if (error)
+      return error;
+  }
+
+  return 0;
+}
+
+static devops_t blkdev_devops = {
+  .d_type = DT_SEEKABLE,
+  .d_read = blkdev_uio,
+  .d_write = blkdev_uio,
+};
+
+int blkdev_register(blkdev_t *bd, const char *name) {
+  int error;
+
+  assert(powerof2(bd->bd_blksize));
+
+  bd->bd_bufsize = max(bd->bd_blksize, (size_t)BLKDEV_BUFSIZE);
+  bd->bd_lastblk = -1;
+  bd->bd_busy = false;
+  bd->bd_mounted = false;
+  mtx_init(&bd->bd_lock, 0);
+  cv_init(&bd->bd_cv, "block device");
+
+  if ((error = devfs_makedev_new(NULL, name, &blkdev_devops, bd, &bd->bd_node)))
+    return error;
+
+  uint64_t devsize = bd->bd_nblocks * bd->bd_blksize;
+  bd->bd_node->size = min(devsize, (uint64_t)(size_t)-1);
+
+  klog("Registered block device '%s' (%llu blocks of %u bytes)", name,
+       bd->bd_nblocks, bd->bd_blksize);
+  return 0;
+}
+
+int blkdev_unregister(blkdev_t *bd) {
+  WITH_MTX_LOCK (&bd->bd_lock)
+    if (bd->bd_mounted)
+      return EBUSY;
+
+  int error = binval(bd);
+
+  devfs_unlink_dev(bd->bd_node);
+  bd->bd_node = NULL;
+  cv_destroy(&bd->bd_cv);
+  mtx_destroy(&bd->bd_lock);
+  return error;
+}
+
+int blkdev_mount(blkdev_t *bd) {
+  SCOPED_MTX_LOCK(&bd->bd_lock);
+  if (bd->bd_mounted)
+    return EBUSY;
+  bd->bd_mounted = true;
+  return 0;
+}
+
+void blkdev_unmount(blkdev_t *bd) {
+  SCOPED_MTX_LOCK(&bd->bd_lock);
+  assert(bd->bd_mounted);
+  bd->bd_mounted = false;
+}
+
+blkdev_t *blkdev_of(vnode_t *vn) {
+  devnode_t *dev = devfs_devnode(vn);
+  if (dev == NULL || dev->ops != &blkdev_devops)
+    return NULL;
+  return dev->data;
+}
@@ -31,6 +31,17 @@ int cv_wait_timed(condvar_t *cv, mtx_t *m, systime_t timeout) {
   return status;
 }
 
+int cv_wait_timed_intr(condvar_t *cv, mtx_t *m, systime_t timeout) {
+  int status;
+  WITH_INTR_DISABLED {
+    cv->waiters++;
+    mtx_unlock(m);
+    status = sleepq_wait_timed_intr(cv, __caller(0), NULL, timeout);
+  }
+  _mtx_lock(m, __caller(0));
+  return status;
+}
+
 void cv_signal(condvar_t *cv) {
   SCOPED_NO_PREEMPTION();
   if (cv->waiters > 0) {
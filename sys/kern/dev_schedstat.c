@@ -0,0 +1,54 @@
+#include <sys/devfs.h>
+#include <sys/linker_set.h>
+#include <sys/malloc.h>
+#include <sys/mimiker.h>
+#include <sys/mutex.h>
+#include <sys/sched.h>
+#include <sys/schedstat.h>
+#include <sys/thread.h>
+#include <sys/uio.h>
+
+/* Implementation of /dev/schedstat
+ *
+ * Each read call takes a snapshot of scheduler statistics of the system and
+ * all existing threads, and returns it as an array of schedstat_t records.
+ * The first record describes the whole system. Use `schedlat` program to
+ * display the statistics in human readable form.
+ */
+
+static int dev_schedstat_read(devnode_t *dev, uio_t *uio) {
+  schedstat_t *buf;
+  thread_t *td;
+  size_t size;
+  int n = 1;
+
+  WITH_MTX_LOCK (&threads_lock) {
+    TAILQ_FOREACH (td, &all_threads, td_all)
+      n++;
+
+    size = n * sizeof(schedstat_t);
+    buf = kmalloc(M_TEMP, size, M_ZERO);
+
+    sched_getstats(NULL, &buf[0]);
+    n = 1;
+    TAILQ_FOREACH (td, &all_threads, td_all)
+      sched_getstats(td, &buf[n++]);
+  }
+
+  int error = 0;
+  if ((size_t)uio->uio_offset < size)
+    error = uiomove_frombuf(buf, size, uio);
+  kfree(M_TEMP, buf);
+  return error;
+}
+
+static devops_t dev_schedstat_ops = {
+  .d_type = DT_SEEKABLE,
+  .d_read = dev_schedstat_read,
+};
+
+static void init_dev_schedstat(void) {
+  devfs_makedev_new(NULL, "schedstat", &dev_schedstat_ops, NULL, NULL);
+}
+
+SET_ENTRY(devfs_init, init_dev_schedstat);
@@ -118,6 +118,9 @@ static int devfs_add_entry(devfs_node_t *parent, const char *name, int mode,
   if (devfs_find_child(parent, &COMPONENTNAME(name)))
     return EEXIST;
 
+  /* Forget that the name used not to exist. */
+  namecache_remove(parent->dn_vnode, &COMPONENTNAME(name));
+
   devfs_node_t *dn = devfs_node_create(name, mode);
   dn->dn_parent = parent;
   TAILQ_INSERT_TAIL(&parent->dn_children, dn, dn_link);
@@ -140,14 +143,19 @@ void devfs_free(devfs_node_t *dn) {
 
 static int devfs_fop_read(file_t *fp, uio_t *uio) {
   devnode_t *dev = fp->f_data;
+  bool seekable = dev->ops->d_type & DT_SEEKABLE;
+  bool positional = uio->uio_ioflags & IO_OFFSET;
   int err;
 
-  if (dev->ops->d_type & DT_SEEKABLE)
+  if (positional && !seekable)
+    return ESPIPE;
+
+  if (seekable && !positional)
     uio->uio_offset = fp->f_offset;
 
   err = dev->ops->d_read(dev, uio);
 
-  if (dev->ops->d_type & DT_SEEKABLE)
+  if (seekable && !positional)
     fp->f_offset = uio->uio_offset;
 
   return err;
@@ -155,14 +163,19 @@ static int devfs_fop_read(file_t *fp, uio_t *uio) {
 
 static int devfs_fop_write(file_t *fp, uio_t *uio) {
   devnode_t *dev = fp->f_data;
+  bool seekable = dev->ops->d_type & DT_SEEKABLE;
+  bool positional = uio->uio_ioflags & IO_OFFSET;
   int err;
 
-  if (dev->ops->d_type & DT_SEEKABLE)
+  if (positional && !seekable)
+    return ESPIPE;
+
+  if (seekable && !positional)
     uio->uio_offset = fp->f_offset;
 
   err = dev->ops->d_write(dev, uio);
 
-  if (dev->ops->d_type & DT_SEEKABLE)
+  if (seekable && !positional)
     fp->f_offset = uio->uio_offset;
 
   return err;
@@ -527,6 +540,12 @@ void *devfs_node_data(vnode_t *v) {
   return devfs_node_of(v)->dn_device.data;
 }
 
+devnode_t *devfs_devnode(vnode_t *v) {
+  if (v->v_ops != &devfs_dev_vnodeops)
+    return NULL;
+  return &devfs_node_of(v)->dn_device;
+}
+
 int devfs_makedir(devfs_node_t *parent, const char *name,
                   devfs_node_t **dir_p) {
   SCOPED_MTX_LOCK(&devfs.lock);
@@ -555,6 +574,12 @@ int devfs_unlink(devfs_node_t *dn) {
   TAILQ_REMOVE(&parent->dn_children, dn, dn_link);
   if (dn->dn_device.mode & S_IFDIR)
     parent->dn_nlinks--;
+  /* The vnode may outlive the node if it's still opened. */
+  namecache_purge(dn->dn_vnode);
   vnode_drop(dn->dn_vnode);
   return 0;
 }
+
+int devfs_unlink_dev(devnode_t *dev) {
+  return devfs_unlink(container_of(dev, devfs_node_t, dn_device));
+}
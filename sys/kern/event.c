@@ -1,17 +1,29 @@
+#include <sys/aio.h>
+#include <sys/callout.h>
 #include <sys/event.h>
 #include <sys/mimiker.h>
 #include <sys/libkern.h>
 #include <sys/file.h>
 #include <sys/filedesc.h>
+#include <sys/hash.h>
 #include <sys/condvar.h>
 #include <sys/errno.h>
 #include <sys/malloc.h>
 #include <sys/device.h>
 #include <sys/proc.h>
 #include <sys/pool.h>
+#include <sys/poll.h>
+#include <sys/select.h>
+#include <sys/signal.h>
+#include <sys/thread.h>
 #include <sys/time.h>
 
-#define KN_HASHSIZE 8
+#define KN_HASHSIZE_MIN 8    /* buckets embedded in kqueue */
+#define KN_HASHSIZE_MAX 1024 /* hash table doesn't grow beyond that */
+#define KN_HASHLOAD 2        /* grow hash table above that many knotes/bucket */
+
+/* Number of knotes preallocated for poll & select. */
+#define POLL_NKNOTES 8
 
 static POOL_DEFINE(P_KNOTE, "knote", sizeof(knote_t));
 
@@ -20,7 +32,9 @@ static void kqueue_drain(kqueue_t *kq);
 static void kqueue_destroy(kqueue_t *kq);
 
 static void knote_enqueue(knote_t *kn);
+static void knote_fire(knote_t *kn);
 static void knote_dequeue(knote_t *kn);
+static void knote_acquire(knote_t *kn);
 static void knote_drop(knote_t *kn);
 
 typedef TAILQ_HEAD(, knote) knote_tailq_t;
@@ -37,23 +51,72 @@ typedef struct kqueue {
   knote_tailq_t kq_head; /* list of pending events */
   mtx_t kq_lock;         /* mutex for queue access */
   condvar_t kq_cv;
-  knlist_t kq_knhash[KN_HASHSIZE]; /* hash table for knotes */
+  knlist_t *kq_knhash;   /* hash table for knotes */
+  unsigned kq_knmask;    /* number of hash buckets minus one */
+  unsigned kq_nknotes;   /* number of knotes in the hash table */
+  knlist_t kq_knsmall[KN_HASHSIZE_MIN]; /* initial hash table */
 } kqueue_t;
 
 /* Returns a hash bucket for a given object */
 static inline knlist_t *kq_get_hashbucket(kqueue_t *kq, void *obj) {
-  return &kq->kq_knhash[((uintptr_t)obj) % KN_HASHSIZE];
+  uint32_t hash = hash32_buf(&obj, sizeof(obj), HASH32_BUF_INIT);
+  return &kq->kq_knhash[hash & kq->kq_knmask];
 }
 
-static kqueue_t *kqueue_create(void) {
-  kqueue_t *kq = kmalloc(M_DEV, sizeof(kqueue_t), M_ZERO);
+static void kqueue_init(kqueue_t *kq) {
   mtx_init(&kq->kq_lock, 0);
   cv_init(&kq->kq_cv, 0);
 
   TAILQ_INIT(&kq->kq_head);
-  for (int i = 0; i < KN_HASHSIZE; i++)
-    SLIST_INIT(&kq->kq_knhash[i]);
+  for (int i = 0; i < KN_HASHSIZE_MIN; i++)
+    SLIST_INIT(&kq->kq_knsmall[i]);
+  kq->kq_knhash = kq->kq_knsmall;
+  kq->kq_knmask = KN_HASHSIZE_MIN - 1;
+  kq->kq_nknotes = 0;
+}
+
+/* Doubles the size of the hash table if it's getting crowded.
+ * Must be called without `kq_lock`, since it may sleep. */
+static void kqueue_grow(kqueue_t *kq) {
+  knlist_t *newhash, *oldhash;
+  unsigned size;
 
+  WITH_MTX_LOCK (&kq->kq_lock) {
+    size = kq->kq_knmask + 1;
+    if (kq->kq_nknotes < size * KN_HASHLOAD || size >= KN_HASHSIZE_MAX)
+      return;
+  }
+
+  newhash = kmalloc(M_DEV, 2 * size * sizeof(knlist_t), M_ZERO);
+
+  WITH_MTX_LOCK (&kq->kq_lock) {
+    /* Another thread could have grown the table while we were allocating
+     * memory, in such case the new table is not needed. */
+    if (kq->kq_knmask + 1 != size) {
+      oldhash = newhash;
+      break;
+    }
+
+    oldhash = kq->kq_knhash;
+    kq->kq_knhash = newhash;
+    kq->kq_knmask = 2 * size - 1;
+
+    for (unsigned i = 0; i < size; i++) {
+      knote_t *kn;
+      while ((kn = SLIST_FIRST(&oldhash[i]))) {
+        SLIST_REMOVE_HEAD(&oldhash[i], kn_hashlink);
+        SLIST_INSERT_HEAD(kq_get_hashbucket(kq, kn->kn_obj), kn, kn_hashlink);
+      }
+    }
+  }
+
+  if (oldhash != kq->kq_knsmall)
+    kfree(M_DEV, oldhash);
+}
+
+static kqueue_t *kqueue_create(void) {
+  kqueue_t *kq = kmalloc(M_DEV, sizeof(kqueue_t), M_ZERO);
+  kqueue_init(kq);
   return kq;
 }
 
@@ -61,22 +124,31 @@ static kqueue_t *kqueue_create(void) {
 static void kqueue_drain(kqueue_t *kq) {
   knote_t *kn;
 
-  for (int i = 0; i < KN_HASHSIZE; i++) {
+  for (unsigned i = 0; i <= kq->kq_knmask; i++) {
     while ((kn = SLIST_FIRST(&kq->kq_knhash[i])) != NULL) {
+      knote_acquire(kn);
       knote_drop(kn);
     }
   }
 }
 
-static void kqueue_destroy(kqueue_t *kq) {
+static void kqueue_fini(kqueue_t *kq) {
   kqueue_drain(kq);
+  if (kq->kq_knhash != kq->kq_knsmall)
+    kfree(M_DEV, kq->kq_knhash);
   cv_destroy(&kq->kq_cv);
   mtx_destroy(&kq->kq_lock);
+}
+
+static void kqueue_destroy(kqueue_t *kq) {
+  kqueue_fini(kq);
   kfree(M_DEV, kq);
 }
 
 static int filt_fileattach(knote_t *kn) {
   file_t *fp = kn->kn_obj;
+  if (fp->f_ops->fo_kqfilter == NULL)
+    return EOPNOTSUPP;
   return fp->f_ops->fo_kqfilter(fp, kn);
 }
 
@@ -87,9 +159,259 @@ static filterops_t file_filtops = {
   .filt_attach = filt_fileattach,
 };
 
+/* Objects that are always ready don't keep a list of knotes, so
+ * the knote only needs some lock to serve as its object lock. */
+static MTX_DEFINE(seltrue_lock, 0);
+
+static void filt_seltruedetach(knote_t *kn) {
+}
+
+static int filt_seltrueevent(knote_t *kn, long hint) {
+  return 1;
+}
+
+static filterops_t seltrue_filtops = {
+  .filt_detach = filt_seltruedetach,
+  .filt_event = filt_seltrueevent,
+};
+
+int seltrue_kqfilter(file_t *f, knote_t *kn) {
+  kn->kn_objlock = &seltrue_lock;
+  kn->kn_filtops = &seltrue_filtops;
+  return 0;
+}
+
+/*
+ * EVFILT_PROC and EVFILT_SIGNAL knotes are kept on `p_klist` of the process.
+ * Process knotes outlive the process, so they're protected by a global lock
+ * instead of `p_lock`.
+ */
+static MTX_DEFINE(proc_knote_lock, 0);
+
+static int filt_procevent(knote_t *kn, long hint);
+
+static int filt_procattach(knote_t *kn) {
+  pid_t pid = (pid_t)(uintptr_t)kn->kn_obj;
+  proc_t *p;
+
+  SCOPED_MTX_LOCK(&all_proc_mtx);
+
+  if (!(p = proc_find_any(pid)))
+    return ESRCH;
+
+  kn->kn_kevent.fflags = 0;
+  kn->kn_kevent.data = 0;
+  kn->kn_objlock = &proc_knote_lock;
+
+  WITH_MTX_LOCK (&proc_knote_lock) {
+    if (p->p_state == PS_ZOMBIE) {
+      /* NOTE_EXIT has already been posted, so report it right away. */
+      kn->kn_hook = NULL;
+      filt_procevent(kn, NOTE_EXIT | (p->p_exitstatus & NOTE_PDATAMASK));
+    } else {
+      kn->kn_hook = p;
+      SLIST_INSERT_HEAD(&p->p_klist, kn, kn_objlink);
+    }
+  }
+
+  proc_unlock(p);
+  return 0;
+}
+
+static void filt_procdetach(knote_t *kn) {
+  SCOPED_MTX_LOCK(&proc_knote_lock);
+
+  /* The process has already exited. */
+  proc_t *p = kn->kn_hook;
+  if (p == NULL)
+    return;
+
+  SLIST_REMOVE(&p->p_klist, kn, knote, kn_objlink);
+}
+
+static int filt_procevent(knote_t *kn, long hint) {
+  uint32_t event = hint & NOTE_PCTRLMASK;
+
+  if (event & kn->kn_sfflags) {
+    kn->kn_kevent.fflags |= event;
+    /* Child's PID for NOTE_FORK and wait status for NOTE_EXIT. */
+    if (event & (NOTE_FORK | NOTE_EXIT))
+      kn->kn_kevent.data = hint & NOTE_PDATAMASK;
+  }
+
+  /* The process is gone, so report the event once and forget about it. */
+  if (event & NOTE_EXIT)
+    kn->kn_kevent.flags |= EV_EOF | EV_ONESHOT;
+
+  return kn->kn_kevent.fflags != 0;
+}
+
+static filterops_t proc_filtops = {
+  .filt_attach = filt_procattach,
+  .filt_detach = filt_procdetach,
+  .filt_event = filt_procevent,
+};
+
+/* Counts signals sent to the process that registered the knote, including
+ * the ignored ones. Always behaves as if EV_CLEAR was set. */
+static int filt_sigattach(knote_t *kn) {
+  proc_t *p = proc_self();
+
+  kn->kn_kevent.flags |= EV_CLEAR;
+  kn->kn_kevent.fflags = 0;
+  kn->kn_kevent.data = 0;
+  kn->kn_hook = p;
+  kn->kn_objlock = &proc_knote_lock;
+
+  WITH_PROC_LOCK(p) {
+    WITH_MTX_LOCK (&proc_knote_lock) {
+      SLIST_INSERT_HEAD(&p->p_klist, kn, kn_objlink);
+    }
+  }
+
+  return 0;
+}
+
+static int filt_sigevent(knote_t *kn, long hint) {
+  if ((hint & NOTE_SIGNAL) &&
+      (uintptr_t)(hint & NOTE_PDATAMASK) == kn->kn_kevent.ident)
+    kn->kn_kevent.data++;
+
+  return kn->kn_kevent.data != 0;
+}
+
+static filterops_t sig_filtops = {
+  .filt_attach = filt_sigattach,
+  .filt_detach = filt_procdetach,
+  .filt_event = filt_sigevent,
+};
+
+void proc_knote(proc_t *p, long hint) {
+  SCOPED_MTX_LOCK(&proc_knote_lock);
+  knote(&p->p_klist, hint);
+}
+
+void proc_knote_exit(proc_t *p) {
+  knote_t *kn;
+
+  SCOPED_MTX_LOCK(&proc_knote_lock);
+
+  knote(&p->p_klist, NOTE_EXIT | (p->p_exitstatus & NOTE_PDATAMASK));
+
+  while ((kn = SLIST_FIRST(&p->p_klist))) {
+    SLIST_REMOVE_HEAD(&p->p_klist, kn_objlink);
+    kn->kn_hook = NULL;
+  }
+}
+
+/*
+ * EVFILT_TIMER knotes are backed by callouts. `data` of the reported event is
+ * the number of expirations since the event was last reported. A timer is
+ * periodic unless EV_ONESHOT is set.
+ */
+static MTX_DEFINE(timer_knote_lock, 0);
+
+typedef struct kntimer {
+  callout_t kt_callout;
+  systime_t kt_period; /* (!) in ticks */
+} kntimer_t;
+
+static POOL_DEFINE(P_KNTIMER, "knote timer", sizeof(kntimer_t));
+
+static void filt_timerexpire(void *arg) {
+  knote_t *kn = arg;
+  kntimer_t *kt = kn->kn_hook;
+
+  SCOPED_MTX_LOCK(&timer_knote_lock);
+
+  kn->kn_kevent.data++;
+  WITH_MTX_LOCK (&kn->kn_kq->kq_lock) {
+    knote_fire(kn);
+  }
+
+  if (!(kn->kn_kevent.flags & EV_ONESHOT))
+    callout_reschedule(&kt->kt_callout,
+                       kt->kt_callout.c_time + kt->kt_period);
+}
+
+/* Converts timer period to ticks. */
+static int timer_period(knote_t *kn, systime_t *ticksp) {
+  int64_t data = kn->kn_sdata;
+  timespec_t ts;
+
+  if (data < 0)
+    return EINVAL;
+
+  switch (kn->kn_sfflags & NOTE_TIMER_UNITMASK) {
+    case NOTE_SECONDS:
+      ts = (timespec_t){.tv_sec = data};
+      break;
+    case NOTE_MSECONDS:
+      ts = (timespec_t){.tv_sec = data / 1000,
+                        .tv_nsec = data % 1000 * 1000000};
+      break;
+    case NOTE_USECONDS:
+      ts = (timespec_t){.tv_sec = data / 1000000,
+                        .tv_nsec = data % 1000000 * 1000};
+      break;
+    default: /* NOTE_NSECONDS */
+      ts = (timespec_t){.tv_sec = data / 1000000000,
+                        .tv_nsec = data % 1000000000};
+      break;
+  }
+
+  /* Timer must not fire more often than once per tick. */
+  *ticksp = max(ts2hz(&ts), (systime_t)1);
+  return 0;
+}
+
+static int filt_timerattach(knote_t *kn) {
+  systime_t period;
+  int error;
+
+  if ((error = timer_period(kn, &period)))
+    return error;
+
+  kntimer_t *kt = pool_alloc(P_KNTIMER, M_ZERO);
+  kt->kt_period = period;
+  callout_setup(&kt->kt_callout, filt_timerexpire, kn);
+
+  kn->kn_kevent.flags |= EV_CLEAR;
+  kn->kn_kevent.fflags = 0;
+  kn->kn_kevent.data = 0;
+  kn->kn_hook = kt;
+  kn->kn_objlock = &timer_knote_lock;
+
+  callout_schedule(&kt->kt_callout, period);
+  return 0;
+}
+
+static void filt_timerdetach(knote_t *kn) {
+  kntimer_t *kt = kn->kn_hook;
+
+  if (!callout_stop(&kt->kt_callout))
+    callout_drain(&kt->kt_callout);
+
+  pool_free(P_KNTIMER, kt);
+}
+
+static int filt_timerevent(knote_t *kn, long hint) {
+  return kn->kn_kevent.data != 0;
+}
+
+static filterops_t timer_filtops = {
+  .filt_attach = filt_timerattach,
+  .filt_detach = filt_timerdetach,
+  .filt_event = filt_timerevent,
+};
+
 static filterops_t *sys_kfilters[EVFILT_SYSCOUNT] = {
   [EVFILT_READ] = &file_filtops,
   [EVFILT_WRITE] = &file_filtops,
+  [EVFILT_AIO] = &aio_filtops,
+  [EVFILT_PROC] = &proc_filtops,
+  [EVFILT_SIGNAL] = &sig_filtops,
+  [EVFILT_TIMER] = &timer_filtops,
 };
 
 static filterops_t *filt_getops(uint32_t filter) {
@@ -136,9 +458,22 @@ static fileops_t kqueueops = {
 };
 
 static int kqueue_get_obj(proc_t *p, kevent_t *kev, void **obj) {
-  if (kev->filter == EVFILT_READ || kev->filter == EVFILT_WRITE)
+  if (kev->filter == EVFILT_READ)
     return fdtab_get_file(p->p_fdtable, kev->ident, FF_READ, (file_t **)obj);
+  if (kev->filter == EVFILT_WRITE)
+    return fdtab_get_file(p->p_fdtable, kev->ident, FF_WRITE, (file_t **)obj);
+
+  /* Remaining filters use the identifier to tell knotes apart. */
+  *obj = (void *)kev->ident;
 
+  if (kev->filter == EVFILT_PROC)
+    return ((pid_t)kev->ident > 0) ? 0 : ESRCH;
+  if (kev->filter == EVFILT_SIGNAL)
+    return (kev->ident > 0 && kev->ident < NSIG) ? 0 : EINVAL;
+  if (kev->filter == EVFILT_TIMER)
+    return 0;
+
+  /* EVFILT_AIO knotes are attached only by aio requests. */
   return EINVAL;
 }
 
@@ -149,26 +484,142 @@ static void knote_drop_obj(knote_t *kn) {
     file_drop(kn->kn_obj);
 }
 
+/* Makes the knote unreachable through the kqueue, so that nobody else finds
+ * it, and prevents it from being queued again.
+ *
+ * `kq_lock` must be held.
+ */
+static void knote_unhash(knote_t *kn) {
+  kqueue_t *kq = kn->kn_kq;
+  assert(mtx_owned(&kq->kq_lock));
+  assert(!(kn->kn_status & KN_SCANNING));
+
+  SLIST_REMOVE(kq_get_hashbucket(kq, kn->kn_obj), kn, knote, kn_hashlink);
+  kq->kq_nknotes--;
+  if (kn->kn_status & KN_QUEUED)
+    knote_dequeue(kn);
+  kn->kn_status |= KN_DROPPING;
+}
+
+/* Frees the knote that has been unhashed and detached from the object. */
+static void knote_free(knote_t *kn) {
+  knote_drop_obj(kn);
+  if (!(kn->kn_status & KN_TRANSIENT))
+    pool_free(P_KNOTE, kn);
+}
+
 /* Drops an already detached knote. */
 static void knote_drop_detached(knote_t *kn) {
+  WITH_MTX_LOCK (&kn->kn_kq->kq_lock)
+    knote_unhash(kn);
+  knote_free(kn);
+}
+
+/* Waits until no other thread uses the knote and marks it as in-flux.
+ * The knote must not go away in the meantime. */
+static void knote_acquire(knote_t *kn) {
   kqueue_t *kq = kn->kn_kq;
-  knlist_t *knote_list = kq_get_hashbucket(kq, kn->kn_obj);
-  SLIST_REMOVE(knote_list, kn, knote, kn_hashlink);
 
-  WITH_MTX_LOCK (&kq->kq_lock) {
-    if (kn->kn_status & KN_QUEUED) {
-      knote_dequeue(kn);
-    }
-  }
+  SCOPED_MTX_LOCK(&kq->kq_lock);
 
-  knote_drop_obj(kn);
-  pool_free(P_KNOTE, kn);
+  while (kn->kn_status & (KN_SCANNING | KN_INFLUX))
+    cv_wait(&kq->kq_cv, &kq->kq_lock);
+  kn->kn_status |= KN_INFLUX;
 }
 
-/* Detaches the knote from the object and then removes it. */
+/* Lets other threads use the knote marked as in-flux. */
+static void knote_release(knote_t *kn) {
+  kqueue_t *kq = kn->kn_kq;
+
+  SCOPED_MTX_LOCK(&kq->kq_lock);
+
+  kn->kn_status &= ~KN_INFLUX;
+  cv_broadcast(&kq->kq_cv);
+}
+
+/* Removes the knote and detaches it from the object. The knote must be marked
+ * as in-flux by the caller, unless it's transient. */
 static void knote_drop(knote_t *kn) {
+  WITH_MTX_LOCK (&kn->kn_kq->kq_lock)
+    knote_unhash(kn);
   kn->kn_filtops->filt_detach(kn);
-  knote_drop_detached(kn);
+  knote_free(kn);
+}
+
+/* Inserts an initialized knote into the kqueue and attaches it to the object.
+ * On failure the knote is dropped. */
+static int knote_attach(kqueue_t *kq, knote_t *kn) {
+  int error;
+
+  kqueue_grow(kq);
+
+  kn->kn_kq = kq;
+  WITH_MTX_LOCK (&kq->kq_lock) {
+    SLIST_INSERT_HEAD(kq_get_hashbucket(kq, kn->kn_obj), kn, kn_hashlink);
+    kq->kq_nknotes++;
+  }
+
+  if ((error = kn->kn_filtops->filt_attach(kn))) {
+    knote_drop_detached(kn);
+    return error;
+  }
+
+  return 0;
+}
+
+/* Marks the event as triggered and queues it unless it's disabled.
+ *
+ * `kq_lock` must be held.
+ */
+static void knote_fire(knote_t *kn) {
+  assert(mtx_owned(&kn->kn_kq->kq_lock));
+
+  /* The knote is going away, but it hasn't been detached yet. */
+  if (kn->kn_status & KN_DROPPING)
+    return;
+
+  kn->kn_status |= KN_ACTIVE;
+  if ((kn->kn_status & (KN_QUEUED | KN_DISABLED)) == 0)
+    knote_enqueue(kn);
+}
+
+/* Checks if the event has already been triggered and queues it if so. */
+static void knote_activate(knote_t *kn) {
+  kqueue_t *kq = kn->kn_kq;
+  int event;
+
+  WITH_MTX_LOCK (kn->kn_objlock) {
+    event = kn->kn_filtops->filt_event(kn, 0);
+    WITH_MTX_LOCK (&kq->kq_lock) {
+      if (event)
+        knote_fire(kn);
+    }
+  }
+}
+
+/* Finds a knote for a given filter and object and marks it as in-flux.
+ * Release the knote with `knote_release` or drop it with `knote_drop`. */
+static knote_t *knote_lookup(kqueue_t *kq, uint32_t filter, void *obj) {
+  knote_t *kn;
+
+  SCOPED_MTX_LOCK(&kq->kq_lock);
+
+retry:
+  SLIST_FOREACH(kn, kq_get_hashbucket(kq, obj), kn_hashlink) {
+    if (filter != kn->kn_kevent.filter || kn->kn_obj != obj)
+      continue;
+
+    /* The knote may be gone once we wake up, so look it up again. */
+    if (kn->kn_status & (KN_SCANNING | KN_INFLUX)) {
+      cv_wait(&kq->kq_cv, &kq->kq_lock);
+      goto retry;
+    }
+
+    kn->kn_status |= KN_INFLUX;
+    return kn;
+  }
+
+  return NULL;
 }
 
 /* Modifies the knote based on the flags in the kevent (or creates
@@ -185,11 +636,7 @@ static int kqueue_register(kqueue_t *kq, kevent_t *kev, void *obj) {
     return EINVAL;
 
   /* Find an existing knote to use for this kevent. */
-  knlist_t *knote_list = kq_get_hashbucket(kq, obj);
-  SLIST_FOREACH(kn, knote_list, kn_hashlink) {
-    if (kev->filter == kn->kn_kevent.filter && kn->kn_obj == obj)
-      break;
-  }
+  kn = knote_lookup(kq, kev->filter, obj);
 
   /* There isn't the matching knote. Create a new one. */
   if (kn == NULL) {
@@ -198,17 +645,16 @@ static int kqueue_register(kqueue_t *kq, kevent_t *kev, void *obj) {
       return ENOENT;
 
     kn = pool_alloc(P_KNOTE, M_ZERO);
-    kn->kn_kq = kq;
+    kn->kn_status = KN_INFLUX;
     kn->kn_kevent = *kev;
+    kn->kn_kevent.flags &= EV_ONESHOT | EV_CLEAR | EV_DISPATCH;
+    kn->kn_sfflags = kev->fflags;
+    kn->kn_sdata = kev->data;
     kn->kn_obj = obj;
     kn->kn_filtops = filtops;
 
-    SLIST_INSERT_HEAD(knote_list, kn, kn_hashlink);
-
-    if ((error = kn->kn_filtops->filt_attach(kn)) != 0) {
-      knote_drop_detached(kn);
+    if ((error = knote_attach(kq, kn)))
       return error;
-    }
   }
 
   if (kev->flags & EV_DELETE) {
@@ -230,14 +676,65 @@ static int kqueue_register(kqueue_t *kq, kevent_t *kev, void *obj) {
 
     event = kn->kn_filtops->filt_event(kn, 0);
     WITH_MTX_LOCK (&kq->kq_lock) {
-      if (event && (kn->kn_status & KN_QUEUED) == 0)
-        knote_enqueue(kn);
+      if (kev->flags & EV_DISABLE) {
+        kn->kn_status |= KN_DISABLED;
+        if (kn->kn_status & KN_QUEUED)
+          knote_dequeue(kn);
+      } else if (kev->flags & EV_ENABLE) {
+        kn->kn_status &= ~KN_DISABLED;
+      }
+
+      if (event)
+        knote_fire(kn);
     }
   }
 
+  knote_release(kn);
   return 0;
 }
 
+/* Number of knotes checked in `kqueue_scan` without taking `kq_lock`. */
+#define KQ_SCAN_BATCH 32
+
+/* Checks events of knotes taken from pending list and copies those still
+ * active to `eventlist`. Knotes which turned out to be inactive are moved to
+ * `stale` list. Consecutive knotes sharing the object lock are checked under
+ * single acquisition of that lock.
+ */
+static size_t kqueue_scan_batch(knote_tailq_t *batch, knote_tailq_t *stale,
+                                kevent_t *eventlist) {
+  mtx_t *objlock = NULL;
+  knote_t *kn, *next;
+  size_t count = 0;
+
+  TAILQ_FOREACH_SAFE (kn, batch, kn_penlink, next) {
+    if (kn->kn_objlock != objlock) {
+      if (objlock)
+        mtx_unlock(objlock);
+      objlock = kn->kn_objlock;
+      mtx_lock(objlock);
+    }
+
+    if (!kn->kn_filtops->filt_event(kn, 0)) {
+      TAILQ_REMOVE(batch, kn, kn_penlink);
+      TAILQ_INSERT_TAIL(stale, kn, kn_penlink);
+      continue;
+    }
+
+    eventlist[count++] = kn->kn_kevent;
+
+    if (kn->kn_kevent.flags & EV_CLEAR) {
+      kn->kn_kevent.data = 0;
+      kn->kn_kevent.fflags = 0;
+    }
+  }
+
+  if (objlock)
+    mtx_unlock(objlock);
+
+  return count;
+}
+
 /* Scans for events triggered in a given kqueue. Returns at most `nevents`
  * events via `eventlist`. If there are no events available, blocks for at
  * most `tsp`. If `tsp` is null, blocks infinitely. If the timeout is not
@@ -245,13 +742,14 @@ static int kqueue_register(kqueue_t *kq, kevent_t *kev, void *obj) {
  */
 static int kqueue_scan(kqueue_t *kq, kevent_t *eventlist, size_t nevents,
                        timespec_t *tsp, int *retval) {
-  int error, event, timeout;
+  int error, timeout;
   size_t count = 0;
   systime_t sleepts;
-  knote_tailq_t knqueue;
+  knote_tailq_t requeue, batch, stale, dropped;
   knote_t *kn;
 
-  TAILQ_INIT(&knqueue);
+  TAILQ_INIT(&requeue);
+  TAILQ_INIT(&dropped);
 
   if (tsp) {
     timeout = ts2hz(tsp);
@@ -264,66 +762,121 @@ static int kqueue_scan(kqueue_t *kq, kevent_t *eventlist, size_t nevents,
 
   mtx_lock(&kq->kq_lock);
 
+retry:
   /* Block until there are no events or we time out. */
   while (kq->kq_count == 0) {
-    if (timeout < 0) {
-      error = 0;
+    if (timeout < 0)
       goto done;
-    }
 
-    error = cv_wait_timed(&kq->kq_cv, &kq->kq_lock, timeout);
+    error = cv_wait_timed_intr(&kq->kq_cv, &kq->kq_lock, timeout);
     if (error == EINTR) {
       mtx_unlock(&kq->kq_lock);
       return EINTR;
     }
 
-    if (tsp)
+    if (tsp) {
       timeout = sleepts - getsystime();
+      if (timeout <= 0)
+        timeout = -1; /* timed out, don't wait forever */
+    }
   }
 
-  /* To ensure the correctness of the iteration over pending events,
-   * we need to move already processed knotes to another list. `kq_head`
-   * can change in between iterations, because we are releasing the lock
-   * for a moment.
+  /* Pending knotes are taken off `kq_head` in batches, and then `kq_lock` is
+   * released to call `filt_event`, since `kn_objlock` must be taken before
+   * `kq_lock`. Knotes that remain active are moved to `requeue` list, so that
+   * each of them is reported at most once by a single scan. An event can
+   * fire while `kq_lock` is released - `KN_ACTIVE` tells us about that.
+   * Knotes taken off the queue are marked with `KN_SCANNING`, so that other
+   * threads wait for us before they modify or drop them.
    */
 
-  while (count < nevents) {
-    assert(mtx_owned(&kq->kq_lock));
+  while (count < nevents && !TAILQ_EMPTY(&kq->kq_head)) {
+    size_t n = min(nevents - count, (size_t)KQ_SCAN_BATCH);
 
-    if (TAILQ_EMPTY(&kq->kq_head))
-      break;
+    TAILQ_INIT(&batch);
+    TAILQ_INIT(&stale);
 
-    kn = TAILQ_FIRST(&kq->kq_head);
-    TAILQ_REMOVE(&kq->kq_head, kn, kn_penlink);
+    while (n > 0 && (kn = TAILQ_FIRST(&kq->kq_head))) {
+      /* Let `kqueue_register` finish with the knote first. */
+      if (kn->kn_status & KN_INFLUX) {
+        if (!TAILQ_EMPTY(&batch))
+          break;
+        cv_wait(&kq->kq_cv, &kq->kq_lock);
+        continue;
+      }
+      TAILQ_REMOVE(&kq->kq_head, kn, kn_penlink);
+      TAILQ_INSERT_TAIL(&batch, kn, kn_penlink);
+      kn->kn_status &= ~KN_ACTIVE;
+      kn->kn_status |= KN_SCANNING;
+      n--;
+    }
 
-    /* To call `filt_event` we need to lock `kn_objlock`, but firstly
-     * we need to release `kq_lock` since holding it would violate the locking
-     * order. `kn_objlock` must be taken before `kq_lock`.
-     */
     mtx_unlock(&kq->kq_lock);
-    WITH_MTX_LOCK (kn->kn_objlock) {
-      event = kn->kn_filtops->filt_event(kn, 0);
-    }
+    count += kqueue_scan_batch(&batch, &stale, &eventlist[count]);
     mtx_lock(&kq->kq_lock);
 
-    /* Make sure that the event is still active. */
-    if (event == 0) {
-      kn->kn_status &= ~KN_QUEUED;
-      kq->kq_count--;
-      continue;
+    /* Wake up threads waiting for knotes we've been checking. */
+    cv_broadcast(&kq->kq_cv);
+
+    /* Inactive knotes leave the queue unless they fired in the meantime. */
+    while ((kn = TAILQ_FIRST(&stale))) {
+      TAILQ_REMOVE(&stale, kn, kn_penlink);
+      kn->kn_status &= ~KN_SCANNING;
+      if ((kn->kn_status & (KN_ACTIVE | KN_DISABLED)) == KN_ACTIVE) {
+        TAILQ_INSERT_TAIL(&requeue, kn, kn_penlink);
+      } else {
+        kn->kn_status &= ~KN_QUEUED;
+        kq->kq_count--;
+      }
     }
 
-    TAILQ_INSERT_HEAD(&knqueue, kn, kn_penlink);
+    while ((kn = TAILQ_FIRST(&batch))) {
+      TAILQ_REMOVE(&batch, kn, kn_penlink);
+      kn->kn_status &= ~KN_SCANNING;
+      uint32_t flags = kn->kn_kevent.flags;
+
+      /* Disabled knotes can't be queued again by `knote`. */
+      if (flags & (EV_ONESHOT | EV_DISPATCH))
+        kn->kn_status |= KN_DISABLED;
+
+      /* Level-triggered knotes stay on the queue, while edge-triggered ones
+       * only if they fired again since they were taken off the queue. */
+      if (!(flags & (EV_ONESHOT | EV_CLEAR | EV_DISPATCH)) ||
+          ((flags & EV_CLEAR) && (kn->kn_status & KN_ACTIVE))) {
+        if (!(kn->kn_status & KN_DISABLED)) {
+          TAILQ_INSERT_TAIL(&requeue, kn, kn_penlink);
+          continue;
+        }
+      }
 
-    eventlist[count++] = kn->kn_kevent;
+      kn->kn_status &= ~KN_QUEUED;
+      kq->kq_count--;
+
+      /* Nobody can find the knote once `kq_lock` is released. */
+      if (flags & EV_ONESHOT) {
+        knote_unhash(kn);
+        TAILQ_INSERT_TAIL(&dropped, kn, kn_penlink);
+      }
+    }
   }
 
-  TAILQ_CONCAT(&kq->kq_head, &knqueue, kn_penlink);
+  TAILQ_CONCAT(&kq->kq_head, &requeue, kn_penlink);
+
+  /* All events turned out to be stale, so wait for new ones. */
+  if (count == 0 && nevents > 0)
+    goto retry;
 
 done:
   mtx_unlock(&kq->kq_lock);
-  *retval = count;
 
+  /* One-shot knotes are dropped after they have been reported. */
+  while ((kn = TAILQ_FIRST(&dropped))) {
+    TAILQ_REMOVE(&dropped, kn, kn_penlink);
+    kn->kn_filtops->filt_detach(kn);
+    knote_free(kn);
+  }
+
+  *retval = count;
   return 0;
 }
 
@@ -359,6 +912,12 @@ static int kevent(proc_t *p, kqueue_t *kq, kevent_t *changelist,
     return 0;
   }
 
+  /* Nothing to wait for if the caller only wanted to make changes. */
+  if (nevents == 0) {
+    *retval = 0;
+    return 0;
+  }
+
   /* Second, scan for triggered events. */
   return kqueue_scan(kq, eventlist, nevents, timeout, retval);
 }
@@ -385,6 +944,25 @@ int do_kqueue1(proc_t *p, int flags, int *fd) {
   return error;
 }
 
+int kqueue_attach(proc_t *p, int kqfd, kevent_t *kev, void *obj) {
+  file_t *f;
+  int error;
+
+  if ((error = fdtab_get_file(p->p_fdtable, kqfd, 0, &f)))
+    return error;
+
+  if (f->f_type != FT_KQUEUE) {
+    file_drop(f);
+    return EBADF;
+  }
+
+  kev->flags = EV_ADD;
+  error = kqueue_register(f->f_data, kev, obj);
+  file_drop(f);
+
+  return error;
+}
+
 /* The entry point of kevent(2) syscall. */
 int do_kevent(proc_t *p, int kq, kevent_t *changelist, size_t nchanges,
               kevent_t *eventlist, size_t nevents, timespec_t *timeout,
@@ -407,6 +985,230 @@ int do_kevent(proc_t *p, int kq, kevent_t *changelist, size_t nchanges,
   return error;
 }
 
+/*
+ * poll(2) and select(2) are built on the same knotes as kevent(2), but they
+ * use a transient kqueue that lives on the stack of the calling thread.
+ * Knotes are kept on the stack too, unless there are too many of them.
+ */
+
+/* Number of knotes needed to poll given descriptors. */
+static size_t poll_nknotes(struct pollfd *fds, nfds_t nfds) {
+  size_t n = 0;
+
+  for (nfds_t i = 0; i < nfds; i++) {
+    if (fds[i].fd < 0)
+      continue;
+    if (fds[i].events & (POLLIN | POLLRDNORM))
+      n++;
+    if (fds[i].events & (POLLOUT | POLLWRNORM))
+      n++;
+  }
+
+  return n;
+}
+
+/* Attaches transient knote monitoring file `f` to the kqueue. */
+static int poll_attach(kqueue_t *kq, knote_t *kn, file_t *f, uint32_t filter,
+                       nfds_t i) {
+  int error;
+
+  bzero(kn, sizeof(knote_t));
+  kn->kn_kevent.filter = filter;
+  kn->kn_kevent.udata = (void *)(uintptr_t)i;
+  kn->kn_obj = f;
+  kn->kn_filtops = &file_filtops;
+  kn->kn_status = KN_TRANSIENT;
+
+  file_hold(f);
+  if ((error = knote_attach(kq, kn)))
+    return error;
+
+  knote_activate(kn);
+  return 0;
+}
+
+/* Installs signal mask for the duration of the call. If the call is
+ * interrupted, the old mask is set back after returning from signal handler,
+ * just like with sigsuspend(2). */
+static void poll_setmask(proc_t *p, const sigset_t *mask) {
+  thread_t *td = thread_self();
+
+  td->td_oldsigmask = td->td_sigmask;
+  td->td_pflags |= TDP_OLDSIGMASK;
+
+  WITH_PROC_LOCK(p) {
+    do_sigprocmask(SIG_SETMASK, mask, NULL);
+  }
+}
+
+static void poll_restoremask(proc_t *p, int error) {
+  thread_t *td = thread_self();
+
+  if (error == EINTR || !(td->td_pflags & TDP_OLDSIGMASK))
+    return;
+
+  td->td_pflags &= ~TDP_OLDSIGMASK;
+
+  WITH_PROC_LOCK(p) {
+    do_sigprocmask(SIG_SETMASK, &td->td_oldsigmask, NULL);
+  }
+}
+
+/* Kernel stack is too small to hold the kqueue and knotes of poll & select,
+ * so they come from a pool. Only calls watching many descriptors need extra
+ * memory for knotes and events. */
+typedef struct poll_state {
+  kqueue_t ps_kq;
+  knote_t ps_knotes[POLL_NKNOTES];
+  kevent_t ps_events[POLL_NKNOTES];
+} poll_state_t;
+
+static POOL_DEFINE(P_POLL, "poll", sizeof(poll_state_t));
+
+int do_poll(proc_t *p, struct pollfd *fds, nfds_t nfds, timespec_t *tsp,
+            const sigset_t *mask, int *retval) {
+  poll_state_t *ps = pool_alloc(P_POLL, 0);
+  kqueue_t *kq = &ps->ps_kq;
+  knote_t *knotes = ps->ps_knotes;
+  kevent_t *events = ps->ps_events;
+  timespec_t nowait = {0, 0};
+  size_t nknotes = 0;
+  int nready = 0, nevents;
+  int error;
+
+  size_t n = poll_nknotes(fds, nfds);
+  if (n > POLL_NKNOTES) {
+    knotes = kmalloc(M_TEMP, n * sizeof(knote_t), M_WAITOK);
+    events = kmalloc(M_TEMP, n * sizeof(kevent_t), M_WAITOK);
+  }
+
+  kqueue_init(kq);
+
+  for (nfds_t i = 0; i < nfds; i++) {
+    struct pollfd *pfd = &fds[i];
+    file_t *f;
+
+    pfd->revents = 0;
+    if (pfd->fd < 0)
+      continue;
+
+    if (fdtab_get_file(p->p_fdtable, pfd->fd, 0, &f)) {
+      pfd->revents = POLLNVAL;
+      nready++;
+      continue;
+    }
+
+    if (pfd->events & (POLLIN | POLLRDNORM)) {
+      if (poll_attach(kq, &knotes[nknotes++], f, EVFILT_READ, i))
+        pfd->revents |= POLLERR;
+    }
+    if (pfd->events & (POLLOUT | POLLWRNORM)) {
+      if (poll_attach(kq, &knotes[nknotes++], f, EVFILT_WRITE, i))
+        pfd->revents |= POLLERR;
+    }
+
+    file_drop(f);
+
+    if (pfd->revents)
+      nready++;
+  }
+
+  if (mask)
+    poll_setmask(p, mask);
+
+  /* Don't block if some descriptors are already known to be in error. */
+  error = kqueue_scan(kq, events, nknotes, nready ? &nowait : tsp, &nevents);
+
+  if (mask)
+    poll_restoremask(p, error);
+
+  if (!error) {
+    for (int i = 0; i < nevents; i++) {
+      struct pollfd *pfd = &fds[(uintptr_t)events[i].udata];
+      short revents = pfd->revents;
+
+      if (events[i].filter == EVFILT_READ)
+        pfd->revents |= pfd->events & (POLLIN | POLLRDNORM);
+      else
+        pfd->revents |= pfd->events & (POLLOUT | POLLWRNORM);
+
+      if (revents == 0)
+        nready++;
+    }
+    *retval = nready;
+  }
+
+  kqueue_fini(kq);
+
+  if (knotes != ps->ps_knotes) {
+    kfree(M_TEMP, knotes);
+    kfree(M_TEMP, events);
+  }
+
+  pool_free(P_POLL, ps);
+  return error;
+}
+
+int do_pselect(proc_t *p, int nfds, fd_set *readfds, fd_set *writefds,
+               fd_set *exceptfds, timespec_t *tsp, const sigset_t *mask,
+               int *retval) {
+  struct pollfd *fds = NULL;
+  nfds_t n = 0;
+  int error;
+
+  for (int fd = 0; fd < nfds; fd++) {
+    if ((readfds && FD_ISSET(fd, readfds)) ||
+        (writefds && FD_ISSET(fd, writefds)))
+      n++;
+  }
+
+  if (n > 0)
+    fds = kmalloc(M_TEMP, n * sizeof(struct pollfd), M_WAITOK);
+
+  n = 0;
+  for (int fd = 0; fd < nfds; fd++) {
+    short events = 0;
+    if (readfds && FD_ISSET(fd, readfds))
+      events |= POLLIN;
+    if (writefds && FD_ISSET(fd, writefds))
+      events |= POLLOUT;
+    if (events)
+      fds[n++] = (struct pollfd){.fd = fd, .events = events};
+  }
+
+  if ((error = do_poll(p, fds, n, tsp, mask, retval)))
+    goto end;
+
+  /* Exceptional conditions are not supported. */
+  if (readfds)
+    FD_ZERO(readfds);
+  if (writefds)
+    FD_ZERO(writefds);
+  if (exceptfds)
+    FD_ZERO(exceptfds);
+
+  int nready = 0;
+  for (nfds_t i = 0; i < n; i++) {
+    if (fds[i].revents & POLLNVAL) {
+      error = EBADF;
+      goto end;
+    }
+    if (readfds && (fds[i].revents & (POLLIN | POLLERR))) {
+      FD_SET(fds[i].fd, readfds);
+      nready++;
+    }
+    if (writefds && (fds[i].revents & (POLLOUT | POLLERR))) {
+      FD_SET(fds[i].fd, writefds);
+      nready++;
+    }
+  }
+  *retval = nready;
+
+end:
+  kfree(M_TEMP, fds);
+  return error;
+}
+
 /*
  * Queue a new event for knote.
  *
@@ -431,6 +1233,7 @@ static void knote_enqueue(knote_t *kn) {
 static void knote_dequeue(knote_t *kn) {
   kqueue_t *kq = kn->kn_kq;
   assert(mtx_owned(&kq->kq_lock));
+  assert(!(kn->kn_status & KN_SCANNING));
 
   TAILQ_REMOVE(&kq->kq_head, kn, kn_penlink);
   kn->kn_status &= ~KN_QUEUED;
@@ -444,11 +1247,19 @@ void knote(knlist_t *list, long hint) {
     assert(mtx_owned(kn->kn_objlock));
 
     if (kn->kn_filtops->filt_event(kn, hint)) {
-      SCOPED_MTX_LOCK(&kn->kn_kq->kq_lock);
-      if (kn->kn_status & KN_QUEUED)
-        continue;
-
-      knote_enqueue(kn);
+      WITH_MTX_LOCK (&kn->kn_kq->kq_lock) {
+        knote_fire(kn);
+      }
     }
   }
 }
+
+void knlist_clear(knlist_t *list) {
+  knote_t *kn;
+
+  /* `filt_detach` removes the knote from the list. */
+  while ((kn = SLIST_FIRST(list))) {
+    knote_acquire(kn);
+    knote_drop(kn);
+  }
+}
@@ -0,0 +1,192 @@
+#define KL_LOG KL_FILE
+#include <sys/klog.h>
+#include <sys/condvar.h>
+#include <sys/errno.h>
+#include <sys/event.h>
+#include <sys/eventfd.h>
+#include <sys/file.h>
+#include <sys/filedesc.h>
+#include <sys/libkern.h>
+#include <sys/mutex.h>
+#include <sys/pool.h>
+#include <sys/proc.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* Event counter is much cheaper than a pipe used as a doorbell: it needs no
+ * buffer and each notification is a single addition. */
+typedef struct efd {
+  mtx_t efd_lock;      /* protects all other fields */
+  eventfd_t efd_count; /* current value of the counter */
+  bool efd_semaphore;  /* each read takes one unit only */
+  condvar_t efd_cv;    /* counter has changed */
+  knlist_t efd_knotes; /* knotes attached to the counter */
+} efd_t;
+
+static POOL_DEFINE(P_EVENTFD, "eventfd", sizeof(efd_t));
+
+static int efd_read(file_t *f, uio_t *uio) {
+  efd_t *efd = f->f_data;
+  eventfd_t value;
+  int error;
+
+  if (uio->uio_resid < sizeof(eventfd_t))
+    return EINVAL;
+
+  SCOPED_MTX_LOCK(&efd->efd_lock);
+
+  while (efd->efd_count == 0) {
+    if (f->f_flags & IO_NONBLOCK)
+      return EAGAIN;
+    if (cv_wait_intr(&efd->efd_cv, &efd->efd_lock))
+      return ERESTARTSYS;
+  }
+
+  value = efd->efd_semaphore ? 1 : efd->efd_count;
+  if ((error = uiomove(&value, sizeof(eventfd_t), uio)))
+    return error;
+
+  efd->efd_count -= value;
+  cv_broadcast(&efd->efd_cv);
+  knote(&efd->efd_knotes, 0);
+  return 0;
+}
+
+static int efd_write(file_t *f, uio_t *uio) {
+  efd_t *efd = f->f_data;
+  eventfd_t value;
+  int error;
+
+  if (uio->uio_resid < sizeof(eventfd_t))
+    return EINVAL;
+
+  if ((error = uiomove(&value, sizeof(eventfd_t), uio)))
+    return error;
+
+  if (value > EVENTFD_MAX)
+    return EINVAL;
+
+  SCOPED_MTX_LOCK(&efd->efd_lock);
+
+  while (EVENTFD_MAX - efd->efd_count < value) {
+    if (f->f_flags & IO_NONBLOCK)
+      return EAGAIN;
+    if (cv_wait_intr(&efd->efd_cv, &efd->efd_lock))
+      return ERESTARTSYS;
+  }
+
+  if (value > 0) {
+    efd->efd_count += value;
+    cv_broadcast(&efd->efd_cv);
+    knote(&efd->efd_knotes, 0);
+  }
+  return 0;
+}
+
+static int efd_close(file_t *f) {
+  pool_free(P_EVENTFD, f->f_data);
+  return 0;
+}
+
+static int efd_stat(file_t *f, stat_t *sb) {
+  memset(sb, 0, sizeof(stat_t));
+  sb->st_mode = S_IRUSR | S_IWUSR;
+  return 0;
+}
+
+static int efd_ioctl(file_t *f, u_long cmd, void *data) {
+  return EOPNOTSUPP;
+}
+
+static void efd_kq_detach(knote_t *kn) {
+  efd_t *efd = kn->kn_hook;
+
+  WITH_MTX_LOCK (&efd->efd_lock)
+    SLIST_REMOVE(&efd->efd_knotes, kn, knote, kn_objlink);
+}
+
+static int efd_kq_read(knote_t *kn, long hint) {
+  efd_t *efd = kn->kn_hook;
+  assert(mtx_owned(&efd->efd_lock));
+
+  kn->kn_kevent.data = efd->efd_count;
+  return efd->efd_count > 0;
+}
+
+static int efd_kq_write(knote_t *kn, long hint) {
+  efd_t *efd = kn->kn_hook;
+  assert(mtx_owned(&efd->efd_lock));
+
+  kn->kn_kevent.data = EVENTFD_MAX - efd->efd_count;
+  return efd->efd_count < EVENTFD_MAX;
+}
+
+static filterops_t efd_read_filterops = {
+  .filt_detach = efd_kq_detach,
+  .filt_event = efd_kq_read,
+};
+
+static filterops_t efd_write_filterops = {
+  .filt_detach = efd_kq_detach,
+  .filt_event = efd_kq_write,
+};
+
+static int efd_kqfilter(file_t *f, knote_t *kn) {
+  efd_t *efd = f->f_data;
+
+  if (kn->kn_kevent.filter == EVFILT_READ)
+    kn->kn_filtops = &efd_read_filterops;
+  else if (kn->kn_kevent.filter == EVFILT_WRITE)
+    kn->kn_filtops = &efd_write_filterops;
+  else
+    return EINVAL;
+
+  kn->kn_hook = efd;
+  kn->kn_objlock = &efd->efd_lock;
+
+  WITH_MTX_LOCK (&efd->efd_lock)
+    SLIST_INSERT_HEAD(&efd->efd_knotes, kn, kn_objlink);
+
+  return 0;
+}
+
+static fileops_t eventfdops = {
+  .fo_read = efd_read,
+  .fo_write = efd_write,
+  .fo_close = efd_close,
+  .fo_seek = noseek,
+  .fo_stat = efd_stat,
+  .fo_ioctl = efd_ioctl,
+  .fo_kqfilter = efd_kqfilter,
+};
+
+int do_eventfd(proc_t *p, unsigned initval, int flags, int *fdp) {
+  int error;
+
+  if (flags & ~(EFD_SEMAPHORE | EFD_CLOEXEC | EFD_NONBLOCK))
+    return EINVAL;
+
+  efd_t *efd = pool_alloc(P_EVENTFD, M_ZERO);
+  mtx_init(&efd->efd_lock, 0);
+  efd->efd_count = initval;
+  efd->efd_semaphore = flags & EFD_SEMAPHORE;
+  cv_init(&efd->efd_cv, "eventfd");
+  SLIST_INIT(&efd->efd_knotes);
+
+  file_t *f = file_alloc();
+  f->f_data = efd;
+  f->f_ops = &eventfdops;
+  f->f_type = FT_EVENTFD;
+  f->f_flags = FF_READ | FF_WRITE;
+  if (flags & EFD_NONBLOCK)
+    f->f_flags |= IO_NONBLOCK;
+
+  if ((error = fdtab_install_file(p->p_fdtable, f, 0, fdp))) {
+    file_destroy(f);
+    return error;
+  }
+
+  if ((error = fd_set_cloexec(p->p_fdtable, *fdp, flags & EFD_CLOEXEC)))
+    fdtab_close_fd(p->p_fdtable, *fdp);
+  return error;
+}
@@ -17,6 +17,7 @@
 #include <sys/malloc.h>
 #include <sys/signal.h>
 #include <sys/stat.h>
+#include <sys/aio.h>
 
 typedef int (*copy_ptr_t)(exec_args_t *args, char *const *ptr_p);
 typedef int (*copy_str_t)(exec_args_t *args, const char *str, size_t *copied_p);
@@ -261,7 +262,7 @@ static void enter_new_vmspace(proc_t *p, exec_vmspace_t *saved,
   saved->sbrk = p->p_sbrk;
   saved->sbrk_end = p->p_sbrk_end;
 
-  /* We are the only live thread in this process.
+  /* We are the only live thread in this process (see `proc_single_thread`).
    * We can safely give it a new uspace. */
   p->p_uspace = vm_map_new();
 
@@ -343,9 +344,8 @@ static char *pargs_create(exec_args_t *args) {
   return pargs;
 }
 
-/* XXX We assume process may only have a single thread. But if there were more
- * than one thread in the process that called exec, all other threads must be
- * forcefully terminated. */
+/* If there is more than one thread in the process that called exec, all other
+ * threads are forcefully terminated before the address space is replaced. */
 static int _do_execve(exec_args_t *args) {
   thread_t *td = thread_self();
   proc_t *p = td->td_proc;
@@ -390,6 +390,13 @@ static int _do_execve(exec_args_t *args) {
   if ((error = exec_elf_inspect(vn, &eh)))
     return error;
 
+  /* XXX Other threads cannot be brought back if exec fails from now on. */
+  WITH_PROC_LOCK(p) {
+    error = proc_single_thread(p);
+  }
+  if (error)
+    return error;
+
   /* We can not destroy the current vm_map, because exec can still fail.
    * Is such case we must be able to return to the original address space. */
   exec_vmspace_t saved;
@@ -406,6 +413,7 @@ static int _do_execve(exec_args_t *args) {
   kfree(M_STR, p->p_args);
   p->p_args = pargs_create(args);
 
+  aio_proc_drain(p);
   fdtab_onexec(p->p_fdtable);
 
   /* Set up user context. */
@@ -421,6 +429,8 @@ static int _do_execve(exec_args_t *args) {
       cred_exec_setid(p, uid, gid);
   }
 
+  proc_knote(p, NOTE_EXEC);
+
   /* At this point we are certain that exec succeeds.  We can safely destroy the
    * previous vm_map, and permanently assign this one to the current process. */
   destroy_vmspace(&saved);
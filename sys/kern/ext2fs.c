@@ -0,0 +1,1587 @@
+#define KL_LOG KL_FILESYS
+#include <sys/klog.h>
+#include <sys/blkdev.h>
+#include <sys/buf.h>
+#include <sys/cred.h>
+#include <sys/dirent.h>
+#include <sys/endian.h>
+#include <sys/errno.h>
+#include <sys/ext2fs.h>
+#include <sys/libkern.h>
+#include <sys/malloc.h>
+#include <sys/mimiker.h>
+#include <sys/mount.h>
+#include <sys/mutex.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <sys/unistd.h>
+#include <sys/vfs.h>
+#include <sys/vnode.h>
+
+/*
+ * Second extended filesystem. All disk accesses go through the buffer cache.
+ * Filesystem blocks may be smaller than buffer cache blocks, so a single
+ * buffer may contain a few filesystem blocks. Hence at most one buffer is
+ * held at any time, otherwise a thread could wait for a buffer it owns.
+ *
+ * In-core inodes are kept in a hash table as long as there is a vnode that
+ * refers to them. Modified inodes, bitmaps, group descriptors and the
+ * superblock are written back to their buffers immediately as delayed writes.
+ *
+ * Each operation is performed with the filesystem lock held, so there's no
+ * need for finer-grained locking.
+ */
+
+static_assert(_BYTE_ORDER == _LITTLE_ENDIAN,
+              "ext2fs on-disk structures are accessed without byte swapping!");
+static_assert(sizeof(ext2_superblock_t) == 1024, "Bad size of superblock!");
+static_assert(sizeof(ext2_gd_t) == 32, "Bad size of group descriptor!");
+static_assert(sizeof(ext2_dinode_t) == EXT2_GOOD_OLD_INODE_SIZE,
+              "Bad size of inode!");
+
+#define EXT2_INCOMPAT_SUPP EXT2F_INCOMPAT_FILETYPE
+#define EXT2_ROCOMPAT_SUPP                                                     \
+  (EXT2F_ROCOMPAT_SPARSESUPER | EXT2F_ROCOMPAT_LARGEFILE)
+
+static KMALLOC_DEFINE(M_EXT2, "ext2fs");
+
+typedef struct ext2_node ext2_node_t;
+
+/* Fields marked with (!) are constant after the filesystem is mounted.
+ * Other fields are protected by em_lock, which is taken only to allocate or
+ * free blocks and inodes. */
+typedef struct ext2_mount {
+  mtx_t em_lock;           /* guards allocation bitmaps and free counters */
+  blkdev_t *em_dev;        /* (!) device the filesystem resides on */
+  ext2_superblock_t em_sb; /* in-core copy of the superblock */
+  ext2_gd_t *em_gd;        /* in-core copy of group descriptors table */
+  uint32_t em_bsize;       /* (!) block size in bytes */
+  uint32_t em_ngroups;     /* (!) number of block groups */
+  uint32_t em_nindir;      /* (!) number of pointers in an indirect block */
+  uint32_t em_inodesize;   /* (!) size of on-disk inode */
+  uint32_t em_gdblock;     /* (!) first block of group descriptors table */
+  bool em_filetype;        /* (!) directory entries contain file type */
+  bool em_rdonly;          /* (!) uses features unsupported for writing */
+} ext2_mount_t;
+
+/* In-core inode. There is exactly one per vnode, since vnodes of ext2 are
+ * looked up by inode number in the vnode cache. The inode, as well as file
+ * blocks it points to, is protected by the vnode lock held by the caller of
+ * vnode operations. */
+struct ext2_node {
+  uint32_t en_ino;     /* (!) inode number */
+  ext2_dinode_t en_di; /* copy of on-disk inode */
+};
+
+static vnodeops_t ext2_vnodeops;
+
+static inline ext2_mount_t *ext2_mount_of(vnode_t *v) {
+  return v->v_mount->mnt_data;
+}
+
+static inline ext2_node_t *ext2_node_of(vnode_t *v) {
+  return v->v_data;
+}
+
+static uint32_t ext2_now(void) {
+  return nanotime().tv_sec;
+}
+
+/* Zeroes returned when reading holes in sparse files. */
+static char ext2_zeroes[1024];
+
+/*
+ * Block and metadata access.
+ */
+
+/* Get buffer that contains filesystem block `blkno`. */
+static int ext2_bread(ext2_mount_t *em, uint32_t blkno, buf_t **bpp,
+                      void **datap) {
+  blkdev_t *bd = em->em_dev;
+  int error;
+
+  if (blkno >= em->em_sb.s_blocks_count) {
+    klog("ext2: block %u is out of filesystem bounds!", blkno);
+    return EIO;
+  }
+
+  uint64_t offset = (uint64_t)blkno * em->em_bsize;
+  if ((error = bread(bd, offset / bd->bd_bufsize, bpp)))
+    return error;
+  *datap = (*bpp)->b_data + offset % bd->bd_bufsize;
+  return 0;
+}
+
+static int ext2_get_ptr(ext2_mount_t *em, uint32_t blkno, uint32_t idx,
+                        uint32_t *ptrp) {
+  uint32_t *ptrs;
+  buf_t *bp;
+  int error;
+
+  if ((error = ext2_bread(em, blkno, &bp, (void **)&ptrs)))
+    return error;
+  *ptrp = ptrs[idx];
+  brelse(bp);
+  return 0;
+}
+
+static int ext2_set_ptr(ext2_mount_t *em, uint32_t blkno, uint32_t idx,
+                        uint32_t ptr) {
+  uint32_t *ptrs;
+  buf_t *bp;
+  int error;
+
+  if ((error = ext2_bread(em, blkno, &bp, (void **)&ptrs)))
+    return error;
+  ptrs[idx] = ptr;
+  bdwrite(bp);
+  return 0;
+}
+
+/* Superblock always resides in the first buffer of the device. */
+static void ext2_sb_write(ext2_mount_t *em) {
+  buf_t *bp;
+
+  if (bread(em->em_dev, 0, &bp)) {
+    klog("ext2: failed to write back superblock!");
+    return;
+  }
+  em->em_sb.s_wtime = ext2_now();
+  memcpy(bp->b_data + EXT2_SBLOCK_OFF, &em->em_sb, sizeof(ext2_superblock_t));
+  bdwrite(bp);
+}
+
+static void ext2_gd_write(ext2_mount_t *em, uint32_t group) {
+  uint32_t offset = group * sizeof(ext2_gd_t);
+  void *data;
+  buf_t *bp;
+
+  if (ext2_bread(em, em->em_gdblock + offset / em->em_bsize, &bp, &data)) {
+    klog("ext2: failed to write back group %u descriptor!", group);
+    return;
+  }
+  memcpy(data + offset % em->em_bsize, &em->em_gd[group], sizeof(ext2_gd_t));
+  bdwrite(bp);
+}
+
+static int ext2_inode_get(ext2_mount_t *em, uint32_t ino, buf_t **bpp,
+                          ext2_dinode_t **dip) {
+  uint32_t group = (ino - 1) / em->em_sb.s_inodes_per_group;
+  uint32_t index = (ino - 1) % em->em_sb.s_inodes_per_group;
+  uint32_t offset = index * em->em_inodesize;
+  uint32_t blkno = em->em_gd[group].bg_inode_table + offset / em->em_bsize;
+  void *data;
+  int error;
+
+  if ((error = ext2_bread(em, blkno, bpp, &data)))
+    return error;
+  *dip = data + offset % em->em_bsize;
+  return 0;
+}
+
+static int ext2_inode_read(ext2_mount_t *em, ext2_node_t *node) {
+  ext2_dinode_t *di;
+  buf_t *bp;
+  int error;
+
+  if ((error = ext2_inode_get(em, node->en_ino, &bp, &di)))
+    return error;
+  memcpy(&node->en_di, di, sizeof(ext2_dinode_t));
+  brelse(bp);
+  return 0;
+}
+
+static int ext2_inode_write(ext2_mount_t *em, ext2_node_t *node) {
+  ext2_dinode_t *di;
+  buf_t *bp;
+  int error;
+
+  if ((error = ext2_inode_get(em, node->en_ino, &bp, &di)))
+    return error;
+  memcpy(di, &node->en_di, sizeof(ext2_dinode_t));
+  bdwrite(bp);
+  return 0;
+}
+
+/*
+ * Block and inode allocation.
+ */
+
+/* Find a clear bit among first `nbits` of bitmap stored in block `blkno`
+ * and set it. Returns -1 in *bitp if there are no clear bits. */
+static int ext2_bitmap_alloc(ext2_mount_t *em, uint32_t blkno, uint32_t nbits,
+                             int *bitp) {
+  uint8_t *bm;
+  buf_t *bp;
+  int error;
+
+  if ((error = ext2_bread(em, blkno, &bp, (void **)&bm)))
+    return error;
+
+  for (uint32_t i = 0; i < nbits; i++) {
+    if (bm[i / 8] == 0xff) {
+      i |= 7;
+      continue;
+    }
+    if (!(bm[i / 8] & (1 << (i % 8)))) {
+      bm[i / 8] |= 1 << (i % 8);
+      bdwrite(bp);
+      *bitp = i;
+      return 0;
+    }
+  }
+
+  brelse(bp);
+  *bitp = -1;
+  return 0;
+}
+
+static int ext2_bitmap_free(ext2_mount_t *em, uint32_t blkno, uint32_t bit) {
+  uint8_t *bm;
+  buf_t *bp;
+  int error;
+
+  if ((error = ext2_bread(em, blkno, &bp, (void **)&bm)))
+    return error;
+
+  if (!(bm[bit / 8] & (1 << (bit % 8))))
+    klog("ext2: freeing free item %u in bitmap block %u!", bit, blkno);
+  bm[bit / 8] &= ~(1 << (bit % 8));
+  bdwrite(bp);
+  return 0;
+}
+
+/* Find a free block and mark it as used. Blocks are taken from the group
+ * the inode belongs to, unless the group is full. */
+static int ext2_bfind(ext2_mount_t *em, ext2_node_t *node, uint32_t *blkp) {
+  ext2_superblock_t *sb = &em->em_sb;
+  uint32_t goal = (node->en_ino - 1) / sb->s_inodes_per_group;
+  int error;
+
+  assert(mtx_owned(&em->em_lock));
+
+  if (sb->s_free_blocks_count == 0)
+    return ENOSPC;
+
+  for (uint32_t i = 0; i < em->em_ngroups; i++) {
+    uint32_t group = (goal + i) % em->em_ngroups;
+    ext2_gd_t *gd = &em->em_gd[group];
+
+    if (gd->bg_free_blocks_count == 0)
+      continue;
+
+    uint32_t first = sb->s_first_data_block + group * sb->s_blocks_per_group;
+    uint32_t nbits = min(sb->s_blocks_per_group, sb->s_blocks_count - first);
+    int bit;
+
+    if ((error = ext2_bitmap_alloc(em, gd->bg_block_bitmap, nbits, &bit)))
+      return error;
+    if (bit < 0)
+      continue;
+
+    gd->bg_free_blocks_count--;
+    sb->s_free_blocks_count--;
+    ext2_gd_write(em, group);
+    ext2_sb_write(em);
+
+    *blkp = first + bit;
+    return 0;
+  }
+
+  return ENOSPC;
+}
+
+/* Allocate a zeroed block for file described by `node`. */
+static int ext2_balloc(ext2_mount_t *em, ext2_node_t *node, uint32_t *blkp) {
+  uint32_t blkno;
+  void *data;
+  buf_t *bp;
+  int error;
+
+  WITH_MTX_LOCK (&em->em_lock)
+    error = ext2_bfind(em, node, &blkno);
+  if (error)
+    return error;
+
+  /* The block is not reachable from any file yet, so it's ours. */
+  if ((error = ext2_bread(em, blkno, &bp, &data)))
+    return error;
+  bzero(data, em->em_bsize);
+  bdwrite(bp);
+
+  node->en_di.i_blocks += em->em_bsize / EXT2_SECTOR_SIZE;
+  *blkp = blkno;
+  return 0;
+}
+
+static void ext2_bfree(ext2_mount_t *em, ext2_node_t *node, uint32_t blkno) {
+  ext2_superblock_t *sb = &em->em_sb;
+  uint32_t group = (blkno - sb->s_first_data_block) / sb->s_blocks_per_group;
+  uint32_t bit = (blkno - sb->s_first_data_block) % sb->s_blocks_per_group;
+  ext2_gd_t *gd = &em->em_gd[group];
+
+  SCOPED_MTX_LOCK(&em->em_lock);
+
+  if (ext2_bitmap_free(em, gd->bg_block_bitmap, bit))
+    return;
+
+  gd->bg_free_blocks_count++;
+  sb->s_free_blocks_count++;
+  ext2_gd_write(em, group);
+  ext2_sb_write(em);
+
+  node->en_di.i_blocks -= em->em_bsize / EXT2_SECTOR_SIZE;
+}
+
+/* Allocate an inode preferably in the same group as directory `dnode`. */
+static int ext2_ialloc(ext2_mount_t *em, ext2_node_t *dnode, bool isdir,
+                       uint32_t *inop) {
+  ext2_superblock_t *sb = &em->em_sb;
+  uint32_t goal = (dnode->en_ino - 1) / sb->s_inodes_per_group;
+  int error;
+
+  SCOPED_MTX_LOCK(&em->em_lock);
+
+  if (sb->s_free_inodes_count == 0)
+    return ENOSPC;
+
+  for (uint32_t i = 0; i < em->em_ngroups; i++) {
+    uint32_t group = (goal + i) % em->em_ngroups;
+    ext2_gd_t *gd = &em->em_gd[group];
+    int bit;
+
+    if (gd->bg_free_inodes_count == 0)
+      continue;
+
+    if ((error = ext2_bitmap_alloc(em, gd->bg_inode_bitmap,
+                                   sb->s_inodes_per_group, &bit)))
+      return error;
+    if (bit < 0)
+      continue;
+
+    gd->bg_free_inodes_count--;
+    sb->s_free_inodes_count--;
+    if (isdir)
+      gd->bg_used_dirs_count++;
+    ext2_gd_write(em, group);
+    ext2_sb_write(em);
+
+    *inop = group * sb->s_inodes_per_group + bit + 1;
+    return 0;
+  }
+
+  return ENOSPC;
+}
+
+static void ext2_ifree(ext2_mount_t *em, uint32_t ino, bool isdir) {
+  ext2_superblock_t *sb = &em->em_sb;
+  uint32_t group = (ino - 1) / sb->s_inodes_per_group;
+  uint32_t bit = (ino - 1) % sb->s_inodes_per_group;
+  ext2_gd_t *gd = &em->em_gd[group];
+
+  SCOPED_MTX_LOCK(&em->em_lock);
+
+  if (ext2_bitmap_free(em, gd->bg_inode_bitmap, bit))
+    return;
+
+  gd->bg_free_inodes_count++;
+  sb->s_free_inodes_count++;
+  if (isdir)
+    gd->bg_used_dirs_count--;
+  ext2_gd_write(em, group);
+  ext2_sb_write(em);
+}
+
+/*
+ * File block mapping.
+ */
+
+/* Number of file blocks mapped by a single pointer in an indirect block of
+ * given level. Level 0 indirect block points directly at data blocks. */
+static uint64_t ext2_span(ext2_mount_t *em, int level) {
+  uint64_t span = 1;
+  while (level-- > 0)
+    span *= em->em_nindir;
+  return span;
+}
+
+/* Translate file block `lbn` into filesystem block. If `alloc` is set, then
+ * missing data and indirect blocks are allocated, otherwise 0 is returned in
+ * *blknop for holes. */
+static int ext2_bmap(ext2_mount_t *em, ext2_node_t *node, uint32_t lbn,
+                     bool alloc, uint32_t *blknop) {
+  ext2_dinode_t *di = &node->en_di;
+  uint32_t *blkp;
+  int level, error = 0;
+
+  *blknop = 0;
+
+  if (lbn < EXT2_NDADDR) {
+    blkp = &di->i_block[lbn];
+    level = -1;
+  } else {
+    uint64_t n = lbn - EXT2_NDADDR;
+    for (level = 0; level < EXT2_NIADDR; level++) {
+      uint64_t span = ext2_span(em, level + 1);
+      if (n < span)
+        break;
+      n -= span;
+    }
+    if (level == EXT2_NIADDR)
+      return EFBIG;
+    blkp = &di->i_block[EXT2_NDADDR + level];
+    lbn = n;
+  }
+
+  uint32_t blkno = *blkp;
+  bool dirty = false;
+
+  if (blkno == 0) {
+    if (!alloc)
+      return 0;
+    if ((error = ext2_balloc(em, node, &blkno)))
+      return error;
+    *blkp = blkno;
+    dirty = true;
+  }
+
+  /* Walk down the indirect blocks. */
+  for (; level >= 0; level--) {
+    uint64_t span = ext2_span(em, level);
+    uint32_t idx = lbn / span;
+    uint32_t next;
+
+    lbn %= span;
+
+    if ((error = ext2_get_ptr(em, blkno, idx, &next)))
+      break;
+
+    if (next == 0) {
+      if (!alloc)
+        break;
+      if ((error = ext2_balloc(em, node, &next)))
+        break;
+      if ((error = ext2_set_ptr(em, blkno, idx, next)))
+        break;
+      dirty = true;
+    }
+
+    blkno = next;
+  }
+
+  if (level < 0)
+    *blknop = blkno;
+
+  if (dirty)
+    ext2_inode_write(em, node);
+
+  return error;
+}
+
+/* Free blocks that map file blocks starting from `first` in a tree rooted at
+ * indirect block *blkp of given level, which maps file blocks starting from
+ * `base`. The indirect block itself is freed if it becomes unused. */
+static void ext2_free_indir(ext2_mount_t *em, ext2_node_t *node,
+                            uint32_t *blkp, int level, uint64_t base,
+                            uint64_t first) {
+  uint64_t span = ext2_span(em, level);
+
+  if (*blkp == 0 || first >= base + span * em->em_nindir)
+    return;
+
+  for (uint32_t i = 0; i < em->em_nindir; i++) {
+    uint64_t cbase = base + i * span;
+    uint32_t child;
+
+    if (cbase + span <= first)
+      continue;
+    if (ext2_get_ptr(em, *blkp, i, &child) || child == 0)
+      continue;
+
+    if (level > 0) {
+      ext2_free_indir(em, node, &child, level - 1, cbase, first);
+      if (child != 0)
+        continue;
+    } else {
+      ext2_bfree(em, node, child);
+    }
+
+    /* No need to update the pointer if the whole block is going away. */
+    if (first > base)
+      ext2_set_ptr(em, *blkp, i, 0);
+  }
+
+  if (first <= base) {
+    ext2_bfree(em, node, *blkp);
+    *blkp = 0;
+  }
+}
+
+/* Symbolic links with short targets store them in place of block pointers. */
+static bool ext2_is_fastlink(ext2_mount_t *em, ext2_node_t *node) {
+  ext2_dinode_t *di = &node->en_di;
+  uint32_t aclblks = di->i_file_acl ? em->em_bsize / EXT2_SECTOR_SIZE : 0;
+  return S_ISLNK(di->i_mode) && di->i_size < EXT2_MAXSYMLINKLEN &&
+         di->i_blocks == aclblks;
+}
+
+static int ext2_truncate(ext2_mount_t *em, ext2_node_t *node, uint32_t size) {
+  ext2_dinode_t *di = &node->en_di;
+  uint32_t bsize = em->em_bsize;
+  int error;
+
+  if (ext2_is_fastlink(em, node)) {
+    bzero(di->i_block, sizeof(di->i_block));
+  } else if (size < di->i_size) {
+    uint64_t first = howmany(size, bsize);
+
+    for (uint32_t i = first; i < EXT2_NDADDR; i++) {
+      if (di->i_block[i]) {
+        ext2_bfree(em, node, di->i_block[i]);
+        di->i_block[i] = 0;
+      }
+    }
+
+    uint64_t base = EXT2_NDADDR;
+    for (int level = 0; level < EXT2_NIADDR; level++) {
+      ext2_free_indir(em, node, &di->i_block[EXT2_NDADDR + level], level, base,
+                      first);
+      base += ext2_span(em, level + 1);
+    }
+
+    /* Clear the tail of last block, so that the file can be extended
+     * without exposing stale data. */
+    if (size % bsize) {
+      uint32_t blkno;
+      void *data;
+      buf_t *bp;
+
+      if ((error = ext2_bmap(em, node, size / bsize, false, &blkno)))
+        return error;
+      if (blkno) {
+        if ((error = ext2_bread(em, blkno, &bp, &data)))
+          return error;
+        bzero(data + size % bsize, bsize - size % bsize);
+        bdwrite(bp);
+      }
+    }
+  }
+
+  di->i_size = size;
+  di->i_mtime = di->i_ctime = ext2_now();
+  return ext2_inode_write(em, node);
+}
+
+/*
+ * Reading and writing file contents.
+ */
+
+static int ext2_read(ext2_mount_t *em, ext2_node_t *node, uio_t *uio) {
+  uint32_t bsize = em->em_bsize;
+  uint32_t size = node->en_di.i_size;
+  int error = 0;
+
+  while (!error && uio->uio_resid > 0 && (size_t)uio->uio_offset < size) {
+    uint32_t lbn = uio->uio_offset / bsize;
+    uint32_t blkoff = uio->uio_offset % bsize;
+    size_t len = min(bsize - blkoff, size - uio->uio_offset);
+    uint32_t blkno;
+    void *data;
+    buf_t *bp;
+
+    len = min(len, uio->uio_resid);
+
+    if ((error = ext2_bmap(em, node, lbn, false, &blkno)))
+      break;
+
+    if (blkno == 0) {
+      error = uiomove(ext2_zeroes, min(len, sizeof(ext2_zeroes)), uio);
+      continue;
+    }
+
+    if ((error = ext2_bread(em, blkno, &bp, &data)))
+      break;
+    error = uiomove(data + blkoff, len, uio);
+    brelse(bp);
+  }
+
+  return error;
+}
+
+static int ext2_write(ext2_mount_t *em, ext2_node_t *node, uio_t *uio) {
+  ext2_dinode_t *di = &node->en_di;
+  uint32_t bsize = em->em_bsize;
+  int error = 0;
+
+  if (uio->uio_ioflags & IO_APPEND)
+    uio->uio_offset = di->i_size;
+
+  if (uio->uio_offset + uio->uio_resid > UINT32_MAX)
+    return EFBIG;
+
+  while (!error && uio->uio_resid > 0) {
+    uint32_t lbn = uio->uio_offset / bsize;
+    uint32_t blkoff = uio->uio_offset % bsize;
+    size_t len = min(bsize - blkoff, uio->uio_resid);
+    uint32_t blkno;
+    void *data;
+    buf_t *bp;
+
+    if ((error = ext2_bmap(em, node, lbn, true, &blkno)))
+      break;
+    if ((error = ext2_bread(em, blkno, &bp, &data)))
+      break;
+    /* The buffer may be modified even if uiomove fails. */
+    error = uiomove(data + blkoff, len, uio);
+    bdwrite(bp);
+
+    if ((size_t)uio->uio_offset > di->i_size)
+      di->i_size = uio->uio_offset;
+  }
+
+  di->i_mtime = di->i_ctime = ext2_now();
+  ext2_inode_write(em, node);
+  return error;
+}
+
+/*
+ * Directory operations.
+ */
+
+static const uint8_t ext2_ft2dt[] = {
+  [EXT2_FT_UNKNOWN] = DT_UNKNOWN, [EXT2_FT_REG_FILE] = DT_REG,
+  [EXT2_FT_DIR] = DT_DIR,         [EXT2_FT_CHRDEV] = DT_CHR,
+  [EXT2_FT_BLKDEV] = DT_BLK,      [EXT2_FT_FIFO] = DT_FIFO,
+  [EXT2_FT_SOCK] = DT_SOCK,       [EXT2_FT_SYMLINK] = DT_LNK,
+};
+
+static uint8_t ext2_mode2ft(mode_t mode) {
+  switch (mode & S_IFMT) {
+    case S_IFREG:
+      return EXT2_FT_REG_FILE;
+    case S_IFDIR:
+      return EXT2_FT_DIR;
+    case S_IFCHR:
+      return EXT2_FT_CHRDEV;
+    case S_IFBLK:
+      return EXT2_FT_BLKDEV;
+    case S_IFIFO:
+      return EXT2_FT_FIFO;
+    case S_IFSOCK:
+      return EXT2_FT_SOCK;
+    case S_IFLNK:
+      return EXT2_FT_SYMLINK;
+    default:
+      return EXT2_FT_UNKNOWN;
+  }
+}
+
+/* Get the buffer with directory block `lbn`. Directories have no holes. */
+static int ext2_dir_bread(ext2_mount_t *em, ext2_node_t *dnode, uint32_t lbn,
+                          buf_t **bpp, void **datap) {
+  uint32_t blkno;
+  int error;
+
+  if ((error = ext2_bmap(em, dnode, lbn, false, &blkno)))
+    return error;
+  if (blkno == 0)
+    return EIO;
+  return ext2_bread(em, blkno, bpp, datap);
+}
+
+static bool ext2_dirent_valid(ext2_mount_t *em, ext2_dirent_t *de,
+                              uint32_t off) {
+  if (de->d_reclen < EXT2_DIRENT_SIZE(0) || de->d_reclen % 4 ||
+      off + de->d_reclen > em->em_bsize ||
+      (de->d_ino && EXT2_DIRENT_SIZE(de->d_namelen) > de->d_reclen)) {
+    klog("ext2: corrupted directory entry at offset %u!", off);
+    return false;
+  }
+  return true;
+}
+
+#define EXT2_DIRENT_FOREACH(de, off, data, em)                                 \
+  for ((off) = 0; (de) = (data) + (off), (off) < (em)->em_bsize;               \
+       (off) += (de)->d_reclen)
+
+static uint32_t ext2_dir_nblocks(ext2_mount_t *em, ext2_node_t *dnode) {
+  return dnode->en_di.i_size / em->em_bsize;
+}
+
+/* Find entry named `cn` in directory `dnode`. On success returns inode number
+ * and offset of the entry within the directory. */
+static int ext2_dir_lookup(ext2_mount_t *em, ext2_node_t *dnode,
+                           const componentname_t *cn, uint32_t *inop,
+                           uint32_t *offp) {
+  ext2_dirent_t *de;
+  uint32_t off;
+  void *data;
+  buf_t *bp;
+  int error;
+
+  for (uint32_t lbn = 0; lbn < ext2_dir_nblocks(em, dnode); lbn++) {
+    if ((error = ext2_dir_bread(em, dnode, lbn, &bp, &data)))
+      return error;
+
+    EXT2_DIRENT_FOREACH(de, off, data, em) {
+      if (!ext2_dirent_valid(em, de, off)) {
+        brelse(bp);
+        return EIO;
+      }
+      if (de->d_ino && de->d_namelen == cn->cn_namelen &&
+          !memcmp(de->d_name, cn->cn_nameptr, cn->cn_namelen)) {
+        *inop = de->d_ino;
+        if (offp)
+          *offp = lbn * em->em_bsize + off;
+        brelse(bp);
+        return 0;
+      }
+    }
+
+    brelse(bp);
+  }
+
+  return ENOENT;
+}
+
+/* The kernel does not maintain hashed directory index, so it has to be
+ * invalidated when the directory is modified. */
+static void ext2_dir_modified(ext2_mount_t *em, ext2_node_t *dnode) {
+  ext2_dinode_t *di = &dnode->en_di;
+  di->i_flags &= ~EXT2_INDEX_FL;
+  di->i_mtime = di->i_ctime = ext2_now();
+  ext2_inode_write(em, dnode);
+}
+
+static void ext2_dirent_fill(ext2_mount_t *em, ext2_dirent_t *de,
+                             const componentname_t *cn, uint32_t ino,
+                             mode_t mode) {
+  de->d_ino = ino;
+  de->d_namelen = cn->cn_namelen;
+  de->d_type = em->em_filetype ? ext2_mode2ft(mode) : 0;
+  memcpy(de->d_name, cn->cn_nameptr, cn->cn_namelen);
+}
+
+static int ext2_dir_add(ext2_mount_t *em, ext2_node_t *dnode,
+                        const componentname_t *cn, uint32_t ino, mode_t mode) {
+  size_t need = EXT2_DIRENT_SIZE(cn->cn_namelen);
+  uint32_t nblocks = ext2_dir_nblocks(em, dnode);
+  ext2_dirent_t *de;
+  uint32_t off, blkno;
+  void *data;
+  buf_t *bp;
+  int error;
+
+  /* Look for an unused entry or an entry with enough slack space. */
+  for (uint32_t lbn = 0; lbn < nblocks; lbn++) {
+    if ((error = ext2_dir_bread(em, dnode, lbn, &bp, &data)))
+      return error;
+
+    EXT2_DIRENT_FOREACH(de, off, data, em) {
+      if (!ext2_dirent_valid(em, de, off)) {
+        brelse(bp);
+        return EIO;
+      }
+
+      size_t used = de->d_ino ? EXT2_DIRENT_SIZE(de->d_namelen) : 0;
+      if (de->d_reclen - used < need)
+        continue;
+
+      if (used > 0) {
+        ext2_dirent_t *new = (void *)de + used;
+        new->d_reclen = de->d_reclen - used;
+        de->d_reclen = used;
+        de = new;
+      }
+
+      ext2_dirent_fill(em, de, cn, ino, mode);
+      bdwrite(bp);
+      ext2_dir_modified(em, dnode);
+      return 0;
+    }
+
+    brelse(bp);
+  }
+
+  /* Extend the directory with a new block. */
+  if ((error = ext2_bmap(em, dnode, nblocks, true, &blkno)))
+    return error;
+  if ((error = ext2_bread(em, blkno, &bp, &data)))
+    return error;
+
+  de = data;
+  de->d_reclen = em->em_bsize;
+  ext2_dirent_fill(em, de, cn, ino, mode);
+  bdwrite(bp);
+
+  dnode->en_di.i_size += em->em_bsize;
+  ext2_dir_modified(em, dnode);
+  return 0;
+}
+
+/* Remove directory entry at offset `diroff` by merging it with the previous
+ * entry in the same block, or marking it unused if it's the first one. */
+static int ext2_dir_remove(ext2_mount_t *em, ext2_node_t *dnode,
+                           uint32_t diroff) {
+  ext2_dirent_t *de, *prev = NULL;
+  uint32_t off;
+  void *data;
+  buf_t *bp;
+  int error;
+
+  if ((error = ext2_dir_bread(em, dnode, diroff / em->em_bsize, &bp, &data)))
+    return error;
+
+  EXT2_DIRENT_FOREACH(de, off, data, em) {
+    if (off == diroff % em->em_bsize)
+      break;
+    prev = de;
+  }
+
+  assert(off < em->em_bsize);
+
+  if (prev)
+    prev->d_reclen += de->d_reclen;
+  else
+    de->d_ino = 0;
+
+  bdwrite(bp);
+  ext2_dir_modified(em, dnode);
+  return 0;
+}
+
+/* Check whether the directory contains only "." and ".." entries. */
+static int ext2_dir_empty(ext2_mount_t *em, ext2_node_t *dnode, bool *emptyp) {
+  ext2_dirent_t *de;
+  uint32_t off;
+  void *data;
+  buf_t *bp;
+  int error;
+
+  for (uint32_t lbn = 0; lbn < ext2_dir_nblocks(em, dnode); lbn++) {
+    if ((error = ext2_dir_bread(em, dnode, lbn, &bp, &data)))
+      return error;
+
+    EXT2_DIRENT_FOREACH(de, off, data, em) {
+      if (!ext2_dirent_valid(em, de, off)) {
+        brelse(bp);
+        return EIO;
+      }
+      if (de->d_ino == 0)
+        continue;
+      if ((de->d_namelen == 1 && de->d_name[0] == '.') ||
+          (de->d_namelen == 2 && de->d_name[0] == '.' && de->d_name[1] == '.'))
+        continue;
+      brelse(bp);
+      *emptyp = false;
+      return 0;
+    }
+
+    brelse(bp);
+  }
+
+  *emptyp = true;
+  return 0;
+}
+
+/* Directory offsets seen by user-space refer to entries converted to
+ * `dirent_t`, so directory has to be scanned from the beginning to find
+ * the entry at given offset. */
+static int ext2_readdir(ext2_mount_t *em, ext2_node_t *dnode, uio_t *uio) {
+  dirent_t *dir = kmalloc(M_TEMP, sizeof(dirent_t), M_WAITOK);
+  off_t offset = 0;
+  ext2_dirent_t *de;
+  uint32_t off;
+  void *data;
+  buf_t *bp;
+  int error = 0;
+
+  for (uint32_t lbn = 0; lbn < ext2_dir_nblocks(em, dnode); lbn++) {
+    if ((error = ext2_dir_bread(em, dnode, lbn, &bp, &data)))
+      break;
+
+    EXT2_DIRENT_FOREACH(de, off, data, em) {
+      if (!ext2_dirent_valid(em, de, off)) {
+        error = EIO;
+        break;
+      }
+      if (de->d_ino == 0)
+        continue;
+
+      unsigned reclen = _DIRENT_RECLEN(dir, de->d_namelen);
+      if (offset < uio->uio_offset) {
+        offset += reclen;
+        continue;
+      }
+      if (uio->uio_resid < reclen)
+        break;
+
+      bzero(dir, reclen);
+      dir->d_fileno = de->d_ino;
+      dir->d_reclen = reclen;
+      dir->d_namlen = de->d_namelen;
+      dir->d_type = DT_UNKNOWN;
+      if (em->em_filetype && de->d_type < __arraycount(ext2_ft2dt))
+        dir->d_type = ext2_ft2dt[de->d_type];
+      memcpy(dir->d_name, de->d_name, de->d_namelen);
+
+      if ((error = uiomove(dir, reclen, uio)))
+        break;
+      offset += reclen;
+    }
+
+    brelse(bp);
+    if (error || off < em->em_bsize)
+      break;
+  }
+
+  kfree(M_TEMP, dir);
+  return error;
+}
+
+/*
+ * In-core inodes.
+ */
+
+static vnodetype_t ext2_vtype(mode_t mode) {
+  if (S_ISDIR(mode))
+    return V_DIR;
+  if (S_ISLNK(mode))
+    return V_LNK;
+  return V_REG;
+}
+
+static int ext2_vnode_load(vnode_t *v, void *arg) {
+  ext2_mount_t *em = ext2_mount_of(v);
+  ext2_node_t *node = kmalloc(M_EXT2, sizeof(ext2_node_t), M_ZERO | M_WAITOK);
+  int error;
+
+  node->en_ino = v->v_ino;
+
+  error = ext2_inode_read(em, node);
+
+  if (!error && node->en_di.i_links_count == 0) {
+    klog("ext2: reference to free inode %u!", node->en_ino);
+    error = EIO;
+  }
+
+  if (error) {
+    kfree(M_EXT2, node);
+    return error;
+  }
+
+  v->v_type = ext2_vtype(node->en_di.i_mode);
+  v->v_ops = &ext2_vnodeops;
+  v->v_data = node;
+  return 0;
+}
+
+/* Get vnode for inode `ino` with usecnt incremented. */
+static int ext2_get_vnode(mount_t *mp, uint32_t ino, vnode_t **vp) {
+  ext2_mount_t *em = mp->mnt_data;
+
+  if (ino < 1 || ino > em->em_sb.s_inodes_count)
+    return EIO;
+
+  return vcache_get(mp, ino, ext2_vnode_load, NULL, vp);
+}
+
+/* Create a new file of type given by `va->va_mode` in directory `dv`.
+ * On failure the new vnode (if any) must be dropped by the caller, which
+ * releases the inode. */
+static int ext2_create_file(vnode_t *dv, componentname_t *cn, vattr_t *va,
+                            const char *target, vnode_t **vp) {
+  ext2_mount_t *em = ext2_mount_of(dv);
+  ext2_node_t *dnode = ext2_node_of(dv);
+  bool isdir = S_ISDIR(va->va_mode);
+  uint32_t ino, blkno;
+  void *data;
+  buf_t *bp;
+  int error;
+
+  if (em->em_rdonly)
+    return EROFS;
+  if (cn->cn_namelen > EXT2_NAME_LEN)
+    return ENAMETOOLONG;
+  if (isdir && dnode->en_di.i_links_count >= EXT2_LINK_MAX)
+    return EMLINK;
+
+  if ((error = ext2_ialloc(em, dnode, isdir, &ino)))
+    return error;
+
+  ext2_node_t *node = kmalloc(M_EXT2, sizeof(ext2_node_t), M_ZERO | M_WAITOK);
+  ext2_dinode_t *di = &node->en_di;
+  node->en_ino = ino;
+  di->i_mode = va->va_mode;
+  di->i_uid = va->va_uid & 0xffff;
+  di->i_uid_high = va->va_uid >> 16;
+  di->i_gid = va->va_gid & 0xffff;
+  di->i_gid_high = va->va_gid >> 16;
+  di->i_atime = di->i_mtime = di->i_ctime = ext2_now();
+  di->i_links_count = 1;
+
+  /* The inode has just been allocated, so it cannot be in the vnode cache. */
+  vnode_t *v = vnode_new(ext2_vtype(di->i_mode), &ext2_vnodeops, node);
+  v->v_mount = dv->v_mount;
+  vcache_new(v, ino);
+  *vp = v;
+
+  if (isdir) {
+    /* Fill in the first block with "." and ".." entries. */
+    if ((error = ext2_bmap(em, node, 0, true, &blkno)))
+      goto fail;
+    if ((error = ext2_bread(em, blkno, &bp, &data)))
+      goto fail;
+
+    ext2_dirent_t *de = data;
+    ext2_dirent_fill(em, de, &COMPONENTNAME("."), ino, S_IFDIR);
+    de->d_reclen = EXT2_DIRENT_SIZE(1);
+    de = data + de->d_reclen;
+    ext2_dirent_fill(em, de, &COMPONENTNAME(".."), dnode->en_ino, S_IFDIR);
+    de->d_reclen = em->em_bsize - EXT2_DIRENT_SIZE(1);
+    bdwrite(bp);
+
+    di->i_size = em->em_bsize;
+    di->i_links_count = 2;
+  } else if (target) {
+    size_t len = strlen(target);
+
+    if (len < EXT2_MAXSYMLINKLEN) {
+      memcpy(di->i_block, target, len);
+    } else if (len <= em->em_bsize) {
+      if ((error = ext2_bmap(em, node, 0, true, &blkno)))
+        goto fail;
+      if ((error = ext2_bread(em, blkno, &bp, &data)))
+        goto fail;
+      memcpy(data, target, len);
+      bdwrite(bp);
+    } else {
+      error = ENAMETOOLONG;
+      goto fail;
+    }
+    di->i_size = len;
+  }
+
+  if ((error = ext2_inode_write(em, node)))
+    goto fail;
+
+  if ((error = ext2_dir_add(em, dnode, cn, ino, di->i_mode)))
+    goto fail;
+
+  if (isdir) {
+    dnode->en_di.i_links_count++;
+    ext2_inode_write(em, dnode);
+  }
+
+  return 0;
+
+fail:
+  di->i_links_count = 0;
+  return error;
+}
+
+/*
+ * Vnode operations.
+ */
+
+static int ext2_vop_lookup(vnode_t *dv, componentname_t *cn, vnode_t **vp) {
+  ext2_mount_t *em = ext2_mount_of(dv);
+  uint32_t ino;
+  int error;
+
+  if (componentname_equal(cn, ".")) {
+    vnode_hold(dv);
+    *vp = dv;
+    return 0;
+  }
+
+  if (cn->cn_namelen > EXT2_NAME_LEN)
+    return ENAMETOOLONG;
+
+  error = ext2_dir_lookup(em, ext2_node_of(dv), cn, &ino, NULL);
+
+  /* Directory entry cannot go away, since `dv` is locked by the caller. */
+  if (error)
+    return error;
+
+  return ext2_get_vnode(dv->v_mount, ino, vp);
+}
+
+static int ext2_vop_readdir(vnode_t *dv, uio_t *uio) {
+  return ext2_readdir(ext2_mount_of(dv), ext2_node_of(dv), uio);
+}
+
+static int ext2_vop_close(vnode_t *v, file_t *fp) {
+  return 0;
+}
+
+static int ext2_vop_read(vnode_t *v, uio_t *uio) {
+  ext2_mount_t *em = ext2_mount_of(v);
+  ext2_node_t *node = ext2_node_of(v);
+
+  if (v->v_type == V_DIR)
+    return EISDIR;
+  if (!S_ISREG(node->en_di.i_mode))
+    return EOPNOTSUPP;
+
+  return ext2_read(em, node, uio);
+}
+
+static int ext2_vop_write(vnode_t *v, uio_t *uio) {
+  ext2_mount_t *em = ext2_mount_of(v);
+  ext2_node_t *node = ext2_node_of(v);
+
+  if (v->v_type == V_DIR)
+    return EISDIR;
+  if (!S_ISREG(node->en_di.i_mode))
+    return EOPNOTSUPP;
+  if (em->em_rdonly)
+    return EROFS;
+
+  return ext2_write(em, node, uio);
+}
+
+static int ext2_vop_getattr(vnode_t *v, vattr_t *va) {
+  ext2_node_t *node = ext2_node_of(v);
+  ext2_dinode_t *di = &node->en_di;
+
+  memset(va, 0, sizeof(vattr_t));
+  va->va_mode = di->i_mode;
+  va->va_nlink = di->i_links_count;
+  va->va_ino = node->en_ino;
+  va->va_uid = di->i_uid | (di->i_uid_high << 16);
+  va->va_gid = di->i_gid | (di->i_gid_high << 16);
+  va->va_size = di->i_size;
+  va->va_atime.tv_sec = di->i_atime;
+  va->va_mtime.tv_sec = di->i_mtime;
+  va->va_ctime.tv_sec = di->i_ctime;
+  return 0;
+}
+
+static int ext2_vop_setattr(vnode_t *v, vattr_t *va, cred_t *cred) {
+  ext2_mount_t *em = ext2_mount_of(v);
+  ext2_node_t *node = ext2_node_of(v);
+  ext2_dinode_t *di = &node->en_di;
+  uid_t uid = di->i_uid | (di->i_uid_high << 16);
+  gid_t gid = di->i_gid | (di->i_gid_high << 16);
+  int error;
+
+  if (em->em_rdonly)
+    return EROFS;
+
+  if (va->va_size != (size_t)VNOVAL) {
+    if (v->v_type == V_DIR)
+      return EISDIR;
+    if (va->va_size > UINT32_MAX)
+      return EFBIG;
+    if ((error = ext2_truncate(em, node, va->va_size)))
+      return error;
+  }
+
+  if (va->va_mode != (mode_t)VNOVAL) {
+    if (!cred_can_chmod(uid, gid, cred, va->va_mode))
+      return EPERM;
+    di->i_mode = (di->i_mode & ~ALLPERMS) | (va->va_mode & ALLPERMS);
+  }
+
+  if (va->va_uid != (uid_t)VNOVAL || va->va_gid != (gid_t)VNOVAL) {
+    if (!cred_can_chown(uid, cred, va->va_uid, va->va_gid))
+      return EPERM;
+    if (va->va_uid != (uid_t)-1) {
+      di->i_uid = va->va_uid & 0xffff;
+      di->i_uid_high = va->va_uid >> 16;
+      di->i_mode &= ~S_ISUID;
+    }
+    if (va->va_gid != (gid_t)-1) {
+      di->i_gid = va->va_gid & 0xffff;
+      di->i_gid_high = va->va_gid >> 16;
+      di->i_mode &= ~S_ISGID;
+    }
+  }
+
+  if (va->va_atime.tv_sec != VNOVAL || va->va_mtime.tv_sec != VNOVAL) {
+    if (!cred_can_utime(v, uid, cred, va->va_flags))
+      return EPERM;
+    if (va->va_atime.tv_sec != VNOVAL)
+      di->i_atime = va->va_atime.tv_sec;
+    if (va->va_mtime.tv_sec != VNOVAL)
+      di->i_mtime = va->va_mtime.tv_sec;
+  }
+
+  di->i_ctime = ext2_now();
+  return ext2_inode_write(em, node);
+}
+
+static int ext2_vop_create_file(vnode_t *dv, componentname_t *cn, vattr_t *va,
+                                const char *target, vnode_t **vp) {
+  vnode_t *v = NULL;
+  int error;
+
+  if ((error = ext2_create_file(dv, cn, va, target, &v))) {
+    if (v) {
+      vcache_remove(v);
+      vnode_drop(v);
+    }
+    return error;
+  }
+
+  *vp = v;
+  return 0;
+}
+
+static int ext2_vop_create(vnode_t *dv, componentname_t *cn, vattr_t *va,
+                           vnode_t **vp) {
+  assert(S_ISREG(va->va_mode));
+  return ext2_vop_create_file(dv, cn, va, NULL, vp);
+}
+
+static int ext2_vop_mkdir(vnode_t *dv, componentname_t *cn, vattr_t *va,
+                          vnode_t **vp) {
+  assert(S_ISDIR(va->va_mode));
+  return ext2_vop_create_file(dv, cn, va, NULL, vp);
+}
+
+static int ext2_vop_symlink(vnode_t *dv, componentname_t *cn, vattr_t *va,
+                            char *target, vnode_t **vp) {
+  assert(S_ISLNK(va->va_mode));
+  return ext2_vop_create_file(dv, cn, va, target, vp);
+}
+
+static int ext2_vop_remove(vnode_t *dv, vnode_t *v, componentname_t *cn) {
+  ext2_mount_t *em = ext2_mount_of(dv);
+  ext2_node_t *node = ext2_node_of(v);
+  uint32_t ino, off;
+  int error;
+
+  if (em->em_rdonly)
+    return EROFS;
+
+  if ((error = ext2_dir_lookup(em, ext2_node_of(dv), cn, &ino, &off)))
+    return error;
+  assert(ino == node->en_ino);
+
+  if ((error = ext2_dir_remove(em, ext2_node_of(dv), off)))
+    return error;
+
+  /* The inode is released once the last reference is dropped. */
+  node->en_di.i_links_count--;
+  node->en_di.i_ctime = ext2_now();
+  if (node->en_di.i_links_count == 0)
+    vcache_remove(v);
+  return ext2_inode_write(em, node);
+}
+
+static int ext2_vop_rmdir(vnode_t *dv, vnode_t *v, componentname_t *cn) {
+  ext2_mount_t *em = ext2_mount_of(dv);
+  ext2_node_t *dnode = ext2_node_of(dv);
+  ext2_node_t *node = ext2_node_of(v);
+  uint32_t ino, off;
+  bool empty;
+  int error;
+
+  if (em->em_rdonly)
+    return EROFS;
+
+  if ((error = ext2_dir_lookup(em, dnode, cn, &ino, &off)))
+    return error;
+  assert(ino == node->en_ino);
+
+  if ((error = ext2_dir_empty(em, node, &empty)))
+    return error;
+  if (!empty)
+    return ENOTEMPTY;
+
+  if ((error = ext2_dir_remove(em, dnode, off)))
+    return error;
+
+  /* Drop links from the parent directory and the '.' entry. */
+  node->en_di.i_links_count = 0;
+  node->en_di.i_ctime = ext2_now();
+  error = ext2_inode_write(em, node);
+  vcache_remove(v);
+
+  /* Drop link from the '..' entry. */
+  dnode->en_di.i_links_count--;
+  int derror = ext2_inode_write(em, dnode);
+  return error ? error : derror;
+}
+
+static int ext2_vop_link(vnode_t *dv, vnode_t *v, componentname_t *cn) {
+  ext2_mount_t *em = ext2_mount_of(dv);
+  ext2_node_t *node = ext2_node_of(v);
+  int error;
+
+  if (em->em_rdonly)
+    return EROFS;
+  if (cn->cn_namelen > EXT2_NAME_LEN)
+    return ENAMETOOLONG;
+
+  if (node->en_di.i_links_count >= EXT2_LINK_MAX)
+    return EMLINK;
+
+  if ((error = ext2_dir_add(em, ext2_node_of(dv), cn, node->en_ino,
+                            node->en_di.i_mode)))
+    return error;
+
+  node->en_di.i_links_count++;
+  node->en_di.i_ctime = ext2_now();
+  return ext2_inode_write(em, node);
+}
+
+static int ext2_vop_readlink(vnode_t *v, uio_t *uio) {
+  ext2_mount_t *em = ext2_mount_of(v);
+  ext2_node_t *node = ext2_node_of(v);
+  size_t len = node->en_di.i_size;
+  uint32_t blkno;
+  void *data;
+  buf_t *bp;
+  int error;
+
+  assert(v->v_type == V_LNK);
+
+  if (ext2_is_fastlink(em, node))
+    return uiomove_frombuf(node->en_di.i_block, min(len, uio->uio_resid), uio);
+
+  if ((error = ext2_bmap(em, node, 0, false, &blkno)))
+    return error;
+  if (blkno == 0 || len > em->em_bsize)
+    return EIO;
+  if ((error = ext2_bread(em, blkno, &bp, &data)))
+    return error;
+  error = uiomove_frombuf(data, min(len, uio->uio_resid), uio);
+  brelse(bp);
+  return error;
+}
+
+static int ext2_vop_reclaim(vnode_t *v) {
+  ext2_mount_t *em = ext2_mount_of(v);
+  ext2_node_t *node = ext2_node_of(v);
+  ext2_dinode_t *di = &node->en_di;
+
+  v->v_data = NULL;
+
+  if (di->i_links_count == 0 && !em->em_rdonly) {
+    bool isdir = S_ISDIR(di->i_mode);
+    ext2_truncate(em, node, 0);
+    di->i_dtime = ext2_now();
+    ext2_inode_write(em, node);
+    ext2_ifree(em, node->en_ino, isdir);
+  }
+
+  kfree(M_EXT2, node);
+  return 0;
+}
+
+static int ext2_vop_pathconf(vnode_t *v, int name, register_t *res) {
+  switch (name) {
+    case _PC_NAME_MAX:
+      *res = EXT2_NAME_LEN;
+      return 0;
+    case _PC_LINK_MAX:
+      *res = EXT2_LINK_MAX;
+      return 0;
+    default:
+      return vnode_pathconf_generic(v, name, res);
+  }
+}
+
+static vnodeops_t ext2_vnodeops = {.v_lookup = ext2_vop_lookup,
+                                   .v_readdir = ext2_vop_readdir,
+                                   .v_open = vnode_open_generic,
+                                   .v_close = ext2_vop_close,
+                                   .v_read = ext2_vop_read,
+                                   .v_write = ext2_vop_write,
+                                   .v_seek = vnode_seek_generic,
+                                   .v_getattr = ext2_vop_getattr,
+                                   .v_setattr = ext2_vop_setattr,
+                                   .v_create = ext2_vop_create,
+                                   .v_remove = ext2_vop_remove,
+                                   .v_mkdir = ext2_vop_mkdir,
+                                   .v_rmdir = ext2_vop_rmdir,
+                                   .v_access = vnode_access_generic,
+                                   .v_reclaim = ext2_vop_reclaim,
+                                   .v_readlink = ext2_vop_readlink,
+                                   .v_symlink = ext2_vop_symlink,
+                                   .v_link = ext2_vop_link,
+                                   .v_pathconf = ext2_vop_pathconf};
+
+/*
+ * Filesystem operations.
+ */
+
+static int ext2_read_sb(ext2_mount_t *em) {
+  ext2_superblock_t *sb = &em->em_sb;
+  blkdev_t *bd = em->em_dev;
+  buf_t *bp;
+  int error;
+
+  if ((error = bread(bd, 0, &bp)))
+    return error;
+  memcpy(sb, bp->b_data + EXT2_SBLOCK_OFF, sizeof(ext2_superblock_t));
+  brelse(bp);
+
+  if (sb->s_magic != EXT2_MAGIC) {
+    klog("ext2: bad superblock magic %04x!", sb->s_magic);
+    return EINVAL;
+  }
+
+  if (sb->s_log_block_size > 6 ||
+      (1024U << sb->s_log_block_size) > bd->bd_bufsize) {
+    klog("ext2: unsupported block size (%u)!", 1024 << sb->s_log_block_size);
+    return EINVAL;
+  }
+
+  if (sb->s_blocks_per_group == 0 || sb->s_inodes_per_group == 0 ||
+      sb->s_first_data_block >= sb->s_blocks_count ||
+      sb->s_blocks_count > bd->bd_nblocks * bd->bd_blksize /
+                             (1024U << sb->s_log_block_size)) {
+    klog("ext2: corrupted superblock!");
+    return EINVAL;
+  }
+
+  if (sb->s_rev_level == EXT2_GOOD_OLD_REV) {
+    em->em_inodesize = EXT2_GOOD_OLD_INODE_SIZE;
+    return 0;
+  }
+
+  if (sb->s_feature_incompat & ~EXT2_INCOMPAT_SUPP) {
+    klog("ext2: unsupported incompatible features (%08x)!",
+         sb->s_feature_incompat & ~EXT2_INCOMPAT_SUPP);
+    return EINVAL;
+  }
+
+  if (sb->s_feature_ro_compat & ~EXT2_ROCOMPAT_SUPP) {
+    klog("ext2: unsupported features (%08x), mounting read-only!",
+         sb->s_feature_ro_compat & ~EXT2_ROCOMPAT_SUPP);
+    em->em_rdonly = true;
+  }
+
+  em->em_inodesize = sb->s_inode_size;
+  em->em_filetype = sb->s_feature_incompat & EXT2F_INCOMPAT_FILETYPE;
+
+  if (em->em_inodesize < EXT2_GOOD_OLD_INODE_SIZE ||
+      !powerof2(em->em_inodesize) ||
+      em->em_inodesize > (1024U << sb->s_log_block_size)) {
+    klog("ext2: bad inode size (%u)!", em->em_inodesize);
+    return EINVAL;
+  }
+
+  return 0;
+}
+
+static int ext2_read_gd(ext2_mount_t *em) {
+  size_t size = em->em_ngroups * sizeof(ext2_gd_t);
+  void *data;
+  buf_t *bp;
+  int error;
+
+  em->em_gd = kmalloc(M_EXT2, size, M_WAITOK);
+
+  for (size_t off = 0; off < size; off += em->em_bsize) {
+    uint32_t blkno = em->em_gdblock + off / em->em_bsize;
+    if ((error = ext2_bread(em, blkno, &bp, &data)))
+      return error;
+    memcpy((void *)em->em_gd + off, data, min(size - off, em->em_bsize));
+    brelse(bp);
+  }
+
+  return 0;
+}
+
+static int ext2_mount(mount_t *mp) {
+  int error;
+
+  if (mp->mnt_dev == NULL)
+    return ENOTBLK;
+
+  /* There's no unmount, so the device stays busy once mounted. */
+  if ((error = blkdev_mount(mp->mnt_dev)))
+    return error;
+
+  ext2_mount_t *em = kmalloc(M_EXT2, sizeof(ext2_mount_t), M_ZERO | M_WAITOK);
+  ext2_superblock_t *sb = &em->em_sb;
+
+  mtx_init(&em->em_lock, 0);
+  em->em_dev = mp->mnt_dev;
+
+  if ((error = ext2_read_sb(em)))
+    goto fail;
+
+  em->em_bsize = 1024 << sb->s_log_block_size;
+  em->em_nindir = em->em_bsize / sizeof(uint32_t);
+  em->em_ngroups = howmany(sb->s_blocks_count - sb->s_first_data_block,
+                           sb->s_blocks_per_group);
+  em->em_gdblock = sb->s_first_data_block + 1;
+
+  if ((error = ext2_read_gd(em)))
+    goto fail;
+
+  if (sb->s_state != EXT2_VALID_FS)
+    klog("ext2: filesystem was not cleanly unmounted, run fsck!");
+
+  if (!em->em_rdonly) {
+    sb->s_mtime = ext2_now();
+    sb->s_mnt_count++;
+    ext2_sb_write(em);
+  }
+
+  mp->mnt_data = em;
+
+  klog("ext2: mounted filesystem with %u blocks of %u bytes in %u groups",
+       sb->s_blocks_count, em->em_bsize, em->em_ngroups);
+  return 0;
+
+fail:
+  blkdev_unmount(em->em_dev);
+  if (em->em_gd)
+    kfree(M_EXT2, em->em_gd);
+  kfree(M_EXT2, em);
+  return error;
+}
+
+static int ext2_root(mount_t *mp, vnode_t **vp) {
+  return VFS_VGET(mp, EXT2_ROOTINO, vp);
+}
+
+static int ext2_vget(mount_t *mp, ino_t ino, vnode_t **vp) {
+  return ext2_get_vnode(mp, ino, vp);
+}
+
+static int ext2_statvfs(mount_t *mp, statvfs_t *sb) {
+  ext2_mount_t *em = mp->mnt_data;
+  ext2_superblock_t *esb = &em->em_sb;
+
+  SCOPED_MTX_LOCK(&em->em_lock);
+
+  memset(sb, 0, sizeof(statvfs_t));
+  sb->f_bsize = em->em_bsize;
+  sb->f_frsize = em->em_bsize;
+  sb->f_blocks = esb->s_blocks_count;
+  sb->f_bfree = esb->s_free_blocks_count;
+  sb->f_bavail = esb->s_free_blocks_count > esb->s_r_blocks_count
+                   ? esb->s_free_blocks_count - esb->s_r_blocks_count
+                   : 0;
+  sb->f_files = esb->s_inodes_count;
+  sb->f_ffree = esb->s_free_inodes_count;
+  sb->f_favail = esb->s_free_inodes_count;
+  sb->f_flag = em->em_rdonly ? MNT_RDONLY : 0;
+  sb->f_namemax = EXT2_NAME_LEN;
+  strlcpy(sb->f_fstypename, mp->mnt_vfc->vfc_name, sizeof(sb->f_fstypename));
+  return 0;
+}
+
+static int ext2_init(vfsconf_t *vfc) {
+  vnodeops_init(&ext2_vnodeops);
+  return 0;
+}
+
+static vfsops_t ext2_vfsops = {.vfs_mount = ext2_mount,
+                               .vfs_root = ext2_root,
+                               .vfs_statvfs = ext2_statvfs,
+                               .vfs_vget = ext2_vget,
+                               .vfs_init = ext2_init};
+
+static vfsconf_t ext2_conf = {.vfc_name = "ext2", .vfc_vfsops = &ext2_vfsops};
+
+SET_ENTRY(vfsconf, ext2_conf);
@@ -3,14 +3,37 @@
 #include <sys/errno.h>
 #include <sys/file.h>
 #include <sys/filedesc.h>
+#include <sys/malloc.h>
 #include <sys/proc.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <sys/vnode.h>
 
 int do_close(proc_t *p, int fd) {
   return fdtab_close_fd(p->p_fdtable, fd);
 }
 
+/* Positional I/O makes sense only for files that have a notion of offset. */
+static int check_positional(file_t *f, uio_t *uio) {
+  if (!(uio->uio_ioflags & IO_OFFSET))
+    return 0;
+  if (f->f_type != FT_VNODE || f->f_ops->fo_seek == noseek)
+    return ESPIPE;
+  if (uio->uio_offset < 0)
+    return EINVAL;
+  return 0;
+}
+
+/* Writing to a pipe or socket with no readers raises SIGPIPE. */
+void file_sigpipe(proc_t *p, int error) {
+  if (error == EPIPE) {
+    proc_lock(p);
+    sig_kill(p, &DEF_KSI_RAW(SIGPIPE));
+    proc_unlock(p);
+  }
+}
+
 int do_read(proc_t *p, int fd, uio_t *uio) {
   file_t *f;
   int error;
@@ -18,6 +41,11 @@ int do_read(proc_t *p, int fd, uio_t *uio) {
   if ((error = fdtab_get_file(p->p_fdtable, fd, FF_READ, &f)))
     return error;
 
+  if ((error = check_positional(f, uio))) {
+    file_drop(f);
+    return error;
+  }
+
   uio->uio_ioflags |= f->f_flags & IO_MASK;
   error = f->f_ops->fo_read(f, uio);
   file_drop(f);
@@ -31,14 +59,14 @@ int do_write(proc_t *p, int fd, uio_t *uio) {
   if ((error = fdtab_get_file(p->p_fdtable, fd, FF_WRITE, &f)))
     return error;
 
-  uio->uio_ioflags |= f->f_flags & IO_MASK;
-  error = f->f_ops->fo_write(f, uio);
-  if (error == EPIPE) {
-    proc_lock(p);
-    sig_kill(p, &DEF_KSI_RAW(SIGPIPE));
-    proc_unlock(p);
+  if ((error = check_positional(f, uio))) {
+    file_drop(f);
+    return error;
   }
 
+  uio->uio_ioflags |= f->f_flags & IO_MASK;
+  error = f->f_ops->fo_write(f, uio);
+  file_sigpipe(p, error);
   file_drop(f);
   return error;
 }
@@ -172,3 +200,138 @@ int do_umask(proc_t *p, int newmask, int *oldmaskp) {
   p->p_cmask = newmask & ALLPERMS;
   return 0;
 }
+
+/* Data is moved between files through a kernel buffer of this size. */
+#define SPLICE_CHUNK PAGESIZE
+
+static bool file_seekable(file_t *f) {
+  return f->f_type == FT_VNODE && f->f_ops->fo_seek != noseek;
+}
+
+/* Move file offset back over data that was read but not written. The offset
+ * is protected by vnode lock, like in read(2) and lseek(2). */
+static void splice_unread(file_t *f, size_t n) {
+  vnode_t *v = f->f_vnode;
+
+  vnode_lock(v);
+  f->f_offset -= n;
+  vnode_unlock(v);
+}
+
+/* Input is read at `*inoffp` if it's not NULL, or at file offset. Output is
+ * written at `*outoffp` if it's not NULL, or at file offset. Offsets are
+ * advanced by number of bytes that were actually written. */
+static int splice_files(file_t *in, off_t *inoffp, file_t *out, off_t *outoffp,
+                        size_t count, size_t *donep) {
+  bool seekable = file_seekable(in);
+  size_t done = 0;
+  int error = 0;
+
+  /* Data that was read but could not be written would be lost. */
+  if (!seekable && (out->f_flags & IO_NONBLOCK))
+    return EINVAL;
+
+  void *buf = kmalloc(M_TEMP, SPLICE_CHUNK, M_WAITOK);
+
+  while (done < count) {
+    size_t len = min(count - done, (size_t)SPLICE_CHUNK);
+
+    uio_t uio = UIO_SINGLE_KERNEL(UIO_READ, 0, buf, len);
+    if (inoffp) {
+      uio.uio_offset = *inoffp;
+      uio.uio_ioflags = IO_OFFSET;
+    }
+    if ((error = in->f_ops->fo_read(in, &uio)))
+      break;
+
+    size_t nread = len - uio.uio_resid;
+    if (nread == 0)
+      break;
+
+    uio = UIO_SINGLE_KERNEL(UIO_WRITE, 0, buf, nread);
+    uio.uio_ioflags = out->f_flags & IO_MASK;
+    if (outoffp) {
+      uio.uio_offset = *outoffp;
+      uio.uio_ioflags |= IO_OFFSET;
+    }
+    error = out->f_ops->fo_write(out, &uio);
+
+    size_t nwritten = nread - uio.uio_resid;
+    done += nwritten;
+    if (inoffp)
+      *inoffp += nwritten;
+    else if (seekable && nwritten < nread)
+      splice_unread(in, nread - nwritten);
+    if (outoffp)
+      *outoffp += nwritten;
+
+    /* Stop on error, short transfer, or after a chunk from a stream. */
+    if (error || nwritten < len || !seekable)
+      break;
+  }
+
+  kfree(M_TEMP, buf);
+
+  /* Report partial transfer as a success. */
+  if (done > 0)
+    error = 0;
+  *donep = done;
+  return error;
+}
+
+static int splice_getfiles(proc_t *p, int infd, int outfd, file_t **inp,
+                           file_t **outp) {
+  int error;
+
+  if ((error = fdtab_get_file(p->p_fdtable, infd, FF_READ, inp)))
+    return error;
+  if ((error = fdtab_get_file(p->p_fdtable, outfd, FF_WRITE, outp))) {
+    file_drop(*inp);
+    return error;
+  }
+  return 0;
+}
+
+int do_sendfile(proc_t *p, int outfd, int infd, off_t *offp, size_t count,
+                size_t *donep) {
+  file_t *in, *out;
+  int error;
+
+  if ((error = splice_getfiles(p, infd, outfd, &in, &out)))
+    return error;
+
+  if (!file_seekable(in) || in->f_vnode->v_type != V_REG) {
+    error = EINVAL;
+  } else if (offp && *offp < 0) {
+    error = EINVAL;
+  } else {
+    error = splice_files(in, offp, out, NULL, count, donep);
+  }
+
+  file_sigpipe(p, error);
+  file_drop(in);
+  file_drop(out);
+  return error;
+}
+
+int do_splice(proc_t *p, int infd, off_t *inoffp, int outfd, off_t *outoffp,
+              size_t count, size_t *donep) {
+  file_t *in, *out;
+  int error;
+
+  if ((error = splice_getfiles(p, infd, outfd, &in, &out)))
+    return error;
+
+  if ((inoffp && !file_seekable(in)) || (outoffp && !file_seekable(out))) {
+    error = ESPIPE;
+  } else if ((inoffp && *inoffp < 0) || (outoffp && *outoffp < 0)) {
+    error = EINVAL;
+  } else {
+    error = splice_files(in, inoffp, out, outoffp, count, donep);
+  }
+
+  file_sigpipe(p, error);
+  file_drop(in);
+  file_drop(out);
+  return error;
+}
@@ -108,6 +108,8 @@ int do_fork(void (*start)(void *), void *arg, pid_t *cldpidp) {
 
   *cldpidp = child->p_pid;
 
+  proc_knote(parent, NOTE_FORK | child->p_pid);
+
   /* After this point you cannot access child process without a lock. */
   sched_add(newtd);
 
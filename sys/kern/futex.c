@@ -0,0 +1,173 @@
+#define KL_LOG KL_PROC
+#include <sys/klog.h>
+#include <sys/errno.h>
+#include <sys/futex.h>
+#include <sys/hash.h>
+#include <sys/mimiker.h>
+#include <sys/mutex.h>
+#include <sys/pool.h>
+#include <sys/proc.h>
+#include <sys/queue.h>
+#include <sys/sleepq.h>
+#include <sys/vm_map.h>
+
+#define FUTEX_HASH_SIZE 64
+#define FUTEX_HASH_MASK (FUTEX_HASH_SIZE - 1)
+
+/* Futex key identifies the user word. Private futexes are keyed by address
+ * space and virtual address. Shared futexes are keyed by physical page and
+ * offset within it, so the word can be mapped at different addresses in many
+ * processes. */
+typedef struct futex_key {
+  void *fk_obj;   /* address space or physical page */
+  vaddr_t fk_off; /* virtual address or offset in the page */
+} futex_key_t;
+
+/* Futex is created by the first thread that waits on a given user word
+ * and is destroyed by the last waiter that leaves it. Its address serves as
+ * sleep queue wait channel. */
+typedef struct futex {
+  TAILQ_ENTRY(futex) f_link; /* (b) link on bucket list */
+  futex_key_t f_key;         /* (!) user word the futex is bound to */
+  unsigned f_waiters;        /* (b) number of threads waiting on the word */
+} futex_t;
+
+typedef TAILQ_HEAD(, futex) futex_list_t;
+
+typedef struct futex_bucket {
+  mtx_t fb_lock;
+  futex_list_t fb_list; /* (b) futexes that hash to this bucket */
+} futex_bucket_t;
+
+static POOL_DEFINE(P_FUTEX, "futex", sizeof(futex_t));
+
+static futex_bucket_t futex_hashtab[FUTEX_HASH_SIZE];
+
+/* For shared futexes the page is held in `*anonp`, so that it cannot be
+ * reused as a key of another futex. Release it with `futex_key_put`. */
+static int futex_key_get(proc_t *p, vaddr_t addr, int flags, futex_key_t *key,
+                         vm_anon_t **anonp) {
+  int error;
+
+  if (addr & (sizeof(int) - 1))
+    return EINVAL;
+
+  *anonp = NULL;
+
+  if (!(flags & FUTEX_SHARED)) {
+    *key = (futex_key_t){.fk_obj = p->p_uspace, .fk_off = addr};
+    return 0;
+  }
+
+  if ((error = vm_map_loan(p->p_uspace, addr, VM_PROT_READ, anonp)))
+    return error;
+
+  *key = (futex_key_t){.fk_obj = (*anonp)->page, .fk_off = addr % PAGESIZE};
+  return 0;
+}
+
+static void futex_key_put(vm_anon_t *anon) {
+  if (anon)
+    vm_anon_drop(anon);
+}
+
+static futex_bucket_t *futex_bucket(futex_key_t *key) {
+  uint32_t hash = hash32_buf(key, sizeof(futex_key_t), HASH32_BUF_INIT);
+  return &futex_hashtab[hash & FUTEX_HASH_MASK];
+}
+
+static futex_t *futex_lookup(futex_bucket_t *fb, futex_key_t *key) {
+  assert(mtx_owned(&fb->fb_lock));
+
+  futex_t *f;
+  TAILQ_FOREACH (f, &fb->fb_list, f_link)
+    if (f->f_key.fk_obj == key->fk_obj && f->f_key.fk_off == key->fk_off)
+      return f;
+  return NULL;
+}
+
+static int futex_wait(futex_key_t *key, int *uaddr, int val, systime_t ticks) {
+  futex_bucket_t *fb = futex_bucket(key);
+  int error, cur;
+
+  SCOPED_MTX_LOCK(&fb->fb_lock);
+
+  /* The value must be checked with bucket lock held, otherwise we could miss
+   * a wakeup issued just after the word was changed. */
+  if ((error = copyin_s(uaddr, cur)))
+    return error;
+
+  if (cur != val)
+    return EAGAIN;
+
+  futex_t *f = futex_lookup(fb, key);
+  if (f == NULL) {
+    f = pool_alloc(P_FUTEX, M_ZERO);
+    f->f_key = *key;
+    TAILQ_INSERT_TAIL(&fb->fb_list, f, f_link);
+  }
+
+  f->f_waiters++;
+  error = sleepq_wait_timed(f, __caller(0), &fb->fb_lock, ticks);
+  if (--f->f_waiters == 0) {
+    TAILQ_REMOVE(&fb->fb_list, f, f_link);
+    pool_free(P_FUTEX, f);
+  }
+
+  return error;
+}
+
+int do_futex_wait(proc_t *p, int *uaddr, int flags, int val,
+                  const timespec_t *timeout) {
+  systime_t ticks = 0;
+  futex_key_t key;
+  vm_anon_t *anon;
+  int error;
+
+  if (timeout) {
+    if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 ||
+        timeout->tv_nsec >= 1000000000L)
+      return EINVAL;
+    if ((ticks = ts2hz(timeout)) == 0)
+      return ETIMEDOUT;
+  }
+
+  if ((error = futex_key_get(p, (vaddr_t)uaddr, flags, &key, &anon)))
+    return error;
+
+  error = futex_wait(&key, uaddr, val, ticks);
+  futex_key_put(anon);
+  return error;
+}
+
+int do_futex_wake(proc_t *p, int *uaddr, int flags, int val, int *nwokenp) {
+  futex_key_t key;
+  vm_anon_t *anon;
+  int nwoken = 0;
+  int error;
+
+  if ((error = futex_key_get(p, (vaddr_t)uaddr, flags, &key, &anon)))
+    return error;
+
+  futex_bucket_t *fb = futex_bucket(&key);
+
+  WITH_MTX_LOCK (&fb->fb_lock) {
+    futex_t *f = futex_lookup(fb, &key);
+    if (f == NULL)
+      break;
+    while (nwoken < val && sleepq_signal(f))
+      nwoken++;
+  }
+
+  futex_key_put(anon);
+  *nwokenp = nwoken;
+  return 0;
+}
+
+void init_futex(void) {
+  for (int i = 0; i < FUTEX_HASH_SIZE; i++) {
+    futex_bucket_t *fb = &futex_hashtab[i];
+    mtx_init(&fb->fb_lock, 0);
+    TAILQ_INIT(&fb->fb_list);
+  }
+}
@@ -1,6 +1,7 @@
 #define KL_LOG KL_FILESYS
 #include <sys/klog.h>
 #include <sys/errno.h>
+#include <sys/hash.h>
 #include <sys/malloc.h>
 #include <sys/libkern.h>
 #include <cpio.h>
@@ -21,6 +22,7 @@ typedef uint16_t cpio_mode_t;
 
 typedef struct cpio_node cpio_node_t;
 typedef TAILQ_HEAD(, cpio_node) cpio_list_t;
+typedef LIST_HEAD(, cpio_node) cpio_hash_t;
 
 /* ramdisk related data that will be stored in v_data field of vnode */
 struct cpio_node {
@@ -28,6 +30,11 @@ struct cpio_node {
   cpio_list_t c_children;        /* head of list of direct descendants */
   cpio_node_t *c_parent;         /* pointer to parent or NULL for root node */
   TAILQ_ENTRY(cpio_node) c_siblings; /* nodes that have the same parent */
+  LIST_ENTRY(cpio_node) c_hash;      /* link on parent's c_hashtab */
+  cpio_node_t *c_pathnext;           /* next node on path hash chain */
+  cpio_hash_t *c_hashtab;            /* children hashed by name */
+  unsigned c_hashmask;               /* number of buckets in c_hashtab - 1 */
+  unsigned c_nchildren;              /* number of direct descendants */
 
   cpio_dev_t c_dev;
   cpio_ino_t c_ino;
@@ -43,12 +50,12 @@ struct cpio_node {
   const char *c_name; /* contains name of file */
   void *c_data;
   /* Associated vnode. */
-  vnode_t *c_vnode;
 };
 
 static KMALLOC_DEFINE(M_INITRD, "initrd");
 
 static cpio_list_t initrd_head = TAILQ_HEAD_INITIALIZER(initrd_head);
+static unsigned initrd_count; /* number of nodes on initrd_head */
 static cpio_node_t *root_node;
 static vnodeops_t initrd_vops;
 
@@ -70,11 +77,6 @@ static void cpio_node_dump(cpio_node_t *cn) {
        cn->c_mode, cn->c_nlink, cn->c_uid, cn->c_gid, cn->c_size, cn->c_mtime);
 }
 
-static void read_bytes(void **tape, void *ptr, size_t bytes) {
-  memcpy(ptr, *tape, bytes);
-  *tape += bytes;
-}
-
 static void skip_bytes(void **tape, size_t bytes) {
   *tape = align(*tape + bytes, 4);
 }
@@ -82,28 +84,28 @@ static void skip_bytes(void **tape, size_t bytes) {
 #define MKDEV(major, minor) (((major & 0xff) << 8) | (minor & 0xff))
 
 static bool read_cpio_header(void **tape, cpio_node_t *cpio) {
-  cpio_new_hdr_t hdr;
-
-  read_bytes(tape, &hdr, sizeof(hdr));
+  /* Header fields are parsed in place, as they're just character arrays. */
+  const cpio_new_hdr_t *hdr = *tape;
+  *tape += sizeof(cpio_new_hdr_t);
 
-  uint16_t c_magic = strntoul(hdr.c_magic, 6, NULL, 8);
+  uint16_t c_magic = strntoul(hdr->c_magic, 6, NULL, 8);
 
   if (c_magic != CPIO_NMAGIC && c_magic != CPIO_NCMAGIC) {
     klog("wrong magic number: %o", c_magic);
     return false;
   }
 
-  uint32_t c_ino = strntoul(hdr.c_ino, 8, NULL, 16);
-  uint32_t c_mode = strntoul(hdr.c_mode, 8, NULL, 16);
-  uint32_t c_uid = strntoul(hdr.c_uid, 8, NULL, 16);
-  uint32_t c_gid = strntoul(hdr.c_gid, 8, NULL, 16);
-  uint32_t c_mtime = strntoul(hdr.c_mtime, 8, NULL, 16);
-  uint32_t c_filesize = strntoul(hdr.c_filesize, 8, NULL, 16);
-  uint32_t c_maj = strntoul(hdr.c_maj, 8, NULL, 16);
-  uint32_t c_min = strntoul(hdr.c_min, 8, NULL, 16);
-  uint32_t c_rmaj = strntoul(hdr.c_rmaj, 8, NULL, 16);
-  uint32_t c_rmin = strntoul(hdr.c_rmin, 8, NULL, 16);
-  uint32_t c_namesize = strntoul(hdr.c_namesize, 8, NULL, 16);
+  uint32_t c_ino = strntoul(hdr->c_ino, 8, NULL, 16);
+  uint32_t c_mode = strntoul(hdr->c_mode, 8, NULL, 16);
+  uint32_t c_uid = strntoul(hdr->c_uid, 8, NULL, 16);
+  uint32_t c_gid = strntoul(hdr->c_gid, 8, NULL, 16);
+  uint32_t c_mtime = strntoul(hdr->c_mtime, 8, NULL, 16);
+  uint32_t c_filesize = strntoul(hdr->c_filesize, 8, NULL, 16);
+  uint32_t c_maj = strntoul(hdr->c_maj, 8, NULL, 16);
+  uint32_t c_min = strntoul(hdr->c_min, 8, NULL, 16);
+  uint32_t c_rmaj = strntoul(hdr->c_rmaj, 8, NULL, 16);
+  uint32_t c_rmin = strntoul(hdr->c_rmin, 8, NULL, 16);
+  uint32_t c_namesize = strntoul(hdr->c_namesize, 8, NULL, 16);
 
   cpio->c_dev = MKDEV(c_maj, c_min);
   cpio->c_ino = c_ino;
@@ -151,40 +153,85 @@ static void read_cpio_archive(void) {
     node->c_name = basename(node->c_path);
 
     TAILQ_INSERT_HEAD(&initrd_head, node, c_list);
+    initrd_count++;
   }
 }
 
-/* Check if `p1` is a path to file/directory which can be contained directly
- * inside `p2` directory. */
-static bool is_direct_descendant(const char *p1, const char *p2) {
-  int i;
-
-  for (i = 0; p1[i] && p1[i] == p2[i]; i++)
-    continue;
+static uint32_t cpio_path_hash(const char *path, size_t len) {
+  return hash32_strn(path, len, HASH32_STR_INIT);
+}
 
-  if (p2[i])
-    return false;
+static cpio_node_t *cpio_path_lookup(cpio_node_t **pathtab, unsigned mask,
+                                     const char *path, size_t len) {
+  cpio_node_t *node = pathtab[cpio_path_hash(path, len) & mask];
+  for (; node; node = node->c_pathnext)
+    if (strncmp(node->c_path, path, len) == 0 && node->c_path[len] == '\0')
+      return node;
+  return NULL;
+}
 
-  /* Check whether `p1` is valid filename (does not contain '/') */
-  if (p1[i] == '/')
-    i++; /* skip trailing '/' */
-  else if (i > 0)
-    return false;
+static cpio_hash_t *cpio_child_bucket(cpio_node_t *dir, const char *name,
+                                      size_t len) {
+  return &dir->c_hashtab[hash32_strn(name, len, HASH32_STR_INIT) &
+                         dir->c_hashmask];
+}
 
-  return (strchr(p1 + i, '/') == NULL);
+/* Smallest power of 2 that is not less than `n`. */
+static unsigned cpio_hash_size(unsigned n) {
+  unsigned size = 1;
+  while (size < n)
+    size <<= 1;
+  return size;
 }
 
+/* Link each node with its parent directory. Parents are found by looking up
+ * the path with last component stripped in a temporary hash table of all
+ * paths, hence the tree is built in linear time regardless of the order of
+ * entries in the archive. */
 static void initrd_build_tree(void) {
-  cpio_node_t *parent, *child;
+  unsigned size = cpio_hash_size(initrd_count);
+  cpio_node_t **pathtab =
+    kmalloc(M_INITRD, size * sizeof(cpio_node_t *), M_ZERO | M_WAITOK);
+  cpio_node_t *node, *parent;
+
+  TAILQ_FOREACH (node, &initrd_head, c_list) {
+    cpio_node_t **chain =
+      &pathtab[cpio_path_hash(node->c_path, strlen(node->c_path)) &
+               (size - 1)];
+    node->c_pathnext = *chain;
+    *chain = node;
+  }
 
+  TAILQ_FOREACH (node, &initrd_head, c_list) {
+    if (node == root_node)
+      continue;
+    size_t len = node->c_name - node->c_path;
+    parent = cpio_path_lookup(pathtab, size - 1, node->c_path,
+                              len > 0 ? len - 1 : 0);
+    if (parent == NULL || CMTOFT(parent->c_mode) != C_DIR) {
+      klog("initrd: no parent directory for '%s'!", node->c_path);
+      continue;
+    }
+    TAILQ_INSERT_TAIL(&parent->c_children, node, c_siblings);
+    parent->c_nchildren++;
+  }
+
+  kfree(M_INITRD, pathtab);
+
+  /* Index children of each directory by name. */
   TAILQ_FOREACH (parent, &initrd_head, c_list) {
     if (CMTOFT(parent->c_mode) != C_DIR)
       continue;
-    TAILQ_FOREACH (child, &initrd_head, c_list) {
-      if (parent == child)
-        continue;
-      if (is_direct_descendant(child->c_path, parent->c_path))
-        TAILQ_INSERT_TAIL(&parent->c_children, child, c_siblings);
+    size = cpio_hash_size(parent->c_nchildren / 2 + 1);
+    parent->c_hashtab =
+      kmalloc(M_INITRD, size * sizeof(cpio_hash_t), M_WAITOK);
+    parent->c_hashmask = size - 1;
+    for (unsigned i = 0; i < size; i++)
+      LIST_INIT(&parent->c_hashtab[i]);
+    TAILQ_FOREACH (node, &parent->c_children, c_siblings) {
+      cpio_hash_t *bucket =
+        cpio_child_bucket(parent, node->c_name, strlen(node->c_name));
+      LIST_INSERT_HEAD(bucket, node, c_hash);
     }
   }
 }
@@ -204,14 +251,16 @@ static ino_t initrd_enum_inodes(cpio_node_t *parent, ino_t ino) {
   return ino;
 }
 
-static vnode_t *vnode_of_cpio_node(cpio_node_t *cn) {
-  if (!cn->c_vnode) {
-    vnodetype_t type = ft2vt[CMTOFT(cn->c_mode)];
-    cn->c_vnode = vnode_new(type, &initrd_vops, cn);
-  }
+static int initrd_vnode_load(vnode_t *v, void *arg) {
+  cpio_node_t *cn = arg;
+  v->v_type = ft2vt[CMTOFT(cn->c_mode)];
+  v->v_ops = &initrd_vops;
+  v->v_data = cn;
+  return 0;
+}
 
-  vnode_hold(cn->c_vnode);
-  return cn->c_vnode;
+static int vnode_of_cpio_node(mount_t *mp, cpio_node_t *cn, vnode_t **vp) {
+  return vcache_get(mp, cn->c_ino, initrd_vnode_load, cn, vp);
 }
 
 static int initrd_vnode_lookup(vnode_t *vdir, componentname_t *cn,
@@ -221,18 +270,16 @@ static int initrd_vnode_lookup(vnode_t *vdir, componentname_t *cn,
 
   cpio_node_t *it;
   cpio_node_t *cn_dir = (cpio_node_t *)vdir->v_data;
+  cpio_hash_t *bucket =
+    cpio_child_bucket(cn_dir, cn->cn_nameptr, cn->cn_namelen);
 
-  TAILQ_FOREACH (it, &cn_dir->c_children, c_siblings) {
-    if (componentname_equal(cn, it->c_name)) {
-      *res = vnode_of_cpio_node(it);
-      return 0;
-    }
+  LIST_FOREACH (it, bucket, c_hash) {
+    if (componentname_equal(cn, it->c_name))
+      return vnode_of_cpio_node(vdir->v_mount, it, res);
   }
 
   if (componentname_equal(cn, "..") && cn_dir->c_parent) {
-    it = cn_dir->c_parent;
-    *res = vnode_of_cpio_node(it);
-    return 0;
+    return vnode_of_cpio_node(vdir->v_mount, cn_dir->c_parent, res);
   } else if (componentname_equal(cn, ".")) {
     vnode_hold(vdir);
     *res = vdir;
@@ -335,16 +382,11 @@ static int initrd_vnode_readdir(vnode_t *v, uio_t *uio) {
 }
 
 static int initrd_root(mount_t *m, vnode_t **v) {
-  *v = m->mnt_data;
-  vnode_hold(*v);
-  return 0;
+  return vnode_of_cpio_node(m, m->mnt_data, v);
 }
 
 static int initrd_mount(mount_t *m) {
-  vnode_t *root = vnode_new(V_DIR, &initrd_vops, root_node);
-  root->v_mount = m;
-  root_node->c_vnode = root;
-  m->mnt_data = root;
+  m->mnt_data = root_node;
   return 0;
 }
 
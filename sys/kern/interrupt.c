@@ -9,6 +9,7 @@
 #include <sys/sched.h>
 #include <sys/device.h>
 #include <sys/fdt.h>
+#include <sys/klatency.h>
 
 static KMALLOC_DEFINE(M_INTR, "interrupt events & handlers");
 
@@ -49,15 +50,18 @@ __no_profile bool intr_disabled(void) {
 
 __no_profile void intr_disable(void) {
   cpu_intr_disable();
-  thread_self()->td_idnest++;
+  if (thread_self()->td_idnest++ == 0)
+    klat_start(KLAT_INTR, __caller(0));
 }
 
 void intr_enable(void) {
   assert(intr_disabled());
   thread_t *td = thread_self();
   td->td_idnest--;
-  if (td->td_idnest == 0)
+  if (td->td_idnest == 0) {
+    klat_stop(KLAT_INTR, __caller(0));
     cpu_intr_enable();
+  }
 }
 
 intr_event_t *intr_event_create(void *source, int irq, ie_action_t *disable,
@@ -164,6 +168,7 @@ __no_profile void intr_root_handler(ctx_t *ctx) {
   /* Increment interrupt disable nesting counter in order to prevent filter
    * routines to accidentaly enable interrupts. */
   td->td_idnest++;
+  klat_start(KLAT_INTR, __caller(0));
 
   /* Explicitely disallow switching out to another thread. */
   PCPU_SET(no_switch, true);
@@ -185,6 +190,7 @@ __no_profile void intr_root_handler(ctx_t *ctx) {
   }
 
   td->td_idnest--;
+  klat_stop(KLAT_INTR, __caller(0));
 }
 
 void intr_event_run_handlers(intr_event_t *ie) {
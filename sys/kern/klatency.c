@@ -0,0 +1,156 @@
+#include <sys/cpu.h>
+#include <sys/devfs.h>
+#include <sys/klatency.h>
+#include <sys/libkern.h>
+#include <sys/linker_set.h>
+#include <sys/mimiker.h>
+#include <sys/thread.h>
+#include <sys/uio.h>
+#include <machine/kftrace.h>
+
+/*
+ * The tracer must not use any locks nor call intr_disable, since it's invoked
+ * from the very functions that manipulate interrupt and preemption state.
+ * Its state is protected by disabling interrupts directly on the processor.
+ *
+ * FTTB there's only one processor, hence per-processor state is global.
+ */
+
+/* Counter returned by kft_get_time is as wide as a machine word, hence window
+ * durations are computed modulo word size to handle counter wraparound. */
+typedef unsigned long klat_time_t;
+
+typedef struct klat_state {
+  bool open;         /* is there an open window? */
+  klat_time_t start; /* when the window was opened */
+  const void *pc;    /* where the window was opened */
+  tid_t tid;         /* thread that opened the window */
+} klat_state_t;
+
+static klat_state_t klat_state[KLAT_NTYPES];
+static klat_window_t klat_worst[KLAT_NTYPES][KLAT_WORST];
+
+static __no_profile bool klat_lock(void) {
+  bool disabled = cpu_intr_disabled();
+  cpu_intr_disable();
+  return disabled;
+}
+
+static __no_profile void klat_unlock(bool disabled) {
+  if (!disabled)
+    cpu_intr_enable();
+}
+
+static __no_profile void klat_record(klat_type_t type, klat_state_t *ks,
+                                     klat_time_t now, const void *pc) {
+  klat_window_t *worst = klat_worst[type];
+  klat_window_t *kw = &worst[0];
+  uint64_t duration = (klat_time_t)(now - ks->start);
+
+  /* Replace the shortest window if the new one is longer. */
+  for (int i = 1; i < KLAT_WORST; i++)
+    if (worst[i].kw_duration < kw->kw_duration)
+      kw = &worst[i];
+
+  if (duration <= kw->kw_duration)
+    return;
+
+  kw->kw_type = type;
+  kw->kw_tid = ks->tid;
+  kw->kw_start = ks->start;
+  kw->kw_duration = duration;
+  kw->kw_start_pc = (uintptr_t)ks->pc;
+  kw->kw_end_pc = (uintptr_t)pc;
+}
+
+static __no_profile void _klat_start(klat_type_t type, const void *pc) {
+  klat_state_t *ks = &klat_state[type];
+  if (ks->open)
+    return;
+  ks->open = true;
+  ks->start = kft_get_time();
+  ks->pc = pc;
+  ks->tid = thread_self()->td_tid;
+}
+
+static __no_profile void _klat_stop(klat_type_t type, const void *pc) {
+  klat_state_t *ks = &klat_state[type];
+  if (!ks->open)
+    return;
+  ks->open = false;
+  klat_record(type, ks, kft_get_time(), pc);
+}
+
+__no_profile void klat_start(klat_type_t type, const void *pc) {
+  bool disabled = klat_lock();
+  _klat_start(type, pc);
+  klat_unlock(disabled);
+}
+
+__no_profile void klat_stop(klat_type_t type, const void *pc) {
+  bool disabled = klat_lock();
+  _klat_stop(type, pc);
+  klat_unlock(disabled);
+}
+
+__no_profile void klat_setpc(klat_type_t type, const void *pc) {
+  thread_t *td = thread_self();
+  unsigned nest = (type == KLAT_INTR) ? td->td_idnest : td->td_pdnest;
+
+  /* Only a window opened by the caller can be attributed to it. */
+  if (nest != 1)
+    return;
+
+  bool disabled = klat_lock();
+  if (klat_state[type].open)
+    klat_state[type].pc = pc;
+  klat_unlock(disabled);
+}
+
+/* Interrupts are disabled during context switch, so only preemption state of
+ * the processor may change, depending on the state of the new thread. */
+__no_profile void klat_switch(thread_t *newtd) {
+  bool disabled = klat_lock();
+  if (newtd->td_pdnest > 0)
+    _klat_start(KLAT_PREEMPT, __caller(0));
+  else
+    _klat_stop(KLAT_PREEMPT, __caller(0));
+  klat_unlock(disabled);
+}
+
+static int dev_klatency_read(devnode_t *dev, uio_t *uio) {
+  klat_window_t buf[KLAT_NTYPES * KLAT_WORST];
+  size_t n = 0;
+
+  bool disabled = klat_lock();
+  for (int t = 0; t < KLAT_NTYPES; t++)
+    for (int i = 0; i < KLAT_WORST; i++)
+      if (klat_worst[t][i].kw_duration > 0)
+        buf[n++] = klat_worst[t][i];
+  klat_unlock(disabled);
+
+  size_t size = n * sizeof(klat_window_t);
+  if ((size_t)uio->uio_offset >= size)
+    return 0;
+  return uiomove_frombuf(buf, size, uio);
+}
+
+static int dev_klatency_write(devnode_t *dev, uio_t *uio) {
+  bool disabled = klat_lock();
+  bzero(klat_worst, sizeof(klat_worst));
+  klat_unlock(disabled);
+  uio->uio_resid = 0;
+  return 0;
+}
+
+static devops_t dev_klatency_ops = {
+  .d_type = DT_SEEKABLE,
+  .d_read = dev_klatency_read,
+  .d_write = dev_klatency_write,
+};
+
+static void init_dev_klatency(void) {
+  devfs_makedev_new(NULL, "klatency", &dev_klatency_ops, NULL, NULL);
+}
+
+SET_ENTRY(devfs_init, init_dev_klatency);
@@ -173,3 +173,23 @@ vaddr_t kmem_map_contig(paddr_t pa, size_t size, unsigned flags) {
 
   return va;
 }
+
+vaddr_t kmem_map_pages(vm_page_t **pages, size_t npages) {
+  size_t size = npages * PAGESIZE;
+  vaddr_t va = kva_alloc(size, M_WAITOK);
+
+  kasan_mark_valid((void *)va, size);
+
+  for (size_t i = 0; i < npages; i++)
+    kva_map_page(va + i * PAGESIZE, pages[i]->paddr, 1, 0);
+
+  return va;
+}
+
+void kmem_unmap_pages(vaddr_t va, size_t npages) {
+  size_t size = npages * PAGESIZE;
+
+  kasan_mark_invalid((void *)va, size, KASAN_CODE_KMEM_FREED);
+  pmap_kremove(va, size);
+  kva_free(va);
+}
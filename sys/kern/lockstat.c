@@ -0,0 +1,149 @@
+#include <sys/devfs.h>
+#include <sys/libkern.h>
+#include <sys/linker_set.h>
+#include <sys/lockstat.h>
+#include <sys/malloc.h>
+#include <sys/mimiker.h>
+#include <sys/mutex.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+/*
+ * Statistics are kept in pre-allocated global memory, just like lock classes
+ * in lockdep. Lock statistics are updated with `lockstat_lock` held, which is
+ * a spin lock excluded from profiling to avoid recursion.
+ */
+
+typedef struct lockstat_class {
+  SIMPLEQ_ENTRY(lockstat_class) hash_entry;
+  lock_class_key_t *key;
+  lockstat_info_t info;
+} lockstat_class_t;
+
+static MTX_DEFINE(lockstat_lock, MTX_SPIN | MTX_NODEBUG);
+
+#define CLASSHASH_SIZE 64
+#define CLASSHASH(key)                                                         \
+  (((uintptr_t)(key) / alignof(lock_class_key_t)) % CLASSHASH_SIZE)
+#define CLASS_HASH_CHAIN(key) (&lockstat_hashtbl[CLASSHASH(key)])
+
+static SIMPLEQ_HEAD(, lockstat_class) lockstat_hashtbl[CLASSHASH_SIZE];
+
+#define MAX_CLASSES 128
+static lockstat_class_t lockstat_classes[MAX_CLASSES];
+static int class_cnt = 0;
+
+/* Used for locks that do not fit into `lockstat_classes` array. */
+static lockstat_class_t lockstat_overflow = {.info.ls_name = "<overflow>"};
+
+__no_profile uint64_t lockstat_now(void) {
+  bintime_t bt = binuptime();
+  return bt.sec * 1000000000ULL +
+         ((1000000000ULL * (uint32_t)(bt.frac >> 32)) >> 32);
+}
+
+static __no_profile lockstat_class_t *
+get_or_create_class(lock_class_mapping_t *lock) {
+  lockstat_class_t *class;
+
+  /* If the lock doesn't have a key then it is statically allocated. In this
+   * case use its address as the key. */
+  if (lock->key == NULL)
+    lock->key = (void *)lock;
+
+  SIMPLEQ_FOREACH(class, CLASS_HASH_CHAIN(lock->key), hash_entry) {
+    if (class->key == lock->key)
+      return class;
+  }
+
+  if (class_cnt >= MAX_CLASSES)
+    return &lockstat_overflow;
+
+  class = &lockstat_classes[class_cnt++];
+  class->key = lock->key;
+  strlcpy(class->info.ls_name, lock->name, LOCKSTAT_NAME_MAX);
+  SIMPLEQ_INSERT_HEAD(CLASS_HASH_CHAIN(lock->key), class, hash_entry);
+  return class;
+}
+
+__no_profile void lockstat_acquire(lock_class_mapping_t *lock,
+                                   const void *waitpt, bool contended,
+                                   unsigned spins, uint64_t blocked) {
+  SCOPED_MTX_LOCK(&lockstat_lock);
+
+  lockstat_class_t *class = lock->lock_stat;
+  if (class == NULL)
+    class = lock->lock_stat = get_or_create_class(lock);
+
+  lockstat_info_t *info = &class->info;
+  info->ls_acquired++;
+  if (contended)
+    info->ls_contended++;
+  info->ls_spins += spins;
+  info->ls_blocked += blocked;
+
+  lock->waitpt = waitpt;
+  lock->acquired = lockstat_now();
+}
+
+/* This function is called with the `lock` held. */
+__no_profile void lockstat_release(lock_class_mapping_t *lock) {
+  uint64_t held = lockstat_now() - lock->acquired;
+
+  SCOPED_MTX_LOCK(&lockstat_lock);
+
+  lockstat_info_t *info = &lock->lock_stat->info;
+  info->ls_held += held;
+  if (held > info->ls_maxheld) {
+    info->ls_maxheld = held;
+    info->ls_maxheld_pc = (uintptr_t)lock->waitpt;
+  }
+}
+
+/* Reading /dev/lockstat returns a snapshot of all lock classes statistics. */
+static int dev_lockstat_read(devnode_t *dev, uio_t *uio) {
+  size_t size = (MAX_CLASSES + 1) * sizeof(lockstat_info_t);
+  lockstat_info_t *buf = kmalloc(M_TEMP, size, 0);
+  int n = 0, error = 0;
+
+  WITH_MTX_LOCK (&lockstat_lock) {
+    for (int i = 0; i < class_cnt; i++)
+      buf[n++] = lockstat_classes[i].info;
+    if (lockstat_overflow.info.ls_acquired)
+      buf[n++] = lockstat_overflow.info;
+  }
+
+  size = n * sizeof(lockstat_info_t);
+  if ((size_t)uio->uio_offset < size)
+    error = uiomove_frombuf(buf, size, uio);
+  kfree(M_TEMP, buf);
+  return error;
+}
+
+/* Any write to /dev/lockstat resets gathered statistics. */
+static int dev_lockstat_write(devnode_t *dev, uio_t *uio) {
+  WITH_MTX_LOCK (&lockstat_lock) {
+    for (int i = 0; i < class_cnt; i++) {
+      lockstat_info_t *info = &lockstat_classes[i].info;
+      bzero(&info->ls_acquired,
+            sizeof(lockstat_info_t) - offsetof(lockstat_info_t, ls_acquired));
+    }
+    lockstat_info_t *info = &lockstat_overflow.info;
+    bzero(&info->ls_acquired,
+          sizeof(lockstat_info_t) - offsetof(lockstat_info_t, ls_acquired));
+  }
+  uio->uio_resid = 0;
+  return 0;
+}
+
+static devops_t dev_lockstat_ops = {
+  .d_type = DT_SEEKABLE,
+  .d_read = dev_lockstat_read,
+  .d_write = dev_lockstat_write,
+};
+
+static void init_dev_lockstat(void) {
+  devfs_makedev_new(NULL, "lockstat", &dev_lockstat_ops, NULL, NULL);
+}
+
+SET_ENTRY(devfs_init, init_dev_lockstat);
@@ -14,6 +14,7 @@
 #include <sys/turnstile.h>
 #include <sys/thread.h>
 #include <sys/proc.h>
+#include <sys/futex.h>
 #include <sys/filedesc.h>
 #include <sys/exec.h>
 #include <sys/ktest.h>
@@ -21,6 +22,8 @@
 #include <sys/fdt.h>
 #include <sys/vfs.h>
 #include <sys/vnode.h>
+#include <sys/buf.h>
+#include <sys/aio.h>
 #include <sys/vm_map.h>
 #include <sys/vm_physmem.h>
 #include <sys/pmap.h>
@@ -35,14 +38,42 @@
    userspace init program. */
 static void mount_fs(void) {
   proc_t *p = &proc0;
-  do_mount(p, "initrd", "/");
-  do_mount(p, "devfs", "/dev");
-  do_mount(p, "tmpfs", "/tmp");
-  do_mount(p, "tmpfs", "/root");
+  do_mount(p, "initrd", "/", NULL);
+  do_mount(p, "devfs", "/dev", NULL);
+  do_mount(p, "tmpfs", "/tmp", NULL);
+  do_mount(p, "tmpfs", "/root", NULL);
   do_fchmodat(p, AT_FDCWD, "/tmp", ACCESSPERMS | S_ISTXT, 0);
   do_fchmodat(p, AT_FDCWD, "/root", S_IRWXU, 0);
 }
 
+/* If `root` kernel argument names a block device, then the filesystem stored
+ * there replaces the initial ramdisk. It must be done once all devices have
+ * been attached. Directories for temporary files are kept on disk. */
+static void mount_root(void) {
+  proc_t *p = proc_self();
+  int error;
+
+  char *dev = kenv_get("root");
+  if (dev == NULL)
+    return;
+
+  char *fs = kenv_get("rootfs");
+  if (fs == NULL)
+    fs = "ext2";
+
+  if ((error = do_mountroot(p, fs, dev)))
+    panic("Failed to mount root filesystem %s from %s: error %d!", fs, dev,
+          error);
+
+  if ((error = do_mount(p, "devfs", "/dev", NULL)))
+    panic("Failed to mount devfs on new root filesystem: error %d!", error);
+
+  /* The ramdisk is not released, since initrd cannot be unmounted. Its root
+   * stays as `vfs_root_vnode` covered by the new root and its vnodes read
+   * file contents straight from the ramdisk image. */
+  klog("Mounted root filesystem %s from %s", fs, dev);
+}
+
 static __noreturn void start_init(__unused void *arg) {
   proc_t *p = proc_self();
   int error;
@@ -56,6 +87,8 @@ static __noreturn void start_init(__unused void *arg) {
   /* [SECOND_PASS] Init devices that need extra kernel API to be functional. */
   init_devices();
 
+  mount_root();
+
   assert(p->p_pid == 1);
   error = session_enter(p);
   assert(error == 0);
@@ -112,8 +145,11 @@ __noreturn void kernel_init(void) {
   init_devices();
 
   init_vfs();
+  init_bio();
+  init_aio();
   init_proc();
   init_proc0();
+  init_futex();
 
   /* Mount filesystems (including devfs). */
   mount_fs();
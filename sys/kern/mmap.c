@@ -4,6 +4,8 @@
 #include <sys/mman.h>
 #include <sys/thread.h>
 #include <sys/errno.h>
+#include <sys/file.h>
+#include <sys/filedesc.h>
 #include <sys/vm_map.h>
 #include <sys/mutex.h>
 #include <sys/proc.h>
@@ -22,7 +24,34 @@ static_assert(VM_FIXED == MAP_FIXED, "VM_FIXED != MAP_FIXED");
 static_assert(VM_STACK == MAP_STACK, "VM_STACK != MAP_STACK");
 static_assert(VM_EXCL == MAP_EXCL, "VM_EXCL != MAP_EXCL");
 
-int do_mmap(vaddr_t *addr_p, size_t length, int u_prot, int u_flags) {
+/* Only shared memory objects can be mapped for now. */
+static int mmap_file(proc_t *p, int fd, off_t pos, size_t length,
+                     vm_prot_t prot, vm_flags_t flags, vm_aref_t *arefp) {
+  file_t *f;
+  int error;
+
+  if (pos < 0 || !page_aligned_p(pos))
+    return EINVAL;
+
+  if ((error = fdtab_get_file(p->p_fdtable, fd, 0, &f)))
+    return error;
+
+  if (f->f_type != FT_SHM)
+    error = ENODEV;
+  else if (!(f->f_flags & FF_READ))
+    error = EACCES;
+  else if ((flags & VM_SHARED) && (prot & VM_PROT_WRITE) &&
+           !(f->f_flags & FF_WRITE))
+    error = EACCES;
+  else
+    error = shm_mmap(f, pos, length, arefp);
+
+  file_drop(f);
+  return error;
+}
+
+int do_mmap(vaddr_t *addr_p, size_t length, int u_prot, int u_flags, int fd,
+            off_t pos) {
   thread_t *td = thread_self();
   assert(td->td_proc != NULL);
   vm_map_t *vmap = td->td_proc->p_uspace;
@@ -43,7 +72,16 @@ int do_mmap(vaddr_t *addr_p, size_t length, int u_prot, int u_flags) {
 
   int error;
   vm_map_entry_t *ent;
-  if ((error = vm_map_alloc_entry(vmap, addr, length, prot, flags, &ent)))
+  if (flags & VM_ANON) {
+    error = vm_map_alloc_entry(vmap, addr, length, prot, flags, &ent);
+  } else {
+    vm_aref_t aref;
+    if ((error = mmap_file(td->td_proc, fd, pos, length, prot, flags, &aref)))
+      return error;
+    error =
+      vm_map_alloc_entry_amap(vmap, addr, length, prot, flags, aref, &ent);
+  }
+  if (error)
     return error;
 
   vaddr_t start = vm_map_entry_start(ent);
@@ -1,5 +1,7 @@
 #include <sys/klog.h>
 #include <sys/mutex.h>
+#include <sys/lockstat.h>
+#include <sys/klatency.h>
 #include <sys/interrupt.h>
 #include <sys/turnstile.h>
 #include <sys/sched.h>
@@ -14,7 +16,7 @@ void _mtx_init(mtx_t *m, intptr_t flags, const char *name,
   assert((flags & ~(MTX_SPIN | MTX_NODEBUG)) == 0);
   m->m_owner = flags;
 
-#if LOCKDEP
+#if LOCKDEP || LOCKSTAT
   m->m_lockmap =
     (lock_class_mapping_t){.key = key, .name = name, .lock_class = NULL};
 #endif
@@ -25,6 +27,8 @@ void __no_profile _mtx_lock(mtx_t *m, const void *waitpt) {
 
   if (flags & MTX_SPIN) {
     intr_disable();
+    /* Attribute the window to the lock user rather than to this function. */
+    klat_setpc(KLAT_INTR, waitpt);
   } else {
     if (__unlikely(intr_disabled()))
       panic("Cannot acquire sleep mutex in interrupt context!");
@@ -40,6 +44,12 @@ void __no_profile _mtx_lock(mtx_t *m, const void *waitpt) {
 
   thread_t *td = thread_self();
 
+#if LOCKSTAT
+  bool contended = false;
+  unsigned spins = 0;
+  uint64_t blocked = 0;
+#endif
+
   for (;;) {
     intptr_t expected = flags;
     intptr_t value = (intptr_t)td | flags;
@@ -48,8 +58,16 @@ void __no_profile _mtx_lock(mtx_t *m, const void *waitpt) {
     if (atomic_compare_exchange_strong(&m->m_owner, &expected, value))
       break;
 
-    if (flags & MTX_SPIN)
+#if LOCKSTAT
+    contended = true;
+#endif
+
+    if (flags & MTX_SPIN) {
+#if LOCKSTAT
+      spins++;
+#endif
       continue;
+    }
 
     WITH_NO_PREEMPTION {
       /* TODO(cahir) turnstile_take / turnstile_give doesn't make much sense
@@ -63,12 +81,23 @@ void __no_profile _mtx_lock(mtx_t *m, const void *waitpt) {
         if (ts == td->td_turnstile)
           m->m_owner |= MTX_CONTESTED;
 
+#if LOCKSTAT
+        uint64_t start = lockstat_now();
         turnstile_wait(ts, mtx_owner(m), waitpt);
+        blocked += lockstat_now() - start;
+#else
+        turnstile_wait(ts, mtx_owner(m), waitpt);
+#endif
       } else {
         turnstile_give(ts);
       }
     }
   }
+
+#if LOCKSTAT
+  if (!(flags & MTX_NODEBUG))
+    lockstat_acquire(&m->m_lockmap, waitpt, contended, spins, blocked);
+#endif
 }
 
 void __no_profile mtx_unlock(mtx_t *m) {
@@ -81,6 +110,11 @@ void __no_profile mtx_unlock(mtx_t *m) {
     lockdep_release(&m->m_lockmap);
 #endif
 
+#if LOCKSTAT
+  if (!(flags & MTX_NODEBUG))
+    lockstat_release(&m->m_lockmap);
+#endif
+
   /* Fast path: if lock is not contested then drop ownership. */
   intptr_t expected = (intptr_t)thread_self() | flags;
   intptr_t value = flags;
@@ -102,6 +136,9 @@ void __no_profile mtx_unlock(mtx_t *m) {
   }
 
 done:
-  if (flags & MTX_SPIN)
+  if (flags & MTX_SPIN) {
+    if (thread_self()->td_idnest == 1)
+      klat_stop(KLAT_INTR, __caller(0));
     intr_enable();
+  }
 }
@@ -5,6 +5,7 @@
 #include <sys/kmem.h>
 #include <sys/pool.h>
 #include <sys/errno.h>
+#include <sys/event.h>
 #include <sys/pipe.h>
 #include <sys/libkern.h>
 #include <sys/stat.h>
@@ -13,12 +14,26 @@
 #include <sys/proc.h>
 #include <sys/ringbuf.h>
 #include <sys/uio.h>
+#include <sys/pmap.h>
+#include <sys/vm_amap.h>
+#include <sys/vm_map.h>
+#include <sys/syslimits.h>
 
 /* Our pipes are unidrectional, since almost all software depends on POSIX
  * semantics. Please note that BSD systems implement bidirectional pipes,
  * even if they don't tell you that in pipe(2) manual. */
 
 typedef struct pipe pipe_t;
+typedef struct pipe_direct pipe_direct_t;
+
+/* Large writes are not copied into the pipe buffer. Instead the writer lends
+ * its pages to the reader and waits until the reader copies the data out. */
+struct pipe_direct {
+  vm_anon_t *anons[PIPE_DIRECT_PAGES]; /*!< loaned pages with the data */
+  size_t offset;                       /*!< offset of data in the first page */
+  size_t size;                         /*!< number of bytes to transfer */
+  size_t pos;                          /*!< number of bytes already read */
+};
 
 struct pipe {
   mtx_t mtx; /*!< protects all other fields */
@@ -28,6 +43,9 @@ struct pipe {
   condvar_t nonempty; /*!< used to wait data to appear in the buffer */
   condvar_t nonfull;  /*!< used to wait for free space in the buffer */
   ringbuf_t buf;      /*!< buffer with pipe data */
+  size_t hiwat;       /*!< max. bytes in buffer since it was last empty */
+  pipe_direct_t *direct; /*!< pending direct write (if any) */
+  knlist_t knotes;       /*!< knotes attached to both ends of the pipe */
 };
 
 static POOL_DEFINE(P_PIPE, "pipe", sizeof(pipe_t));
@@ -41,14 +59,59 @@ static pipe_t *pipe_alloc(void) {
   cv_init(&pipe->nonfull, "pipe_nonfull");
   pipe->buf.data = kmem_alloc(PIPE_SIZE, M_ZERO);
   pipe->buf.size = PIPE_SIZE;
+  SLIST_INIT(&pipe->knotes);
   return pipe;
 }
 
 static void pipe_free(pipe_t *pipe) {
-  kmem_free(pipe->buf.data, PIPE_SIZE);
+  kmem_free(pipe->buf.data, pipe->buf.size);
   pool_free(P_PIPE, pipe);
 }
 
+/* Replaces pipe buffer with a new one of `size` bytes. Buffered data is moved
+ * to the beginning of the new buffer. */
+static void pipe_resize(pipe_t *pipe, size_t size) {
+  ringbuf_t *buf = &pipe->buf;
+  size_t count = buf->count;
+  uint8_t *data = kmem_alloc(size, 0);
+
+  assert(count <= size);
+  ringbuf_getnb(buf, data, count);
+  kmem_free(buf->data, buf->size);
+  ringbuf_init(buf, data, size);
+  buf->head = count % size;
+  buf->count = count;
+}
+
+/* Called when the buffer was drained. If the buffer was mostly unused since
+ * it was last empty then the load went down and we can give memory back. */
+static void pipe_shrink(pipe_t *pipe) {
+  size_t hiwat = pipe->hiwat;
+
+  pipe->hiwat = 0;
+  if (pipe->buf.size > PIPE_SIZE && hiwat <= pipe->buf.size / 4)
+    pipe_resize(pipe, pipe->buf.size / 2);
+}
+
+static int pipe_read_direct(pipe_direct_t *pd, uio_t *uio) {
+  int error = 0;
+
+  while (pd->pos < pd->size && uio->uio_resid > 0) {
+    size_t off = pd->offset + pd->pos;
+    size_t pgoff = off & (PAGESIZE - 1);
+    size_t len = min(PAGESIZE - pgoff, pd->size - pd->pos);
+    vm_page_t *pg = pd->anons[off / PAGESIZE]->page;
+    size_t resid = uio->uio_resid;
+
+    error = uiomove(phys_to_dmap(pg->paddr) + pgoff, len, uio);
+    pd->pos += resid - uio->uio_resid;
+    if (error)
+      break;
+  }
+
+  return error;
+}
+
 static int pipe_read(file_t *f, uio_t *uio) {
   pipe_t *pipe = f->f_data;
   int error;
@@ -61,28 +124,109 @@ static int pipe_read(file_t *f, uio_t *uio) {
 
   /* no read atomicity for now! */
   WITH_MTX_LOCK (&pipe->mtx) {
-    if (f->f_flags & IO_NONBLOCK)
-      return EAGAIN;
-    while (ringbuf_empty(&pipe->buf)) {
+    while (ringbuf_empty(&pipe->buf) && !pipe->direct) {
       /* pipe empty & no writers => return end-of-file */
       if (pipe->writer_closed)
         return 0;
+      if (f->f_flags & IO_NONBLOCK)
+        return EAGAIN;
       /* restart the syscall if we were interrupted by a signal */
       if (cv_wait_intr(&pipe->nonempty, &pipe->mtx))
         return ERESTARTSYS;
     }
 
-    if ((error = ringbuf_read(&pipe->buf, uio)))
+    /* Direct write starts only when the buffer is empty, hence any data in
+     * the buffer was written after the loaned data. */
+    if (pipe->direct) {
+      error = pipe_read_direct(pipe->direct, uio);
+    } else {
+      error = ringbuf_read(&pipe->buf, uio);
+      if (ringbuf_empty(&pipe->buf))
+        pipe_shrink(pipe);
+    }
+    if (error)
       return error;
     /* notify writer that free space is available */
     cv_broadcast(&pipe->nonfull);
+    knote(&pipe->knotes, 0);
   }
 
   return 0;
 }
 
+static bool pipe_direct_ok(file_t *f, uio_t *uio) {
+  /* Loaning pages blocks the writer until the reader copies the data. */
+  if (f->f_flags & IO_NONBLOCK)
+    return false;
+  /* We can only lend pages of current process' address space. */
+  if (!uio->uio_vmspace || uio->uio_vmspace != vm_map_user())
+    return false;
+  return uio->uio_iov->iov_len - uio->uio_iovoff >= PIPE_DIRECT_MIN;
+}
+
+/* Called with pipe lock held, but releases it for the time of loaning pages.
+ * Transfers data from (a part of) current io vector of `uio`. */
+static int pipe_write_direct(pipe_t *pipe, uio_t *uio) {
+  iovec_t *iov = uio->uio_iov;
+  vaddr_t va = (vaddr_t)iov->iov_base + uio->uio_iovoff;
+  size_t offset = va & (PAGESIZE - 1);
+  size_t size =
+    min(iov->iov_len - uio->uio_iovoff, PIPE_DIRECT_PAGES * PAGESIZE - offset);
+  size_t npages = howmany(offset + size, PAGESIZE);
+  pipe_direct_t pd = {.offset = offset, .size = size};
+  size_t loaned = 0;
+  int error = 0;
+
+  /* Pages may need to be faulted in, so do not stall the reader meanwhile. */
+  mtx_unlock(&pipe->mtx);
+  for (; loaned < npages; loaned++) {
+    vaddr_t page = va - offset + loaned * PAGESIZE;
+    if ((error = vm_map_loan(uio->uio_vmspace, page, VM_PROT_READ,
+                             &pd.anons[loaned])))
+      break;
+  }
+  mtx_lock(&pipe->mtx);
+
+  /* Wait until the data written so far and other direct writes are gone. */
+  while (!error && (pipe->direct || !ringbuf_empty(&pipe->buf))) {
+    if (pipe->reader_closed)
+      error = EPIPE;
+    else if (cv_wait_intr(&pipe->nonfull, &pipe->mtx))
+      error = ERESTARTSYS;
+  }
+
+  if (!error) {
+    pipe->direct = &pd;
+    cv_broadcast(&pipe->nonempty);
+    knote(&pipe->knotes, 0);
+
+    while (!error && pd.pos < pd.size) {
+      if (pipe->reader_closed)
+        error = EPIPE;
+      else if (cv_wait_intr(&pipe->nonfull, &pipe->mtx))
+        error = ERESTARTSYS;
+    }
+
+    pipe->direct = NULL;
+    /* wake up writers waiting for direct write to finish */
+    cv_broadcast(&pipe->nonfull);
+    knote(&pipe->knotes, 0);
+
+    /* reflect the data consumed by the reader in writer's uio */
+    uio->uio_iovoff += pd.pos;
+    uio->uio_resid -= pd.pos;
+    uio->uio_offset += pd.pos;
+  }
+
+  for (size_t i = 0; i < loaned; i++)
+    vm_anon_drop(pd.anons[i]);
+
+  return error;
+}
+
 static int pipe_write(file_t *f, uio_t *uio) {
   pipe_t *pipe = f->f_data;
+  ringbuf_t *buf = &pipe->buf;
   int error;
 
   assert(!pipe->writer_closed);
@@ -92,23 +236,42 @@ static int pipe_write(file_t *f, uio_t *uio) {
 
   size_t old_resid = uio->uio_resid;
 
-  /* TODO(cahir): no write atomicity for now! */
+  /* Writes of at most PIPE_BUF bytes are never interleaved with data from
+   * other writers, i.e. they wait until there's enough space in the buffer. */
+  size_t atomic = old_resid <= PIPE_BUF ? old_resid : 1;
+
   WITH_MTX_LOCK (&pipe->mtx) {
     while (true) {
       if (pipe->reader_closed) {
         error = EPIPE;
         break;
       }
-      if ((error = ringbuf_write(&pipe->buf, uio)))
-        break;
-      /* notify reader that new data is available */
-      cv_broadcast(&pipe->nonempty);
+      if (pipe_direct_ok(f, uio)) {
+        if ((error = pipe_write_direct(pipe, uio)))
+          break;
+      } else if (buf->size - buf->count >= atomic) {
+        if ((error = ringbuf_write(buf, uio)))
+          break;
+        pipe->hiwat = max(pipe->hiwat, buf->count);
+        /* notify reader that new data is available */
+        cv_broadcast(&pipe->nonempty);
+        knote(&pipe->knotes, 0);
+      }
       /* nothing left to write? */
       if (uio->uio_resid == 0)
         return 0;
+      if (buf->size - buf->count >= atomic)
+        continue;
+      /* the reader does not keep up, so give it more room */
+      if (buf->size < PIPE_MAX_SIZE) {
+        pipe_resize(pipe, buf->size * 2);
+        continue;
+      }
       /* buffer is full, so if we write in NONBLOCK then return with error */
-      if (f->f_flags & IO_NONBLOCK)
-        return EAGAIN;
+      if (f->f_flags & IO_NONBLOCK) {
+        error = EAGAIN;
+        break;
+      }
       /* buffer is full so wait for some data to be consumed */
       if (cv_wait_intr(&pipe->nonfull, &pipe->mtx)) {
         error = ERESTARTSYS;
@@ -139,6 +302,7 @@ static int pipe_close(file_t *f) {
       /* Wake up readers so that they exit. */
       cv_broadcast(&pipe->nonempty);
     }
+    knote(&pipe->knotes, 0);
     closed = pipe->reader_closed && pipe->writer_closed;
   }
 
@@ -161,6 +325,63 @@ static int pipe_seek(file_t *f, off_t offset, int whence, off_t *newoffp) {
   return EOPNOTSUPP;
 }
 
+static void pipe_kq_detach(knote_t *kn) {
+  pipe_t *pipe = kn->kn_hook;
+
+  WITH_MTX_LOCK (&pipe->mtx) {
+    SLIST_REMOVE(&pipe->knotes, kn, knote, kn_objlink);
+  }
+}
+
+static int pipe_kq_read(knote_t *kn, long hint) {
+  pipe_t *pipe = kn->kn_hook;
+  assert(mtx_owned(&pipe->mtx));
+
+  pipe_direct_t *pd = pipe->direct;
+
+  kn->kn_kevent.data = pipe->buf.count + (pd ? pd->size - pd->pos : 0);
+  return kn->kn_kevent.data > 0 || pipe->writer_closed;
+}
+
+static int pipe_kq_write(knote_t *kn, long hint) {
+  pipe_t *pipe = kn->kn_hook;
+  assert(mtx_owned(&pipe->mtx));
+
+  kn->kn_kevent.data = pipe->buf.size - pipe->buf.count;
+  return !ringbuf_full(&pipe->buf) || pipe->reader_closed;
+}
+
+static filterops_t pipe_read_filterops = {
+  .filt_detach = pipe_kq_detach,
+  .filt_event = pipe_kq_read,
+};
+
+static filterops_t pipe_write_filterops = {
+  .filt_detach = pipe_kq_detach,
+  .filt_event = pipe_kq_write,
+};
+
+static int pipe_kqfilter(file_t *f, knote_t *kn) {
+  pipe_t *pipe = f->f_data;
+
+  /* Each end of the pipe can be monitored only in its own direction. */
+  if (kn->kn_kevent.filter == EVFILT_READ && (f->f_flags & FF_READ))
+    kn->kn_filtops = &pipe_read_filterops;
+  else if (kn->kn_kevent.filter == EVFILT_WRITE && (f->f_flags & FF_WRITE))
+    kn->kn_filtops = &pipe_write_filterops;
+  else
+    return EINVAL;
+
+  kn->kn_hook = pipe;
+  kn->kn_objlock = &pipe->mtx;
+
+  WITH_MTX_LOCK (&pipe->mtx) {
+    SLIST_INSERT_HEAD(&pipe->knotes, kn, kn_objlink);
+  }
+
+  return 0;
+}
+
 static fileops_t pipeops = {
   .fo_read = pipe_read,
   .fo_write = pipe_write,
@@ -168,6 +389,7 @@ static fileops_t pipeops = {
   .fo_seek = pipe_seek,
   .fo_stat = pipe_stat,
   .fo_ioctl = pipe_ioctl,
+  .fo_kqfilter = pipe_kqfilter,
 };
 
 static file_t *make_pipe_file(pipe_t *pipe, unsigned flags) {
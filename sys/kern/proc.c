@@ -20,6 +20,7 @@
 #include <sys/mutex.h>
 #include <sys/tty.h>
 #include <sys/time.h>
+#include <sys/aio.h>
 #include <bitstring.h>
 
 /* Allocate PIDs from a reasonable range, can be changed as needed. */
@@ -78,17 +79,22 @@ static pgrp_t pgrp0 = {
 
 proc_t proc0 = {
   .p_lock = MTX_INITIALIZER(proc0.p_lock, 0),
-  .p_thread = &thread0,
+  .p_threads = TAILQ_HEAD_INITIALIZER(proc0.p_threads),
   .p_pid = 0,
   .p_pgrp = &pgrp0,
   .p_state = PS_NORMAL,
   .p_children = TAILQ_HEAD_INITIALIZER(proc0.p_children),
+  .p_aiojobs = TAILQ_HEAD_INITIALIZER(proc0.p_aiojobs),
   .p_args = NULL,
 };
 
 void init_proc0(void) {
   proc_t *p = &proc0;
 
+  cv_init(&p->p_threadcv, "process threads");
+  TAILQ_INSERT_TAIL(&p->p_threads, &thread0, td_procq);
+  p->p_nthreads = 1;
+
   /* Let's assign an empty virtual address space... */
   p->p_uspace = vm_map_new();
 
@@ -449,8 +455,9 @@ proc_t *proc_create(thread_t *td, proc_t *parent) {
   proc_t *p = pool_alloc(P_PROC, M_ZERO);
 
   mtx_init(&p->p_lock, 0);
+  cv_init(&p->p_threadcv, "process threads");
+  TAILQ_INIT(&p->p_threads);
   p->p_state = PS_NORMAL;
-  p->p_thread = td;
   p->p_parent = parent;
 
   if (parent->p_elfpath)
@@ -459,12 +466,101 @@ proc_t *proc_create(thread_t *td, proc_t *parent) {
     p->p_args = kstrndup(M_STR, parent->p_args, PARGS_MAX);
 
   TAILQ_INIT(CHILDREN(p));
+  TAILQ_INIT(&p->p_aiojobs);
+  SLIST_INIT(&p->p_klist);
   kitimer_init(p);
 
+  WITH_PROC_LOCK(p) {
+    proc_add_thread(p, td);
+  }
+
+  return p;
+}
+
+void proc_add_thread(proc_t *p, thread_t *td) {
+  assert(mtx_owned(&p->p_lock));
+
+  TAILQ_INSERT_TAIL(&p->p_threads, td, td_procq);
+  p->p_nthreads++;
+
   WITH_MTX_LOCK (td->td_lock)
     td->td_proc = p;
+}
 
-  return p;
+/* Detach the current thread from its process.
+ * Must be called with p::p_lock held. */
+static void proc_remove_thread(proc_t *p, thread_t *td) {
+  assert(mtx_owned(&p->p_lock));
+  assert(td == thread_self());
+
+  TAILQ_REMOVE(&p->p_threads, td, td_procq);
+  p->p_nthreads--;
+
+  WITH_MTX_LOCK (td->td_lock)
+    td->td_proc = NULL;
+
+  /* Notify the thread that waits in proc_single_thread. */
+  cv_broadcast(&p->p_threadcv);
+}
+
+int proc_single_thread(proc_t *p) {
+  thread_t *td = thread_self();
+
+  assert(mtx_owned(&p->p_lock));
+  assert(td->td_proc == p);
+
+  /* Some other thread has already begun to terminate us. */
+  if (td->td_flags & TDF_EXITING)
+    return EINTR;
+
+  thread_t *otd;
+  TAILQ_FOREACH (otd, &p->p_threads, td_procq) {
+    if (otd == td)
+      continue;
+
+    WITH_MTX_LOCK (otd->td_lock) {
+      otd->td_flags |= TDF_EXITING | TDF_NEEDSIGCHK;
+      /* Make stopped threads run again, so they can exit. */
+      if (otd->td_flags & TDF_STOPPING) {
+        otd->td_flags &= ~TDF_STOPPING;
+      } else if (td_is_stopped(otd)) {
+        sched_wakeup(otd);
+      } else if (td_is_interruptible(otd)) {
+        /* Break the sleep, the thread will notice TDF_EXITING flag on its way
+         * back to user space. */
+        mtx_unlock(otd->td_lock);
+        sleepq_abort(otd); /* Locks & unlocks td_lock */
+        mtx_lock(otd->td_lock);
+      }
+    }
+  }
+
+  while (p->p_nthreads > 1)
+    cv_wait(&p->p_threadcv, &p->p_lock);
+
+  return 0;
+}
+
+__noreturn void proc_thread_exit(int exitstatus) {
+  thread_t *td = thread_self();
+  proc_t *p = td->td_proc;
+
+  assert(mtx_owned(&p->p_lock));
+
+  /* The last thread takes down the whole process with itself. */
+  if (p->p_nthreads == 1)
+    proc_exit(exitstatus);
+
+  klog("Thread %u leaves process PID(%d)", td->td_tid, p->p_pid);
+
+  proc_remove_thread(p, td);
+
+  /* Signals that were pending on this thread must not get lost. */
+  sig_forward(p, td);
+
+  proc_unlock(p);
+
+  thread_exit();
 }
 
 void proc_add(proc_t *p) {
@@ -506,6 +602,15 @@ proc_t *proc_find(pid_t pid) {
   return NULL;
 }
 
+proc_t *proc_find_any(pid_t pid) {
+  assert(mtx_owned(&all_proc_mtx));
+
+  proc_t *p = proc_find_raw(pid);
+  if (p != NULL)
+    proc_lock(p);
+  return p;
+}
+
 int proc_getpgid(pid_t pid, pgid_t *pgidp) {
   SCOPED_MTX_LOCK(&all_proc_mtx);
 
@@ -570,6 +675,11 @@ __noreturn void proc_exit(int exitstatus) {
 
   assert(mtx_owned(&p->p_lock));
 
+  /* Other threads must be gone before process resources are released.
+   * If another thread is already doing the same, it takes precedence. */
+  if (proc_single_thread(p))
+    proc_thread_exit(exitstatus);
+
   /* Mark this process as dying, so others don't attempt to disturb it. */
   p->p_state = PS_DYING;
 
@@ -580,9 +690,8 @@ __noreturn void proc_exit(int exitstatus) {
    * NOTE: this function may release and re-acquire p->p_lock. */
   kitimer_stop(p);
 
-  /* Detach main thread from the process. */
-  p->p_thread = NULL;
-  td->td_proc = NULL;
+  /* Detach the last thread from the process. */
+  proc_remove_thread(p, td);
 
   /* Make sure address space won't get activated by context switch while it's
    * being deleted. */
@@ -594,6 +703,8 @@ __noreturn void proc_exit(int exitstatus) {
 
   proc_unlock(p);
 
+  /* Pending I/O requests still refer to the address space and the files. */
+  aio_proc_drain(p);
   vm_map_delete(uspace);
   fdtab_drop(p->p_fdtable);
 
@@ -640,6 +751,9 @@ __noreturn void proc_exit(int exitstatus) {
       p->p_state = PS_ZOMBIE;
     }
 
+    /* Processes watching us with kqueue can reap us now. */
+    proc_knote_exit(p);
+
     klog("Process PID(%d) {%p} is dead!", p->p_pid, p);
 
     if (auto_reap) {
@@ -835,38 +949,64 @@ void proc_stop(signo_t sig) {
     proc_wakeup_parent(p->p_parent);
     sig_child(p, CLD_STOPPED);
   }
-  WITH_MTX_LOCK (td->td_lock) {
-    td->td_flags |= TDF_STOPPING;
+
+  /* Remaining threads will stop on their way back to user space. */
+  thread_t *otd;
+  TAILQ_FOREACH (otd, &p->p_threads, td_procq) {
+    if (otd == td)
+      continue;
+    WITH_MTX_LOCK (otd->td_lock)
+      otd->td_flags |= TDF_NEEDSIGCHK;
   }
-  proc_unlock(p);
-  /* We're holding no locks here, so our process can be continued before we
-   * actually stop the thread. This is why we need the TDF_STOPPING flag. */
-  mtx_lock(td->td_lock);
-  if (td->td_flags & TDF_STOPPING) {
-    td->td_flags &= ~TDF_STOPPING;
-    td->td_state = TDS_STOPPED;
-    sched_switch(); /* Releases td_lock. */
-  } else {
-    mtx_unlock(td->td_lock);
+
+  proc_stop_thread(p);
+}
+
+void proc_stop_thread(proc_t *p) {
+  thread_t *td = thread_self();
+
+  assert(mtx_owned(&p->p_lock));
+
+  while (p->p_state == PS_STOPPED) {
+    WITH_MTX_LOCK (td->td_lock) {
+      /* Do not stop if we are about to be terminated. */
+      if (td->td_flags & TDF_EXITING)
+        return;
+      td->td_flags |= TDF_STOPPING;
+    }
+    proc_unlock(p);
+    /* We're holding no locks here, so our process can be continued before we
+     * actually stop the thread. This is why we need the TDF_STOPPING flag. */
+    mtx_lock(td->td_lock);
+    if (td->td_flags & TDF_STOPPING) {
+      td->td_flags &= ~TDF_STOPPING;
+      td->td_state = TDS_STOPPED;
+      sched_switch(); /* Releases td_lock. */
+    } else {
+      mtx_unlock(td->td_lock);
+    }
+    proc_lock(p);
   }
-  proc_lock(p);
-  return;
 }
 
 void proc_continue(proc_t *p) {
-  thread_t *td = p->p_thread;
-
   assert(mtx_owned(&p->p_lock));
   assert(p->p_state == PS_STOPPED);
 
-  klog("Continuing thread %u in process PID(%d)", td->td_tid, p->p_pid);
+  klog("Continuing process PID(%d)", p->p_pid);
 
   p->p_state = PS_NORMAL;
   p->p_flags |= PF_STATE_CHANGED;
   WITH_PROC_LOCK(p->p_parent) {
     proc_wakeup_parent(p->p_parent);
   }
-  WITH_MTX_LOCK (td->td_lock) {
-    thread_continue(td);
+
+  thread_t *td;
+  TAILQ_FOREACH (td, &p->p_threads, td_procq) {
+    WITH_MTX_LOCK (td->td_lock) {
+      /* Threads that have not managed to stop yet need no wakeup. */
+      if ((td->td_flags & TDF_STOPPING) || td_is_stopped(td))
+        thread_continue(td);
+    }
   }
 }
@@ -2,6 +2,7 @@
 #include <sys/klog.h>
 #include <sys/mimiker.h>
 #include <sys/libkern.h>
+#include <sys/bitops.h>
 #include <sys/sched.h>
 #include <sys/runq.h>
 #include <sys/interrupt.h>
@@ -10,11 +11,15 @@
 #include <sys/mutex.h>
 #include <sys/pcpu.h>
 #include <sys/turnstile.h>
+#include <sys/klatency.h>
 
 static MTX_DEFINE(sched_lock, MTX_SPIN);
 static runq_t runq;
 static bool sched_active = false;
 
+/* System-wide scheduler statistics, protected by disabling interrupts. */
+static schedstat_t sched_stats = {.ss_name = "*system*"};
+
 #define SLICE 10
 
 void init_sched(void) {
@@ -36,9 +41,11 @@ void sched_wakeup(thread_t *td) {
 
   /* Update sleep time. */
   bintime_t now = binuptime();
-  bintime_sub(&now, &td->td_last_slptime);
-  bintime_add(&td->td_slptime, &now);
+  bintime_t slptime = now;
+  bintime_sub(&slptime, &td->td_last_slptime);
+  bintime_add(&td->td_slptime, &slptime);
 
+  td->td_last_readytime = now;
   td->td_state = TDS_READY;
   td->td_slice = SLICE;
 
@@ -117,6 +124,17 @@ static thread_t *sched_choose(void) {
   runq_remove(&runq, td);
   td->td_state = TDS_RUNNING;
   td->td_last_rtime = binuptime();
+
+  /* Record how long the thread had been waiting for the processor. */
+  bintime_t latency = td->td_last_rtime;
+  bintime_sub(&latency, &td->td_last_readytime);
+  uint64_t us = bt2us(&latency);
+  if (us > td->td_maxlatency)
+    td->td_maxlatency = us;
+  if (us > sched_stats.ss_maxlatency)
+    sched_stats.ss_maxlatency = us;
+  schedstat_hist_add(&td->td_latency, latency);
+  schedstat_hist_add(&sched_stats.ss_latency, latency);
   return td;
 }
 
@@ -129,17 +147,32 @@ void sched_switch(void) {
   assert(mtx_owned(td->td_lock));
   assert(!td_is_running(td));
 
+  /* The thread did not give up the processor on its own will. */
+  bool preempted = td->td_flags & TDF_NEEDSWITCH;
+
   td->td_flags &= ~(TDF_SLICEEND | TDF_NEEDSWITCH);
 
   /* Update running time, */
   bintime_t now = binuptime();
-  bintime_sub(&now, &td->td_last_rtime);
-  bintime_add(&td->td_rtime, &now);
+  bintime_t rtime = now;
+  bintime_sub(&rtime, &td->td_last_rtime);
+  bintime_add(&td->td_rtime, &rtime);
+
+  if (td != PCPU_GET(idle_thread)) {
+    schedstat_hist_add(&td->td_runtime, rtime);
+    schedstat_hist_add(&sched_stats.ss_slice, rtime);
+  }
 
   if (td_is_ready(td)) {
     /* Idle threads need not to be inserted into the run queue. */
-    if (td != PCPU_GET(idle_thread))
+    if (td != PCPU_GET(idle_thread)) {
+      if (preempted) {
+        td->td_npreempt++;
+        sched_stats.ss_npreempt++;
+      }
+      td->td_last_readytime = now;
       runq_add(&runq, td);
+    }
   } else if (td_is_sleeping(td)) {
     /* Record when the thread fell asleep. */
     td->td_last_slptime = now;
@@ -154,12 +187,14 @@ void sched_switch(void) {
 
   /* If we got here then a context switch is required. */
   td->td_nctxsw++;
+  sched_stats.ss_nctxsw++;
 
   if (PCPU_GET(no_switch))
     panic("Switching context while interrupts are disabled is forbidden!");
 
   WITH_INTR_DISABLED {
     mtx_unlock(td->td_lock);
+    klat_switch(newtd);
     ctx_switch(td, newtd);
     return;
     /* XXX Right now all local variables belong to thread we switched to! */
@@ -169,6 +204,29 @@ noswitch:
   mtx_unlock(td->td_lock);
 }
 
+void schedstat_hist_add(schedstat_hist_t *h, bintime_t bt) {
+  uint64_t us = bt2us(&bt);
+  int i = min(fls64(us), SCHEDSTAT_NBUCKETS - 1);
+  h->h_count[i]++;
+}
+
+void sched_getstats(thread_t *td, schedstat_t *ss) {
+  SCOPED_INTR_DISABLED();
+
+  if (td == NULL) {
+    *ss = sched_stats;
+    return;
+  }
+
+  ss->ss_tid = td->td_tid;
+  strlcpy(ss->ss_name, td->td_name, SCHEDSTAT_NAME_MAX);
+  ss->ss_nctxsw = td->td_nctxsw;
+  ss->ss_npreempt = td->td_npreempt;
+  ss->ss_maxlatency = td->td_maxlatency;
+  ss->ss_latency = td->td_latency;
+  ss->ss_slice = td->td_runtime;
+}
+
 void sched_clock(void) {
   assert(intr_disabled());
 
@@ -239,12 +297,15 @@ __no_kcsan_sanitize bool preempt_disabled(void) {
 
 void preempt_disable(void) {
   thread_t *td = thread_self();
-  td->td_pdnest++;
+  if (td->td_pdnest++ == 0)
+    klat_start(KLAT_PREEMPT, __caller(0));
 }
 
 void preempt_enable(void) {
   thread_t *td = thread_self();
   assert(td->td_pdnest > 0);
   td->td_pdnest--;
+  if (td->td_pdnest == 0)
+    klat_stop(KLAT_PREEMPT, __caller(0));
   sched_maybe_preempt();
 }
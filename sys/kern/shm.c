@@ -0,0 +1,282 @@
+#define KL_LOG KL_VM
+#include <sys/klog.h>
+#include <sys/cred.h>
+#include <sys/errno.h>
+#include <sys/file.h>
+#include <sys/filedesc.h>
+#include <sys/libkern.h>
+#include <sys/malloc.h>
+#include <sys/mman.h>
+#include <sys/mutex.h>
+#include <sys/pmap.h>
+#include <sys/pool.h>
+#include <sys/proc.h>
+#include <sys/stat.h>
+#include <sys/vm_amap.h>
+#include <sys/vnode.h>
+
+/*
+ * POSIX shared memory objects live in a flat namespace separate from the file
+ * system. Pages of an object are kept in an amap, which is shared by all the
+ * mappings of the object (see `vm_map_alloc_entry_amap`), so the pages are
+ * never copied between processes.
+ *
+ * An object is referenced by its name (until it is unlinked) and by every file
+ * that refers to it. Each mapping holds a reference to the amap only, hence
+ * the pages outlive the object when it is still mapped.
+ */
+
+/* Upper limit on size of single object. */
+#define SHM_MAXSIZE (256 * 1024 * 1024)
+
+/* Field markings and the corresponding locks:
+ * (a) atomic
+ * (!) read-only access, do not modify!
+ * (s) shm_lock
+ * (@) shm::shm_lock */
+typedef struct shm {
+  TAILQ_ENTRY(shm) shm_link; /* (s) link on `shm_list` */
+  char *shm_name;            /* (!) name the object was created with */
+  refcnt_t shm_refcnt;       /* (a) number of references */
+  mtx_t shm_lock;            /* protects fields below */
+  vm_amap_t *shm_amap;       /* (!) pages of the object */
+  size_t shm_size;           /* (@) size of the object in bytes */
+  mode_t shm_mode;           /* (!) access permissions */
+  uid_t shm_uid;             /* (!) owner user id */
+  gid_t shm_gid;             /* (!) owner group id */
+} shm_t;
+
+static MTX_DEFINE(shm_lock, 0);
+static TAILQ_HEAD(, shm) shm_list = TAILQ_HEAD_INITIALIZER(shm_list);
+
+static POOL_DEFINE(P_SHM, "shm", sizeof(shm_t));
+static KMALLOC_DEFINE(M_SHM, "shm names");
+
+static shm_t *shm_alloc(const char *name, mode_t mode, cred_t *cred) {
+  shm_t *shm = pool_alloc(P_SHM, M_ZERO);
+  shm->shm_name = kstrndup(M_SHM, name, NAME_MAX + 1);
+  shm->shm_refcnt = 1;
+  mtx_init(&shm->shm_lock, 0);
+  shm->shm_amap = vm_amap_alloc(0);
+  shm->shm_mode = mode;
+  shm->shm_uid = cred->cr_euid;
+  shm->shm_gid = cred->cr_egid;
+  return shm;
+}
+
+static void shm_hold(shm_t *shm) {
+  refcnt_acquire(&shm->shm_refcnt);
+}
+
+static void shm_drop(shm_t *shm) {
+  if (!refcnt_release(&shm->shm_refcnt))
+    return;
+  vm_amap_drop(shm->shm_amap);
+  kfree(M_SHM, shm->shm_name);
+  pool_free(P_SHM, shm);
+}
+
+/* Names must have a single leading slash, like "/name". */
+static int shm_checkname(const char *name) {
+  if (name[0] != '/' || name[1] == '\0' || strchr(name + 1, '/'))
+    return EINVAL;
+  if (strlen(name + 1) > NAME_MAX)
+    return ENAMETOOLONG;
+  return 0;
+}
+
+static shm_t *shm_lookup(const char *name) {
+  assert(mtx_owned(&shm_lock));
+
+  shm_t *shm;
+  TAILQ_FOREACH (shm, &shm_list, shm_link)
+    if (!strcmp(shm->shm_name, name))
+      return shm;
+  return NULL;
+}
+
+static int shm_access(shm_t *shm, accmode_t acc, cred_t *cred) {
+  vattr_t va;
+
+  vattr_null(&va);
+  va.va_mode = S_IFREG | shm->shm_mode;
+  va.va_uid = shm->shm_uid;
+  va.va_gid = shm->shm_gid;
+  return cred_can_access(&va, cred, acc);
+}
+
+static int shm_resize(shm_t *shm, off_t length) {
+  vm_aref_t aref = {.offset = 0, .amap = shm->shm_amap};
+
+  if (length < 0)
+    return EINVAL;
+  if (length > SHM_MAXSIZE)
+    return EFBIG;
+
+  SCOPED_MTX_LOCK(&shm->shm_lock);
+
+  size_t oldslots = howmany(shm->shm_size, PAGESIZE);
+  size_t slots = howmany(length, PAGESIZE);
+
+  if (slots > oldslots) {
+    vm_amap_extend(shm->shm_amap, slots);
+  } else if (slots < oldslots) {
+    /* Pages of a mapped object may be entered into pmaps of other processes,
+     * so they can't be freed here. */
+    if (vm_amap_ref(shm->shm_amap) > 1)
+      return EBUSY;
+    vm_amap_remove_pages(aref, slots, oldslots - slots);
+  }
+
+  /* Data past the end of object must read as zeros if it's extended again. */
+  size_t pgoff = length % PAGESIZE;
+  if ((size_t)length < shm->shm_size && pgoff) {
+    vm_anon_t *anon = vm_amap_find_anon(aref, length / PAGESIZE);
+    if (anon)
+      bzero(phys_to_dmap(anon->page->paddr) + pgoff, PAGESIZE - pgoff);
+  }
+
+  shm->shm_size = length;
+  return 0;
+}
+
+static int shm_read(file_t *f, uio_t *uio) {
+  return EOPNOTSUPP;
+}
+
+static int shm_close(file_t *f) {
+  shm_drop(f->f_data);
+  return 0;
+}
+
+static int shm_stat(file_t *f, stat_t *sb) {
+  shm_t *shm = f->f_data;
+
+  memset(sb, 0, sizeof(stat_t));
+  sb->st_mode = S_IFREG | shm->shm_mode;
+  sb->st_nlink = 1;
+  sb->st_uid = shm->shm_uid;
+  sb->st_gid = shm->shm_gid;
+  WITH_MTX_LOCK (&shm->shm_lock)
+    sb->st_size = shm->shm_size;
+  return 0;
+}
+
+static int shm_ioctl(file_t *f, u_long cmd, void *data) {
+  return EOPNOTSUPP;
+}
+
+static fileops_t shmops = {
+  .fo_read = shm_read,
+  .fo_write = nowrite,
+  .fo_close = shm_close,
+  .fo_seek = noseek,
+  .fo_stat = shm_stat,
+  .fo_ioctl = shm_ioctl,
+};
+
+int shm_truncate(file_t *f, off_t length) {
+  assert(f->f_type == FT_SHM);
+  return shm_resize(f->f_data, length);
+}
+
+int shm_mmap(file_t *f, off_t pos, size_t length, vm_aref_t *arefp) {
+  shm_t *shm = f->f_data;
+  assert(f->f_type == FT_SHM);
+
+  SCOPED_MTX_LOCK(&shm->shm_lock);
+
+  /* Pages past the end of object don't exist. */
+  if ((size_t)pos + length > roundup(shm->shm_size, PAGESIZE))
+    return ENXIO;
+
+  vm_amap_hold(shm->shm_amap);
+  *arefp = (vm_aref_t){.offset = pos / PAGESIZE, .amap = shm->shm_amap};
+  return 0;
+}
+
+int do_shm_open(proc_t *p, const char *name, int flags, mode_t mode,
+                int *fdp) {
+  accmode_t acc = VREAD;
+  shm_t *shm;
+  int error;
+
+  if ((error = shm_checkname(name)))
+    return error;
+
+  switch (flags & O_ACCMODE) {
+    case O_RDONLY:
+      if (flags & O_TRUNC)
+        return EINVAL;
+      break;
+    case O_RDWR:
+      acc |= VWRITE;
+      break;
+    default:
+      return EINVAL;
+  }
+
+  WITH_MTX_LOCK (&shm_lock) {
+    if (!(shm = shm_lookup(name))) {
+      if (!(flags & O_CREAT)) {
+        error = ENOENT;
+        break;
+      }
+      mode = (mode & ~p->p_cmask) & ACCESSPERMS;
+      shm = shm_alloc(name, mode, &p->p_cred);
+      TAILQ_INSERT_TAIL(&shm_list, shm, shm_link);
+    } else if ((flags & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL)) {
+      error = EEXIST;
+      break;
+    } else if ((error = shm_access(shm, acc, &p->p_cred))) {
+      break;
+    }
+    shm_hold(shm);
+  }
+
+  if (error)
+    return error;
+
+  if ((flags & O_TRUNC) && (error = shm_resize(shm, 0))) {
+    shm_drop(shm);
+    return error;
+  }
+
+  file_t *f = file_alloc();
+  f->f_data = shm;
+  f->f_ops = &shmops;
+  f->f_type = FT_SHM;
+  f->f_flags = (acc & VWRITE) ? FF_READ | FF_WRITE : FF_READ;
+
+  if ((error = fdtab_install_file(p->p_fdtable, f, 0, fdp))) {
+    file_destroy(f);
+    return error;
+  }
+
+  /* POSIX requires close-on-exec flag to be set. */
+  if ((error = fd_set_cloexec(p->p_fdtable, *fdp, true)))
+    fdtab_close_fd(p->p_fdtable, *fdp);
+  return error;
+}
+
+int do_shm_unlink(proc_t *p, const char *name) {
+  shm_t *shm;
+  int error;
+
+  if ((error = shm_checkname(name)))
+    return error;
+
+  WITH_MTX_LOCK (&shm_lock) {
+    if (!(shm = shm_lookup(name))) {
+      error = ENOENT;
+      break;
+    }
+    if ((error = shm_access(shm, VADMIN, &p->p_cred)))
+      break;
+    TAILQ_REMOVE(&shm_list, shm, shm_link);
+  }
+
+  if (!error)
+    shm_drop(shm);
+  return error;
+}
@@ -112,8 +112,8 @@ static inline bool sig_ignore_ttystop(proc_t *p, signo_t sig) {
 }
 
 int do_sigaction(signo_t sig, const sigaction_t *act, sigaction_t *oldact) {
-  thread_t *td = thread_self();
-  proc_t *p = td->td_proc;
+  proc_t *p = proc_self();
+  thread_t *td;
 
   if (sig >= NSIG)
     return EINVAL;
@@ -127,8 +127,10 @@ int do_sigaction(signo_t sig, const sigaction_t *act, sigaction_t *oldact) {
     if (act != NULL)
       memcpy(&p->p_sigactions[sig], act, sizeof(sigaction_t));
     /* If ignoring a pending signal, discard it. */
-    if (sig_ignored(p->p_sigactions, sig))
-      sigpend_get(&td->td_sigpend, sig, NULL);
+    if (sig_ignored(p->p_sigactions, sig)) {
+      TAILQ_FOREACH (td, &p->p_threads, td_procq)
+        sigpend_get(&td->td_sigpend, sig, NULL);
+    }
   }
 
   return 0;
@@ -149,9 +151,8 @@ static signo_t sig_pending(thread_t *td) {
 }
 
 int do_sigprocmask(int how, const sigset_t *set, sigset_t *oset) {
-  proc_t *proc = proc_self();
-  thread_t *td = proc->p_thread;
-  assert(mtx_owned(&proc->p_lock));
+  thread_t *td = thread_self();
+  assert(mtx_owned(&td->td_proc->p_lock));
 
   sigset_t *const mask = &td->td_sigmask;
 
@@ -211,7 +212,7 @@ int do_sigtimedwait(proc_t *p, sigset_t waitset, ksiginfo_t *ksi,
 
 int do_sigpending(proc_t *p, sigset_t *set) {
   SCOPED_MTX_LOCK(&p->p_lock);
-  thread_t *td = p->p_thread;
+  thread_t *td = thread_self();
 
   *set = td->td_sigpend.sp_set;
   /* Only blocked pending signals are reported. */
@@ -351,14 +352,33 @@ void sig_child(proc_t *p, int code) {
   sig_kill(parent, &ksi);
 }
 
+/* Choose a thread that will receive a signal sent to the whole process.
+ * Threads that do not block the signal are preferred, especially the ones that
+ * sleep interruptibly, since they can handle the signal right away. */
+static thread_t *sig_target(proc_t *p, signo_t sig) {
+  thread_t *td, *target = NULL;
+
+  TAILQ_FOREACH (td, &p->p_threads, td_procq) {
+    if (__sigismember(&td->td_sigmask, sig))
+      continue;
+    if (td_is_interruptible(td))
+      return td;
+    if (target == NULL)
+      target = td;
+  }
+
+  return target ? target : TAILQ_FIRST(&p->p_threads);
+}
+
 /*
  * NOTE: This is a very simple implementation! Unimplemented features:
  * - Thread tracing and debugging
- * - Multiple threads in a process
+ * - Process-wide pending signal set (a signal sent to a process is made pending
+ *   on one of its threads, see `sig_target`)
  * These limitations (plus the fact that we currently have very little thread
  * states) make the logic of sending a signal very simple!
  */
-void sig_kill(proc_t *p, ksiginfo_t *ksi) {
+static void _sig_kill(proc_t *p, thread_t *td, ksiginfo_t *ksi) {
   assert(p != NULL);
   assert(mtx_owned(&p->p_lock));
   assert(ksi != NULL);
@@ -370,7 +390,9 @@ void sig_kill(proc_t *p, ksiginfo_t *ksi) {
   if (!proc_is_alive(p))
     return;
 
-  thread_t *td = p->p_thread;
+  /* EVFILT_SIGNAL records the signal even if it's going to be ignored. */
+  proc_knote(p, NOTE_SIGNAL | sig);
+
   bool ignored = sig_ignored(p->p_sigactions, sig);
 
   if (ignored && !sigprop_cont(sig))
@@ -383,16 +405,22 @@ void sig_kill(proc_t *p, ksiginfo_t *ksi) {
 
   /* If sending a stop or continue signal,
    * remove pending signals with the opposite effect. */
+  thread_t *otd;
   if (defact_stop(sig)) {
-    sigpend_get(&td->td_sigpend, SIGCONT, NULL);
+    TAILQ_FOREACH (otd, &p->p_threads, td_procq)
+      sigpend_get(&otd->td_sigpend, SIGCONT, NULL);
   } else if (sigprop_cont(sig)) {
-    sigpend_delete_set(&td->td_sigpend, &stopmask);
+    TAILQ_FOREACH (otd, &p->p_threads, td_procq)
+      sigpend_delete_set(&otd->td_sigpend, &stopmask);
     if (p->p_state == PS_STOPPED)
       proc_continue(p);
     if (ignored)
       return;
   }
 
+  if (td == NULL)
+    td = sig_target(p, sig);
+
   /* At this point we know the signal isn't ignored, so make it pending. */
   sigpend_put(&td->td_sigpend, ksiginfo_copy(ksi));
 
@@ -413,6 +441,26 @@ void sig_kill(proc_t *p, ksiginfo_t *ksi) {
   }
 }
 
+void sig_kill(proc_t *p, ksiginfo_t *ksi) {
+  _sig_kill(p, NULL, ksi);
+}
+
+void sig_kill_thread(thread_t *td, ksiginfo_t *ksi) {
+  _sig_kill(td->td_proc, td, ksi);
+}
+
+void sig_forward(proc_t *p, thread_t *td) {
+  assert(mtx_owned(&p->p_lock));
+
+  signo_t sig;
+  ksiginfo_t ksi;
+
+  while ((sig = __sigfindset(&td->td_sigpend.sp_set))) {
+    sigpend_get(&td->td_sigpend, sig, &ksi);
+    sig_kill(p, &ksi);
+  }
+}
+
 void sig_pgkill(pgrp_t *pg, ksiginfo_t *ksi) {
   assert(mtx_owned(&pg->pg_lock));
 
@@ -427,7 +475,8 @@ void sig_pgkill(pgrp_t *pg, ksiginfo_t *ksi) {
 
 void sig_onexec(proc_t *p) {
   assert(mtx_owned(&p->p_lock));
-  thread_t *td = p->p_thread;
+  thread_t *td = thread_self();
+  assert(p->p_nthreads == 1);
 
   /* The signal mask, pending and ignored signals remain unchanged.
    * Caught signals have their action reset to SIG_DFL.
@@ -468,7 +517,18 @@ int sig_check(thread_t *td, ksiginfo_t *out) {
   assert(p != NULL);
   assert(mtx_owned(&p->p_lock));
 
-  while ((sig = sig_pending(td))) {
+  for (;;) {
+    /* Another thread has requested this one to terminate. */
+    if (td->td_flags & TDF_EXITING)
+      proc_thread_exit(0);
+
+    /* Another thread has stopped the process. */
+    if (p->p_state == PS_STOPPED)
+      proc_stop_thread(p);
+
+    if (!(sig = sig_pending(td)))
+      break;
+
     sigpend_get(&td->td_sigpend, sig, out);
 
     /* We should never get a pending signal that's ignored,
@@ -602,5 +662,5 @@ void sig_trap(signo_t sig, int code, void *addr, int trapno) {
   ksi.ksi_trap = trapno;
 
   WITH_MTX_LOCK (&proc->p_lock)
-    sig_kill(proc, &ksi);
+    sig_kill_thread(thread_self(), &ksi);
 }
@@ -298,21 +298,18 @@ static void sq_timeout(thread_t *td) {
   _sleepq_abort(td, ETIMEDOUT);
 }
 
-int sleepq_wait_timed(void *wchan, const void *waitpt, mtx_t *mtx,
-                      systime_t timeout) {
+static int sq_wait_timed(void *wchan, const void *waitpt, mtx_t *mtx,
+                         systime_t timeout, bool intr) {
   thread_t *td = thread_self();
   int error = 0;
 
-  if (waitpt == NULL)
-    waitpt = __caller(0);
-
   sleepq_chain_t *sc = sc_acquire(wchan);
   if (mtx)
     mtx_unlock(mtx);
   mtx_lock(td->td_lock);
 
   /* If there are pending signals, interrupt the sleep immediately. */
-  if ((td->td_flags & TDF_NEEDSIGCHK) && (timeout == 0)) {
+  if ((td->td_flags & TDF_NEEDSIGCHK) && intr) {
     mtx_unlock(td->td_lock);
     sc_release(sc);
     error = EINTR;
@@ -324,7 +321,10 @@ int sleepq_wait_timed(void *wchan, const void *waitpt, mtx_t *mtx,
     callout_schedule(&td->td_slpcallout, timeout);
   }
 
-  td->td_flags |= (timeout > 0) ? TDF_SLPTIMED : TDF_SLPINTR;
+  if (intr)
+    td->td_flags |= TDF_SLPINTR;
+  if (timeout > 0)
+    td->td_flags |= TDF_SLPTIMED;
   sq_enter(td, sc, wchan, waitpt);
 
   /* After wakeup, only one of the following flags may be set:
@@ -347,3 +347,17 @@ end:
     mtx_lock(mtx);
   return error;
 }
+
+int sleepq_wait_timed(void *wchan, const void *waitpt, mtx_t *mtx,
+                      systime_t timeout) {
+  if (waitpt == NULL)
+    waitpt = __caller(0);
+  return sq_wait_timed(wchan, waitpt, mtx, timeout, timeout == 0);
+}
+
+int sleepq_wait_timed_intr(void *wchan, const void *waitpt, mtx_t *mtx,
+                           systime_t timeout) {
+  if (waitpt == NULL)
+    waitpt = __caller(0);
+  return sq_wait_timed(wchan, waitpt, mtx, timeout, true);
+}
@@ -0,0 +1,1203 @@
+#define KL_LOG KL_FILE
+#include <sys/klog.h>
+#include <sys/condvar.h>
+#include <sys/errno.h>
+#include <sys/event.h>
+#include <sys/file.h>
+#include <sys/filedesc.h>
+#include <sys/libkern.h>
+#include <sys/malloc.h>
+#include <sys/mutex.h>
+#include <sys/pool.h>
+#include <sys/proc.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/vfs.h>
+#include <sys/vnode.h>
+
+/*
+ * Only local (UNIX-domain) sockets are implemented. Each socket has a receive
+ * buffer, which is a queue of records. A sender appends records directly to
+ * the receive buffer of its peer. Datagram and sequenced packet sockets keep
+ * exactly one message per record, while stream sockets merge records when
+ * reading unless a record carries descriptors (SCM_RIGHTS).
+ *
+ * Both ends of a stream (or sequenced packet) connection share a single lock,
+ * so the state of the whole connection can be inspected and modified without
+ * worrying about lock ordering. Datagram sockets use their own locks.
+ */
+
+#define SOCKBUF_SIZE (16 * 1024) /* capacity of receive buffer */
+#define SOCKREC_SIZE PAGESIZE    /* max. data in stream socket record */
+
+typedef struct sorec sorec_t;
+typedef TAILQ_HEAD(, sorec) sorec_list_t;
+
+/* Record stored in socket receive buffer. */
+struct sorec {
+  TAILQ_ENTRY(sorec) sr_link;
+  struct sockaddr_un sr_from; /* address of the sender (datagrams only) */
+  socklen_t sr_fromlen;       /* length of `sr_from` or 0 if unknown */
+  file_t **sr_files;          /* descriptors in flight (or NULL) */
+  int sr_nfiles;              /* number of descriptors in flight */
+  size_t sr_len;              /* length of data */
+  size_t sr_off;              /* offset of data not consumed yet */
+  uint8_t sr_data[];
+};
+
+typedef struct solock {
+  mtx_t sl_mtx;
+  refcnt_t sl_refcnt; /* number of sockets that use this lock */
+} solock_t;
+
+typedef enum {
+  SS_ISCONNECTED = 1,  /* connection was established */
+  SS_CANTSENDMORE = 2, /* can't send more data to peer */
+  SS_CANTRCVMORE = 4,  /* can't receive more data from peer */
+  SS_LISTENING = 8,    /* accepting connections */
+} so_state_t;
+
+/* Field markings and the corresponding locks:
+ * (a) atomic
+ * (!) read-only access, do not modify!
+ * (l) socket lock (shared with the peer for connected stream sockets)
+ * (h) socket lock of listening socket that queued the connection */
+typedef struct socket {
+  mtx_t *so_lock;             /* (!) see above */
+  solock_t *so_solock;        /* (!) storage for `so_lock` */
+  refcnt_t so_refcnt;         /* (a) number of references */
+  int so_type;                /* (!) SOCK_* type */
+  so_state_t so_state;        /* (l) SS_* flags */
+  struct socket *so_peer;     /* (l) connected peer, holds reference */
+  vnode_t *so_vnode;          /* (l) vnode the socket is bound to */
+  struct sockaddr_un so_addr; /* (l) address the socket is bound to */
+  socklen_t so_addrlen;       /* (l) length of `so_addr` or 0 if unbound */
+  sorec_list_t so_rcv;        /* (l) receive buffer */
+  size_t so_rcvcc;            /* (l) number of bytes in receive buffer */
+  condvar_t so_rcvcv;         /* (l) data or connection request arrived */
+  condvar_t so_sndcv;         /* (l) receive buffer has more free space */
+  /* Connections that are ready to be accepted. */
+  TAILQ_HEAD(, socket) so_accq;     /* (l) queue of connections */
+  TAILQ_ENTRY(socket) so_accq_link; /* (h) link on `so_accq` */
+  int so_qlen;                      /* (l) number of queued connections */
+  int so_qlimit;                    /* (l) max. number of queued connections */
+  knlist_t so_knotes;         /* (l) knotes attached to the socket */
+} socket_t;
+
+/* Protects `v_socket` of socket vnodes. */
+static MTX_DEFINE(unp_lock, 0);
+
+static POOL_DEFINE(P_SOCKET, "socket", sizeof(socket_t));
+static POOL_DEFINE(P_SOLOCK, "socket lock", sizeof(solock_t));
+static KMALLOC_DEFINE(M_SOCKET, "socket records");
+
+static inline bool so_atomic(socket_t *so) {
+  return so->so_type != SOCK_STREAM;
+}
+
+static inline bool so_connoriented(socket_t *so) {
+  return so->so_type != SOCK_DGRAM;
+}
+
+/* If `sl` is given, the new socket shares the lock with other sockets. */
+static socket_t *socket_alloc(int type, solock_t *sl) {
+  socket_t *so = pool_alloc(P_SOCKET, M_ZERO);
+
+  if (sl == NULL) {
+    sl = pool_alloc(P_SOLOCK, M_ZERO);
+    mtx_init(&sl->sl_mtx, 0);
+  }
+  refcnt_acquire(&sl->sl_refcnt);
+
+  so->so_lock = &sl->sl_mtx;
+  so->so_solock = sl;
+  so->so_refcnt = 1;
+  so->so_type = type;
+  TAILQ_INIT(&so->so_rcv);
+  cv_init(&so->so_rcvcv, "so_rcv");
+  cv_init(&so->so_sndcv, "so_snd");
+  TAILQ_INIT(&so->so_accq);
+  SLIST_INIT(&so->so_knotes);
+  return so;
+}
+
+static void socket_hold(socket_t *so) {
+  refcnt_acquire(&so->so_refcnt);
+}
+
+static void socket_drop(socket_t *so) {
+  if (!refcnt_release(&so->so_refcnt))
+    return;
+
+  assert(TAILQ_EMPTY(&so->so_rcv));
+  assert(TAILQ_EMPTY(&so->so_accq));
+  assert(SLIST_EMPTY(&so->so_knotes));
+  assert(so->so_peer == NULL);
+
+  if (refcnt_release(&so->so_solock->sl_refcnt))
+    pool_free(P_SOLOCK, so->so_solock);
+  pool_free(P_SOCKET, so);
+}
+
+static sorec_t *sorec_alloc(size_t len) {
+  sorec_t *sr = kmalloc(M_SOCKET, sizeof(sorec_t) + len, M_WAITOK);
+  sr->sr_fromlen = 0;
+  sr->sr_files = NULL;
+  sr->sr_nfiles = 0;
+  sr->sr_len = len;
+  sr->sr_off = 0;
+  return sr;
+}
+
+static void sorec_free_files(file_t **files, int nfiles) {
+  for (int i = 0; i < nfiles; i++)
+    file_drop(files[i]);
+  kfree(M_SOCKET, files);
+}
+
+/* Must not be called with any socket lock held, since dropping descriptors
+ * in flight may close another socket. */
+static void sorec_free(sorec_t *sr) {
+  if (sr->sr_files)
+    sorec_free_files(sr->sr_files, sr->sr_nfiles);
+  kfree(M_SOCKET, sr);
+}
+
+/* Takes all records out of receive buffer, so that they can be freed once
+ * the socket lock is released. */
+static void sorcv_flush(socket_t *so, sorec_list_t *list) {
+  assert(mtx_owned(so->so_lock));
+
+  TAILQ_CONCAT(list, &so->so_rcv, sr_link);
+  so->so_rcvcc = 0;
+  cv_broadcast(&so->so_sndcv);
+}
+
+static void sorec_list_free(sorec_list_t *list) {
+  sorec_t *sr;
+  while ((sr = TAILQ_FIRST(list))) {
+    TAILQ_REMOVE(list, sr, sr_link);
+    sorec_free(sr);
+  }
+}
+
+/* Wake up everyone waiting for state change of `so`. */
+static void sowakeup(socket_t *so) {
+  assert(mtx_owned(so->so_lock));
+
+  cv_broadcast(&so->so_rcvcv);
+  cv_broadcast(&so->so_sndcv);
+  knote(&so->so_knotes, 0);
+}
+
+/* Extract path from a socket address and check that it is well formed. */
+static int sockaddr_path(struct sockaddr *sa, socklen_t len, char *path) {
+  const size_t off = offsetof(struct sockaddr_un, sun_path);
+  struct sockaddr_un *sun = (struct sockaddr_un *)sa;
+
+  if (len <= off || len > sizeof(struct sockaddr_un))
+    return EINVAL;
+  if (sun->sun_family != AF_UNIX)
+    return EAFNOSUPPORT;
+
+  size_t n = strnlen(sun->sun_path, len - off);
+  if (n == 0)
+    return EINVAL;
+  if (n == sizeof(sun->sun_path))
+    return ENAMETOOLONG;
+  memcpy(path, sun->sun_path, n);
+  path[n] = '\0';
+  return 0;
+}
+
+/* Copy an address to a buffer of size `*lenp` and set `*lenp` to the length
+ * of the address, as done by accept(2) and recvfrom(2). */
+static void sockaddr_copy(struct sockaddr_un *sun, socklen_t sunlen,
+                          struct sockaddr *sa, socklen_t *lenp) {
+  struct sockaddr_un unnamed = {
+    .sun_len = offsetof(struct sockaddr_un, sun_path),
+    .sun_family = AF_UNIX,
+  };
+
+  if (sunlen == 0) {
+    sun = &unnamed;
+    sunlen = unnamed.sun_len;
+  }
+
+  memcpy(sa, sun, min(*lenp, sunlen));
+  *lenp = sunlen;
+}
+
+/* Find the socket bound to the vnode at `path`. */
+static int unp_lookup(proc_t *p, char *path, int type, socket_t **sop) {
+  socket_t *so = NULL;
+  vnode_t *v;
+  int error;
+
+  if ((error = vfs_namelookup(path, &v, &p->p_cred)))
+    return error;
+
+  if (v->v_type != V_SOCK) {
+    error = ENOTSOCK;
+  } else if (!(error = VOP_ACCESS(v, VWRITE, &p->p_cred))) {
+    WITH_MTX_LOCK (&unp_lock) {
+      if ((so = v->v_socket))
+        socket_hold(so);
+    }
+    if (so == NULL)
+      error = ECONNREFUSED;
+  }
+
+  vnode_drop(v);
+
+  if (!error && so->so_type != type) {
+    socket_drop(so);
+    error = EPROTOTYPE;
+  }
+
+  if (!error)
+    *sop = so;
+  return error;
+}
+
+/* Links two sockets that share the lock into a connection. */
+static void soconnect2(socket_t *so1, socket_t *so2) {
+  assert(so1->so_lock == so2->so_lock);
+  assert(mtx_owned(so1->so_lock));
+
+  socket_hold(so1);
+  socket_hold(so2);
+  so1->so_peer = so2;
+  so2->so_peer = so1;
+  so1->so_state |= SS_ISCONNECTED;
+  so2->so_state |= SS_ISCONNECTED;
+}
+
+/* Breaks the connection, so both sockets see end-of-file. Returns
+ * the reference to the peer, which must be dropped by the caller. */
+static socket_t *sodisconnect(socket_t *so) {
+  assert(mtx_owned(so->so_lock));
+
+  socket_t *peer = so->so_peer;
+  so->so_peer = NULL;
+  so->so_state |= SS_CANTRCVMORE | SS_CANTSENDMORE;
+
+  /* Datagram sockets do not point back at their destination. */
+  if (peer && so_connoriented(so)) {
+    assert(peer->so_peer == so);
+    peer->so_peer = NULL;
+    peer->so_state |= SS_CANTRCVMORE | SS_CANTSENDMORE;
+    sowakeup(peer);
+    socket_drop(so); /* reference held by peer, the caller has another one */
+  }
+
+  sowakeup(so);
+  return peer;
+}
+
+static void soclose(socket_t *so) {
+  sorec_list_t recs = TAILQ_HEAD_INITIALIZER(recs);
+  TAILQ_HEAD(, socket) accq = TAILQ_HEAD_INITIALIZER(accq);
+  socket_t *peer, *nso;
+  vnode_t *v;
+
+  WITH_MTX_LOCK (so->so_lock) {
+    so->so_state &= ~SS_LISTENING;
+    TAILQ_CONCAT(&accq, &so->so_accq, so_accq_link);
+    so->so_qlen = 0;
+    peer = sodisconnect(so);
+    sorcv_flush(so, &recs);
+    v = so->so_vnode;
+    so->so_vnode = NULL;
+  }
+
+  if (v) {
+    WITH_MTX_LOCK (&unp_lock)
+      v->v_socket = NULL;
+    vnode_drop(v);
+  }
+
+  /* Abort connections that were never accepted. */
+  while ((nso = TAILQ_FIRST(&accq))) {
+    TAILQ_REMOVE(&accq, nso, so_accq_link);
+    soclose(nso);
+  }
+
+  if (peer)
+    socket_drop(peer);
+  sorec_list_free(&recs);
+  socket_drop(so);
+}
+
+/*
+ * Sending & receiving
+ */
+
+/* Find the socket that receives data sent by `so`. */
+static int sosend_target(proc_t *p, socket_t *so, struct sockaddr *to,
+                         socklen_t tolen, socket_t **targetp) {
+  char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+  int error;
+
+  if (to && so_connoriented(so))
+    return EISCONN;
+
+  if (to) {
+    if ((error = sockaddr_path(to, tolen, path)))
+      return error;
+    return unp_lookup(p, path, so->so_type, targetp);
+  }
+
+  SCOPED_MTX_LOCK(so->so_lock);
+
+  if (so->so_state & SS_CANTSENDMORE)
+    return EPIPE;
+  if (so->so_peer == NULL)
+    return so_connoriented(so) ? ENOTCONN : EDESTADDRREQ;
+  socket_hold(so->so_peer);
+  *targetp = so->so_peer;
+  return 0;
+}
+
+/* Sends data described by `uio` to the socket `so` is connected to or to
+ * address `to`. Descriptors in flight are passed with the first record and
+ * if that happens `*filesp` is set to NULL. */
+static int sosend(proc_t *p, socket_t *so, struct sockaddr *to,
+                  socklen_t tolen, uio_t *uio, file_t ***filesp, int nfiles,
+                  bool nonblock) {
+  file_t **files = filesp ? *filesp : NULL;
+  struct sockaddr_un from;
+  socklen_t fromlen;
+  socket_t *target;
+  int error;
+
+  if (so_atomic(so) && uio->uio_resid > SOCKBUF_SIZE)
+    return EMSGSIZE;
+
+  if ((error = sosend_target(p, so, to, tolen, &target)))
+    return error;
+
+  WITH_MTX_LOCK (so->so_lock) {
+    from = so->so_addr;
+    fromlen = so->so_addrlen;
+  }
+
+  WITH_MTX_LOCK (target->so_lock) {
+    /* Nothing to send, unless we're passing descriptors or a datagram. */
+    bool first = files || so_atomic(so);
+
+    while (uio->uio_resid > 0 || first) {
+      if (target->so_state & SS_CANTRCVMORE) {
+        error = so_connoriented(so) ? EPIPE : ECONNREFUSED;
+        break;
+      }
+
+      size_t space = SOCKBUF_SIZE - target->so_rcvcc;
+      size_t len = uio->uio_resid;
+
+      if (!so_atomic(so))
+        len = min(len, min(space, (size_t)SOCKREC_SIZE));
+
+      if (space < len || (len == 0 && uio->uio_resid > 0)) {
+        if (nonblock) {
+          error = EAGAIN;
+          break;
+        }
+        if (cv_wait_intr(&target->so_sndcv, target->so_lock)) {
+          error = ERESTARTSYS;
+          break;
+        }
+        continue;
+      }
+
+      sorec_t *sr = sorec_alloc(len);
+
+      if ((error = uiomove(sr->sr_data, len, uio))) {
+        sorec_free(sr);
+        break;
+      }
+
+      if (!so_connoriented(so)) {
+        sr->sr_from = from;
+        sr->sr_fromlen = fromlen;
+      }
+
+      if (files) {
+        sr->sr_files = files;
+        sr->sr_nfiles = nfiles;
+        files = NULL;
+        *filesp = NULL;
+      }
+
+      TAILQ_INSERT_TAIL(&target->so_rcv, sr, sr_link);
+      target->so_rcvcc += len;
+      cv_broadcast(&target->so_rcvcv);
+      knote(&target->so_knotes, 0);
+      first = false;
+    }
+  }
+
+  socket_drop(target);
+  return error;
+}
+
+/* Receives data from socket `so` into `uio`. If the sender's address is
+ * known, it's stored in `from`. Descriptors in flight are returned in
+ * `*filesp` and must be disposed of by the caller. */
+static int soreceive(socket_t *so, uio_t *uio, struct sockaddr_un *from,
+                     socklen_t *fromlenp, file_t ***filesp, int *nfilesp,
+                     int *flagsp, bool nonblock) {
+  sorec_list_t done = TAILQ_HEAD_INITIALIZER(done);
+  int error = 0;
+
+  *filesp = NULL;
+  *nfilesp = 0;
+  *fromlenp = 0;
+
+  /* user requested read of 0 bytes from a stream */
+  if (uio->uio_resid == 0 && !so_atomic(so))
+    return 0;
+
+  WITH_MTX_LOCK (so->so_lock) {
+    while (TAILQ_EMPTY(&so->so_rcv)) {
+      /* no more data will arrive => return end-of-file */
+      if (so->so_state & SS_CANTRCVMORE)
+        return 0;
+      if (so_connoriented(so) && !(so->so_state & SS_ISCONNECTED))
+        return ENOTCONN;
+      if (nonblock)
+        return EAGAIN;
+      if (cv_wait_intr(&so->so_rcvcv, so->so_lock))
+        return ERESTARTSYS;
+    }
+
+    sorec_t *sr;
+    bool first = true;
+
+    while ((sr = TAILQ_FIRST(&so->so_rcv))) {
+      /* Descriptors are delivered with the first byte of their record. */
+      if (sr->sr_files && !first)
+        break;
+
+      if (sr->sr_files) {
+        *filesp = sr->sr_files;
+        *nfilesp = sr->sr_nfiles;
+        sr->sr_files = NULL;
+      }
+
+      if (sr->sr_fromlen > 0) {
+        *from = sr->sr_from;
+        *fromlenp = sr->sr_fromlen;
+      }
+
+      size_t resid = uio->uio_resid;
+      size_t len = min(sr->sr_len - sr->sr_off, resid);
+      error = uiomove(sr->sr_data + sr->sr_off, len, uio);
+      len = resid - uio->uio_resid;
+      sr->sr_off += len;
+      so->so_rcvcc -= len;
+      first = false;
+
+      /* The rest of a message that does not fit is discarded. */
+      if (so_atomic(so) && sr->sr_off < sr->sr_len) {
+        *flagsp |= MSG_TRUNC;
+        so->so_rcvcc -= sr->sr_len - sr->sr_off;
+        sr->sr_off = sr->sr_len;
+      }
+
+      if (sr->sr_off == sr->sr_len) {
+        TAILQ_REMOVE(&so->so_rcv, sr, sr_link);
+        TAILQ_INSERT_TAIL(&done, sr, sr_link);
+      }
+
+      if (error || so_atomic(so) || uio->uio_resid == 0)
+        break;
+    }
+
+    /* notify senders that free space is available */
+    cv_broadcast(&so->so_sndcv);
+    if (so_connoriented(so) && so->so_peer)
+      knote(&so->so_peer->so_knotes, 0);
+  }
+
+  sorec_list_free(&done);
+  return error;
+}
+
+/*
+ * File operations
+ */
+
+static int soo_read(file_t *f, uio_t *uio) {
+  socket_t *so = f->f_data;
+  struct sockaddr_un from;
+  socklen_t fromlen;
+  file_t **files;
+  int nfiles, flags = 0;
+  int error;
+
+  error = soreceive(so, uio, &from, &fromlen, &files, &nfiles, &flags,
+                    uio->uio_ioflags & IO_NONBLOCK);
+
+  /* read(2) can't receive descriptors, so they're discarded. */
+  if (files)
+    sorec_free_files(files, nfiles);
+  return error;
+}
+
+static int soo_write(file_t *f, uio_t *uio) {
+  socket_t *so = f->f_data;
+  size_t old_resid = uio->uio_resid;
+
+  int error = sosend(NULL, so, NULL, 0, uio, NULL, 0,
+                     uio->uio_ioflags & IO_NONBLOCK);
+
+  /* don't report errors on partial writes */
+  if (uio->uio_resid < old_resid && !so_atomic(so))
+    error = 0;
+
+  return error;
+}
+
+static int soo_close(file_t *f) {
+  soclose(f->f_data);
+  return 0;
+}
+
+static int soo_stat(file_t *f, stat_t *sb) {
+  socket_t *so = f->f_data;
+
+  memset(sb, 0, sizeof(stat_t));
+  sb->st_mode = S_IFSOCK | S_IRUSR | S_IWUSR;
+  WITH_MTX_LOCK (so->so_lock)
+    sb->st_size = so->so_rcvcc;
+  return 0;
+}
+
+static int soo_ioctl(file_t *f, u_long cmd, void *data) {
+  return EOPNOTSUPP;
+}
+
+static void soo_kq_detach(knote_t *kn) {
+  socket_t *so = kn->kn_hook;
+
+  WITH_MTX_LOCK (so->so_lock)
+    SLIST_REMOVE(&so->so_knotes, kn, knote, kn_objlink);
+  socket_drop(so);
+}
+
+static int soo_kq_read(knote_t *kn, long hint) {
+  socket_t *so = kn->kn_hook;
+  assert(mtx_owned(so->so_lock));
+
+  if (so->so_state & SS_LISTENING) {
+    kn->kn_kevent.data = so->so_qlen;
+    return so->so_qlen > 0;
+  }
+
+  kn->kn_kevent.data = so->so_rcvcc;
+  return !TAILQ_EMPTY(&so->so_rcv) || (so->so_state & SS_CANTRCVMORE);
+}
+
+static int soo_kq_write(knote_t *kn, long hint) {
+  socket_t *so = kn->kn_hook;
+  assert(mtx_owned(so->so_lock));
+
+  /* Datagram receivers aren't known in advance, so assume there's space. */
+  if (!so_connoriented(so)) {
+    kn->kn_kevent.data = SOCKBUF_SIZE;
+    return 1;
+  }
+
+  if (!(so->so_state & SS_ISCONNECTED))
+    return 0;
+
+  socket_t *peer = so->so_peer;
+  if (peer == NULL || (so->so_state & SS_CANTSENDMORE)) {
+    kn->kn_kevent.data = 0;
+    return 1;
+  }
+
+  kn->kn_kevent.data = SOCKBUF_SIZE - peer->so_rcvcc;
+  return kn->kn_kevent.data > 0;
+}
+
+static filterops_t soo_read_filterops = {
+  .filt_detach = soo_kq_detach,
+  .filt_event = soo_kq_read,
+};
+
+static filterops_t soo_write_filterops = {
+  .filt_detach = soo_kq_detach,
+  .filt_event = soo_kq_write,
+};
+
+static int soo_kqfilter(file_t *f, knote_t *kn) {
+  socket_t *so = f->f_data;
+
+  if (kn->kn_kevent.filter == EVFILT_READ)
+    kn->kn_filtops = &soo_read_filterops;
+  else if (kn->kn_kevent.filter == EVFILT_WRITE)
+    kn->kn_filtops = &soo_write_filterops;
+  else
+    return EINVAL;
+
+  /* Knote may outlive the file, when the socket is in flight. */
+  socket_hold(so);
+  kn->kn_hook = so;
+  kn->kn_objlock = so->so_lock;
+
+  WITH_MTX_LOCK (so->so_lock)
+    SLIST_INSERT_HEAD(&so->so_knotes, kn, kn_objlink);
+
+  return 0;
+}
+
+static fileops_t socketops = {
+  .fo_read = soo_read,
+  .fo_write = soo_write,
+  .fo_close = soo_close,
+  .fo_seek = noseek,
+  .fo_stat = soo_stat,
+  .fo_ioctl = soo_ioctl,
+  .fo_kqfilter = soo_kqfilter,
+};
+
+static file_t *make_socket_file(socket_t *so, int flags) {
+  file_t *file = file_alloc();
+  file->f_data = so;
+  file->f_ops = &socketops;
+  file->f_type = FT_SOCKET;
+  file->f_flags = FF_READ | FF_WRITE;
+  if (flags & SOCK_NONBLOCK)
+    file->f_flags |= IO_NONBLOCK;
+  return file;
+}
+
+static int install_socket_file(proc_t *p, file_t *file, int flags, int *fdp) {
+  int error;
+
+  if ((error = fdtab_install_file(p->p_fdtable, file, 0, fdp)))
+    return error;
+  if ((error = fd_set_cloexec(p->p_fdtable, *fdp, flags & SOCK_CLOEXEC)))
+    fdtab_close_fd(p->p_fdtable, *fdp);
+  return error;
+}
+
+static int getsock(proc_t *p, int s, file_t **fp) {
+  file_t *f;
+  int error;
+
+  if ((error = fdtab_get_file(p->p_fdtable, s, 0, &f)))
+    return error;
+
+  if (f->f_type != FT_SOCKET) {
+    file_drop(f);
+    return ENOTSOCK;
+  }
+
+  *fp = f;
+  return 0;
+}
+
+/*
+ * Descriptor passing
+ */
+
+/* Take references to files passed in SCM_RIGHTS messages. */
+static int sock_internalize(proc_t *p, struct msghdr *msg, file_t ***filesp,
+                            int *nfilesp) {
+  struct cmsghdr *cm;
+  int nfds = 0;
+  int error = 0;
+
+  *filesp = NULL;
+  *nfilesp = 0;
+
+  for (cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+    if (cm->cmsg_len < CMSG_LEN(0) ||
+        (char *)cm + cm->cmsg_len > (char *)msg->msg_control +
+                                      msg->msg_controllen)
+      return EINVAL;
+    if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+      return EINVAL;
+    nfds += (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+  }
+
+  if (nfds == 0)
+    return 0;
+  if (nfds > SCM_MAXFDS)
+    return EMSGSIZE;
+
+  file_t **files = kmalloc(M_SOCKET, nfds * sizeof(file_t *), M_WAITOK);
+  int n = 0;
+
+  for (cm = CMSG_FIRSTHDR(msg); cm && !error; cm = CMSG_NXTHDR(msg, cm)) {
+    int *fds = (int *)CMSG_DATA(cm);
+    int cnt = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+    for (int i = 0; i < cnt; i++) {
+      if ((error = fdtab_get_file(p->p_fdtable, fds[i], 0, &files[n])))
+        break;
+      /* Kqueues are bound to the process that created them. */
+      if (files[n]->f_type == FT_KQUEUE) {
+        file_drop(files[n]);
+        error = EBADF;
+        break;
+      }
+      n++;
+    }
+  }
+
+  if (error) {
+    sorec_free_files(files, n);
+    return error;
+  }
+
+  *filesp = files;
+  *nfilesp = nfds;
+  return 0;
+}
+
+/* Install received files in descriptor table and describe them with
+ * a SCM_RIGHTS message. Files that do not fit are closed. */
+static void sock_externalize(proc_t *p, struct msghdr *msg, file_t **files,
+                             int nfiles) {
+  socklen_t space = msg->msg_controllen;
+  int n = 0;
+
+  msg->msg_controllen = 0;
+
+  if (files == NULL)
+    return;
+
+  if (space >= CMSG_LEN(sizeof(int))) {
+    struct cmsghdr *cm = msg->msg_control;
+    int *fds = (int *)CMSG_DATA(cm);
+    int maxfds = (space - CMSG_LEN(0)) / sizeof(int);
+
+    for (; n < nfiles && n < maxfds; n++)
+      if (fdtab_install_file(p->p_fdtable, files[n], 0, &fds[n]))
+        break;
+
+    if (n > 0) {
+      cm->cmsg_len = CMSG_LEN(n * sizeof(int));
+      cm->cmsg_level = SOL_SOCKET;
+      cm->cmsg_type = SCM_RIGHTS;
+      msg->msg_controllen = min(space, CMSG_SPACE(n * sizeof(int)));
+    }
+  }
+
+  if (n < nfiles)
+    msg->msg_flags |= MSG_CTRUNC;
+
+  sorec_free_files(files, nfiles);
+}
+
+void sock_close_rights(proc_t *p, struct msghdr *msg) {
+  struct cmsghdr *cm;
+
+  for (cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+    if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+      continue;
+
+    int *fds = (int *)CMSG_DATA(cm);
+    int cnt = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (int i = 0; i < cnt; i++)
+      fdtab_close_fd(p->p_fdtable, fds[i]);
+  }
+}
+
+/*
+ * Procedures called by system calls implementation
+ */
+
+static int check_socket_args(int domain, int type, int protocol) {
+  if (domain != AF_UNIX)
+    return EAFNOSUPPORT;
+
+  type &= ~SOCK_FLAGS_MASK;
+  if (type != SOCK_STREAM && type != SOCK_DGRAM && type != SOCK_SEQPACKET)
+    return EPROTOTYPE;
+
+  if (protocol != 0)
+    return EPROTONOSUPPORT;
+
+  return 0;
+}
+
+int do_socket(proc_t *p, int domain, int type, int protocol, int *fdp) {
+  int error;
+
+  if ((error = check_socket_args(domain, type, protocol)))
+    return error;
+
+  socket_t *so = socket_alloc(type & ~SOCK_FLAGS_MASK, NULL);
+  file_t *file = make_socket_file(so, type);
+
+  file_hold(file);
+  error = install_socket_file(p, file, type, fdp);
+  file_drop(file);
+  return error;
+}
+
+int do_socketpair(proc_t *p, int domain, int type, int protocol, int *sv) {
+  int error;
+
+  if ((error = check_socket_args(domain, type, protocol)))
+    return error;
+
+  socket_t *so1 = socket_alloc(type & ~SOCK_FLAGS_MASK, NULL);
+  socket_t *so2 = socket_alloc(type & ~SOCK_FLAGS_MASK, so1->so_solock);
+
+  WITH_MTX_LOCK (so1->so_lock)
+    soconnect2(so1, so2);
+
+  file_t *file1 = make_socket_file(so1, type);
+  file_t *file2 = make_socket_file(so2, type);
+
+  /* See do_pipe2 for explanation. */
+  file_hold(file1);
+  file_hold(file2);
+
+  if (!(error = install_socket_file(p, file1, type, &sv[0]))) {
+    if ((error = install_socket_file(p, file2, type, &sv[1])))
+      fdtab_close_fd(p->p_fdtable, sv[0]);
+  }
+
+  file_drop(file1);
+  file_drop(file2);
+  return error;
+}
+
+int do_bind(proc_t *p, int s, struct sockaddr *sa, socklen_t len) {
+  char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+  file_t *f;
+  vnode_t *v;
+  int error;
+
+  if ((error = sockaddr_path(sa, len, path)))
+    return error;
+
+  if ((error = getsock(p, s, &f)))
+    return error;
+
+  socket_t *so = f->f_data;
+
+  /* Name resolution may sleep, so the node is created without `so_lock`. */
+  WITH_MTX_LOCK (so->so_lock) {
+    if (so->so_vnode)
+      error = EINVAL;
+  }
+
+  if (error || (error = vfs_mksock(p, path, ACCESSPERMS, &v))) {
+    file_drop(f);
+    return error;
+  }
+
+  WITH_MTX_LOCK (so->so_lock) {
+    /* Another thread has bound the socket in the meantime. */
+    if (so->so_vnode) {
+      error = EINVAL;
+      break;
+    }
+
+    WITH_MTX_LOCK (&unp_lock)
+      v->v_socket = so;
+
+    so->so_vnode = v;
+    so->so_addrlen = offsetof(struct sockaddr_un, sun_path) + strlen(path) + 1;
+    so->so_addr.sun_len = so->so_addrlen;
+    so->so_addr.sun_family = AF_UNIX;
+    strlcpy(so->so_addr.sun_path, path, sizeof(so->so_addr.sun_path));
+  }
+
+  if (error) {
+    vnode_drop(v);
+    do_unlinkat(p, AT_FDCWD, path, 0);
+  }
+
+  file_drop(f);
+  return error;
+}
+
+int do_listen(proc_t *p, int s, int backlog) {
+  file_t *f;
+  int error;
+
+  if ((error = getsock(p, s, &f)))
+    return error;
+
+  socket_t *so = f->f_data;
+
+  WITH_MTX_LOCK (so->so_lock) {
+    if (!so_connoriented(so)) {
+      error = EOPNOTSUPP;
+    } else if (so->so_state & SS_ISCONNECTED) {
+      error = EINVAL;
+    } else if (so->so_vnode == NULL) {
+      error = EINVAL;
+    } else {
+      so->so_state |= SS_LISTENING;
+      /* Let at least one connection through, as other systems do. */
+      so->so_qlimit = (backlog < 0 || backlog > SOMAXCONN) ? SOMAXCONN
+                                                           : max(backlog, 1);
+    }
+  }
+
+  file_drop(f);
+  return error;
+}
+
+int do_accept(proc_t *p, int s, struct sockaddr *sa, socklen_t *lenp,
+              int *fdp) {
+  socket_t *nso = NULL;
+  file_t *f;
+  int error;
+
+  if ((error = getsock(p, s, &f)))
+    return error;
+
+  socket_t *so = f->f_data;
+
+  WITH_MTX_LOCK (so->so_lock) {
+    while (TAILQ_EMPTY(&so->so_accq)) {
+      if (!(so->so_state & SS_LISTENING)) {
+        error = EINVAL;
+        break;
+      }
+      if (f->f_flags & IO_NONBLOCK) {
+        error = EAGAIN;
+        break;
+      }
+      if (cv_wait_intr(&so->so_rcvcv, so->so_lock)) {
+        error = ERESTARTSYS;
+        break;
+      }
+    }
+
+    if (!error) {
+      nso = TAILQ_FIRST(&so->so_accq);
+      TAILQ_REMOVE(&so->so_accq, nso, so_accq_link);
+      so->so_qlen--;
+    }
+  }
+
+  file_drop(f);
+
+  if (error)
+    return error;
+
+  /* The reference held by accept queue is passed to the file. */
+  file_t *file = make_socket_file(nso, 0);
+  file_hold(file);
+
+  if (!(error = install_socket_file(p, file, 0, fdp)) && sa) {
+    WITH_MTX_LOCK (nso->so_lock) {
+      socket_t *peer = nso->so_peer;
+      if (peer)
+        sockaddr_copy(&peer->so_addr, peer->so_addrlen, sa, lenp);
+      else
+        sockaddr_copy(NULL, 0, sa, lenp);
+    }
+  }
+
+  file_drop(file);
+  return error;
+}
+
+static int soconnect_dgram(socket_t *so, socket_t *target) {
+  socket_t *old;
+
+  WITH_MTX_LOCK (so->so_lock) {
+    old = so->so_peer;
+    so->so_peer = target;
+    so->so_state |= SS_ISCONNECTED;
+  }
+
+  if (old)
+    socket_drop(old);
+  return 0;
+}
+
+static int soconnect_stream(socket_t *so, socket_t *head) {
+  /* Server side of the connection shares the lock with the client. */
+  socket_t *nso = socket_alloc(so->so_type, so->so_solock);
+  int error = 0;
+
+  /* Connecting socket is always locked before the listening one. They can't
+   * share the lock, since neither of them was ever connected. */
+  WITH_MTX_LOCK (so->so_lock) {
+    if (so->so_state & SS_ISCONNECTED) {
+      error = EISCONN;
+      break;
+    }
+    if (so->so_state & SS_LISTENING) {
+      error = EOPNOTSUPP;
+      break;
+    }
+
+    assert(so->so_lock != head->so_lock);
+
+    WITH_MTX_LOCK (head->so_lock) {
+      if (!(head->so_state & SS_LISTENING) ||
+          head->so_qlen >= head->so_qlimit) {
+        error = ECONNREFUSED;
+        break;
+      }
+
+      nso->so_addr = head->so_addr;
+      nso->so_addrlen = head->so_addrlen;
+      soconnect2(so, nso);
+
+      TAILQ_INSERT_TAIL(&head->so_accq, nso, so_accq_link);
+      head->so_qlen++;
+      cv_broadcast(&head->so_rcvcv);
+      knote(&head->so_knotes, 0);
+      nso = NULL;
+    }
+
+    /* the socket became writable */
+    if (!error)
+      knote(&so->so_knotes, 0);
+  }
+
+  if (nso)
+    socket_drop(nso);
+  return error;
+}
+
+int do_connect(proc_t *p, int s, struct sockaddr *sa, socklen_t len) {
+  char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+  socket_t *target;
+  file_t *f;
+  int error;
+
+  if ((error = sockaddr_path(sa, len, path)))
+    return error;
+
+  if ((error = getsock(p, s, &f)))
+    return error;
+
+  socket_t *so = f->f_data;
+
+  if (!(error = unp_lookup(p, path, so->so_type, &target))) {
+    if (so_connoriented(so)) {
+      error = (target == so) ? ECONNREFUSED : soconnect_stream(so, target);
+      socket_drop(target);
+    } else {
+      /* Reference to the target is passed to `so_peer`. */
+      error = soconnect_dgram(so, target);
+    }
+  }
+
+  file_drop(f);
+  return error;
+}
+
+int do_sendmsg(proc_t *p, int s, struct msghdr *msg, uio_t *uio, int flags) {
+  file_t **files;
+  int nfiles;
+  file_t *f;
+  int error;
+
+  if ((error = getsock(p, s, &f)))
+    return error;
+
+  socket_t *so = f->f_data;
+  size_t old_resid = uio->uio_resid;
+  bool atomic = so_atomic(so);
+  bool nonblock = (f->f_flags & IO_NONBLOCK) || (flags & MSG_DONTWAIT);
+
+  if (!(error = sock_internalize(p, msg, &files, &nfiles))) {
+    error = sosend(p, so, msg->msg_name, msg->msg_namelen, uio, &files, nfiles,
+                   nonblock);
+    /* Descriptors were not sent, so release them. */
+    if (files)
+      sorec_free_files(files, nfiles);
+  }
+
+  file_drop(f);
+
+  /* don't report errors on partial writes */
+  if (uio->uio_resid < old_resid && !atomic)
+    error = 0;
+
+  if (!(flags & MSG_NOSIGNAL))
+    file_sigpipe(p, error);
+
+  return error;
+}
+
+int do_recvmsg(proc_t *p, int s, struct msghdr *msg, uio_t *uio, int flags) {
+  struct sockaddr_un from;
+  socklen_t fromlen;
+  file_t **files;
+  int nfiles;
+  file_t *f;
+  int error;
+
+  if ((error = getsock(p, s, &f)))
+    return error;
+
+  socket_t *so = f->f_data;
+  bool nonblock = (f->f_flags & IO_NONBLOCK) || (flags & MSG_DONTWAIT);
+
+  msg->msg_flags = 0;
+  error = soreceive(so, uio, &from, &fromlen, &files, &nfiles, &msg->msg_flags,
+                    nonblock);
+  sock_externalize(p, msg, files, nfiles);
+
+  if (msg->msg_name) {
+    if (fromlen > 0)
+      sockaddr_copy(&from, fromlen, msg->msg_name, &msg->msg_namelen);
+    else
+      msg->msg_namelen = 0;
+  }
+
+  file_drop(f);
+  return error;
+}
+
+int do_shutdown(proc_t *p, int s, int how) {
+  sorec_list_t recs = TAILQ_HEAD_INITIALIZER(recs);
+  file_t *f;
+  int error;
+
+  if (how != SHUT_RD && how != SHUT_WR && how != SHUT_RDWR)
+    return EINVAL;
+
+  if ((error = getsock(p, s, &f)))
+    return error;
+
+  socket_t *so = f->f_data;
+
+  WITH_MTX_LOCK (so->so_lock) {
+    if (so_connoriented(so) && !(so->so_state & SS_ISCONNECTED)) {
+      error = ENOTCONN;
+      break;
+    }
+
+    if (how != SHUT_WR) {
+      so->so_state |= SS_CANTRCVMORE;
+      sorcv_flush(so, &recs);
+      sowakeup(so);
+    }
+
+    if (how != SHUT_RD) {
+      so->so_state |= SS_CANTSENDMORE;
+      socket_t *peer = so->so_peer;
+      if (peer && so_connoriented(so)) {
+        peer->so_state |= SS_CANTRCVMORE;
+        sowakeup(peer);
+      }
+      sowakeup(so);
+    }
+  }
+
+  sorec_list_free(&recs);
+  file_drop(f);
+  return error;
+}
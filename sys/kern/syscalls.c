@@ -25,6 +25,17 @@
 #include <sys/statvfs.h>
 #include <sys/pty.h>
 #include <sys/event.h>
+#include <sys/thr.h>
+#include <sys/futex.h>
+#include <sys/sendfile.h>
+#include <sys/aio.h>
+#include <sys/poll.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/buf.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 
 #include "sysent.h"
 
@@ -169,11 +180,14 @@ static int sys_mmap(proc_t *p, mmap_args_t *args, register_t *res) {
   size_t length = SCARG(args, len);
   vm_prot_t prot = SCARG(args, prot);
   int flags = SCARG(args, flags);
+  int fd = SCARG(args, fd);
+  off_t pos = SCARG(args, pos);
 
-  klog("mmap(%p, %u, %d, %d)", (void *)va, length, prot, flags);
+  klog("mmap(%p, %u, %d, %d, %d, %d)", (void *)va, length, prot, flags, fd,
+       pos);
 
   int error;
-  if ((error = do_mmap(&va, length, prot, flags)))
+  if ((error = do_mmap(&va, length, prot, flags, fd, pos)))
     return error;
 
   *res = va;
@@ -338,9 +352,11 @@ end:
 static int sys_mount(proc_t *p, mount_args_t *args, register_t *res) {
   const char *u_type = SCARG(args, type);
   const char *u_path = SCARG(args, path);
+  const char *u_from = SCARG(args, from);
 
   char *type = kmalloc(M_TEMP, PATH_MAX, 0);
   char *path = kmalloc(M_TEMP, PATH_MAX, 0);
+  char *from = NULL;
   size_t n = 0;
   int error;
 
@@ -352,12 +368,22 @@ static int sys_mount(proc_t *p, mount_args_t *args, register_t *res) {
   if ((error = copyinstr(u_path, path, PATH_MAX, &n)))
     goto end;
 
-  klog("mount(\"%s\", \"%s\")", path, type);
+  /* Copyout device pathname if filesystem is disk-based. */
+  if (u_from) {
+    from = kmalloc(M_TEMP, PATH_MAX, 0);
+    n = 0;
+    if ((error = copyinstr(u_from, from, PATH_MAX, &n)))
+      goto end;
+  }
+
+  klog("mount(\"%s\", \"%s\", \"%s\")", path, type, from ? from : "");
 
-  error = do_mount(p, type, path);
+  error = do_mount(p, type, path, from);
 end:
   kfree(M_TEMP, type);
   kfree(M_TEMP, path);
+  if (from)
+    kfree(M_TEMP, from);
   return error;
 }
 
@@ -625,7 +651,7 @@ static int sys_setcontext(proc_t *p, setcontext_args_t *args, register_t *res) {
   ucontext_t uc;
   copyin_s(ucp, uc);
 
-  return do_setcontext(p->p_thread, &uc);
+  return do_setcontext(thread_self(), &uc);
 }
 
 static int sys_ioctl(proc_t *p, ioctl_args_t *args, register_t *res) {
@@ -1271,13 +1297,18 @@ static int sys_setitimer(proc_t *p, setitimer_args_t *args, register_t *res) {
 }
 
 static int sys_sync(proc_t *p, void *args, register_t *res) {
-  /* TODO(mohrcore): implement buffering */
+  klog("sync()");
+  /* Errors are not reported by sync(2). */
+  (void)bsync(NULL);
   return 0;
 }
 
 static int sys_fsync(proc_t *p, fsync_args_t *args, register_t *res) {
-  /* TODO(mohrcore): implement buffering */
-  return 0;
+  int fd = SCARG(args, fd);
+
+  klog("fsync(%d)", fd);
+
+  return do_fsync(p, fd);
 }
 
 static int sys_kqueue1(proc_t *p, kqueue1_args_t *args, register_t *res) {
@@ -1384,3 +1415,735 @@ end:
   kfree(M_TEMP, path);
   return error;
 }
+
+static int sys_thr_new(proc_t *p, thr_new_args_t *args, register_t *res) {
+  struct thr_param *u_param = SCARG(args, param);
+  size_t param_size = SCARG(args, param_size);
+  struct thr_param param;
+  tid_t tid;
+  int error;
+
+  klog("thr_new(%p, %u)", u_param, param_size);
+
+  if (param_size != sizeof(param))
+    return EINVAL;
+
+  if ((error = copyin_s(u_param, param)))
+    return error;
+
+  if ((error = do_thr_new(p, &param, &tid)))
+    return error;
+
+  *res = tid;
+  return 0;
+}
+
+static int sys_thr_exit(proc_t *p, thr_exit_args_t *args, register_t *res) {
+  klog("thr_exit(%p)", SCARG(args, state));
+  do_thr_exit(p, SCARG(args, state));
+}
+
+static int sys_thr_self(proc_t *p, void *args, register_t *res) {
+  klog("thr_self()");
+  *res = thread_self()->td_tid;
+  return 0;
+}
+
+static int sys_thr_kill(proc_t *p, thr_kill_args_t *args, register_t *res) {
+  tid_t tid = SCARG(args, tid);
+  int sig = SCARG(args, sig);
+
+  klog("thr_kill(%u, %d)", tid, sig);
+
+  return do_thr_kill(p, tid, sig);
+}
+
+static int sys_futex(proc_t *p, futex_args_t *args, register_t *res) {
+  int *u_addr = SCARG(args, uaddr);
+  int op = SCARG(args, op);
+  int val = SCARG(args, val);
+  const timespec_t *u_timeout = SCARG(args, timeout);
+  timespec_t timeout;
+  int error, nwoken;
+
+  klog("futex(%p, %d, %d, %p)", u_addr, op, val, u_timeout);
+
+  int flags = op & FUTEX_SHARED;
+
+  switch (op & FUTEX_CMD_MASK) {
+    case FUTEX_WAIT:
+      if (u_timeout && (error = copyin_s(u_timeout, timeout)))
+        return error;
+      return do_futex_wait(p, u_addr, flags, val,
+                           u_timeout ? &timeout : NULL);
+    case FUTEX_WAKE:
+      if ((error = do_futex_wake(p, u_addr, flags, val, &nwoken)))
+        return error;
+      *res = nwoken;
+      return 0;
+    default:
+      return EINVAL;
+  }
+}
+
+static int sys_pread(proc_t *p, pread_args_t *args, register_t *res) {
+  int fd = SCARG(args, fd);
+  void *u_buf = SCARG(args, buf);
+  size_t nbyte = SCARG(args, nbyte);
+  off_t offset = SCARG(args, offset);
+  int error;
+
+  klog("pread(%d, %p, %u, %ld)", fd, u_buf, nbyte, offset);
+
+  uio_t uio = UIO_SINGLE_USER(UIO_READ, offset, u_buf, nbyte);
+  uio.uio_ioflags = IO_OFFSET;
+  if ((error = do_read(p, fd, &uio)))
+    return error;
+
+  *res = nbyte - uio.uio_resid;
+  return 0;
+}
+
+static int sys_pwrite(proc_t *p, pwrite_args_t *args, register_t *res) {
+  int fd = SCARG(args, fd);
+  const char *u_buf = SCARG(args, buf);
+  size_t nbyte = SCARG(args, nbyte);
+  off_t offset = SCARG(args, offset);
+  int error;
+
+  klog("pwrite(%d, %p, %u, %ld)", fd, u_buf, nbyte, offset);
+
+  uio_t uio = UIO_SINGLE_USER(UIO_WRITE, offset, u_buf, nbyte);
+  uio.uio_ioflags = IO_OFFSET;
+  if ((error = do_write(p, fd, &uio)))
+    return error;
+
+  *res = nbyte - uio.uio_resid;
+  return 0;
+}
+
+static int sys_preadv(proc_t *p, preadv_args_t *args, register_t *res) {
+  int fd = SCARG(args, fd);
+  const iovec_t *u_iov = SCARG(args, iov);
+  int iovcnt = SCARG(args, iovcnt);
+  off_t offset = SCARG(args, offset);
+  size_t len;
+  int error;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX)
+    return EINVAL;
+
+  const size_t iov_size = sizeof(iovec_t) * iovcnt;
+  iovec_t *k_iov = kmalloc(M_TEMP, iov_size, 0);
+
+  if ((error = copyin(u_iov, k_iov, iov_size)) ||
+      (error = iovec_length(k_iov, iovcnt, &len)))
+    goto end;
+
+  uio_t uio = UIO_VECTOR_USER(UIO_READ, k_iov, iovcnt, len);
+  uio.uio_offset = offset;
+  uio.uio_ioflags = IO_OFFSET;
+  error = do_read(p, fd, &uio);
+  *res = len - uio.uio_resid;
+
+end:
+  kfree(M_TEMP, k_iov);
+  return error;
+}
+
+static int sys_pwritev(proc_t *p, pwritev_args_t *args, register_t *res) {
+  int fd = SCARG(args, fd);
+  const iovec_t *u_iov = SCARG(args, iov);
+  int iovcnt = SCARG(args, iovcnt);
+  off_t offset = SCARG(args, offset);
+  size_t len;
+  int error;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX)
+    return EINVAL;
+
+  const size_t iov_size = sizeof(iovec_t) * iovcnt;
+  iovec_t *k_iov = kmalloc(M_TEMP, iov_size, 0);
+
+  if ((error = copyin(u_iov, k_iov, iov_size)) ||
+      (error = iovec_length(k_iov, iovcnt, &len)))
+    goto end;
+
+  uio_t uio = UIO_VECTOR_USER(UIO_WRITE, k_iov, iovcnt, len);
+  uio.uio_offset = offset;
+  uio.uio_ioflags = IO_OFFSET;
+  error = do_write(p, fd, &uio);
+  *res = len - uio.uio_resid;
+
+end:
+  kfree(M_TEMP, k_iov);
+  return error;
+}
+
+static int sys_sendfile(proc_t *p, sendfile_args_t *args, register_t *res) {
+  int outfd = SCARG(args, outfd);
+  int infd = SCARG(args, infd);
+  off_t *u_offset = SCARG(args, offset);
+  size_t count = SCARG(args, count);
+  off_t offset;
+  size_t done;
+  int error;
+
+  klog("sendfile(%d, %d, %p, %u)", outfd, infd, u_offset, count);
+
+  if (u_offset && (error = copyin_s(u_offset, offset)))
+    return error;
+
+  if ((error = do_sendfile(p, outfd, infd, u_offset ? &offset : NULL, count,
+                           &done)))
+    return error;
+
+  if (u_offset && (error = copyout_s(offset, u_offset)))
+    return error;
+
+  *res = done;
+  return 0;
+}
+
+static int sys_splice(proc_t *p, splice_args_t *args, register_t *res) {
+  int infd = SCARG(args, infd);
+  off_t *u_inoff = SCARG(args, inoff);
+  int outfd = SCARG(args, outfd);
+  off_t *u_outoff = SCARG(args, outoff);
+  size_t count = SCARG(args, count);
+  unsigned flags = SCARG(args, flags);
+  off_t inoff, outoff;
+  size_t done;
+  int error;
+
+  klog("splice(%d, %p, %d, %p, %u, %x)", infd, u_inoff, outfd, u_outoff, count,
+       flags);
+
+  if (flags)
+    return EINVAL;
+
+  if (u_inoff && (error = copyin_s(u_inoff, inoff)))
+    return error;
+  if (u_outoff && (error = copyin_s(u_outoff, outoff)))
+    return error;
+
+  if ((error = do_splice(p, infd, u_inoff ? &inoff : NULL, outfd,
+                         u_outoff ? &outoff : NULL, count, &done)))
+    return error;
+
+  if (u_inoff && (error = copyout_s(inoff, u_inoff)))
+    return error;
+  if (u_outoff && (error = copyout_s(outoff, u_outoff)))
+    return error;
+
+  *res = done;
+  return 0;
+}
+
+static int aio_rw(proc_t *p, struct aiocb *u_aiocb, int opcode) {
+  struct aiocb aiocb;
+  int error;
+
+  if ((error = copyin_s(u_aiocb, aiocb)))
+    return error;
+
+  aiocb.aio_lio_opcode = opcode;
+  return do_aio_submit(p, u_aiocb, &aiocb);
+}
+
+static int sys_aio_read(proc_t *p, aio_read_args_t *args, register_t *res) {
+  struct aiocb *u_aiocb = SCARG(args, aiocbp);
+  klog("aio_read(%p)", u_aiocb);
+  return aio_rw(p, u_aiocb, LIO_READ);
+}
+
+static int sys_aio_write(proc_t *p, aio_write_args_t *args, register_t *res) {
+  struct aiocb *u_aiocb = SCARG(args, aiocbp);
+  klog("aio_write(%p)", u_aiocb);
+  return aio_rw(p, u_aiocb, LIO_WRITE);
+}
+
+static int sys_aio_error(proc_t *p, aio_error_args_t *args, register_t *res) {
+  struct aiocb *u_aiocb = __UNCONST(SCARG(args, aiocbp));
+  int error, status;
+
+  klog("aio_error(%p)", u_aiocb);
+
+  if ((error = do_aio_error(p, u_aiocb, &status)))
+    return error;
+
+  *res = status;
+  return 0;
+}
+
+static int sys_aio_return(proc_t *p, aio_return_args_t *args,
+                          register_t *res) {
+  struct aiocb *u_aiocb = SCARG(args, aiocbp);
+  ssize_t result;
+  int error;
+
+  klog("aio_return(%p)", u_aiocb);
+
+  if ((error = do_aio_return(p, u_aiocb, &result)))
+    return error;
+
+  *res = result;
+  return 0;
+}
+
+static int sys_aio_suspend(proc_t *p, aio_suspend_args_t *args,
+                           register_t *res) {
+  const struct aiocb *const *u_list = SCARG(args, list);
+  int nent = SCARG(args, nent);
+  const timespec_t *u_timeout = SCARG(args, timeout);
+  struct aiocb *list[AIO_LISTIO_MAX];
+  timespec_t timeout;
+  int error;
+
+  klog("aio_suspend(%p, %d, %p)", u_list, nent, u_timeout);
+
+  if (nent <= 0 || nent > AIO_LISTIO_MAX)
+    return EINVAL;
+
+  if ((error = copyin(u_list, list, nent * sizeof(struct aiocb *))))
+    return error;
+
+  if (u_timeout && (error = copyin_s(u_timeout, timeout)))
+    return error;
+
+  return do_aio_suspend(p, list, nent, u_timeout ? &timeout : NULL);
+}
+
+static int sys_lio_listio(proc_t *p, lio_listio_args_t *args,
+                          register_t *res) {
+  int mode = SCARG(args, mode);
+  struct aiocb *const *u_list = SCARG(args, list);
+  int nent = SCARG(args, nent);
+  struct sigevent *u_sig = SCARG(args, sig);
+  struct aiocb *list[AIO_LISTIO_MAX];
+  struct aiocb *aiocbs;
+  struct sigevent sig;
+  int error;
+
+  klog("lio_listio(%d, %p, %d, %p)", mode, u_list, nent, u_sig);
+
+  if (nent <= 0 || nent > AIO_LISTIO_MAX)
+    return EINVAL;
+
+  if ((error = copyin(u_list, list, nent * sizeof(struct aiocb *))))
+    return error;
+
+  if (u_sig && (error = copyin_s(u_sig, sig)))
+    return error;
+
+  aiocbs = kmalloc(M_TEMP, nent * sizeof(struct aiocb), M_WAITOK);
+
+  for (int i = 0; i < nent; i++) {
+    if (list[i] && (error = copyin_s(list[i], aiocbs[i])))
+      goto end;
+  }
+
+  error = do_lio_listio(p, mode, list, aiocbs, nent, u_sig ? &sig : NULL);
+
+end:
+  kfree(M_TEMP, aiocbs);
+  return error;
+}
+
+static int sys_pollts(proc_t *p, pollts_args_t *args, register_t *res) {
+  struct pollfd *u_fds = SCARG(args, fds);
+  nfds_t nfds = SCARG(args, nfds);
+  const timespec_t *u_ts = SCARG(args, ts);
+  const sigset_t *u_mask = SCARG(args, mask);
+  struct pollfd *fds = NULL;
+  timespec_t ts;
+  sigset_t mask;
+  int error, nready;
+
+  klog("pollts(%p, %u, %p, %p)", u_fds, nfds, u_ts, u_mask);
+
+  if (nfds > OPEN_MAX)
+    return EINVAL;
+
+  if (u_ts && (error = copyin_s(u_ts, ts)))
+    return error;
+  if (u_mask && (error = copyin_s(u_mask, mask)))
+    return error;
+
+  /* With no descriptors poll just sleeps, so there's nothing to copy. */
+  if (nfds > 0) {
+    fds = kmalloc(M_TEMP, nfds * sizeof(struct pollfd), 0);
+    if ((error = copyin(u_fds, fds, nfds * sizeof(struct pollfd))))
+      goto end;
+  }
+
+  if ((error = do_poll(p, fds, nfds, u_ts ? &ts : NULL, u_mask ? &mask : NULL,
+                       &nready)))
+    goto end;
+
+  if (nfds > 0 && (error = copyout(fds, u_fds, nfds * sizeof(struct pollfd))))
+    goto end;
+
+  *res = nready;
+
+end:
+  kfree(M_TEMP, fds);
+  return error;
+}
+
+static int sys_pselect(proc_t *p, pselect_args_t *args, register_t *res) {
+  int nd = SCARG(args, nd);
+  fd_set *u_in = SCARG(args, in);
+  fd_set *u_ou = SCARG(args, ou);
+  fd_set *u_ex = SCARG(args, ex);
+  const timespec_t *u_ts = SCARG(args, ts);
+  const sigset_t *u_mask = SCARG(args, mask);
+  timespec_t ts;
+  sigset_t mask;
+  int error, nready;
+
+  klog("pselect(%d, %p, %p, %p, %p, %p)", nd, u_in, u_ou, u_ex, u_ts, u_mask);
+
+  if (nd < 0 || nd > FD_SETSIZE)
+    return EINVAL;
+
+  if (u_ts && (error = copyin_s(u_ts, ts)))
+    return error;
+  if (u_mask && (error = copyin_s(u_mask, mask)))
+    return error;
+
+  /* Descriptor sets would take a big chunk of the kernel stack. */
+  fd_set *sets = kmalloc(M_TEMP, 3 * sizeof(fd_set), M_WAITOK);
+  fd_set *in = u_in ? &sets[0] : NULL;
+  fd_set *ou = u_ou ? &sets[1] : NULL;
+  fd_set *ex = u_ex ? &sets[2] : NULL;
+
+  if (in && (error = copyin(u_in, in, sizeof(fd_set))))
+    goto end;
+  if (ou && (error = copyin(u_ou, ou, sizeof(fd_set))))
+    goto end;
+  if (ex && (error = copyin(u_ex, ex, sizeof(fd_set))))
+    goto end;
+
+  if ((error = do_pselect(p, nd, in, ou, ex, u_ts ? &ts : NULL,
+                          u_mask ? &mask : NULL, &nready)))
+    goto end;
+
+  if (in && (error = copyout(in, u_in, sizeof(fd_set))))
+    goto end;
+  if (ou && (error = copyout(ou, u_ou, sizeof(fd_set))))
+    goto end;
+  if (ex && (error = copyout(ex, u_ex, sizeof(fd_set))))
+    goto end;
+
+  *res = nready;
+
+end:
+  kfree(M_TEMP, sets);
+  return error;
+}
+
+static int sys_socket(proc_t *p, socket_args_t *args, register_t *res) {
+  int domain = SCARG(args, domain);
+  int type = SCARG(args, type);
+  int protocol = SCARG(args, protocol);
+  int error, fd;
+
+  klog("socket(%d, %d, %d)", domain, type, protocol);
+
+  if ((error = do_socket(p, domain, type, protocol, &fd)))
+    return error;
+
+  *res = fd;
+  return 0;
+}
+
+static int sys_socketpair(proc_t *p, socketpair_args_t *args,
+                          register_t *res) {
+  int domain = SCARG(args, domain);
+  int type = SCARG(args, type);
+  int protocol = SCARG(args, protocol);
+  int *u_rsv = SCARG(args, rsv);
+  int sv[2];
+  int error;
+
+  klog("socketpair(%d, %d, %d, %p)", domain, type, protocol, u_rsv);
+
+  if ((error = do_socketpair(p, domain, type, protocol, sv)))
+    return error;
+
+  return copyout(sv, u_rsv, 2 * sizeof(int));
+}
+
+/* Fetch socket address from user space. */
+static int copyin_sockaddr(const struct sockaddr *u_name, u_int namelen,
+                           struct sockaddr_un *sun) {
+  if (namelen > sizeof(struct sockaddr_un))
+    return EINVAL;
+  return copyin(u_name, sun, namelen);
+}
+
+static int sys_bind(proc_t *p, bind_args_t *args, register_t *res) {
+  int s = SCARG(args, s);
+  const struct sockaddr *u_name = SCARG(args, name);
+  u_int namelen = SCARG(args, namelen);
+  struct sockaddr_un sun;
+  int error;
+
+  klog("bind(%d, %p, %u)", s, u_name, namelen);
+
+  if ((error = copyin_sockaddr(u_name, namelen, &sun)))
+    return error;
+
+  return do_bind(p, s, (struct sockaddr *)&sun, namelen);
+}
+
+static int sys_listen(proc_t *p, listen_args_t *args, register_t *res) {
+  int s = SCARG(args, s);
+  int backlog = SCARG(args, backlog);
+
+  klog("listen(%d, %d)", s, backlog);
+
+  return do_listen(p, s, backlog);
+}
+
+static int sys_accept(proc_t *p, accept_args_t *args, register_t *res) {
+  int s = SCARG(args, s);
+  struct sockaddr *u_name = SCARG(args, name);
+  u_int *u_anamelen = SCARG(args, anamelen);
+  struct sockaddr_un sun;
+  socklen_t buflen = 0, namelen;
+  int error, fd;
+
+  klog("accept(%d, %p, %p)", s, u_name, u_anamelen);
+
+  if (u_name && (error = copyin_s(u_anamelen, buflen)))
+    return error;
+
+  namelen = buflen = min(buflen, sizeof(struct sockaddr_un));
+
+  if ((error = do_accept(p, s, u_name ? (struct sockaddr *)&sun : NULL,
+                         &namelen, &fd)))
+    return error;
+
+  if (u_name) {
+    if ((error = copyout(&sun, u_name, min(buflen, namelen))) ||
+        (error = copyout_s(namelen, u_anamelen))) {
+      do_close(p, fd);
+      return error;
+    }
+  }
+
+  *res = fd;
+  return 0;
+}
+
+static int sys_connect(proc_t *p, connect_args_t *args, register_t *res) {
+  int s = SCARG(args, s);
+  const struct sockaddr *u_name = SCARG(args, name);
+  u_int namelen = SCARG(args, namelen);
+  struct sockaddr_un sun;
+  int error;
+
+  klog("connect(%d, %p, %u)", s, u_name, namelen);
+
+  if ((error = copyin_sockaddr(u_name, namelen, &sun)))
+    return error;
+
+  return do_connect(p, s, (struct sockaddr *)&sun, namelen);
+}
+
+/* Fetch message header and scatter/gather list from user space. */
+static int copyin_msghdr(const struct msghdr *u_msg, struct msghdr *msg,
+                         iovec_t **iovp, size_t *lenp) {
+  int error;
+
+  if ((error = copyin_s(u_msg, *msg)))
+    return error;
+
+  if (msg->msg_iovlen < 0 || msg->msg_iovlen > IOV_MAX)
+    return EMSGSIZE;
+  if (msg->msg_controllen > MAXCONTROLLEN)
+    return EINVAL;
+
+  const size_t iov_size = sizeof(iovec_t) * msg->msg_iovlen;
+  iovec_t *k_iov = kmalloc(M_TEMP, iov_size, 0);
+
+  if ((error = copyin(msg->msg_iov, k_iov, iov_size)) ||
+      (error = iovec_length(k_iov, msg->msg_iovlen, lenp))) {
+    kfree(M_TEMP, k_iov);
+    return error;
+  }
+
+  *iovp = k_iov;
+  return 0;
+}
+
+static int sys_sendmsg(proc_t *p, sendmsg_args_t *args, register_t *res) {
+  int s = SCARG(args, s);
+  const struct msghdr *u_msg = SCARG(args, msg);
+  int flags = SCARG(args, flags);
+  struct sockaddr_un sun;
+  struct msghdr msg;
+  iovec_t *k_iov;
+  void *control = NULL;
+  size_t len;
+  int error;
+
+  klog("sendmsg(%d, %p, %x)", s, u_msg, flags);
+
+  if ((error = copyin_msghdr(u_msg, &msg, &k_iov, &len)))
+    return error;
+
+  if (msg.msg_name) {
+    if ((error = copyin_sockaddr(msg.msg_name, msg.msg_namelen, &sun)))
+      goto end;
+    msg.msg_name = &sun;
+  }
+
+  if (msg.msg_control && msg.msg_controllen > 0) {
+    control = kmalloc(M_TEMP, msg.msg_controllen, 0);
+    if ((error = copyin(msg.msg_control, control, msg.msg_controllen)))
+      goto end;
+  }
+  msg.msg_control = control;
+  if (control == NULL)
+    msg.msg_controllen = 0;
+
+  uio_t uio = UIO_VECTOR_USER(UIO_WRITE, k_iov, msg.msg_iovlen, len);
+  error = do_sendmsg(p, s, &msg, &uio, flags);
+  *res = len - uio.uio_resid;
+
+end:
+  if (control)
+    kfree(M_TEMP, control);
+  kfree(M_TEMP, k_iov);
+  return error;
+}
+
+static int sys_recvmsg(proc_t *p, recvmsg_args_t *args, register_t *res) {
+  int s = SCARG(args, s);
+  struct msghdr *u_msg = SCARG(args, msg);
+  int flags = SCARG(args, flags);
+  struct sockaddr_un sun;
+  struct msghdr msg;
+  iovec_t *k_iov;
+  void *control = NULL;
+  size_t len;
+  int error;
+
+  klog("recvmsg(%d, %p, %x)", s, u_msg, flags);
+
+  if ((error = copyin_msghdr(u_msg, &msg, &k_iov, &len)))
+    return error;
+
+  void *u_name = msg.msg_name;
+  void *u_control = msg.msg_control;
+  socklen_t buflen = 0;
+
+  if (u_name) {
+    buflen = min(msg.msg_namelen, sizeof(struct sockaddr_un));
+    msg.msg_namelen = buflen;
+    msg.msg_name = &sun;
+  }
+
+  if (u_control && msg.msg_controllen > 0)
+    control = kmalloc(M_TEMP, msg.msg_controllen, M_ZERO);
+  msg.msg_control = control;
+  if (control == NULL)
+    msg.msg_controllen = 0;
+
+  uio_t uio = UIO_VECTOR_USER(UIO_READ, k_iov, msg.msg_iovlen, len);
+  if ((error = do_recvmsg(p, s, &msg, &uio, flags)))
+    goto end;
+  *res = len - uio.uio_resid;
+
+  if (u_name && msg.msg_namelen > 0 &&
+      (error = copyout(&sun, u_name, min(buflen, msg.msg_namelen))))
+    goto fail;
+
+  if (control && msg.msg_controllen > 0 &&
+      (error = copyout(control, u_control, msg.msg_controllen)))
+    goto fail;
+
+  /* Update value-result fields of user's message header. */
+  msg.msg_name = u_name;
+  msg.msg_control = u_control;
+  if (!(error = copyout_s(msg, u_msg)))
+    goto end;
+
+fail:
+  /* The user won't learn about received descriptors, so close them. */
+  msg.msg_control = control;
+  sock_close_rights(p, &msg);
+
+end:
+  if (control)
+    kfree(M_TEMP, control);
+  kfree(M_TEMP, k_iov);
+  return error;
+}
+
+static int sys_shutdown(proc_t *p, shutdown_args_t *args, register_t *res) {
+  int s = SCARG(args, s);
+  int how = SCARG(args, how);
+
+  klog("shutdown(%d, %d)", s, how);
+
+  return do_shutdown(p, s, how);
+}
+
+static int sys_shm_open(proc_t *p, shm_open_args_t *args, register_t *res) {
+  const char *u_name = SCARG(args, name);
+  int flags = SCARG(args, flags);
+  mode_t mode = SCARG(args, mode);
+
+  char *name = kmalloc(M_TEMP, PATH_MAX, 0);
+  int fd, error;
+
+  if ((error = copyinstr(u_name, name, PATH_MAX, NULL)))
+    goto end;
+
+  klog("shm_open(\"%s\", %d, %d)", name, flags, mode);
+
+  if ((error = do_shm_open(p, name, flags, mode, &fd)))
+    goto end;
+
+  *res = fd;
+
+end:
+  kfree(M_TEMP, name);
+  return error;
+}
+
+static int sys_shm_unlink(proc_t *p, shm_unlink_args_t *args, register_t *res) {
+  const char *u_name = SCARG(args, name);
+
+  char *name = kmalloc(M_TEMP, PATH_MAX, 0);
+  int error;
+
+  if ((error = copyinstr(u_name, name, PATH_MAX, NULL)))
+    goto end;
+
+  klog("shm_unlink(\"%s\")", name);
+
+  error = do_shm_unlink(p, name);
+
+end:
+  kfree(M_TEMP, name);
+  return error;
+}
+
+static int sys_eventfd(proc_t *p, eventfd_args_t *args, register_t *res) {
+  u_int initval = SCARG(args, initval);
+  int flags = SCARG(args, flags);
+  int fd, error;
+
+  klog("eventfd(%u, %d)", initval, flags);
+
+  if ((error = do_eventfd(p, initval, flags, &fd)))
+    return error;
+
+  *res = fd;
+  return 0;
+}
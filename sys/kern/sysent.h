@@ -94,6 +94,37 @@ static int sys_kevent(proc_t *, kevent_args_t *, register_t *);
 static int sys_sigtimedwait(proc_t *, sigtimedwait_args_t *, register_t *);
 static int sys_clock_settime(proc_t *, clock_settime_args_t *, register_t *);
 static int sys_pathconf(proc_t *, pathconf_args_t *, register_t *);
+static int sys_thr_new(proc_t *, thr_new_args_t *, register_t *);
+static int sys_thr_exit(proc_t *, thr_exit_args_t *, register_t *);
+static int sys_thr_self(proc_t *, void *, register_t *);
+static int sys_thr_kill(proc_t *, thr_kill_args_t *, register_t *);
+static int sys_futex(proc_t *, futex_args_t *, register_t *);
+static int sys_pread(proc_t *, pread_args_t *, register_t *);
+static int sys_pwrite(proc_t *, pwrite_args_t *, register_t *);
+static int sys_preadv(proc_t *, preadv_args_t *, register_t *);
+static int sys_pwritev(proc_t *, pwritev_args_t *, register_t *);
+static int sys_sendfile(proc_t *, sendfile_args_t *, register_t *);
+static int sys_splice(proc_t *, splice_args_t *, register_t *);
+static int sys_aio_read(proc_t *, aio_read_args_t *, register_t *);
+static int sys_aio_write(proc_t *, aio_write_args_t *, register_t *);
+static int sys_aio_error(proc_t *, aio_error_args_t *, register_t *);
+static int sys_aio_return(proc_t *, aio_return_args_t *, register_t *);
+static int sys_aio_suspend(proc_t *, aio_suspend_args_t *, register_t *);
+static int sys_lio_listio(proc_t *, lio_listio_args_t *, register_t *);
+static int sys_pollts(proc_t *, pollts_args_t *, register_t *);
+static int sys_pselect(proc_t *, pselect_args_t *, register_t *);
+static int sys_socket(proc_t *, socket_args_t *, register_t *);
+static int sys_socketpair(proc_t *, socketpair_args_t *, register_t *);
+static int sys_bind(proc_t *, bind_args_t *, register_t *);
+static int sys_listen(proc_t *, listen_args_t *, register_t *);
+static int sys_accept(proc_t *, accept_args_t *, register_t *);
+static int sys_connect(proc_t *, connect_args_t *, register_t *);
+static int sys_sendmsg(proc_t *, sendmsg_args_t *, register_t *);
+static int sys_recvmsg(proc_t *, recvmsg_args_t *, register_t *);
+static int sys_shutdown(proc_t *, shutdown_args_t *, register_t *);
+static int sys_shm_open(proc_t *, shm_open_args_t *, register_t *);
+static int sys_shm_unlink(proc_t *, shm_unlink_args_t *, register_t *);
+static int sys_eventfd(proc_t *, eventfd_args_t *, register_t *);
 
 struct sysent sysent[] = {
   [SYS_syscall] = { .name = "syscall", .nargs = 1, .call = (syscall_t *)sys_syscall },
@@ -110,7 +141,7 @@ struct sysent sysent[] = {
   [SYS_fstat] = { .name = "fstat", .nargs = 2, .call = (syscall_t *)sys_fstat },
   [SYS_sbrk] = { .name = "sbrk", .nargs = 1, .call = (syscall_t *)sys_sbrk },
   [SYS_mmap] = { .name = "mmap", .nargs = 6, .call = (syscall_t *)sys_mmap },
-  [SYS_mount] = { .name = "mount", .nargs = 2, .call = (syscall_t *)sys_mount },
+  [SYS_mount] = { .name = "mount", .nargs = 3, .call = (syscall_t *)sys_mount },
   [SYS_getdents] = { .name = "getdents", .nargs = 3, .call = (syscall_t *)sys_getdents },
   [SYS_dup] = { .name = "dup", .nargs = 1, .call = (syscall_t *)sys_dup },
   [SYS_dup2] = { .name = "dup2", .nargs = 2, .call = (syscall_t *)sys_dup2 },
@@ -185,5 +216,36 @@ struct sysent sysent[] = {
   [SYS_sigtimedwait] = { .name = "sigtimedwait", .nargs = 3, .call = (syscall_t *)sys_sigtimedwait },
   [SYS_clock_settime] = { .name = "clock_settime", .nargs = 2, .call = (syscall_t *)sys_clock_settime },
   [SYS_pathconf] = { .name = "pathconf", .nargs = 2, .call = (syscall_t *)sys_pathconf },
+  [SYS_thr_new] = { .name = "thr_new", .nargs = 2, .call = (syscall_t *)sys_thr_new },
+  [SYS_thr_exit] = { .name = "thr_exit", .nargs = 1, .call = (syscall_t *)sys_thr_exit },
+  [SYS_thr_self] = { .name = "thr_self", .nargs = 0, .call = (syscall_t *)sys_thr_self },
+  [SYS_thr_kill] = { .name = "thr_kill", .nargs = 2, .call = (syscall_t *)sys_thr_kill },
+  [SYS_futex] = { .name = "futex", .nargs = 4, .call = (syscall_t *)sys_futex },
+  [SYS_pread] = { .name = "pread", .nargs = 4, .call = (syscall_t *)sys_pread },
+  [SYS_pwrite] = { .name = "pwrite", .nargs = 4, .call = (syscall_t *)sys_pwrite },
+  [SYS_preadv] = { .name = "preadv", .nargs = 4, .call = (syscall_t *)sys_preadv },
+  [SYS_pwritev] = { .name = "pwritev", .nargs = 4, .call = (syscall_t *)sys_pwritev },
+  [SYS_sendfile] = { .name = "sendfile", .nargs = 4, .call = (syscall_t *)sys_sendfile },
+  [SYS_splice] = { .name = "splice", .nargs = 6, .call = (syscall_t *)sys_splice },
+  [SYS_aio_read] = { .name = "aio_read", .nargs = 1, .call = (syscall_t *)sys_aio_read },
+  [SYS_aio_write] = { .name = "aio_write", .nargs = 1, .call = (syscall_t *)sys_aio_write },
+  [SYS_aio_error] = { .name = "aio_error", .nargs = 1, .call = (syscall_t *)sys_aio_error },
+  [SYS_aio_return] = { .name = "aio_return", .nargs = 1, .call = (syscall_t *)sys_aio_return },
+  [SYS_aio_suspend] = { .name = "aio_suspend", .nargs = 3, .call = (syscall_t *)sys_aio_suspend },
+  [SYS_lio_listio] = { .name = "lio_listio", .nargs = 4, .call = (syscall_t *)sys_lio_listio },
+  [SYS_pollts] = { .name = "pollts", .nargs = 4, .call = (syscall_t *)sys_pollts },
+  [SYS_pselect] = { .name = "pselect", .nargs = 6, .call = (syscall_t *)sys_pselect },
+  [SYS_socket] = { .name = "socket", .nargs = 3, .call = (syscall_t *)sys_socket },
+  [SYS_socketpair] = { .name = "socketpair", .nargs = 4, .call = (syscall_t *)sys_socketpair },
+  [SYS_bind] = { .name = "bind", .nargs = 3, .call = (syscall_t *)sys_bind },
+  [SYS_listen] = { .name = "listen", .nargs = 2, .call = (syscall_t *)sys_listen },
+  [SYS_accept] = { .name = "accept", .nargs = 3, .call = (syscall_t *)sys_accept },
+  [SYS_connect] = { .name = "connect", .nargs = 3, .call = (syscall_t *)sys_connect },
+  [SYS_sendmsg] = { .name = "sendmsg", .nargs = 3, .call = (syscall_t *)sys_sendmsg },
+  [SYS_recvmsg] = { .name = "recvmsg", .nargs = 3, .call = (syscall_t *)sys_recvmsg },
+  [SYS_shutdown] = { .name = "shutdown", .nargs = 2, .call = (syscall_t *)sys_shutdown },
+  [SYS_shm_open] = { .name = "shm_open", .nargs = 3, .call = (syscall_t *)sys_shm_open },
+  [SYS_shm_unlink] = { .name = "shm_unlink", .nargs = 1, .call = (syscall_t *)sys_shm_unlink },
+  [SYS_eventfd] = { .name = "eventfd", .nargs = 2, .call = (syscall_t *)sys_eventfd },
 };
 
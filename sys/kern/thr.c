@@ -0,0 +1,114 @@
+#define KL_LOG KL_PROC
+#include <sys/klog.h>
+#include <sys/errno.h>
+#include <sys/futex.h>
+#include <sys/libkern.h>
+#include <sys/mimiker.h>
+#include <sys/proc.h>
+#include <sys/sched.h>
+#include <sys/signal.h>
+#include <sys/thr.h>
+#include <sys/thread.h>
+#include <sys/wait.h>
+#include <machine/abi.h>
+
+int do_thr_new(proc_t *p, struct thr_param *param, tid_t *tidp) {
+  thread_t *td = thread_self();
+  int error;
+
+  if (param->start_func == NULL || param->stack_base == NULL ||
+      param->stack_size == 0)
+    return EINVAL;
+
+  vaddr_t sp = rounddown2((vaddr_t)param->stack_base + param->stack_size,
+                          STACK_ALIGN);
+
+  /* Similarly to fork, the new thread will start its life by returning from
+   * an exception into user space. */
+  thread_t *newtd = thread_create(td->td_name, (entry_fn_t)user_exc_leave,
+                                  NULL, td->td_base_prio);
+
+  /* Start with a copy of caller's user context, so that all machine dependent
+   * registers (e.g. status register or thread pointer) are set up properly,
+   * then make the thread call the entry function. */
+  mcontext_copy(newtd->td_uctx, td->td_uctx);
+  mcontext_setup_call(newtd->td_uctx, param->start_func, (void *)sp,
+                      (register_t)param->arg);
+
+  newtd->td_kframe = NULL;
+  newtd->td_onfault = 0;
+
+  newtd->td_wchan = NULL;
+  newtd->td_waitpt = NULL;
+
+  newtd->td_prio = td->td_prio;
+
+  newtd->td_sigmask = td->td_sigmask;
+
+  tid_t tid = newtd->td_tid;
+
+  /* Thread identifiers are stored before the new thread joins the process,
+   * so it can rely on them as soon as it begins execution. If that fails
+   * the caller must be able to release the thread's stack. */
+  error = 0;
+  if (param->child_tid)
+    error = copyout_s(tid, param->child_tid);
+  if (!error && param->parent_tid)
+    error = copyout_s(tid, param->parent_tid);
+
+  WITH_PROC_LOCK(p) {
+    /* Do not let new threads in if the process is going down. */
+    if (!error && ((td->td_flags & TDF_EXITING) || p->p_state == PS_DYING))
+      error = EINTR;
+    if (error) {
+      newtd->td_state = TDS_DEAD;
+      thread_delete(newtd);
+      return error;
+    }
+    proc_add_thread(p, newtd);
+  }
+
+  klog("Thread %u created thread %u in process PID(%d)", td->td_tid, tid,
+       p->p_pid);
+
+  sched_add(newtd);
+
+  *tidp = tid;
+  return 0;
+}
+
+__noreturn void do_thr_exit(proc_t *p, int *state) {
+  thread_t *td = thread_self();
+
+  klog("Thread %u in process PID(%d) exits", td->td_tid, p->p_pid);
+
+  /* Let others know the thread is gone, e.g. pthread_join. Failures are
+   * ignored, since there's nobody to report them to. */
+  if (state != NULL) {
+    int one = 1, nwoken;
+    if (!copyout_s(one, state))
+      do_futex_wake(p, state, 0, INT_MAX, &nwoken);
+  }
+
+  proc_lock(p);
+  proc_thread_exit(MAKE_STATUS_EXIT(0));
+}
+
+int do_thr_kill(proc_t *p, tid_t tid, int sig) {
+  if (sig < 0 || sig >= NSIG)
+    return EINVAL;
+
+  SCOPED_MTX_LOCK(&p->p_lock);
+
+  thread_t *td;
+  TAILQ_FOREACH (td, &p->p_threads, td_procq) {
+    if (td->td_tid != tid)
+      continue;
+    /* Signal number 0 only checks whether the thread exists. */
+    if (sig > 0)
+      sig_kill_thread(td, &DEF_KSI_RAW(sig));
+    return 0;
+  }
+
+  return ESRCH;
+}
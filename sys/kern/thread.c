@@ -13,15 +13,27 @@
 #include <sys/turnstile.h>
 #include <sys/kmem.h>
 #include <sys/context.h>
+#include <sys/kenv.h>
 
 static POOL_DEFINE(P_THREAD, "thread", sizeof(thread_t));
 
-typedef TAILQ_HEAD(, thread) thread_list_t;
-
-static MTX_DEFINE(threads_lock, 0);
-static thread_list_t all_threads = TAILQ_HEAD_INITIALIZER(all_threads);
+MTX_DEFINE(threads_lock, 0);
+thread_list_t all_threads = TAILQ_HEAD_INITIALIZER(all_threads);
 static thread_list_t zombie_threads = TAILQ_HEAD_INITIALIZER(zombie_threads);
 
+/*
+ * Thread cache keeps shells of deleted threads, i.e. thread structures with
+ * kernel stack, dispatcher lock, name buffer, sleepqueue and turnstile still
+ * attached. Shells are never returned to the allocator while cached, so
+ * thread_create can reuse them without reinitializing those resources.
+ */
+static MTX_DEFINE(thread_cache_lock, 0);
+static thread_list_t thread_cache = TAILQ_HEAD_INITIALIZER(thread_cache);
+static unsigned thread_cache_count; /* (c) number of cached shells */
+unsigned thread_cache_max = THREAD_CACHE_MAX;
+bool thread_cache_zero = false;
+unsigned thread_cache_hits; /* (c) */
+
 /* FTTB such a primitive method of creating new TIDs will do. */
 static tid_t make_tid(void) {
   static volatile tid_t tid = 1;
@@ -56,6 +68,11 @@ void init_thread0(void) {
 
   WITH_MTX_LOCK (&threads_lock)
     TAILQ_INSERT_TAIL(&all_threads, td, td_all);
+
+  const char *max = kenv_get("thread-cache-max");
+  if (max)
+    thread_cache_max = strtoul(max, NULL, 10);
+  thread_cache_zero = kenv_get_ulong("thread-cache-zero");
 }
 
 void thread_reap(void) {
@@ -71,12 +88,71 @@ void thread_reap(void) {
     thread_delete(td);
 }
 
+/* Takes a thread shell from the cache or allocates a brand new one. */
+static thread_t *thread_alloc(void) {
+  thread_t *td;
+
+  WITH_MTX_LOCK (&thread_cache_lock) {
+    if ((td = TAILQ_FIRST(&thread_cache))) {
+      TAILQ_REMOVE(&thread_cache, td, td_zombieq);
+      thread_cache_count--;
+      thread_cache_hits++;
+    }
+  }
+
+  if (td == NULL) {
+    td = pool_alloc(P_THREAD, M_ZERO);
+    td->td_lock = kmalloc(M_TEMP, sizeof(mtx_t), M_ZERO);
+    td->td_name = kmalloc(M_STR, TD_NAME_MAX, 0);
+    kstack_init(&td->td_kstack, kmem_alloc(KSTACK_SIZE, M_ZERO), KSTACK_SIZE);
+    td->td_sleepqueue = sleepq_alloc();
+    td->td_turnstile = turnstile_alloc();
+    return td;
+  }
+
+  /* Keep resources attached to the shell, but reset everything else. */
+  mtx_t *lock = td->td_lock;
+  char *name = td->td_name;
+  void *stack = td->td_kstack.stk_base;
+  sleepq_t *sq = td->td_sleepqueue;
+  turnstile_t *ts = td->td_turnstile;
+
+  bzero(td, sizeof(thread_t));
+
+  td->td_lock = lock;
+  td->td_name = name;
+  if (thread_cache_zero)
+    bzero(stack, KSTACK_SIZE);
+  kstack_init(&td->td_kstack, stack, KSTACK_SIZE);
+  td->td_sleepqueue = sq;
+  td->td_turnstile = ts;
+  return td;
+}
+
+/* Returns thread shell to the cache or frees it if the cache is full. */
+static void thread_free(thread_t *td) {
+  WITH_MTX_LOCK (&thread_cache_lock) {
+    if (thread_cache_count < thread_cache_max) {
+      TAILQ_INSERT_HEAD(&thread_cache, td, td_zombieq);
+      thread_cache_count++;
+      return;
+    }
+  }
+
+  kmem_free(td->td_kstack.stk_base, KSTACK_SIZE);
+  sleepq_destroy(td->td_sleepqueue);
+  turnstile_destroy(td->td_turnstile);
+  kfree(M_STR, td->td_name);
+  kfree(M_TEMP, td->td_lock);
+  pool_free(P_THREAD, td);
+}
+
 thread_t *thread_create(const char *name, void (*fn)(void *), void *arg,
                         prio_t prio) {
   /* Firstly recycle some threads to free up memory. */
   thread_reap();
 
-  thread_t *td = pool_alloc(P_THREAD, M_ZERO);
+  thread_t *td = thread_alloc();
 
   td->td_tid = make_tid();
   td->td_state = TDS_INACTIVE;
@@ -84,18 +160,12 @@ thread_t *thread_create(const char *name, void (*fn)(void *), void *arg,
   td->td_prio = prio;
   td->td_base_prio = prio;
 
-  td->td_lock = kmalloc(M_TEMP, sizeof(mtx_t), M_ZERO);
   mtx_init(td->td_lock, MTX_SPIN | MTX_NODEBUG);
 
   cv_init(&td->td_waitcv, "thread waiters");
   LIST_INIT(&td->td_contested);
-  bzero(&td->td_slpcallout, sizeof(callout_t));
 
-  td->td_name = kstrndup(M_STR, name, TD_NAME_MAX);
-  kstack_init(&td->td_kstack, kmem_alloc(KSTACK_SIZE, M_ZERO), KSTACK_SIZE);
-
-  td->td_sleepqueue = sleepq_alloc();
-  td->td_turnstile = turnstile_alloc();
+  strlcpy(td->td_name, name, TD_NAME_MAX);
 
   sigpend_init(&td->td_sigpend);
 
@@ -120,15 +190,9 @@ void thread_delete(thread_t *td) {
   WITH_MTX_LOCK (&threads_lock)
     TAILQ_REMOVE(&all_threads, td, td_all);
 
-  kmem_free(td->td_kstack.stk_base, KSTACK_SIZE);
-
   callout_drain(&td->td_slpcallout);
-  sleepq_destroy(td->td_sleepqueue);
-  turnstile_destroy(td->td_turnstile);
   sigpend_destroy(&td->td_sigpend);
-  kfree(M_STR, td->td_name);
-  kfree(M_TEMP, td->td_lock);
-  pool_free(P_THREAD, td);
+  thread_free(td);
 }
 
 /*
@@ -4,6 +4,7 @@
 #include <sys/dirent.h>
 #include <sys/vnode.h>
 #include <sys/errno.h>
+#include <sys/hash.h>
 #include <sys/libkern.h>
 #include <sys/mutex.h>
 #include <sys/stat.h>
@@ -12,14 +13,16 @@
 #include <sys/pmap.h>
 #include <sys/malloc.h>
 #include <sys/cred.h>
+#include <sys/filio.h>
+#include <sys/statvfs.h>
+#include <sys/vm_physmem.h>
 #include <bitstring.h>
 #include <sys/unistd.h>
 
 /*
- * All memory used by the tmpfs is organized in the list of arenas. A single
- * arena consists of a header, which contains block usage bitmap and the inode
- * usage bitmap. Afterwards there are a few blocks for inodes. The rest is used
- * for storing file data.
+ * Inodes used by the tmpfs are organized in the list of arenas. A single
+ * arena consists of a header, which contains the inode usage bitmap.
+ * The rest is used for storing inodes. Pages of an arena are mapped on demand.
  *
  * BLOCKS         BYTES
  *   0+------------+ 0
@@ -27,23 +30,35 @@
  *    +------------+ 256B
  *    |            |      - inodes
  *    |            |
- *   5+------------+ 20KiB
- *    |            |
- *    |            |      - data blocks
- *    |            |
- * 256+------------+
+ *  32+------------+ 128KiB
  *   END OF THE ARENA
  *
- * Dirctory entries uses the same memory blocks as regular files. Every
- * directory has two lists containing free and used direntries. If a new
- * direntry is needed, but there aren't any free direntries then the new data
- * block is allocated and subsequently partitioned into free direntries.
+ * File data is stored in physical pages, which are found through direct,
+ * single indirect and double indirect pointers. Indirect blocks are physical
+ * pages too and they're accessed through direct map. Pages are allocated only
+ * when data is written to them, hence files may contain holes which read as
+ * zeros and take no memory.
  *
- * When a direntry is freed, then it is returned back to the pool of free
- * direntries. For simplicity, we never return back whole data blocks.
+ * Directory entries are allocated with kmalloc and have just enough space to
+ * store the name. Every directory keeps its entries on a list ordered by the
+ * readdir cookie, which is assigned to an entry when it's created and never
+ * changes. Hence the position of readdir stays valid, even if the directory
+ * is modified between calls. Once a directory grows beyond TMPFS_DIRHASH_MIN
+ * entries, a hash table is created to speed up name lookups. The table
+ * doubles in size as the directory grows.
  */
 
-#define TMPFS_NAME_MAX 64
+#define TMPFS_NAME_MAX NAME_MAX
+
+#define TMPFS_DIRHASH_MIN 16   /* build hash table for more entries */
+#define TMPFS_DIRHASH_INIT 32  /* initial number of hash buckets */
+#define TMPFS_DIRHASH_LOAD 2   /* max. average length of hash chain */
+
+/* Readdir cookies of "." and ".." entries. Other entries get cookies starting
+ * from TMPFS_DIRCOOKIE_FIRST. */
+#define TMPFS_DIRCOOKIE_DOT 0
+#define TMPFS_DIRCOOKIE_DOTDOT 1
+#define TMPFS_DIRCOOKIE_FIRST 2
 
 #define BLOCK_SIZE PAGESIZE
 #define BLOCK_MASK (BLOCK_SIZE - 1)
@@ -51,39 +66,43 @@
 #define BLKOFF(x) ((x) % BLOCK_SIZE)
 #define NBLOCKS(x) (howmany(x, BLOCK_SIZE))
 
-#define PTR_IN_BLK (BLOCK_SIZE / sizeof(blkptr_t))
+#define PTR_IN_BLK (BLOCK_SIZE / sizeof(vm_page_t *))
 
-#define DIRECT_BLK_NO 6   /* Number of direct block addresses. */
-#define INDIRECT_BLK_NO 2 /* Number of indirect block addresses. */
+#define DIRECT_BLK_NO 6 /* Number of direct block addresses. */
 
 #define L1_BLK_NO PTR_IN_BLK
 #define L2_BLK_NO (PTR_IN_BLK * PTR_IN_BLK)
 
-#define BLOCKS_PER_ARENA 256
+/* Max. number of blocks in a file. */
+#define MAX_BLK_NO (DIRECT_BLK_NO + L1_BLK_NO + L2_BLK_NO)
+
+#define BLOCKS_PER_ARENA 32
 #define ARENA_SIZE (BLOCKS_PER_ARENA * BLOCK_SIZE)
 #define ARENA_HEADER_SIZE 256
 
-#define ARENA_INODE_BLOCKS 4
-#define ARENA_DATA_BLOCKS 251
+#define ARENA_INODE_BLOCKS (BLOCKS_PER_ARENA - 1)
 
 /* Number of inodes in a arena */
 #define ARENA_INODE_CNT                                                        \
   ((ARENA_INODE_BLOCKS * BLOCK_SIZE + BLOCK_SIZE - ARENA_HEADER_SIZE) /        \
    sizeof(struct tmpfs_node))
 
-typedef struct _blk *blkptr_t;
-
 typedef struct tmpfs_dirent {
   TAILQ_ENTRY(tmpfs_dirent) tfd_entries; /* node on dirent list */
+  LIST_ENTRY(tmpfs_dirent) tfd_hash;     /* node on hash chain */
   struct tmpfs_node *tfd_node;           /* pointer to the file's node */
-  size_t tfd_namelen;            /* number of bytes occupied in array below */
-  char tfd_name[TMPFS_NAME_MAX]; /* name of file */
+  off_t tfd_cookie;                      /* position for readdir */
+  size_t tfd_namelen; /* number of bytes occupied in array below */
+  char tfd_name[];    /* name of file (NUL-terminated) */
 } tmpfs_dirent_t;
 
 typedef TAILQ_HEAD(, tmpfs_dirent) tmpfs_dirent_list_t;
+typedef LIST_HEAD(, tmpfs_dirent) tmpfs_dirent_hash_t;
+
+/* Size of directory is the sum of sizes of its entries. */
+#define TMPFS_DIRENT_SIZE(namelen) (sizeof(tmpfs_dirent_t) + (namelen) + 1)
 
 typedef struct tmpfs_node {
-  vnode_t *tfn_vnode;   /* corresponding v-node */
   vnodetype_t tfn_type; /* node type */
 
   /* Node attributes (as in vattr) */
@@ -98,17 +117,21 @@ typedef struct tmpfs_node {
   timespec_t tfn_ctime; /* time of last file status change */
   mtx_t tfn_timelock;
 
-  size_t tfn_nblocks;                 /* number of blocks used by this file */
-  blkptr_t tfn_direct[DIRECT_BLK_NO]; /* blocks containing the data */
-  blkptr_t *tfn_l1indirect;
-  blkptr_t **tfn_l2indirect;
+  size_t tfn_nblocks;                   /* number of pages used by this file */
+  vm_page_t *tfn_direct[DIRECT_BLK_NO]; /* pages containing the data */
+  vm_page_t *tfn_l1indirect;            /* page with pointers to data pages */
+  vm_page_t *tfn_l2indirect;            /* page with pointers to L1 pages */
 
   /* Data that is only applicable to a particular type. */
   union {
     struct {
       struct tmpfs_node *parent;    /* Parent directory. */
       tmpfs_dirent_list_t dirents;  /* List of directory entries. */
-      tmpfs_dirent_list_t fdirents; /* List of free directory entries. */
+      tmpfs_dirent_hash_t *hashtab; /* Entries hashed by name (or NULL). */
+      size_t hashmask;              /* Number of hash buckets - 1. */
+      size_t nentries;              /* Number of directory entries. */
+      off_t next_cookie;            /* Cookie for the next new entry. */
+      tmpfs_dirent_t *readdir_hint; /* Entry to be returned next by readdir. */
     } tfn_dir;
     struct {
       char *link;
@@ -129,26 +152,27 @@ typedef struct tmpfs_mount {
   mtx_t tfm_lock;
   ino_t tfm_next_ino;
   mem_arena_list_t tfm_arenas;
+  size_t tfm_nodes; /* number of allocated inodes */
+  size_t tfm_pages; /* number of pages used by files */
 } tmpfs_mount_t;
 
 typedef struct mem_arena {
   STAILQ_ENTRY(mem_arena) tma_link; /* link on list of all arenas */
   size_t tma_ninodes;               /* number of free inodes */
-  size_t tma_ndblocks;              /* number of free data blocks */
 
-  /* bitmaps of free items */
+  /* bitmap of free inodes */
   bitstr_t tma_inode_bm[bitstr_size(ARENA_INODE_CNT)];
-  bitstr_t tma_dblock_bm[bitstr_size(ARENA_DATA_BLOCKS)];
 
-  /* pointers to first item */
+  /* pointer to first inode */
   tmpfs_node_t *tma_inodes;
-  blkptr_t tma_dblocks;
 } mem_arena_t;
 
 static_assert(
   sizeof(struct mem_arena) <= ARENA_HEADER_SIZE,
   "The size of mem_arena struct can't exceed value declared in the macro!");
 
+static KMALLOC_DEFINE(M_TMPFS, "tmpfs");
+
 static void ensure_vaddr_mapped(vaddr_t va) {
   paddr_t pap;
   va &= ~(PAGESIZE - 1); /* align address to the page size */
@@ -166,13 +190,8 @@ static mem_arena_t *tmpfs_add_mem_arena(tmpfs_mount_t *tfm) {
   kva_map((vaddr_t)arena, BLOCK_SIZE, M_ZERO);
 
   arena->tma_ninodes = ARENA_INODE_CNT;
-  arena->tma_ndblocks = ARENA_DATA_BLOCKS;
-
   bit_nset(arena->tma_inode_bm, 0, ARENA_INODE_CNT - 1);
-  bit_nset(arena->tma_dblock_bm, 0, ARENA_DATA_BLOCKS - 1);
-
   arena->tma_inodes = (void *)arena + ARENA_HEADER_SIZE;
-  arena->tma_dblocks = (void *)arena + (1 + ARENA_INODE_BLOCKS) * BLOCK_SIZE;
 
   STAILQ_INSERT_TAIL(&tfm->tfm_arenas, arena, tma_link);
   return arena;
@@ -189,15 +208,6 @@ static mem_arena_t *tmpfs_find_mem_arena(tmpfs_mount_t *tfm, void *ptr) {
   return NULL;
 }
 
-static mem_arena_t *mem_arena_with_blocks(tmpfs_mount_t *tfm) {
-  mem_arena_t *arena = NULL;
-  STAILQ_FOREACH(arena, &tfm->tfm_arenas, tma_link) {
-    if (arena->tma_ndblocks > 0)
-      return arena;
-  }
-  return tmpfs_add_mem_arena(tfm);
-}
-
 static mem_arena_t *mem_arena_with_inodes(tmpfs_mount_t *tfm) {
   mem_arena_t *arena = NULL;
   STAILQ_FOREACH(arena, &tfm->tfm_arenas, tma_link) {
@@ -207,38 +217,36 @@ static mem_arena_t *mem_arena_with_inodes(tmpfs_mount_t *tfm) {
   return tmpfs_add_mem_arena(tfm);
 }
 
-static blkptr_t tmpfs_alloc_dblk(tmpfs_mount_t *tfm) {
-  SCOPED_MTX_LOCK(&tfm->tfm_lock);
-
-  mem_arena_t *arena = mem_arena_with_blocks(tfm);
-  if (!arena)
+/*
+ * tmpfs_alloc_page: allocate a zeroed page that will be used by file `v`.
+ */
+static vm_page_t *tmpfs_alloc_page(tmpfs_mount_t *tfm, tmpfs_node_t *v) {
+  vm_page_t *pg = vm_page_alloc(1);
+  if (pg == NULL)
     return NULL;
+  pmap_zero_page(pg);
 
-  assert(arena->tma_ndblocks > 0);
-
-  int index;
-  bit_ffs(arena->tma_dblock_bm, ARENA_DATA_BLOCKS, &index);
-  bit_clear(arena->tma_dblock_bm, index);
-  assert(index != -1);
-  arena->tma_ndblocks--;
-
-  blkptr_t blk = (void *)arena->tma_dblocks + BLOCK_SIZE * index;
-  kva_map((vaddr_t)blk, BLOCK_SIZE, M_ZERO);
-  return blk;
+  WITH_MTX_LOCK (&tfm->tfm_lock)
+    tfm->tfm_pages++;
+  v->tfn_nblocks++;
+  return pg;
 }
 
-static void tmpfs_free_dblk(tmpfs_mount_t *tfm, blkptr_t blk) {
-  SCOPED_MTX_LOCK(&tfm->tfm_lock);
+static void tmpfs_free_page(tmpfs_mount_t *tfm, tmpfs_node_t *v,
+                            vm_page_t **pgp) {
+  if (*pgp == NULL)
+    return;
 
-  mem_arena_t *arena = tmpfs_find_mem_arena(tfm, blk);
-  assert(arena != NULL);
+  vm_page_free(*pgp);
+  *pgp = NULL;
 
-  int index = ((void *)blk - (void *)arena->tma_dblocks) / BLOCK_SIZE;
-  assert(0 <= index && index < (int)ARENA_DATA_BLOCKS);
+  WITH_MTX_LOCK (&tfm->tfm_lock)
+    tfm->tfm_pages--;
+  v->tfn_nblocks--;
+}
 
-  bit_set(arena->tma_dblock_bm, index);
-  arena->tma_ndblocks++;
-  kva_unmap((vaddr_t)blk, BLOCK_SIZE);
+static inline void *tmpfs_page_data(vm_page_t *pg) {
+  return phys_to_dmap(pg->paddr);
 }
 
 static tmpfs_node_t *tmpfs_alloc_inode(tmpfs_mount_t *tfm) {
@@ -255,6 +263,7 @@ static tmpfs_node_t *tmpfs_alloc_inode(tmpfs_mount_t *tfm) {
   bit_clear(arena->tma_inode_bm, index);
   assert(index != -1);
   arena->tma_ninodes--;
+  tfm->tfm_nodes++;
 
   tmpfs_node_t *node = arena->tma_inodes + index;
   ensure_vaddr_mapped((vaddr_t)node);
@@ -277,6 +286,7 @@ static void tmpfs_free_inode(tmpfs_mount_t *tfm, tmpfs_node_t *node) {
 
   bit_set(arena->tma_inode_bm, index);
   arena->tma_ninodes++;
+  tfm->tfm_nodes--;
 }
 
 /* XXX: Temporary solution. There should be dedicated allocator for mount
@@ -293,7 +303,7 @@ static inline tmpfs_node_t *TMPFS_NODE_OF(vnode_t *vp) {
 }
 
 /* Prototypes for internal routines. */
-static void tmpfs_attach_vnode(tmpfs_node_t *tfn, mount_t *mp);
+static vnode_load_t tmpfs_vnode_load;
 static tmpfs_node_t *tmpfs_new_node(tmpfs_mount_t *tfm, vattr_t *va,
                                     vnodetype_t ntype);
 static void tmpfs_free_node(tmpfs_mount_t *tfm, tmpfs_node_t *tfn);
@@ -307,57 +317,92 @@ static int tmpfs_alloc_dirent(tmpfs_node_t *tfn, const char *name,
 static tmpfs_dirent_t *tmpfs_dir_lookup(tmpfs_node_t *tfn,
                                         const componentname_t *cn);
 static void tmpfs_dir_detach(tmpfs_node_t *dv, tmpfs_dirent_t *de);
+static void tmpfs_dir_hash_insert(tmpfs_node_t *dnode, tmpfs_dirent_t *de);
 
-static blkptr_t *tmpfs_get_blk(tmpfs_node_t *v, size_t blkno);
+static int tmpfs_get_blk(tmpfs_mount_t *tfm, tmpfs_node_t *v, size_t blkno,
+                         bool alloc, vm_page_t ***pgpp);
 static int tmpfs_resize(tmpfs_mount_t *tfm, tmpfs_node_t *v, size_t newsize);
-static int tmpfs_chtimes(tmpfs_node_t *v, timespec_t *atime, timespec_t *mtime,
+static int tmpfs_chtimes(vnode_t *vn, timespec_t *atime, timespec_t *mtime,
                          cred_t *cred, va_flags_t vaflags);
 static void tmpfs_update_time(tmpfs_node_t *v, tmpfs_time_type_t type);
+static int tmpfs_seek_data(tmpfs_node_t *v, off_t *offp, bool hole);
 
 /* tmpfs readdir operations */
 
-static void *tmpfs_dirent_next(vnode_t *v, void *it) {
-  assert(it != NULL);
-  if (it == DIRENT_DOT)
-    return DIRENT_DOTDOT;
-  if (it == DIRENT_DOTDOT)
-    return TAILQ_FIRST(&TMPFS_NODE_OF(v)->tfn_dir.dirents);
-  return TAILQ_NEXT((tmpfs_dirent_t *)it, tfd_entries);
-}
+/* Find the first entry with cookie not less than `cookie`. Sequential reads
+ * of a directory are served in constant time with help of a hint. */
+static tmpfs_dirent_t *tmpfs_dir_seek(tmpfs_node_t *dnode, off_t cookie) {
+  tmpfs_dirent_t *de = dnode->tfn_dir.readdir_hint;
+
+  if (de && de->tfd_cookie == cookie)
+    return de;
 
-static size_t tmpfs_dirent_namlen(vnode_t *v, void *it) {
-  assert(it != NULL);
-  if (it == DIRENT_DOT)
-    return 1;
-  if (it == DIRENT_DOTDOT)
-    return 2;
-  return ((tmpfs_dirent_t *)it)->tfd_namelen;
+  TAILQ_FOREACH (de, &dnode->tfn_dir.dirents, tfd_entries)
+    if (de->tfd_cookie >= cookie)
+      break;
+  return de;
 }
 
-static void tmpfs_to_dirent(vnode_t *v, void *it, dirent_t *dir) {
-  assert(it != NULL);
-  tmpfs_node_t *node;
-  const char *name;
-  if (it == DIRENT_DOT) {
-    node = TMPFS_NODE_OF(v);
-    name = ".";
-  } else if (it == DIRENT_DOTDOT) {
-    node = TMPFS_NODE_OF(v)->tfn_dir.parent;
-    name = "..";
-  } else {
-    node = ((tmpfs_dirent_t *)it)->tfd_node;
-    name = ((tmpfs_dirent_t *)it)->tfd_name;
+/* Directory offset passed in `uio` is a readdir cookie of the next entry
+ * rather than byte offset, so it stays valid when the directory changes. */
+static int tmpfs_readdir(tmpfs_node_t *dnode, uio_t *uio) {
+  dirent_t *dir = kmalloc(M_TEMP, sizeof(dirent_t), M_WAITOK);
+  off_t cookie = uio->uio_offset;
+  tmpfs_dirent_t *de = NULL;
+  int error = 0;
+
+  if (cookie < 0) {
+    error = EINVAL;
+    goto end;
+  }
+
+  if (cookie >= TMPFS_DIRCOOKIE_FIRST)
+    de = tmpfs_dir_seek(dnode, cookie);
+  else
+    de = TAILQ_FIRST(&dnode->tfn_dir.dirents);
+
+  for (;;) {
+    tmpfs_node_t *node;
+    const char *name;
+    size_t namlen;
+    off_t next;
+
+    if (cookie == TMPFS_DIRCOOKIE_DOT) {
+      node = dnode, name = ".", namlen = 1;
+      next = TMPFS_DIRCOOKIE_DOTDOT;
+    } else if (cookie == TMPFS_DIRCOOKIE_DOTDOT) {
+      node = dnode->tfn_dir.parent, name = "..", namlen = 2;
+      next = de ? de->tfd_cookie : dnode->tfn_dir.next_cookie;
+    } else if (de) {
+      node = de->tfd_node, name = de->tfd_name, namlen = de->tfd_namelen;
+      de = TAILQ_NEXT(de, tfd_entries);
+      next = de ? de->tfd_cookie : dnode->tfn_dir.next_cookie;
+    } else {
+      break;
+    }
+
+    unsigned reclen = _DIRENT_RECLEN(dir, namlen);
+    if (uio->uio_resid < reclen)
+      break;
+
+    bzero(dir, reclen);
+    dir->d_fileno = node->tfn_ino;
+    dir->d_reclen = reclen;
+    dir->d_namlen = namlen;
+    dir->d_type = vt2dt(node->tfn_type);
+    memcpy(dir->d_name, name, namlen + 1);
+
+    if ((error = uiomove(dir, reclen, uio)))
+      break;
+    uio->uio_offset = cookie = next;
   }
-  dir->d_fileno = node->tfn_ino;
-  dir->d_type = vt2dt(node->tfn_type);
-  memcpy(dir->d_name, name, dir->d_namlen + 1);
-}
 
-static readdir_ops_t tmpfs_readdir_ops = {
-  .next = tmpfs_dirent_next,
-  .namlen_of = tmpfs_dirent_namlen,
-  .convert = tmpfs_to_dirent,
-};
+  dnode->tfn_dir.readdir_hint = de;
+
+end:
+  kfree(M_TEMP, dir);
+  return error;
+}
 
 /* tmpfs vnode operations */
 
@@ -384,22 +429,43 @@ static int tmpfs_vop_lookup(vnode_t *dv, componentname_t *cn, vnode_t **vp) {
 static int tmpfs_vop_readdir(vnode_t *dv, uio_t *uio) {
   tmpfs_node_t *node = TMPFS_NODE_OF(dv);
   tmpfs_update_time(node, TMPFS_UPDATE_ATIME);
-  return readdir_generic(dv, uio, &tmpfs_readdir_ops);
+  return tmpfs_readdir(node, uio);
 }
 
 static int tmpfs_vop_close(vnode_t *v, file_t *fp) {
   return 0;
 }
 
-static int tmpfs_uiomove(tmpfs_node_t *node, uio_t *uio, size_t n) {
+/* Holes in files read as zeros. */
+static char tmpfs_zeroes[BLOCK_SIZE];
+
+/*
+ * tmpfs_uiomove: transfer up to `n` bytes within single block of a file.
+ * Pages are allocated on write, if needed.
+ */
+static int tmpfs_uiomove(tmpfs_mount_t *tfm, tmpfs_node_t *node, uio_t *uio,
+                         size_t n) {
   size_t blkoff = BLKOFF(uio->uio_offset);
   size_t len = min(BLOCK_SIZE - blkoff, n);
   size_t blkno = BLKNO(uio->uio_offset);
-  void *blk = *tmpfs_get_blk(node, blkno);
-  return uiomove(blk + blkoff, len, uio);
+  bool alloc = (uio->uio_op == UIO_WRITE);
+  vm_page_t **pgp;
+  int error;
+
+  if ((error = tmpfs_get_blk(tfm, node, blkno, alloc, &pgp)))
+    return error;
+
+  if (alloc && *pgp == NULL && (*pgp = tmpfs_alloc_page(tfm, node)) == NULL)
+    return ENOSPC;
+
+  if (pgp == NULL || *pgp == NULL)
+    return uiomove(tmpfs_zeroes, len, uio);
+
+  return uiomove(tmpfs_page_data(*pgp) + blkoff, len, uio);
 }
 
 static int tmpfs_vop_read(vnode_t *v, uio_t *uio) {
+  tmpfs_mount_t *tfm = TMPFS_ROOT_OF(v->v_mount);
   tmpfs_node_t *node = TMPFS_NODE_OF(v);
   size_t remaining;
   int error = 0;
@@ -414,7 +480,7 @@ static int tmpfs_vop_read(vnode_t *v, uio_t *uio) {
 
   while (!error &&
          (remaining = min(node->tfn_size - uio->uio_offset, uio->uio_resid))) {
-    error = tmpfs_uiomove(node, uio, remaining);
+    error = tmpfs_uiomove(tfm, node, uio, remaining);
   }
   tmpfs_update_time(node, TMPFS_UPDATE_ATIME);
 
@@ -434,13 +500,15 @@ static int tmpfs_vop_write(vnode_t *v, uio_t *uio) {
   if (uio->uio_ioflags & IO_APPEND)
     uio->uio_offset = node->tfn_size;
 
-  if (uio->uio_offset + uio->uio_resid > node->tfn_size)
-    if ((error = tmpfs_resize(tfm, node, uio->uio_offset + uio->uio_resid)))
-      return error;
+  if (NBLOCKS(uio->uio_offset + uio->uio_resid) > MAX_BLK_NO)
+    return EFBIG;
 
   while (!error && uio->uio_resid > 0) {
-    error = tmpfs_uiomove(node, uio, uio->uio_resid);
+    error = tmpfs_uiomove(tfm, node, uio, uio->uio_resid);
   }
+
+  if ((size_t)uio->uio_offset > node->tfn_size)
+    node->tfn_size = uio->uio_offset;
   tmpfs_update_time(node, TMPFS_UPDATE_MTIME | TMPFS_UPDATE_CTIME);
 
   return error;
@@ -497,8 +565,12 @@ static int tmpfs_vop_setattr(vnode_t *v, vattr_t *va, cred_t *cred) {
   tmpfs_mount_t *tfm = TMPFS_ROOT_OF(v->v_mount);
   tmpfs_node_t *node = TMPFS_NODE_OF(v);
 
-  if (va->va_size != (size_t)VNOVAL)
-    tmpfs_resize(tfm, node, va->va_size);
+  if (va->va_size != (size_t)VNOVAL) {
+    if (node->tfn_type == V_DIR)
+      return EISDIR;
+    if ((error = tmpfs_resize(tfm, node, va->va_size)))
+      return error;
+  }
 
   if (va->va_mode != (mode_t)VNOVAL) {
     if ((error = tmpfs_chmod(node, va->va_mode, cred)))
@@ -511,7 +583,7 @@ static int tmpfs_vop_setattr(vnode_t *v, vattr_t *va, cred_t *cred) {
   }
 
   if (va->va_atime.tv_sec != VNOVAL || va->va_mtime.tv_sec != VNOVAL) {
-    if ((error = tmpfs_chtimes(node, &va->va_atime, &va->va_mtime, cred,
+    if ((error = tmpfs_chtimes(v, &va->va_atime, &va->va_mtime, cred,
                                va->va_flags)))
       return error;
   }
@@ -525,12 +597,23 @@ static int tmpfs_vop_create(vnode_t *dv, componentname_t *cn, vattr_t *va,
   return tmpfs_create_file(dv, vp, va, V_REG, cn);
 }
 
+static int tmpfs_vop_mknod(vnode_t *dv, componentname_t *cn, vattr_t *va,
+                           vnode_t **vp) {
+  if (!S_ISSOCK(va->va_mode))
+    return EOPNOTSUPP;
+  return tmpfs_create_file(dv, vp, va, V_SOCK, cn);
+}
+
 static int tmpfs_vop_remove(vnode_t *dv, vnode_t *v, componentname_t *cn) {
   tmpfs_node_t *dnode = TMPFS_NODE_OF(dv);
   tmpfs_dirent_t *de = tmpfs_dir_lookup(dnode, cn);
   assert(de != NULL);
 
   tmpfs_dir_detach(dnode, de);
+
+  /* Do not keep vnode of removed file in the cache. */
+  if (TMPFS_NODE_OF(v)->tfn_links == 0)
+    vcache_remove(v);
   return 0;
 }
 
@@ -553,6 +636,7 @@ static int tmpfs_vop_rmdir(vnode_t *dv, vnode_t *v, componentname_t *cn) {
   /* Decrement link count for the '.' entry. */
   node->tfn_links--;
   tmpfs_dir_detach(dnode, de);
+  vcache_remove(v);
   return 0;
 }
 
@@ -561,7 +645,6 @@ static int tmpfs_vop_reclaim(vnode_t *v) {
   tmpfs_node_t *node = TMPFS_NODE_OF(v);
 
   v->v_data = NULL;
-  node->tfn_vnode = NULL;
 
   if (node->tfn_links == 0)
     tmpfs_free_node(tfm, node);
@@ -582,24 +665,17 @@ static int tmpfs_vop_readlink(vnode_t *v, uio_t *uio) {
 
 static int tmpfs_vop_symlink(vnode_t *dv, componentname_t *cn, vattr_t *va,
                              char *target, vnode_t **vp) {
-  tmpfs_mount_t *tfm = TMPFS_ROOT_OF(dv->v_mount);
   assert(S_ISLNK(va->va_mode));
   size_t targetlen = strlen(target);
   int error;
 
-  assert(targetlen <= BLOCK_SIZE);
-
   if ((error = tmpfs_create_file(dv, vp, va, V_LNK, cn)))
     return error;
 
   tmpfs_node_t *node = TMPFS_NODE_OF(*vp);
-  if (targetlen > 0) {
-    tmpfs_resize(tfm, node, targetlen);
-    char *str = (char *)*tmpfs_get_blk(node, 0);
-    memcpy(str, target, targetlen);
-    node->tfn_lnk.link = str;
-  }
-
+  node->tfn_lnk.link = kmalloc(M_TMPFS, targetlen + 1, M_WAITOK);
+  memcpy(node->tfn_lnk.link, target, targetlen + 1);
+  node->tfn_size = targetlen;
   return 0;
 }
 
@@ -615,6 +691,22 @@ static int tmpfs_vop_link(vnode_t *dv, vnode_t *v, componentname_t *cn) {
   return 0;
 }
 
+static int tmpfs_vop_ioctl(vnode_t *v, u_long cmd, void *data, file_t *fp) {
+  tmpfs_node_t *node = TMPFS_NODE_OF(v);
+
+  if (node->tfn_type != V_REG)
+    return EOPNOTSUPP;
+
+  switch (cmd) {
+    case FIOSEEKDATA:
+      return tmpfs_seek_data(node, data, false);
+    case FIOSEEKHOLE:
+      return tmpfs_seek_data(node, data, true);
+    default:
+      return EOPNOTSUPP;
+  }
+}
+
 static int tmpfs_vop_pathconf(vnode_t *v, int name, register_t *res) {
   switch (name) {
     case _PC_NAME_MAX:
@@ -635,10 +727,12 @@ static vnodeops_t tmpfs_vnodeops = {.v_lookup = tmpfs_vop_lookup,
                                     .v_getattr = tmpfs_vop_getattr,
                                     .v_setattr = tmpfs_vop_setattr,
                                     .v_create = tmpfs_vop_create,
+                                    .v_mknod = tmpfs_vop_mknod,
                                     .v_remove = tmpfs_vop_remove,
                                     .v_mkdir = tmpfs_vop_mkdir,
                                     .v_rmdir = tmpfs_vop_rmdir,
                                     .v_access = vnode_access_generic,
+                                    .v_ioctl = tmpfs_vop_ioctl,
                                     .v_reclaim = tmpfs_vop_reclaim,
                                     .v_readlink = tmpfs_vop_readlink,
                                     .v_symlink = tmpfs_vop_symlink,
@@ -648,16 +742,14 @@ static vnodeops_t tmpfs_vnodeops = {.v_lookup = tmpfs_vop_lookup,
 /* tmpfs internal routines */
 
 /*
- * tmpfs_attach_vnode: init v-node and associate with existing inode.
+ * tmpfs_vnode_load: init v-node and associate with existing inode.
  */
-static void tmpfs_attach_vnode(tmpfs_node_t *tfn, mount_t *mp) {
-  vnode_t *vn = vnode_new(tfn->tfn_type, &tmpfs_vnodeops, tfn);
-  vn->v_mount = mp;
+static int tmpfs_vnode_load(vnode_t *vn, void *arg) {
+  tmpfs_node_t *tfn = arg;
   vn->v_data = tfn;
   vn->v_type = tfn->tfn_type;
   vn->v_ops = &tmpfs_vnodeops;
-
-  tfn->tfn_vnode = vn;
+  return 0;
 }
 
 /*
@@ -666,7 +758,6 @@ static void tmpfs_attach_vnode(tmpfs_node_t *tfn, mount_t *mp) {
 static tmpfs_node_t *tmpfs_new_node(tmpfs_mount_t *tfm, vattr_t *va,
                                     vnodetype_t ntype) {
   tmpfs_node_t *node = tmpfs_alloc_inode(tfm);
-  node->tfn_vnode = NULL;
   node->tfn_mode = va->va_mode;
   node->tfn_type = ntype;
   node->tfn_links = 0;
@@ -687,11 +778,12 @@ static tmpfs_node_t *tmpfs_new_node(tmpfs_mount_t *tfm, vattr_t *va,
   switch (node->tfn_type) {
     case V_DIR:
       TAILQ_INIT(&node->tfn_dir.dirents);
-      TAILQ_INIT(&node->tfn_dir.fdirents);
+      node->tfn_dir.next_cookie = TMPFS_DIRCOOKIE_FIRST;
       /* Extra link count for the '.' entry. */
       node->tfn_links++;
       break;
     case V_REG:
+    case V_SOCK:
       break;
     case V_LNK:
       node->tfn_lnk.link = NULL;
@@ -708,7 +800,16 @@ static tmpfs_node_t *tmpfs_new_node(tmpfs_mount_t *tfm, vattr_t *va,
  * destroy the inode structures.
  */
 static void tmpfs_free_node(tmpfs_mount_t *tfm, tmpfs_node_t *tfn) {
-  tmpfs_resize(tfm, tfn, 0);
+  if (tfn->tfn_type == V_DIR) {
+    assert(TAILQ_EMPTY(&tfn->tfn_dir.dirents));
+    if (tfn->tfn_dir.hashtab)
+      kfree(M_TMPFS, tfn->tfn_dir.hashtab);
+  } else if (tfn->tfn_type == V_LNK) {
+    if (tfn->tfn_lnk.link)
+      kfree(M_TMPFS, tfn->tfn_lnk.link);
+  } else {
+    tmpfs_resize(tfm, tfn, 0);
+  }
   tmpfs_free_inode(tfm, tfn);
 }
 
@@ -727,12 +828,10 @@ static int tmpfs_create_file(vnode_t *dv, vnode_t **vp, vattr_t *va,
     return error;
 
   tmpfs_node_t *node = tmpfs_new_node(TMPFS_ROOT_OF(dv->v_mount), va, ntype);
-  tmpfs_attach_vnode(node, dv->v_mount);
 
   /* Attach directory entry */
   tmpfs_dir_attach(dnode, de, node);
-  *vp = node->tfn_vnode;
-  return 0;
+  return tmpfs_get_vnode(dv->v_mount, node, vp);
 }
 
 /*
@@ -743,7 +842,11 @@ static void tmpfs_dir_attach(tmpfs_node_t *dnode, tmpfs_dirent_t *de,
                              tmpfs_node_t *node) {
   node->tfn_links++;
   de->tfd_node = node;
+  de->tfd_cookie = dnode->tfn_dir.next_cookie++;
   TAILQ_INSERT_TAIL(&dnode->tfn_dir.dirents, de, tfd_entries);
+  dnode->tfn_dir.nentries++;
+  dnode->tfn_size += TMPFS_DIRENT_SIZE(de->tfd_namelen);
+  tmpfs_dir_hash_insert(dnode, de);
 
   /* If directory set parent and increase the link count of parent. */
   if (node->tfn_type == V_DIR) {
@@ -759,32 +862,62 @@ static void tmpfs_dir_attach(tmpfs_node_t *dnode, tmpfs_dirent_t *de,
  * tmpfs_get_vnode: get a v-node with usecnt incremented.
  */
 static int tmpfs_get_vnode(mount_t *mp, tmpfs_node_t *tfn, vnode_t **vp) {
-  vnode_t *vn = tfn->tfn_vnode;
-  if (vn == NULL) {
-    tmpfs_attach_vnode(tfn, mp);
-  } else {
-    vnode_hold(vn);
-  }
-  *vp = tfn->tfn_vnode;
-  return 0;
+  return vcache_get(mp, tfn->tfn_ino, tmpfs_vnode_load, tfn, vp);
 }
 
-static int tmpfs_dir_extend(tmpfs_node_t *tfn) {
-  int error;
-  tmpfs_mount_t *tfm = TMPFS_ROOT_OF(tfn->tfn_vnode->v_mount);
+static tmpfs_dirent_hash_t *tmpfs_dir_bucket(tmpfs_node_t *dnode,
+                                              const char *name,
+                                              size_t namelen) {
+  uint32_t hash = hash32_strn(name, namelen, HASH32_STR_INIT);
+  return &dnode->tfn_dir.hashtab[hash & dnode->tfn_dir.hashmask];
+}
 
-  if ((error = tmpfs_resize(tfm, tfn, tfn->tfn_size + BLOCK_SIZE)))
-    return error;
+/*
+ * tmpfs_dir_rehash: (re)build directory hash table with `size` buckets.
+ */
+static void tmpfs_dir_rehash(tmpfs_node_t *dnode, size_t size) {
+  tmpfs_dirent_hash_t *hashtab =
+    kmalloc(M_TMPFS, size * sizeof(tmpfs_dirent_hash_t), M_WAITOK);
+  tmpfs_dirent_t *de;
 
-  blkptr_t blk = *tmpfs_get_blk(tfn, BLKNO(tfn->tfn_size) - 1);
+  for (size_t i = 0; i < size; i++)
+    LIST_INIT(&hashtab[i]);
 
-  size_t ndirent = BLOCK_SIZE / sizeof(tmpfs_dirent_t);
-  for (size_t i = 0; i < ndirent; i++) {
-    tmpfs_dirent_t *de = (tmpfs_dirent_t *)blk + i;
-    TAILQ_INSERT_TAIL(&tfn->tfn_dir.fdirents, de, tfd_entries);
+  if (dnode->tfn_dir.hashtab)
+    kfree(M_TMPFS, dnode->tfn_dir.hashtab);
+  dnode->tfn_dir.hashtab = hashtab;
+  dnode->tfn_dir.hashmask = size - 1;
+
+  TAILQ_FOREACH (de, &dnode->tfn_dir.dirents, tfd_entries) {
+    tmpfs_dirent_hash_t *bucket =
+      tmpfs_dir_bucket(dnode, de->tfd_name, de->tfd_namelen);
+    LIST_INSERT_HEAD(bucket, de, tfd_hash);
   }
+}
 
-  return 0;
+/*
+ * tmpfs_dir_hash_insert: add an entry that has just been put on the list of
+ * directory entries to the hash table. The table is created or grown if the
+ * directory became too large.
+ */
+static void tmpfs_dir_hash_insert(tmpfs_node_t *dnode, tmpfs_dirent_t *de) {
+  size_t nentries = dnode->tfn_dir.nentries;
+
+  if (dnode->tfn_dir.hashtab == NULL) {
+    if (nentries > TMPFS_DIRHASH_MIN)
+      tmpfs_dir_rehash(dnode, TMPFS_DIRHASH_INIT);
+    return;
+  }
+
+  size_t size = dnode->tfn_dir.hashmask + 1;
+  if (nentries > size * TMPFS_DIRHASH_LOAD) {
+    tmpfs_dir_rehash(dnode, size * 2);
+    return;
+  }
+
+  tmpfs_dirent_hash_t *bucket =
+    tmpfs_dir_bucket(dnode, de->tfd_name, de->tfd_namelen);
+  LIST_INSERT_HEAD(bucket, de, tfd_hash);
 }
 
 /*
@@ -792,19 +925,11 @@ static int tmpfs_dir_extend(tmpfs_node_t *tfn) {
  */
 static int tmpfs_alloc_dirent(tmpfs_node_t *tfn, const char *name,
                               size_t namelen, tmpfs_dirent_t **dep) {
-  int error = 0;
-
-  if (namelen + 1 > TMPFS_NAME_MAX)
+  if (namelen > TMPFS_NAME_MAX)
     return ENAMETOOLONG;
 
-  if (TAILQ_EMPTY(&tfn->tfn_dir.fdirents)) {
-    if ((error = tmpfs_dir_extend(tfn)))
-      return error;
-  }
-
-  tmpfs_dirent_t *dirent = TAILQ_FIRST(&tfn->tfn_dir.fdirents);
-  TAILQ_REMOVE(&tfn->tfn_dir.fdirents, dirent, tfd_entries);
-  bzero(dirent, sizeof(tmpfs_dirent_t));
+  tmpfs_dirent_t *dirent =
+    kmalloc(M_TMPFS, TMPFS_DIRENT_SIZE(namelen), M_ZERO | M_WAITOK);
 
   dirent->tfd_node = NULL;
   dirent->tfd_namelen = namelen;
@@ -818,6 +943,17 @@ static int tmpfs_alloc_dirent(tmpfs_node_t *tfn, const char *name,
 static tmpfs_dirent_t *tmpfs_dir_lookup(tmpfs_node_t *tfn,
                                         const componentname_t *cn) {
   tmpfs_dirent_t *de;
+
+  if (tfn->tfn_dir.hashtab) {
+    tmpfs_dirent_hash_t *bucket =
+      tmpfs_dir_bucket(tfn, cn->cn_nameptr, cn->cn_namelen);
+    LIST_FOREACH (de, bucket, tfd_hash) {
+      if (componentname_equal(cn, de->tfd_name))
+        return de;
+    }
+    return NULL;
+  }
+
   TAILQ_FOREACH (de, &tfn->tfn_dir.dirents, tfd_entries) {
     if (componentname_equal(cn, de->tfd_name))
       return de;
@@ -839,169 +975,135 @@ static void tmpfs_dir_detach(tmpfs_node_t *dv, tmpfs_dirent_t *de) {
     v->tfn_dir.parent = NULL;
     dv->tfn_links--;
   }
-  de->tfd_node = NULL;
+  if (dv->tfn_dir.readdir_hint == de)
+    dv->tfn_dir.readdir_hint = TAILQ_NEXT(de, tfd_entries);
   TAILQ_REMOVE(&dv->tfn_dir.dirents, de, tfd_entries);
-  TAILQ_INSERT_TAIL(&dv->tfn_dir.fdirents, de, tfd_entries);
+  if (dv->tfn_dir.hashtab)
+    LIST_REMOVE(de, tfd_hash);
+  dv->tfn_dir.nentries--;
+  dv->tfn_size -= TMPFS_DIRENT_SIZE(de->tfd_namelen);
+  kfree(M_TMPFS, de);
 
   tmpfs_update_time(dv, TMPFS_UPDATE_MTIME | TMPFS_UPDATE_CTIME);
 }
 
-static int tmpfs_alloc_block(tmpfs_mount_t *tfm, tmpfs_node_t *v,
-                             blkptr_t *blkptrp) {
-  assert(blkptrp != NULL);
-
-  if (!(*blkptrp)) {
-    blkptr_t blkptr = tmpfs_alloc_dblk(tfm);
-    if (!blkptr)
-      return ENOMEM;
-    v->tfn_nblocks++;
-    *blkptrp = blkptr;
-  }
-
-  return 0;
-}
-
-static void tmpfs_free_block(tmpfs_mount_t *tfm, tmpfs_node_t *v,
-                             blkptr_t *blkptrp) {
-  assert(blkptrp != NULL);
-
-  if (*blkptrp == NULL)
-    return;
-
-  tmpfs_free_dblk(tfm, *blkptrp);
-  *blkptrp = NULL;
-  v->tfn_nblocks--;
+static inline vm_page_t **tmpfs_page_ptrs(vm_page_t *pg) {
+  return tmpfs_page_data(pg);
 }
 
 /*
- * tmpfs_expand_meta: expand indirect blocks metadata to store up to blkcnt
- * data blocks.
+ * tmpfs_get_blk: find the slot that holds the page for file block `blkno`.
+ * Missing indirect blocks are allocated if `alloc` is set. Otherwise NULL is
+ * returned in `pgpp` if the block lies in a hole without indirect blocks.
  */
-static int tmpfs_expand_meta(tmpfs_mount_t *tfm, tmpfs_node_t *v,
-                             size_t blkcnt) {
-  int error;
+static int tmpfs_get_blk(tmpfs_mount_t *tfm, tmpfs_node_t *v, size_t blkno,
+                         bool alloc, vm_page_t ***pgpp) {
+  vm_page_t **l1p;
 
-  /* L1 */
-  if (blkcnt <= DIRECT_BLK_NO)
-    return 0;
-
-  if ((error = tmpfs_alloc_block(tfm, v, (blkptr_t *)&v->tfn_l1indirect)))
-    return error;
+  *pgpp = NULL;
 
-  /* L2 */
-  if (blkcnt <= DIRECT_BLK_NO + L1_BLK_NO)
+  if (blkno < DIRECT_BLK_NO) {
+    *pgpp = &v->tfn_direct[blkno];
     return 0;
+  }
 
-  if ((error = tmpfs_alloc_block(tfm, v, (blkptr_t *)&v->tfn_l2indirect)))
-    return error;
+  blkno -= DIRECT_BLK_NO;
+  if (blkno < L1_BLK_NO) {
+    l1p = &v->tfn_l1indirect;
+  } else {
+    blkno -= L1_BLK_NO;
+    if (blkno >= L2_BLK_NO)
+      return EFBIG;
+    if (v->tfn_l2indirect == NULL) {
+      if (!alloc)
+        return 0;
+      if (!(v->tfn_l2indirect = tmpfs_alloc_page(tfm, v)))
+        return ENOSPC;
+    }
+    l1p = &tmpfs_page_ptrs(v->tfn_l2indirect)[blkno / PTR_IN_BLK];
+    blkno %= PTR_IN_BLK;
+  }
 
-  size_t l2blkcnt = howmany(blkcnt - (DIRECT_BLK_NO + L1_BLK_NO), PTR_IN_BLK);
-  for (size_t i = 0; i < l2blkcnt; i++) {
-    if ((error = tmpfs_alloc_block(tfm, v, (blkptr_t *)&v->tfn_l2indirect[i])))
-      return error;
+  if (*l1p == NULL) {
+    if (!alloc)
+      return 0;
+    if (!(*l1p = tmpfs_alloc_page(tfm, v)))
+      return ENOSPC;
   }
 
+  *pgpp = &tmpfs_page_ptrs(*l1p)[blkno];
   return 0;
 }
 
 /*
- * tmpfs_shrink_meta: shrink indirect blocks metadata to store only blkcnt
- * data blocks.
+ * tmpfs_get_page: return page with file block `blkno` or NULL for a hole.
  */
-static void tmpfs_shrink_meta(tmpfs_mount_t *tfm, tmpfs_node_t *v,
-                              size_t blkcnt) {
-  /* L1 */
-  if (blkcnt <= DIRECT_BLK_NO && v->tfn_l1indirect)
-    tmpfs_free_block(tfm, v, (blkptr_t *)&v->tfn_l1indirect);
-
-  /* L2 */
-  if (!v->tfn_l2indirect)
-    return;
-
-  /* Number of pointers in L2 block that will be still used. */
-  size_t l2ptrcnt = 0;
-
-  if (blkcnt > L1_BLK_NO + DIRECT_BLK_NO)
-    l2ptrcnt = howmany(blkcnt - (DIRECT_BLK_NO + L1_BLK_NO), PTR_IN_BLK);
-
-  for (size_t i = l2ptrcnt; i < PTR_IN_BLK && v->tfn_l2indirect[i]; i++)
-    tmpfs_free_block(tfm, v, (blkptr_t *)&v->tfn_l2indirect[i]);
-
-  if (l2ptrcnt == 0)
-    tmpfs_free_block(tfm, v, (blkptr_t *)&v->tfn_l2indirect);
+static vm_page_t *tmpfs_get_page(tmpfs_node_t *v, size_t blkno) {
+  vm_page_t **pgp;
+  if (tmpfs_get_blk(NULL, v, blkno, false, &pgp) || pgp == NULL)
+    return NULL;
+  return *pgp;
 }
 
 /*
- * tmpfs_get_blk: returns pointer to pointer of data block with number
- * blkno.
+ * tmpfs_free_indirect: free data pages referred by indirect block `pgp`,
+ * that maps file blocks starting from `base`, if their number is at least
+ * `first`. The indirect block is freed too, if it's no longer needed.
  */
-static blkptr_t *tmpfs_get_blk(tmpfs_node_t *v, size_t blkno) {
-  if (blkno < DIRECT_BLK_NO)
-    return &v->tfn_direct[blkno];
+static void tmpfs_free_indirect(tmpfs_mount_t *tfm, tmpfs_node_t *v,
+                                vm_page_t **pgp, size_t base, size_t first) {
+  if (*pgp == NULL || first >= base + PTR_IN_BLK)
+    return;
 
-  blkno -= DIRECT_BLK_NO;
-  if (blkno < L1_BLK_NO)
-    return &v->tfn_l1indirect[blkno];
+  vm_page_t **ptrs = tmpfs_page_ptrs(*pgp);
+  for (size_t i = first > base ? first - base : 0; i < PTR_IN_BLK; i++)
+    tmpfs_free_page(tfm, v, &ptrs[i]);
 
-  blkno -= L1_BLK_NO;
-  blkptr_t *l1arr = v->tfn_l2indirect[blkno / PTR_IN_BLK];
-  return &l1arr[blkno % PTR_IN_BLK];
+  if (first <= base)
+    tmpfs_free_page(tfm, v, pgp);
 }
 
-static int tmpfs_alloc_blk_range(tmpfs_mount_t *tfm, tmpfs_node_t *v,
-                                 size_t from, size_t to) {
-  int error;
+/*
+ * tmpfs_free_blocks: free all pages that store file blocks starting from
+ * `first`, including indirect blocks that are no longer needed.
+ */
+static void tmpfs_free_blocks(tmpfs_mount_t *tfm, tmpfs_node_t *v,
+                              size_t first) {
+  for (size_t i = first; i < DIRECT_BLK_NO; i++)
+    tmpfs_free_page(tfm, v, &v->tfn_direct[i]);
 
-  for (size_t blkno = from; blkno < to; blkno++) {
-    blkptr_t *blk = tmpfs_get_blk(v, blkno);
-    assert(!(*blk));
-    if ((error = tmpfs_alloc_block(tfm, v, blk)))
-      return error;
-  }
+  size_t base = DIRECT_BLK_NO;
+  tmpfs_free_indirect(tfm, v, &v->tfn_l1indirect, base, first);
 
-  return 0;
-}
+  if (v->tfn_l2indirect == NULL)
+    return;
+
+  base += L1_BLK_NO;
+  vm_page_t **l1arr = tmpfs_page_ptrs(v->tfn_l2indirect);
+  for (size_t i = 0; i < PTR_IN_BLK; i++, base += PTR_IN_BLK)
+    tmpfs_free_indirect(tfm, v, &l1arr[i], base, first);
 
-static void tmpfs_free_blk_range(tmpfs_mount_t *tfm, tmpfs_node_t *v,
-                                 size_t from, size_t to) {
-  for (size_t blkno = from; blkno < to; blkno++)
-    tmpfs_free_block(tfm, v, tmpfs_get_blk(v, blkno));
+  if (first <= DIRECT_BLK_NO + L1_BLK_NO)
+    tmpfs_free_page(tfm, v, &v->tfn_l2indirect);
 }
 
 /*
- * tmpfs_resize: resize regular file and possibly allocate new blocks.
+ * tmpfs_resize: resize regular file. Pages beyond the new size are freed,
+ * but no pages are allocated when the file grows.
  */
 static int tmpfs_resize(tmpfs_mount_t *tfm, tmpfs_node_t *v, size_t newsize) {
-  size_t oldsize = v->tfn_size;
-  size_t oldblks = NBLOCKS(oldsize);
-  size_t newblks = NBLOCKS(newsize);
-  int error;
-
-  if (newblks > oldblks) {
-    if ((error = tmpfs_expand_meta(tfm, v, newblks))) {
-      tmpfs_shrink_meta(tfm, v, oldblks);
-      return error;
-    }
-    if ((error = tmpfs_alloc_blk_range(tfm, v, oldblks, newblks))) {
-      tmpfs_free_blk_range(tfm, v, oldblks, newblks);
-      tmpfs_shrink_meta(tfm, v, oldblks);
-      return error;
-    }
+  if (NBLOCKS(newsize) > MAX_BLK_NO)
+    return EFBIG;
 
-  } else if (newsize < oldsize) {
-    if (newblks < oldblks) {
-      tmpfs_free_blk_range(tfm, v, newblks, oldblks);
-      tmpfs_shrink_meta(tfm, v, newblks);
-    }
+  if (newsize < v->tfn_size) {
+    tmpfs_free_blocks(tfm, v, NBLOCKS(newsize));
 
     /* If the file is not being truncated to a block boundry, the contents of
      * the partial block following the end of the file must be zero'ed */
-    size_t blkno = BLKNO(newsize);
     size_t blkoff = BLKOFF(newsize);
-    if (blkoff) {
-      blkptr_t *blk = tmpfs_get_blk(v, blkno);
-      memset((void *)*blk + blkoff, 0, BLOCK_SIZE - blkoff);
-    }
+    vm_page_t *pg = tmpfs_get_page(v, BLKNO(newsize));
+    if (blkoff && pg)
+      memset(tmpfs_page_data(pg) + blkoff, 0, BLOCK_SIZE - blkoff);
   }
 
   v->tfn_size = newsize;
@@ -1009,9 +1111,35 @@ static int tmpfs_resize(tmpfs_mount_t *tfm, tmpfs_node_t *v, size_t newsize) {
   return 0;
 }
 
-static int tmpfs_chtimes(tmpfs_node_t *v, timespec_t *atime, timespec_t *mtime,
+/*
+ * tmpfs_seek_data: find the first offset not less than `*offp` that belongs
+ * to data (or hole if `hole` is set). Area past the end of file is a hole.
+ */
+static int tmpfs_seek_data(tmpfs_node_t *v, off_t *offp, bool hole) {
+  size_t off = *offp;
+
+  if (off >= v->tfn_size)
+    return ENXIO;
+
+  for (size_t blkno = BLKNO(off); blkno < NBLOCKS(v->tfn_size); blkno++) {
+    if ((tmpfs_get_page(v, blkno) == NULL) == hole) {
+      *offp = max(off, blkno * BLOCK_SIZE);
+      return 0;
+    }
+  }
+
+  if (!hole)
+    return ENXIO;
+
+  *offp = v->tfn_size;
+  return 0;
+}
+
+static int tmpfs_chtimes(vnode_t *vn, timespec_t *atime, timespec_t *mtime,
                          cred_t *cred, va_flags_t vaflags) {
-  if (!cred_can_utime(v->tfn_vnode, v->tfn_uid, cred, vaflags))
+  tmpfs_node_t *v = TMPFS_NODE_OF(vn);
+
+  if (!cred_can_utime(vn, v->tfn_uid, cred, vaflags))
     return EPERM;
 
   mtx_lock(&v->tfn_timelock);
@@ -1060,12 +1188,10 @@ static int tmpfs_mount(mount_t *mp) {
   va.va_uid = 0;
   va.va_gid = 0;
   tmpfs_node_t *root = tmpfs_new_node(tfm, &va, V_DIR);
-  tmpfs_attach_vnode(root, mp);
   root->tfn_dir.parent = root; /* Parent of the root node is itself. */
   root->tfn_links++; /* Extra link, because root has no directory entry. */
 
   tfm->tfm_root = root;
-  vnode_drop(root->tfn_vnode);
   return 0;
 }
 
@@ -1074,13 +1200,43 @@ static int tmpfs_root(mount_t *mp, vnode_t **vp) {
   return tmpfs_get_vnode(mp, tfm->tfm_root, vp);
 }
 
+/* Files may use all free physical memory. */
+static int tmpfs_statvfs(mount_t *mp, statvfs_t *sb) {
+  tmpfs_mount_t *tfm = TMPFS_ROOT_OF(mp);
+  size_t nfree = vm_physmem_nfree();
+  size_t ifree = nfree / BLOCKS_PER_ARENA * ARENA_INODE_CNT;
+  mem_arena_t *arena;
+
+  memset(sb, 0, sizeof(statvfs_t));
+
+  SCOPED_MTX_LOCK(&tfm->tfm_lock);
+
+  STAILQ_FOREACH(arena, &tfm->tfm_arenas, tma_link) {
+    ifree += arena->tma_ninodes;
+  }
+
+  sb->f_bsize = BLOCK_SIZE;
+  sb->f_frsize = BLOCK_SIZE;
+  sb->f_blocks = tfm->tfm_pages + nfree;
+  sb->f_bfree = nfree;
+  sb->f_bavail = nfree;
+  sb->f_files = tfm->tfm_nodes + ifree;
+  sb->f_ffree = ifree;
+  sb->f_favail = ifree;
+  sb->f_namemax = TMPFS_NAME_MAX;
+  strlcpy(sb->f_fstypename, mp->mnt_vfc->vfc_name, sizeof(sb->f_fstypename));
+  return 0;
+}
+
 static int tmpfs_init(vfsconf_t *vfc) {
   vnodeops_init(&tmpfs_vnodeops);
   return 0;
 }
 
-static vfsops_t tmpfs_vfsops = {
-  .vfs_mount = tmpfs_mount, .vfs_root = tmpfs_root, .vfs_init = tmpfs_init};
+static vfsops_t tmpfs_vfsops = {.vfs_mount = tmpfs_mount,
+                                .vfs_root = tmpfs_root,
+                                .vfs_statvfs = tmpfs_statvfs,
+                                .vfs_init = tmpfs_init};
 
 static vfsconf_t tmpfs_conf = {.vfc_name = "tmpfs",
                                .vfc_vfsops = &tmpfs_vfsops};
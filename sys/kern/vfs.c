@@ -47,6 +47,7 @@ static vnodeops_t vfs_root_ops = {.v_lookup = vfs_root_vnode_lookup};
 static int vfs_register(vfsconf_t *vfc);
 
 void init_vfs(void) {
+  init_vcache();
   vnodeops_init(&vfs_root_ops);
 
   vfs_root_vnode = vnode_new(V_DIR, &vfs_root_ops, NULL);
@@ -107,8 +108,9 @@ static int vfs_default_statvfs(mount_t *m, statvfs_t *sb) {
   return ENOTSUP;
 }
 
+/* Without filesystem support only vnodes present in the cache can be found. */
 static int vfs_default_vget(mount_t *m, ino_t ino, vnode_t **v) {
-  return ENOTSUP;
+  return vcache_get(m, ino, NULL, NULL, v);
 }
 
 static int vfs_default_init(vfsconf_t *vfc) {
@@ -131,7 +133,7 @@ mount_t *vfs_mount_alloc(vnode_t *v, vfsconf_t *vfc) {
   return m;
 }
 
-int vfs_domount(vfsconf_t *vfc, vnode_t *v) {
+int vfs_domount(vfsconf_t *vfc, vnode_t *v, blkdev_t *dev) {
   int error;
 
   /* Start by checking whether this vnode can be used for mounting */
@@ -143,6 +145,7 @@ int vfs_domount(vfsconf_t *vfc, vnode_t *v) {
   /* TODO: Mark the vnode is in-progress of mounting? See VI_MOUNT in FreeBSD */
 
   mount_t *m = vfs_mount_alloc(v, vfc);
+  m->mnt_dev = dev;
 
   /* Mount the filesystem. */
   if ((error = VFS_MOUNT(m)))
@@ -164,6 +167,24 @@ int vfs_domount(vfsconf_t *vfc, vnode_t *v) {
   return 0;
 }
 
+int vfs_mountroot(vfsconf_t *vfc, blkdev_t *dev) {
+  int error;
+
+  mount_t *m = vfs_mount_alloc(vfs_root_vnode, vfc);
+  m->mnt_dev = dev;
+
+  if ((error = VFS_MOUNT(m)))
+    return error;
+
+  /* Path lookups starting at root vnode descend into new filesystem. */
+  vfs_root_vnode->v_mountedhere = m;
+
+  WITH_MTX_LOCK (&mount_list_mtx)
+    TAILQ_INSERT_TAIL(&mount_list, m, mnt_list);
+
+  return 0;
+}
+
 /* If `*vp` is a root of filesystem that has been mounted,
  * then find vnode of the mount point. */
 void vfs_maybe_ascend(vnode_t **vp) {
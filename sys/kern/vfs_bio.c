@@ -0,0 +1,431 @@
+#define KL_LOG KL_VFS
+#include <sys/klog.h>
+#include <sys/blkdev.h>
+#include <sys/buf.h>
+#include <sys/condvar.h>
+#include <sys/errno.h>
+#include <sys/hash.h>
+#include <sys/kmem.h>
+#include <sys/libkern.h>
+#include <sys/malloc.h>
+#include <sys/mimiker.h>
+#include <sys/mutex.h>
+#include <sys/sched.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <machine/vm_param.h>
+
+#define NBUF 256 /* max. number of buffers */
+#define BUF_HASH_SIZE 64
+#define BUF_HASH_MASK (BUF_HASH_SIZE - 1)
+
+#define BUF_READAHEAD 4    /* buffers read ahead on sequential access */
+#define RA_QUEUE_SIZE 16   /* max. number of pending read-ahead requests */
+#define SYNCER_PERIOD 1000 /* [ms] how often syncer thread wakes up */
+#define SYNCER_DELAY 5000  /* [ms] how long a dirty buffer may stay in memory */
+
+static KMALLOC_DEFINE(M_BUF, "buffer cache");
+
+/* All buffer fields marked with (c) and data below are protected by
+ * buf_lock. Fields marked with (b) belong to the thread owning the buffer. */
+static MTX_DEFINE(buf_lock, 0);
+typedef LIST_HEAD(, buf) buf_list_t;
+
+static buf_list_t buf_hashtab[BUF_HASH_SIZE];
+static TAILQ_HEAD(, buf) buf_lru = TAILQ_HEAD_INITIALIZER(buf_lru);
+static unsigned buf_count;  /* number of allocated buffers */
+static condvar_t buf_freecv; /* wait here if all buffers are busy */
+
+typedef struct ra_req {
+  blkdev_t *dev;
+  uint64_t blkno;
+} ra_req_t;
+
+static ra_req_t ra_queue[RA_QUEUE_SIZE];
+static unsigned ra_first, ra_count;
+static blkdev_t *ra_current; /* device of request being processed */
+static condvar_t ra_cv;      /* read-ahead thread waits here for requests */
+static condvar_t ra_donecv;  /* wait here for request to be processed */
+static condvar_t syncer_cv; /* syncer thread waits here between flushes */
+
+static buf_list_t *buf_bucket(blkdev_t *bd, uint64_t blkno) {
+  uint32_t hash = hash32_buf(&bd, sizeof(bd), HASH32_BUF_INIT);
+  hash = hash32_buf(&blkno, sizeof(blkno), hash);
+  return &buf_hashtab[hash & BUF_HASH_MASK];
+}
+
+static buf_t *buf_lookup(blkdev_t *bd, uint64_t blkno) {
+  assert(mtx_owned(&buf_lock));
+
+  buf_list_t *bucket = buf_bucket(bd, blkno);
+  buf_t *bp;
+  LIST_FOREACH (bp, bucket, b_hash) {
+    if (bp->b_dev == bd && bp->b_blkno == blkno)
+      return bp;
+  }
+  return NULL;
+}
+
+/* Take ownership of a buffer that's on LRU list. */
+static void buf_acquire(buf_t *bp) {
+  assert(mtx_owned(&buf_lock));
+  assert(!(bp->b_flags & B_BUSY));
+
+  TAILQ_REMOVE(&buf_lru, bp, b_lru);
+  bp->b_flags |= B_BUSY;
+}
+
+/* Write out a buffer that's owned by the caller. Called with buf_lock held,
+ * but the lock is released during the transfer. */
+static int buf_writeout(buf_t *bp) {
+  assert(mtx_owned(&buf_lock));
+  assert(bp->b_flags & B_BUSY);
+
+  mtx_unlock(&buf_lock);
+  int error = blkdev_write(bp->b_dev, bp->b_blkno, bp->b_data, bp->b_bcount);
+  mtx_lock(&buf_lock);
+
+  if (error)
+    klog("Failed to write back block %llu: error %d", bp->b_blkno, error);
+
+  /* There is little we can do about the failure, so drop the data anyway,
+   * otherwise the buffer would be written back forever. */
+  bp->b_flags &= ~B_DELWRI;
+  return error;
+}
+
+static void buf_release(buf_t *bp) {
+  assert(mtx_owned(&buf_lock));
+  assert(bp->b_flags & B_BUSY);
+
+  bp->b_flags &= ~B_BUSY;
+
+  /* Buffers without valid data are reused first. */
+  if (bp->b_flags & B_VALID)
+    TAILQ_INSERT_TAIL(&buf_lru, bp, b_lru);
+  else
+    TAILQ_INSERT_HEAD(&buf_lru, bp, b_lru);
+
+  if (bp->b_flags & B_WANTED) {
+    bp->b_flags &= ~B_WANTED;
+    cv_broadcast(&bp->b_cv);
+  }
+  cv_signal(&buf_freecv);
+}
+
+/* Returns buffer that can be assigned to another block or NULL if caller
+ * needs to look up the block again, since buf_lock was released. */
+static buf_t *buf_reclaim(void) {
+  assert(mtx_owned(&buf_lock));
+
+  if (buf_count < NBUF) {
+    buf_t *bp = kmalloc(M_BUF, sizeof(buf_t), M_ZERO | M_WAITOK);
+    cv_init(&bp->b_cv, "buffer");
+    bp->b_flags = B_BUSY;
+    buf_count++;
+    return bp;
+  }
+
+  buf_t *bp = TAILQ_FIRST(&buf_lru);
+  if (bp == NULL) {
+    cv_wait(&buf_freecv, &buf_lock);
+    return NULL;
+  }
+
+  buf_acquire(bp);
+
+  if (bp->b_flags & B_DELWRI) {
+    buf_writeout(bp);
+    buf_release(bp);
+    return NULL;
+  }
+
+  if (bp->b_dev)
+    LIST_REMOVE(bp, b_hash);
+  bp->b_flags = B_BUSY;
+  return bp;
+}
+
+static buf_t *buf_get(blkdev_t *bd, uint64_t blkno, bool canwait) {
+  buf_t *bp;
+
+  mtx_lock(&buf_lock);
+
+  for (;;) {
+    if ((bp = buf_lookup(bd, blkno))) {
+      if (!(bp->b_flags & B_BUSY)) {
+        buf_acquire(bp);
+        break;
+      }
+      if (!canwait) {
+        mtx_unlock(&buf_lock);
+        return NULL;
+      }
+      bp->b_flags |= B_WANTED;
+      cv_wait(&bp->b_cv, &buf_lock);
+      continue;
+    }
+
+    if ((bp = buf_reclaim())) {
+      bp->b_dev = bd;
+      bp->b_blkno = blkno;
+      LIST_INSERT_HEAD(buf_bucket(bd, blkno), bp, b_hash);
+      break;
+    }
+  }
+
+  mtx_unlock(&buf_lock);
+
+  size_t size = bd->bd_bufsize;
+  if (bp->b_bufsize != size) {
+    if (bp->b_data)
+      kmem_free(bp->b_data, roundup(bp->b_bufsize, PAGESIZE));
+    bp->b_data = kmem_alloc(roundup(size, PAGESIZE), M_WAITOK);
+    bp->b_bufsize = size;
+  }
+  bp->b_bcount = blkdev_bufsize(bd, blkno);
+  return bp;
+}
+
+static int buf_fill(buf_t *bp) {
+  int error = blkdev_read(bp->b_dev, bp->b_blkno, bp->b_data, bp->b_bcount);
+  if (!error) {
+    WITH_MTX_LOCK (&buf_lock)
+      bp->b_flags |= B_VALID;
+  }
+  return error;
+}
+
+buf_t *getblk(blkdev_t *bd, uint64_t blkno) {
+  return buf_get(bd, blkno, true);
+}
+
+/* Schedule read of following buffers if the device is read sequentially. */
+static void buf_readahead(blkdev_t *bd, uint64_t blkno) {
+  SCOPED_MTX_LOCK(&buf_lock);
+
+  bool sequential = (blkno == bd->bd_lastblk + 1);
+  bd->bd_lastblk = blkno;
+  if (!sequential)
+    return;
+
+  for (uint64_t i = blkno + 1; i <= blkno + BUF_READAHEAD; i++) {
+    if (ra_count == RA_QUEUE_SIZE || blkdev_bufsize(bd, i) == 0)
+      break;
+    if (buf_lookup(bd, i))
+      continue;
+    ra_queue[(ra_first + ra_count++) % RA_QUEUE_SIZE] = (ra_req_t){bd, i};
+  }
+  cv_signal(&ra_cv);
+}
+
+int bread(blkdev_t *bd, uint64_t blkno, buf_t **bpp) {
+  buf_t *bp = getblk(bd, blkno);
+  int error;
+
+  if (!(bp->b_flags & B_VALID) && (error = buf_fill(bp))) {
+    brelse(bp);
+    *bpp = NULL;
+    return error;
+  }
+
+  buf_readahead(bd, blkno);
+  *bpp = bp;
+  return 0;
+}
+
+int bwrite(buf_t *bp) {
+  SCOPED_MTX_LOCK(&buf_lock);
+  bp->b_flags |= B_VALID;
+  int error = buf_writeout(bp);
+  buf_release(bp);
+  return error;
+}
+
+void bdwrite(buf_t *bp) {
+  SCOPED_MTX_LOCK(&buf_lock);
+  if (!(bp->b_flags & B_DELWRI)) {
+    bp->b_flags |= B_DELWRI;
+    bp->b_dirtied = getsystime();
+  }
+  bp->b_flags |= B_VALID;
+  buf_release(bp);
+}
+
+void brelse(buf_t *bp) {
+  SCOPED_MTX_LOCK(&buf_lock);
+  buf_release(bp);
+}
+
+/* Write out dirty buffers of given device (or all if NULL) that have been
+ * dirty for at least `age` system ticks. */
+static int buf_flush(blkdev_t *bd, systime_t age) {
+  systime_t now = getsystime();
+  int error = 0;
+  buf_t *bp;
+
+  SCOPED_MTX_LOCK(&buf_lock);
+
+restart:
+  TAILQ_FOREACH (bp, &buf_lru, b_lru) {
+    if (!(bp->b_flags & B_DELWRI))
+      continue;
+    if (bd && bp->b_dev != bd)
+      continue;
+    if ((systime_t)(now - bp->b_dirtied) < age)
+      continue;
+    buf_acquire(bp);
+    int werror = buf_writeout(bp);
+    if (werror)
+      error = werror;
+    buf_release(bp);
+    goto restart;
+  }
+
+  return error;
+}
+
+int bsync(blkdev_t *bd) {
+  return buf_flush(bd, 0);
+}
+
+/* Remove read-ahead requests for given device and wait for the one that is
+ * being processed, so that the device can be safely destroyed. */
+static void ra_purge(blkdev_t *bd) {
+  assert(mtx_owned(&buf_lock));
+
+  unsigned n = 0;
+  for (unsigned i = 0; i < ra_count; i++) {
+    ra_req_t req = ra_queue[(ra_first + i) % RA_QUEUE_SIZE];
+    if (req.dev != bd)
+      ra_queue[(ra_first + n++) % RA_QUEUE_SIZE] = req;
+  }
+  ra_count = n;
+
+  while (ra_current == bd)
+    cv_wait(&ra_donecv, &buf_lock);
+}
+
+int binval(blkdev_t *bd) {
+  int error = bsync(bd);
+  buf_t *bp, *next;
+
+  SCOPED_MTX_LOCK(&buf_lock);
+
+  ra_purge(bd);
+
+restart:
+  for (int i = 0; i < BUF_HASH_SIZE; i++) {
+    LIST_FOREACH_SAFE (bp, &buf_hashtab[i], b_hash, next) {
+      if (bp->b_dev != bd)
+        continue;
+
+      /* Wait for the owner, the buffer may become dirty in the meantime. */
+      if (bp->b_flags & B_BUSY) {
+        bp->b_flags |= B_WANTED;
+        cv_wait(&bp->b_cv, &buf_lock);
+        goto restart;
+      }
+
+      if (bp->b_flags & B_DELWRI) {
+        buf_acquire(bp);
+        int werror = buf_writeout(bp);
+        if (werror)
+          error = werror;
+        buf_release(bp);
+        goto restart;
+      }
+
+      LIST_REMOVE(bp, b_hash);
+      bp->b_dev = NULL;
+      bp->b_flags &= ~B_VALID;
+    }
+  }
+
+  return error;
+}
+
+int bsync_range(blkdev_t *bd, uint64_t first, uint64_t last, bool inval) {
+  uint64_t blkno = first;
+  int error = 0;
+
+  SCOPED_MTX_LOCK(&buf_lock);
+
+  while (blkno <= last) {
+    buf_t *bp = buf_lookup(bd, blkno);
+
+    if (bp && (bp->b_flags & B_BUSY)) {
+      bp->b_flags |= B_WANTED;
+      cv_wait(&bp->b_cv, &buf_lock);
+      continue;
+    }
+
+    if (bp && (inval || (bp->b_flags & B_DELWRI))) {
+      buf_acquire(bp);
+      if (bp->b_flags & B_DELWRI) {
+        int werror = buf_writeout(bp);
+        if (werror)
+          error = werror;
+      }
+      if (inval) {
+        LIST_REMOVE(bp, b_hash);
+        bp->b_dev = NULL;
+        bp->b_flags &= ~B_VALID;
+      }
+      buf_release(bp);
+    }
+
+    blkno++;
+  }
+
+  return error;
+}
+
+static void readahead_thread(void *arg) {
+  for (;;) {
+    ra_req_t req;
+
+    WITH_MTX_LOCK (&buf_lock) {
+      while (ra_count == 0)
+        cv_wait(&ra_cv, &buf_lock);
+      req = ra_queue[ra_first];
+      ra_first = (ra_first + 1) % RA_QUEUE_SIZE;
+      ra_count--;
+      ra_current = req.dev;
+    }
+
+    /* If somebody else is using the buffer, then it'll be read anyway. */
+    buf_t *bp = buf_get(req.dev, req.blkno, false);
+    if (bp != NULL) {
+      if (!(bp->b_flags & B_VALID))
+        (void)buf_fill(bp);
+      brelse(bp);
+    }
+
+    WITH_MTX_LOCK (&buf_lock) {
+      ra_current = NULL;
+      cv_broadcast(&ra_donecv);
+    }
+  }
+}
+
+static void syncer_thread(void *arg) {
+  for (;;) {
+    WITH_MTX_LOCK (&buf_lock)
+      cv_wait_timed(&syncer_cv, &buf_lock, SYNCER_PERIOD);
+    buf_flush(NULL, SYNCER_DELAY);
+  }
+}
+
+void init_bio(void) {
+  cv_init(&buf_freecv, "free buffer");
+  cv_init(&ra_cv, "read-ahead requests");
+  cv_init(&ra_donecv, "read-ahead done");
+  cv_init(&syncer_cv, "syncer");
+
+  thread_t *td;
+  td = thread_create("bio-readahead", readahead_thread, NULL, prio_kthread(0));
+  sched_add(td);
+  td = thread_create("bio-syncer", syncer_thread, NULL, prio_kthread(0));
+  sched_add(td);
+}
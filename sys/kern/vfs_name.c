@@ -108,7 +108,7 @@ static int can_lookup(vnode_t *vn, cred_t *cred) {
   return VOP_ACCESS(vn, VEXEC, cred);
 }
 
-/* Call VOP_LOOKUP for a single lookup.
+/* Look up a single component in the name cache or call VOP_LOOKUP on a miss.
  * searchdir vnode is locked on entry and remains locked on return. */
 static int vnr_lookup_once(vnrstate_t *vs, vnode_t **searchdir_p,
                            vnode_t **foundvn_p) {
@@ -124,7 +124,17 @@ static int vnr_lookup_once(vnrstate_t *vs, vnode_t **searchdir_p,
   if ((error = can_lookup(searchdir, cred)))
     return error;
 
-  if ((error = VOP_LOOKUP(searchdir, cn, &foundvn))) {
+  if (namecache_lookup(searchdir, cn, &foundvn)) {
+    error = foundvn ? 0 : ENOENT;
+  } else {
+    error = VOP_LOOKUP(searchdir, cn, &foundvn);
+    if (error == 0)
+      namecache_enter(searchdir, cn, foundvn);
+    else if (error == ENOENT)
+      namecache_enter(searchdir, cn, NULL);
+  }
+
+  if (error) {
     /*
      * The entry was not found in the directory. This is valid if we are
      * creating an entry and are working on the last component of the path name.
@@ -137,7 +147,8 @@ static int vnr_lookup_once(vnrstate_t *vs, vnode_t **searchdir_p,
     return error;
   }
 
-  /* No need to ref foundvn vnode, VOP_LOOKUP already did it for us. */
+  /* No need to ref foundvn vnode, VOP_LOOKUP or name cache already did it for
+   * us. */
   if (searchdir != foundvn)
     vnode_lock(foundvn);
 
@@ -381,7 +392,8 @@ int vfs_name_in_dir(vnode_t *dv, vnode_t *v, char *buf, size_t *lastp) {
     if ((error = VOP_READDIR(dv, &uio)))
       goto end;
 
-    intptr_t nread = uio.uio_offset - offset;
+    /* Directory offset need not be a byte offset, so use residual count. */
+    intptr_t nread = PATH_MAX - uio.uio_resid;
     if (nread == 0)
       break;
 
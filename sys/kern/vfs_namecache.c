@@ -0,0 +1,173 @@
+#define KL_LOG KL_VFS
+#include <sys/klog.h>
+#include <sys/hash.h>
+#include <sys/libkern.h>
+#include <sys/mutex.h>
+#include <sys/pool.h>
+#include <sys/queue.h>
+#include <sys/vfs.h>
+#include <sys/vnode.h>
+
+/*
+ * Name lookup cache maps (directory vnode, name) pairs to vnodes found by
+ * VOP_LOOKUP, so that path name resolution does not need to call into the
+ * filesystem for components that were recently looked up. Entries that refer
+ * to nonexistent names (negative entries) are kept as well, to speed up
+ * searches through PATH-like lists of directories.
+ *
+ * Entries do not hold references to vnodes. Instead each vnode keeps lists
+ * of entries it's referred by and purges them before it's freed.
+ */
+
+#define NC_NAMELEN 32 /* longer names are not cached */
+#define NC_SIZE 512   /* max. number of cache entries */
+#define NC_HASH_SIZE 128
+#define NC_HASH_MASK (NC_HASH_SIZE - 1)
+
+typedef struct namecache {
+  LIST_ENTRY(namecache) nc_hash; /* link on hash chain */
+  TAILQ_ENTRY(namecache) nc_lru; /* link on LRU list */
+  LIST_ENTRY(namecache) nc_src;  /* link on nc_dvp->v_ncsrc */
+  LIST_ENTRY(namecache) nc_dst;  /* link on nc_vp->v_ncdst */
+  vnode_t *nc_dvp;               /* directory vnode */
+  vnode_t *nc_vp;                /* found vnode or NULL if negative entry */
+  uint8_t nc_namelen;            /* length of the name */
+  char nc_name[NC_NAMELEN];      /* name (not NUL-terminated) */
+} namecache_t;
+
+typedef LIST_HEAD(, namecache) nc_list_t;
+
+static POOL_DEFINE(P_NAMECACHE, "namecache", sizeof(namecache_t));
+
+/* All fields below are protected by namecache_lock. */
+static MTX_DEFINE(namecache_lock, 0);
+static nc_list_t nc_hashtab[NC_HASH_SIZE];
+static TAILQ_HEAD(, namecache) nc_lru = TAILQ_HEAD_INITIALIZER(nc_lru);
+static unsigned nc_count;
+
+namecache_stats_t namecache_stats;
+
+static nc_list_t *nc_bucket(vnode_t *dv, componentname_t *cn) {
+  uint32_t hash = hash32_buf(&dv, sizeof(dv), HASH32_BUF_INIT);
+  hash = hash32_strn(cn->cn_nameptr, cn->cn_namelen, hash);
+  return &nc_hashtab[hash & NC_HASH_MASK];
+}
+
+static namecache_t *nc_find(nc_list_t *bucket, vnode_t *dv,
+                            componentname_t *cn) {
+  assert(mtx_owned(&namecache_lock));
+
+  namecache_t *nc;
+  LIST_FOREACH (nc, bucket, nc_hash) {
+    if (nc->nc_dvp == dv && nc->nc_namelen == cn->cn_namelen &&
+        memcmp(nc->nc_name, cn->cn_nameptr, cn->cn_namelen) == 0)
+      return nc;
+  }
+  return NULL;
+}
+
+static void nc_free(namecache_t *nc) {
+  assert(mtx_owned(&namecache_lock));
+
+  LIST_REMOVE(nc, nc_hash);
+  LIST_REMOVE(nc, nc_src);
+  if (nc->nc_vp)
+    LIST_REMOVE(nc, nc_dst);
+  TAILQ_REMOVE(&nc_lru, nc, nc_lru);
+  nc_count--;
+  pool_free(P_NAMECACHE, nc);
+}
+
+/* Names "." and ".." are handled by the filesystem and mount point crossing
+ * logic in name resolver, so they never enter the cache. */
+static bool nc_cacheable(componentname_t *cn) {
+  return cn->cn_namelen <= NC_NAMELEN && !componentname_equal(cn, ".") &&
+         !componentname_equal(cn, "..");
+}
+
+bool namecache_lookup(vnode_t *dv, componentname_t *cn, vnode_t **vp) {
+  /* Long names are counted here only, since each lookup that misses the
+   * cache is followed by an attempt to enter the name. */
+  if (cn->cn_namelen > NC_NAMELEN) {
+    WITH_MTX_LOCK (&namecache_lock)
+      namecache_stats.ncs_long++;
+    return false;
+  }
+
+  if (!nc_cacheable(cn))
+    return false;
+
+  SCOPED_MTX_LOCK(&namecache_lock);
+
+  namecache_t *nc = nc_find(nc_bucket(dv, cn), dv, cn);
+  if (nc == NULL || (nc->nc_vp && !vnode_tryhold(nc->nc_vp))) {
+    namecache_stats.ncs_misses++;
+    return false;
+  }
+
+  /* Move the entry to the tail of LRU list. */
+  TAILQ_REMOVE(&nc_lru, nc, nc_lru);
+  TAILQ_INSERT_TAIL(&nc_lru, nc, nc_lru);
+
+  if (nc->nc_vp)
+    namecache_stats.ncs_hits++;
+  else
+    namecache_stats.ncs_neghits++;
+
+  *vp = nc->nc_vp;
+  return true;
+}
+
+void namecache_enter(vnode_t *dv, componentname_t *cn, vnode_t *v) {
+  if (!nc_cacheable(cn))
+    return;
+
+  namecache_t *new = pool_alloc(P_NAMECACHE, M_WAITOK);
+
+  SCOPED_MTX_LOCK(&namecache_lock);
+
+  nc_list_t *bucket = nc_bucket(dv, cn);
+  namecache_t *nc = nc_find(bucket, dv, cn);
+  if (nc != NULL)
+    nc_free(nc);
+
+  if (nc_count == NC_SIZE) {
+    nc_free(TAILQ_FIRST(&nc_lru));
+    namecache_stats.ncs_evicts++;
+  }
+
+  nc = new;
+  nc->nc_dvp = dv;
+  nc->nc_vp = v;
+  nc->nc_namelen = cn->cn_namelen;
+  memcpy(nc->nc_name, cn->cn_nameptr, cn->cn_namelen);
+
+  LIST_INSERT_HEAD(bucket, nc, nc_hash);
+  LIST_INSERT_HEAD(&dv->v_ncsrc, nc, nc_src);
+  if (v)
+    LIST_INSERT_HEAD(&v->v_ncdst, nc, nc_dst);
+  TAILQ_INSERT_TAIL(&nc_lru, nc, nc_lru);
+  nc_count++;
+  namecache_stats.ncs_enters++;
+}
+
+void namecache_remove(vnode_t *dv, componentname_t *cn) {
+  if (cn->cn_namelen > NC_NAMELEN)
+    return;
+
+  SCOPED_MTX_LOCK(&namecache_lock);
+
+  namecache_t *nc = nc_find(nc_bucket(dv, cn), dv, cn);
+  if (nc != NULL)
+    nc_free(nc);
+}
+
+void namecache_purge(vnode_t *v) {
+  SCOPED_MTX_LOCK(&namecache_lock);
+
+  namecache_t *nc;
+  while ((nc = LIST_FIRST(&v->v_ncsrc)))
+    nc_free(nc);
+  while ((nc = LIST_FIRST(&v->v_ncdst)))
+    nc_free(nc);
+}
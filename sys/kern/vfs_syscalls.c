@@ -12,6 +12,9 @@
 #include <sys/libkern.h>
 #include <sys/statvfs.h>
 #include <sys/cred.h>
+#include <sys/blkdev.h>
+#include <sys/buf.h>
+#include <sys/mman.h>
 
 static int vfs_nameresolveat(proc_t *p, int fdat, vnrstate_t *vs) {
   file_t *f;
@@ -137,7 +140,10 @@ static int vfs_open(proc_t *p, file_t *f, int fdat, char *pathname, int flags,
     if ((error = vfs_check_open(v, flags, &p->p_cred)))
       return error;
 
-  if (flags & O_TRUNC)
+  /* Sockets are accessed with connect(2) and sendto(2) rather than open. */
+  if (v->v_type == V_SOCK)
+    error = EOPNOTSUPP;
+  else if (flags & O_TRUNC)
     error = vfs_truncate(v, 0, &p->p_cred);
 
   if (!error)
@@ -218,17 +224,46 @@ int do_fstatat(proc_t *p, int fd, char *path, stat_t *sb, int flag) {
   return error;
 }
 
-int do_mount(proc_t *p, const char *fs, const char *path) {
+/* Find block device that is accessed through device node at `path`. */
+static int vfs_blkdev_lookup(proc_t *p, const char *path, blkdev_t **bdp) {
+  vnode_t *v;
+  int error;
+
+  if ((error = vfs_namelookup(path, &v, &p->p_cred)))
+    return error;
+
+  *bdp = blkdev_of(v);
+  vnode_drop(v);
+  return *bdp ? 0 : ENOTBLK;
+}
+
+int do_mount(proc_t *p, const char *fs, const char *path, const char *from) {
   vfsconf_t *vfs;
+  blkdev_t *dev = NULL;
   vnode_t *v;
   int error;
 
   if (!(vfs = vfs_get_by_name(fs)))
     return EINVAL;
+  if (from && (error = vfs_blkdev_lookup(p, from, &dev)))
+    return error;
   if ((error = vfs_namelookup(path, &v, &p->p_cred)))
     return error;
 
-  return vfs_domount(vfs, v);
+  return vfs_domount(vfs, v, dev);
+}
+
+int do_mountroot(proc_t *p, const char *fs, const char *from) {
+  vfsconf_t *vfs;
+  blkdev_t *dev;
+  int error;
+
+  if (!(vfs = vfs_get_by_name(fs)))
+    return EINVAL;
+  if ((error = vfs_blkdev_lookup(p, from, &dev)))
+    return error;
+
+  return vfs_mountroot(vfs, dev);
 }
 
 int do_getdents(proc_t *p, int fd, uio_t *uio) {
@@ -268,7 +303,7 @@ int do_unlinkat(proc_t *p, int fd, char *path, int flag) {
   if ((error = vfs_nameresolveat(p, fd, &vs)))
     goto fail;
 
-  if (vs.vs_vp->v_mountedhere != NULL)
+  if (is_mountpoint(vs.vs_vp))
     error = EBUSY;
   else if (vs.vs_vp == vs.vs_dvp) /* No rmdir "." please */
     error = EINVAL;
@@ -445,14 +480,20 @@ int do_ftruncate(proc_t *p, int fd, off_t length) {
   if ((error = fdtab_get_file(p->p_fdtable, fd, FF_WRITE, &f)))
     return error;
 
-  vnode_t *vn = f->f_vnode;
-  vnode_lock(vn);
-  if (vn->v_type == V_DIR)
+  if (f->f_type == FT_SHM) {
+    error = shm_truncate(f, length);
+  } else if (f->f_type != FT_VNODE) {
     error = EINVAL;
-  else
-    error = vfs_truncate(vn, length, &p->p_cred);
+  } else {
+    vnode_t *vn = f->f_vnode;
+    vnode_lock(vn);
+    if (vn->v_type == V_DIR)
+      error = EINVAL;
+    else
+      error = vfs_truncate(vn, length, &p->p_cred);
+    vnode_unlock(vn);
+  }
 
-  vnode_unlock(vn);
   file_drop(f);
   return error;
 }
@@ -546,6 +587,42 @@ fail:
   return error;
 }
 
+int vfs_mksock(proc_t *p, const char *path, mode_t mode, vnode_t **vp) {
+  vnrstate_t vs;
+  vattr_t va;
+  int error;
+
+  if ((error = vnrstate_init(&vs, VNR_CREATE, 0, path, &p->p_cred)))
+    return error;
+
+  if ((error = vfs_nameresolveat(p, AT_FDCWD, &vs)))
+    goto fail;
+
+  if (vs.vs_vp != NULL) {
+    vnode_drop_both(vs.vs_vp, vs.vs_dvp);
+    error = EADDRINUSE;
+    goto fail;
+  }
+
+  if ((error = VOP_ACCESS(vs.vs_dvp, VWRITE, &p->p_cred))) {
+    vnode_put(vs.vs_dvp);
+    goto fail;
+  }
+
+  memset(&va, 0, sizeof(vattr_t));
+  va.va_mode = S_IFSOCK | ((mode & ACCESSPERMS) & ~p->p_cmask);
+  va.va_uid = p->p_cred.cr_euid;
+  va.va_gid = p->p_cred.cr_egid;
+
+  if (!(error = VOP_MKNOD(vs.vs_dvp, &vs.vs_lastcn, &va, &vs.vs_vp)))
+    *vp = vs.vs_vp;
+  vnode_put(vs.vs_dvp);
+
+fail:
+  vnrstate_destroy(&vs);
+  return error;
+}
+
 int do_linkat(proc_t *p, int fd, char *path, int linkfd, char *linkpath,
               int flags) {
   vnrstate_t vs;
@@ -697,6 +774,25 @@ int do_fstatvfs(proc_t *p, int fd, statvfs_t *buf) {
   return error;
 }
 
+int do_fsync(proc_t *p, int fd) {
+  file_t *f;
+  int error;
+
+  if ((error = fdtab_get_file(p->p_fdtable, fd, 0, &f)))
+    return error;
+
+  if (f->f_vnode == NULL) {
+    error = EINVAL;
+  } else {
+    /* Filesystems don't track which buffers belong to a file, so flush either
+     * the whole block device or all devices. */
+    error = bsync(blkdev_of(f->f_vnode));
+  }
+
+  file_drop(f);
+  return error;
+}
+
 static int vfs_utimens(vnode_t *v, timespec_t times[2], cred_t *cred) {
   vattr_t va;
   vattr_null(&va);
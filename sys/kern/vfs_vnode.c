@@ -1,7 +1,12 @@
 #define KL_LOG KL_VFS
 #include <sys/klog.h>
 #include <sys/errno.h>
+#include <sys/event.h>
 #include <sys/file.h>
+#include <sys/filio.h>
+#include <sys/hash.h>
+#include <sys/kenv.h>
+#include <sys/malloc.h>
 #include <sys/pool.h>
 #include <sys/mutex.h>
 #include <sys/libkern.h>
@@ -13,23 +18,249 @@
 #include <sys/condvar.h>
 #include <sys/cred.h>
 #include <sys/unistd.h>
+#include <sys/vm_physmem.h>
 
 static POOL_DEFINE(P_VNODE, "vnode", sizeof(vnode_t));
+static KMALLOC_DEFINE(M_VCACHE, "vnode cache");
 
 static void vnlock_init(vnlock_t *vl);
 
-/* Actually, vnode management should be much more complex than this, because
-   this stub does not recycle vnodes, does not store them on a free list,
-   etc. So at some point we may need a more sophisticated memory management here
-   - but this will do for now. */
+/*
+ * Vnode cache. Cached vnodes with usecnt of zero are kept on the free list in
+ * LRU order, so that vnodes of frequently looked up files stay in memory,
+ * while one-time tree walks do not pin memory forever. The usecnt of a cached
+ * vnode may be raised from zero only with vcache_lock held, while it's taken
+ * off the free list.
+ */
+
+#define VCACHE_MIN 256U    /* lower bound for maxvnodes */
+#define VCACHE_PAGES 4     /* by default one vnode per this many free pages */
+#define VCACHE_CHAIN_LEN 4 /* average hash chain length at maxvnodes */
+
+typedef LIST_HEAD(, vnode) vnode_list_t;
+
+/* All fields below are protected by vcache_lock. */
+static MTX_DEFINE(vcache_lock, 0);
+static condvar_t vcache_cv; /* signaled when a vnode finished loading */
+static vnode_list_t *vcache_hashtab;
+static unsigned vcache_hashmask;
+static TAILQ_HEAD(, vnode) vnode_freelist =
+  TAILQ_HEAD_INITIALIZER(vnode_freelist);
+
+vnode_stats_t vnode_stats;
+unsigned maxvnodes;
+
+void init_vcache(void) {
+  const char *max = kenv_get("maxvnodes");
+  if (max)
+    maxvnodes = strtoul(max, NULL, 10);
+  else
+    maxvnodes = vm_physmem_nfree() / VCACHE_PAGES;
+  maxvnodes = max(maxvnodes, VCACHE_MIN);
+
+  unsigned size = 1;
+  while (size * VCACHE_CHAIN_LEN < maxvnodes)
+    size <<= 1;
+
+  cv_init(&vcache_cv, "vnode loading");
+  vcache_hashtab =
+    kmalloc(M_VCACHE, size * sizeof(vnode_list_t), M_ZERO | M_WAITOK);
+  vcache_hashmask = size - 1;
+
+  klog("Vnode cache holds up to %u vnodes in %u buckets", maxvnodes, size);
+}
 
-vnode_t *vnode_new(vnodetype_t type, vnodeops_t *ops, void *data) {
+static vnode_list_t *vcache_bucket(mount_t *mp, uint32_t ino) {
+  uint32_t hash = hash32_buf(&mp, sizeof(mp), HASH32_BUF_INIT);
+  hash = hash32_buf(&ino, sizeof(ino), hash);
+  return &vcache_hashtab[hash & vcache_hashmask];
+}
+
+static vnode_t *vcache_find(vnode_list_t *bucket, mount_t *mp, uint32_t ino) {
+  assert(mtx_owned(&vcache_lock));
+
+  vnode_t *v;
+  LIST_FOREACH (v, bucket, v_hashlink) {
+    if (v->v_mount == mp && v->v_ino == ino)
+      return v;
+  }
+  return NULL;
+}
+
+/* Take a reference to vnode that is possibly on the free list. */
+static void vcache_hold(vnode_t *v) {
+  assert(mtx_owned(&vcache_lock));
+
+  if (v->v_vflags & VV_FREE) {
+    TAILQ_REMOVE(&vnode_freelist, v, v_freelist);
+    v->v_vflags &= ~VV_FREE;
+    vnode_stats.vs_free--;
+    vnode_stats.vs_reused++;
+  }
+  refcnt_acquire(&v->v_usecnt);
+}
+
+static vnode_t *vnode_alloc(void) {
   vnode_t *v = pool_alloc(P_VNODE, M_ZERO);
+  v->v_usecnt = 1;
+  vnlock_init(&v->v_lock);
+  WITH_MTX_LOCK (&vcache_lock)
+    vnode_stats.vs_vnodes++;
+  return v;
+}
+
+static void vnode_destroy(vnode_t *v) {
+  assert(!(v->v_vflags & (VV_CACHED | VV_FREE)));
+
+  namecache_purge(v);
+  if (v->v_ops)
+    VOP_RECLAIM(v);
+  pool_free(P_VNODE, v);
+  WITH_MTX_LOCK (&vcache_lock)
+    vnode_stats.vs_vnodes--;
+}
+
+/* Take least recently used vnode off the free list and out of the cache. */
+static vnode_t *vcache_take_free(void) {
+  SCOPED_MTX_LOCK(&vcache_lock);
+
+  vnode_t *v = TAILQ_FIRST(&vnode_freelist);
+  if (v == NULL)
+    return NULL;
+
+  TAILQ_REMOVE(&vnode_freelist, v, v_freelist);
+  LIST_REMOVE(v, v_hashlink);
+  v->v_vflags &= ~(VV_FREE | VV_CACHED);
+  vnode_stats.vs_free--;
+  vnode_stats.vs_recycled++;
+  return v;
+}
+
+unsigned vcache_recycle(unsigned count) {
+  unsigned n = 0;
+  vnode_t *v;
+
+  while (n < count && (v = vcache_take_free())) {
+    vnode_destroy(v);
+    n++;
+  }
+
+  return n;
+}
+
+/* Bring number of vnodes down to the limit if possible. */
+static void vcache_trim(void) {
+  unsigned excess = 0;
+
+  WITH_MTX_LOCK (&vcache_lock) {
+    if (vnode_stats.vs_vnodes > maxvnodes)
+      excess = vnode_stats.vs_vnodes - maxvnodes;
+  }
+
+  if (excess)
+    vcache_recycle(excess);
+}
+
+int vcache_get(mount_t *mp, uint32_t ino, vnode_load_t *load, void *arg,
+               vnode_t **vp) {
+  vnode_list_t *bucket = vcache_bucket(mp, ino);
+  vnode_t *v, *new = NULL;
+  int error;
+
+  mtx_lock(&vcache_lock);
+
+  for (;;) {
+    if ((v = vcache_find(bucket, mp, ino))) {
+      /* Wait until other thread finishes loading the vnode. */
+      if (v->v_vflags & VV_LOADING) {
+        cv_wait(&vcache_cv, &vcache_lock);
+        continue;
+      }
+      vcache_hold(v);
+      vnode_stats.vs_hits++;
+      break;
+    }
+
+    if (load == NULL || new != NULL)
+      break;
+
+    /* Memory allocation may sleep, so the cache has to be searched again. */
+    mtx_unlock(&vcache_lock);
+    new = vnode_alloc();
+    mtx_lock(&vcache_lock);
+  }
+
+  if (v != NULL || load == NULL) {
+    mtx_unlock(&vcache_lock);
+    if (new)
+      vnode_destroy(new);
+    if (v == NULL)
+      return ENOENT;
+    *vp = v;
+    return 0;
+  }
+
+  /* Vnode stays in the hash table while it's being loaded, so that others
+   * wait for it instead of loading the same inode for the second time. */
+  new->v_mount = mp;
+  new->v_ino = ino;
+  new->v_vflags = VV_CACHED | VV_LOADING;
+  LIST_INSERT_HEAD(bucket, new, v_hashlink);
+  vnode_stats.vs_misses++;
+  mtx_unlock(&vcache_lock);
+
+  error = load(new, arg);
+
+  WITH_MTX_LOCK (&vcache_lock) {
+    new->v_vflags &= ~VV_LOADING;
+    if (error) {
+      LIST_REMOVE(new, v_hashlink);
+      new->v_vflags &= ~VV_CACHED;
+    }
+    cv_broadcast(&vcache_cv);
+  }
+
+  if (error) {
+    /* Vnode is not filled in, so there is nothing to reclaim. */
+    new->v_ops = NULL;
+    vnode_destroy(new);
+    return error;
+  }
+
+  vcache_trim();
+  *vp = new;
+  return 0;
+}
+
+void vcache_new(vnode_t *v, uint32_t ino) {
+  vnode_list_t *bucket = vcache_bucket(v->v_mount, ino);
+
+  SCOPED_MTX_LOCK(&vcache_lock);
+  assert(!(v->v_vflags & VV_CACHED));
+
+  /* A vnode for the same inode that is still being loaded (and will fail,
+   * since the inode was free) may be in the bucket. Ours must be found first,
+   * hence it's inserted at the head of the chain. */
+  v->v_ino = ino;
+  v->v_vflags |= VV_CACHED;
+  LIST_INSERT_HEAD(bucket, v, v_hashlink);
+}
+
+void vcache_remove(vnode_t *v) {
+  SCOPED_MTX_LOCK(&vcache_lock);
+  assert(v->v_usecnt > 0);
+
+  if (v->v_vflags & VV_CACHED) {
+    LIST_REMOVE(v, v_hashlink);
+    v->v_vflags &= ~VV_CACHED;
+  }
+}
+
+vnode_t *vnode_new(vnodetype_t type, vnodeops_t *ops, void *data) {
+  vnode_t *v = vnode_alloc();
   v->v_type = type;
   v->v_data = data;
   v->v_ops = ops;
-  v->v_usecnt = 1;
-  vnlock_init(&v->v_lock);
   return v;
 }
 
@@ -46,17 +277,35 @@ static void vnlock_init(vnlock_t *vl) {
 void vnode_lock(vnode_t *v) {
   vnlock_t *vl = &v->v_lock;
   WITH_MTX_LOCK (&vl->vl_interlock) {
-    while (vl->vl_locked)
+    vl->vl_xwait++;
+    while (vl->vl_locked || vl->vl_shared)
       cv_wait(&vl->vl_cv, &vl->vl_interlock);
+    vl->vl_xwait--;
     vl->vl_locked = true;
   }
 }
 
+/* Threads waiting for exclusive access take precedence, so that a stream of
+ * readers cannot starve writers. */
+void vnode_lock_shared(vnode_t *v) {
+  vnlock_t *vl = &v->v_lock;
+  WITH_MTX_LOCK (&vl->vl_interlock) {
+    while (vl->vl_locked || vl->vl_xwait)
+      cv_wait(&vl->vl_cv, &vl->vl_interlock);
+    vl->vl_shared++;
+  }
+}
+
 void vnode_unlock(vnode_t *v) {
   vnlock_t *vl = &v->v_lock;
   WITH_MTX_LOCK (&vl->vl_interlock) {
-    vl->vl_locked = false;
-    cv_signal(&vl->vl_cv);
+    if (vl->vl_locked) {
+      vl->vl_locked = false;
+    } else {
+      assert(vl->vl_shared > 0);
+      vl->vl_shared--;
+    }
+    cv_broadcast(&vl->vl_cv);
   }
 }
 
@@ -64,11 +313,45 @@ void vnode_hold(vnode_t *v) {
   refcnt_acquire(&v->v_usecnt);
 }
 
+bool vnode_tryhold(vnode_t *v) {
+  unsigned cnt = atomic_load(&v->v_usecnt);
+  while (cnt > 0) {
+    if (atomic_compare_exchange_weak(&v->v_usecnt, &cnt, cnt + 1))
+      return true;
+  }
+
+  /* Unused vnode may be revived only if it's on the free list. */
+  SCOPED_MTX_LOCK(&vcache_lock);
+  if (!(v->v_vflags & VV_FREE) && v->v_usecnt == 0)
+    return false;
+  vcache_hold(v);
+  return true;
+}
+
 void vnode_drop(vnode_t *v) {
-  if (refcnt_release(&v->v_usecnt)) {
-    VOP_RECLAIM(v);
-    pool_free(P_VNODE, v);
+  /* Unless we drop the last reference, there's no need to take the lock. */
+  unsigned cnt = atomic_load(&v->v_usecnt);
+  while (cnt > 1) {
+    if (atomic_compare_exchange_weak(&v->v_usecnt, &cnt, cnt - 1))
+      return;
   }
+
+  WITH_MTX_LOCK (&vcache_lock) {
+    if (!refcnt_release(&v->v_usecnt))
+      return;
+
+    if (v->v_vflags & VV_CACHED) {
+      TAILQ_INSERT_TAIL(&vnode_freelist, v, v_freelist);
+      v->v_vflags |= VV_FREE;
+      vnode_stats.vs_free++;
+      v = NULL;
+    }
+  }
+
+  if (v)
+    vnode_destroy(v);
+  else
+    vcache_trim();
 }
 
 void vnode_get(vnode_t *v) {
@@ -111,6 +394,7 @@ static int vnode_nop(vnode_t *v, ...) {
 #define vnode_write_nop vnode_nop
 #define vnode_seek_nop vnode_nop
 #define vnode_create_nop vnode_nop
+#define vnode_mknod_nop vnode_nop
 #define vnode_remove_nop vnode_nop
 #define vnode_mkdir_nop vnode_nop
 #define vnode_rmdir_nop vnode_nop
@@ -145,6 +429,7 @@ void vnodeops_init(vnodeops_t *vops) {
   NOP_IF_NULL(vops, seek);
   NOP_IF_NULL(vops, getattr);
   NOP_IF_NULL(vops, create);
+  NOP_IF_NULL(vops, mknod);
   NOP_IF_NULL(vops, remove);
   NOP_IF_NULL(vops, mkdir);
   NOP_IF_NULL(vops, rmdir);
@@ -181,9 +466,19 @@ void vattr_null(vattr_t *va) {
 }
 
 /* Default file operations using v-nodes. */
+/* File offset is protected by the vnode lock. Positional reads do not touch
+ * it, hence they can run concurrently with the vnode locked in shared mode. */
 int default_vnread(file_t *f, uio_t *uio) {
   vnode_t *v = f->f_vnode;
   int error = 0;
+
+  if (uio->uio_ioflags & IO_OFFSET) {
+    vnode_lock_shared(v);
+    error = VOP_READ(v, uio);
+    vnode_unlock(v);
+    return error;
+  }
+
   vnode_lock(v);
   uio->uio_offset = f->f_offset;
   error = VOP_READ(f->f_vnode, uio);
@@ -194,11 +489,14 @@ int default_vnread(file_t *f, uio_t *uio) {
 
 int default_vnwrite(file_t *f, uio_t *uio) {
   vnode_t *v = f->f_vnode;
+  bool positional = uio->uio_ioflags & IO_OFFSET;
   int error = 0;
   vnode_lock(v);
-  uio->uio_offset = f->f_offset;
+  if (!positional)
+    uio->uio_offset = f->f_offset;
   error = VOP_WRITE(f->f_vnode, uio);
-  f->f_offset = uio->uio_offset;
+  if (!positional)
+    f->f_offset = uio->uio_offset;
   vnode_unlock(v);
   return error;
 }
@@ -253,13 +551,31 @@ int default_vnseek(file_t *f, off_t offset, int whence, off_t *newoffp) {
       break;
     case SEEK_SET:
       break;
+    case SEEK_DATA:
+    case SEEK_HOLE:
+      if (offset < 0 || offset >= size) {
+        error = ENXIO;
+        goto out;
+      }
+      error = VOP_IOCTL(v, whence == SEEK_DATA ? FIOSEEKDATA : FIOSEEKHOLE,
+                        &offset, f);
+      /* If filesystem does not know about holes, the whole file is data. */
+      if (error == EOPNOTSUPP) {
+        error = 0;
+        if (whence == SEEK_HOLE)
+          offset = size;
+      }
+      if (error)
+        goto out;
+      break;
     default:
       error = EINVAL;
       goto out;
   }
 
-  /* TODO offset can go past the end of file when it's open for writing */
-  if (offset < 0 || offset > size) {
+  /* Offset can go past the end of regular file only if it's writable. */
+  bool pasteof = S_ISREG(va.va_mode) && (f->f_flags & FF_WRITE);
+  if (offset < 0 || (offset > size && !pasteof)) {
     error = EINVAL;
     goto out;
   }
@@ -282,6 +598,7 @@ int default_vnioctl(file_t *f, u_long cmd, void *data) {
     case V_REG:
     case V_DIR:
     case V_LNK:
+    case V_SOCK:
       break;
     case V_DEV:
       error = VOP_IOCTL(v, cmd, data, f);
@@ -291,6 +608,16 @@ int default_vnioctl(file_t *f, u_long cmd, void *data) {
   return error;
 }
 
+int default_vnkqfilter(file_t *f, knote_t *kn) {
+  vnode_t *v = f->f_vnode;
+
+  /* Regular files and directories never block. */
+  if (v->v_type == V_REG || v->v_type == V_DIR)
+    return seltrue_kqfilter(f, kn);
+
+  return EOPNOTSUPP;
+}
+
 static fileops_t default_vnode_fileops = {
   .fo_read = default_vnread,
   .fo_write = default_vnwrite,
@@ -298,6 +625,7 @@ static fileops_t default_vnode_fileops = {
   .fo_seek = default_vnseek,
   .fo_stat = default_vnstat,
   .fo_ioctl = default_vnioctl,
+  .fo_kqfilter = default_vnkqfilter,
 };
 
 int vnode_open_generic(vnode_t *v, int mode, file_t *fp) {
@@ -1,6 +1,7 @@
 #define KL_LOG KL_VM
 #include <sys/errno.h>
 #include <sys/klog.h>
+#include <sys/libkern.h>
 #include <sys/malloc.h>
 #include <sys/mutex.h>
 #include <sys/pool.h>
@@ -47,7 +48,7 @@
  */
 struct vm_amap {
   mtx_t mtx;             /* Amap lock. */
-  size_t slots;          /* (!) maximum number of slots */
+  size_t slots;          /* (@) maximum number of slots */
   refcnt_t ref_cnt;      /* (a) number map entries using amap */
   vm_anon_t **anon_list; /* (@) pointers of used anons */
 };
@@ -77,6 +78,22 @@ vm_amap_t *vm_amap_alloc(size_t slots) {
   return amap;
 }
 
+void vm_amap_extend(vm_amap_t *amap, size_t slots) {
+  slots += EXTRA_AMAP_SLOTS;
+  vm_anon_t **new_list =
+    kmalloc(M_AMAP, slots * sizeof(vm_anon_t *), M_ZERO | M_WAITOK);
+
+  WITH_MTX_LOCK (&amap->mtx) {
+    if (slots <= amap->slots)
+      break;
+    memcpy(new_list, amap->anon_list, amap->slots * sizeof(vm_anon_t *));
+    swap(new_list, amap->anon_list);
+    amap->slots = slots;
+  }
+
+  kfree(M_AMAP, new_list);
+}
+
 vm_aref_t vm_amap_copy_if_needed(vm_aref_t aref, size_t slots) {
   vm_amap_t *amap = aref.amap;
   if (!amap)
@@ -127,23 +144,29 @@ vm_anon_t *vm_amap_find_anon(vm_aref_t aref, size_t offset) {
   return NULL;
 }
 
-void vm_amap_insert_anon(vm_aref_t aref, vm_anon_t *anon, size_t offset) {
+vm_anon_t *vm_amap_insert_anon(vm_aref_t aref, vm_anon_t *anon,
+                               size_t offset) {
   vm_amap_t *amap = aref.amap;
+  vm_anon_t *found;
   assert(amap != NULL && anon != NULL);
 
-  SCOPED_MTX_LOCK(&amap->mtx);
+  WITH_MTX_LOCK (&amap->mtx) {
+    /* Determine real offset inside the amap. */
+    offset += aref.offset;
+    assert(offset < amap->slots);
 
-  /* Determine real offset inside the amap. */
-  offset += aref.offset;
-  assert(offset < amap->slots);
+    found = amap->anon_list[offset];
+    if (!found)
+      amap->anon_list[offset] = anon;
+  }
 
-  /* Don't allow for inserting anon twice or on top of other. */
-  if (amap->anon_list[offset]) {
-    assert(anon == amap->anon_list[offset]);
-    return;
+  /* Another mapping of a shared amap could have filled the slot first. */
+  if (found && found != anon) {
+    vm_anon_drop(anon);
+    return found;
   }
 
-  amap->anon_list[offset] = anon;
+  return anon;
 }
 
 static void vm_amap_remove_pages_unlocked(vm_amap_t *amap, size_t start,
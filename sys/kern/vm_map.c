@@ -43,7 +43,16 @@ void vm_map_activate(vm_map_t *map) {
 
 void vm_map_switch(thread_t *td) {
   proc_t *p = td->td_proc;
-  vm_map_activate(p ? p->p_uspace : NULL);
+  vm_map_activate(p ? p->p_uspace : td->td_uspace);
+}
+
+void vm_map_borrow(vm_map_t *map) {
+  thread_t *td = thread_self();
+  assert(td->td_proc == NULL);
+
+  SCOPED_NO_PREEMPTION();
+  td->td_uspace = map;
+  vm_map_activate(map);
 }
 
 void vm_map_lock(vm_map_t *map) {
@@ -360,6 +369,8 @@ int vm_map_insert(vm_map_t *map, vm_map_entry_t *ent, vm_flags_t flags) {
   assert((flags & (VM_SHARED | VM_PRIVATE)) != (VM_SHARED | VM_PRIVATE));
 
   entry_flags |= (flags & VM_SHARED) ? VM_ENT_SHARED : VM_ENT_PRIVATE;
+  /* Copy-on-write state is determined by the creator of the entry. */
+  entry_flags |= ent->flags & (VM_ENT_COW | VM_ENT_NEEDSCOPY);
 
   ent->start = start;
   ent->end = start + length;
@@ -369,26 +380,23 @@ int vm_map_insert(vm_map_t *map, vm_map_entry_t *ent, vm_flags_t flags) {
   return 0;
 }
 
-int vm_map_alloc_entry(vm_map_t *map, vaddr_t addr, size_t length,
-                       vm_prot_t prot, vm_flags_t flags,
-                       vm_map_entry_t **ent_p) {
-  if (!(flags & VM_ANON)) {
-    klog("Only anonymous memory mappings are supported!");
-    return ENOTSUP;
-  }
-
-  if (!page_aligned_p(addr))
-    return EINVAL;
-
-  if (length == 0)
-    return EINVAL;
-
-  if (addr != 0 && !userspace_p(addr, addr + length))
+static int vm_map_alloc_entry_aref(vm_map_t *map, vaddr_t addr, size_t length,
+                                   vm_prot_t prot, vm_flags_t flags,
+                                   vm_aref_t aref, vm_map_entry_t **ent_p) {
+  if (!page_aligned_p(addr) || length == 0 ||
+      (addr != 0 && !userspace_p(addr, addr + length))) {
+    if (aref.amap)
+      vm_amap_drop(aref.amap);
     return EINVAL;
+  }
 
-  /* Create entry without amap. */
   vm_map_entry_t *ent =
     vm_map_entry_alloc(addr, addr + length, prot, VM_ENT_SHARED);
+  ent->aref = aref;
+
+  /* Private mapping of existing amap must not modify it. */
+  if (aref.amap && (flags & VM_PRIVATE))
+    ent->flags |= VM_ENT_COW | VM_ENT_NEEDSCOPY;
 
   /* Given the hint try to insert the entry at given position or after it. */
   if (vm_map_insert(map, ent, flags)) {
@@ -400,6 +408,26 @@ int vm_map_alloc_entry(vm_map_t *map, vaddr_t addr, size_t length,
   return 0;
 }
 
+int vm_map_alloc_entry(vm_map_t *map, vaddr_t addr, size_t length,
+                       vm_prot_t prot, vm_flags_t flags,
+                       vm_map_entry_t **ent_p) {
+  if (!(flags & VM_ANON)) {
+    klog("Only anonymous memory mappings are supported!");
+    return ENOTSUP;
+  }
+
+  /* Create entry without amap. */
+  vm_aref_t aref = {.offset = 0, .amap = NULL};
+  return vm_map_alloc_entry_aref(map, addr, length, prot, flags, aref, ent_p);
+}
+
+int vm_map_alloc_entry_amap(vm_map_t *map, vaddr_t addr, size_t length,
+                            vm_prot_t prot, vm_flags_t flags, vm_aref_t aref,
+                            vm_map_entry_t **ent_p) {
+  assert(aref.amap != NULL);
+  return vm_map_alloc_entry_aref(map, addr, length, prot, flags, aref, ent_p);
+}
+
 int vm_map_entry_resize(vm_map_t *map, vm_map_entry_t *ent, vaddr_t new_end) {
   assert(page_aligned_p(new_end));
   assert(new_end >= ent->start);
@@ -624,7 +652,44 @@ int vm_page_fault(vm_map_t *map, vaddr_t fault_addr, vm_prot_t fault_type) {
   if (!anon)
     return ENOMEM;
 
-  vm_amap_insert_anon(ent->aref, anon, offset);
+  anon = vm_amap_insert_anon(ent->aref, anon, offset);
   pmap_enter(map->pmap, fault_page, anon->page, insert_prot, 0);
   return 0;
 }
+
+int vm_map_loan(vm_map_t *map, vaddr_t va, vm_prot_t access,
+                vm_anon_t **anonp) {
+  vaddr_t page = va & -PAGESIZE;
+  int error;
+
+  do {
+    WITH_VM_MAP_LOCK (map) {
+      vm_map_entry_t *ent = vm_map_find_entry(map, page);
+
+      if (!ent)
+        return EFAULT;
+
+      if ((ent->prot & access) != access)
+        return EACCES;
+
+      vm_anon_t *anon = NULL;
+      if (ent->aref.amap)
+        anon = vm_amap_find_anon(ent->aref, vaddr_to_slot(page - ent->start));
+
+      /* Modifications must not be visible through other copies of the page,
+       * so let the write fault break copy-on-write sharing. */
+      if (anon && (access & VM_PROT_WRITE) && (ent->flags & VM_ENT_COW) &&
+          ((ent->flags & VM_ENT_NEEDSCOPY) || anon->ref_cnt > 1))
+        anon = NULL;
+
+      if (anon) {
+        vm_anon_hold(anon);
+        *anonp = anon;
+        return 0;
+      }
+    }
+    /* The page has not been touched yet or it has to be copied. */
+  } while (!(error = vm_page_fault(map, page, access)));
+
+  return error;
+}
@@ -327,3 +327,12 @@ vm_page_t *vm_page_find(paddr_t pa) {
 
   return NULL;
 }
+
+size_t vm_physmem_nfree(void) {
+  SCOPED_MTX_LOCK(&physmem_lock);
+
+  size_t sum = 0;
+  for (unsigned fl = 0; fl < PM_NQUEUES; fl++)
+    sum += pagecount[fl] << fl;
+  return sum;
+}
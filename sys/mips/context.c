@@ -50,6 +50,15 @@ void mcontext_init(mcontext_t *ctx, void *pc, void *sp) {
   _REG(ctx, SR) = mips32_get_c0(C0_STATUS) | SR_IE | SR_KSU_USER;
 }
 
+void mcontext_setup_call(mcontext_t *ctx, void *pc, void *sp, register_t arg) {
+  /* Position independent code expects function address in $t9 register. */
+  _REG(ctx, EPC) = (register_t)pc;
+  _REG(ctx, T9) = (register_t)pc;
+  _REG(ctx, SP) = (register_t)sp;
+  _REG(ctx, RA) = 0;
+  _REG(ctx, A0) = arg;
+}
+
 void mcontext_set_retval(mcontext_t *ctx, register_t value, register_t error) {
   _REG(ctx, V0) = (register_t)value;
   _REG(ctx, V1) = (register_t)error;
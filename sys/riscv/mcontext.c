@@ -75,6 +75,13 @@ void mcontext_init(mcontext_t *ctx, void *pc, void *sp) {
 #endif /* !TRAP_USER_ACCESS */
 }
 
+void mcontext_setup_call(mcontext_t *ctx, void *pc, void *sp, register_t arg) {
+  _REG(ctx, PC) = (register_t)pc;
+  _REG(ctx, SP) = (register_t)sp;
+  _REG(ctx, RA) = 0;
+  _REG(ctx, A0) = arg;
+}
+
 void mcontext_set_retval(mcontext_t *ctx, register_t value, register_t error) {
   _REG(ctx, A0) = value;
   _REG(ctx, A1) = error;
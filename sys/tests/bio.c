@@ -0,0 +1,222 @@
+#include <sys/klog.h>
+#include <sys/blkdev.h>
+#include <sys/buf.h>
+#include <sys/devfs.h>
+#include <sys/ktest.h>
+#include <sys/libkern.h>
+#include <sys/pmap.h>
+#include <sys/uio.h>
+#include <sys/vm_amap.h>
+#include <sys/vm_map.h>
+
+#define RD_BLKSIZE 512
+#define RD_NBLOCKS 20 /* last buffer cache block is shorter */
+
+static uint8_t rd_data[RD_NBLOCKS * RD_BLKSIZE];
+static unsigned rd_reads, rd_writes;
+
+static int rd_read(blkdev_t *bd, uint64_t blkno, void *data, size_t nblks) {
+  memcpy(data, rd_data + blkno * RD_BLKSIZE, nblks * RD_BLKSIZE);
+  rd_reads++;
+  return 0;
+}
+
+static int rd_write(blkdev_t *bd, uint64_t blkno, const void *data,
+                    size_t nblks) {
+  memcpy(rd_data + blkno * RD_BLKSIZE, data, nblks * RD_BLKSIZE);
+  rd_writes++;
+  return 0;
+}
+
+static blkdev_ops_t rd_ops = {
+  .bd_read = rd_read,
+  .bd_write = rd_write,
+};
+
+static blkdev_t rd = {
+  .bd_ops = &rd_ops,
+  .bd_blksize = RD_BLKSIZE,
+  .bd_nblocks = RD_NBLOCKS,
+};
+
+static int test_bio(void) {
+  buf_t *bp;
+
+  for (unsigned i = 0; i < sizeof(rd_data); i++)
+    rd_data[i] = i;
+
+  assert(blkdev_register(&rd, "bio_test") == 0);
+  assert(rd.bd_bufsize == 4096);
+
+  /* Second read of the same block is served from the cache. */
+  assert(bread(&rd, 0, &bp) == 0);
+  assert(bp->b_bcount == rd.bd_bufsize);
+  assert(memcmp(bp->b_data, rd_data, bp->b_bcount) == 0);
+  brelse(bp);
+  rd_data[0] = 0xff;
+  assert(bread(&rd, 0, &bp) == 0);
+  assert(((uint8_t *)bp->b_data)[0] == 0);
+  brelse(bp);
+
+  /* Last buffer is truncated at the end of device. */
+  assert(bread(&rd, 2, &bp) == 0);
+  assert(bp->b_bcount == (RD_NBLOCKS - 16) * RD_BLKSIZE);
+  brelse(bp);
+
+  /* Delayed write reaches the device on sync. */
+  assert(bread(&rd, 1, &bp) == 0);
+  memset(bp->b_data, 0xaa, bp->b_bcount);
+  unsigned writes = rd_writes;
+  bdwrite(bp);
+  assert(rd_writes == writes);
+  assert(bsync(&rd) == 0);
+  assert(rd_writes == writes + 1);
+  assert(rd_data[8 * RD_BLKSIZE] == 0xaa);
+
+  /* Synchronous write goes to the device immediately. */
+  bp = getblk(&rd, 0);
+  memset(bp->b_data, 0x55, bp->b_bcount);
+  assert(bwrite(bp) == 0);
+  assert(rd_data[0] == 0x55);
+
+  /* After invalidation blocks must be read from the device again. */
+  assert(binval(&rd) == 0);
+  rd_data[RD_BLKSIZE] = 0x11;
+  assert(bread(&rd, 0, &bp) == 0);
+  assert(((uint8_t *)bp->b_data)[RD_BLKSIZE] == 0x11);
+  brelse(bp);
+
+  assert(blkdev_unregister(&rd) == 0);
+  return KTEST_SUCCESS;
+}
+
+KTEST_ADD(bio, test_bio, 0);
+
+static blkdev_t rd_direct = {
+  .bd_ops = &rd_ops,
+  .bd_blksize = RD_BLKSIZE,
+  .bd_nblocks = RD_NBLOCKS,
+};
+
+static uint8_t rd_buf[4 * RD_BLKSIZE] __aligned(RD_BLKSIZE);
+
+static int rd_uio(uio_op_t op, off_t offset, void *buf, size_t len) {
+  devnode_t *dev = rd_direct.bd_node;
+  uio_t uio = UIO_SINGLE_KERNEL(op, offset, buf, len);
+  int error;
+
+  if (op == UIO_READ)
+    error = dev->ops->d_read(dev, &uio);
+  else
+    error = dev->ops->d_write(dev, &uio);
+  assert(uio.uio_resid == 0);
+  return error;
+}
+
+#define USER_VA 0x1000000
+
+static int rd_user_uio(uio_op_t op, vm_map_t *map, off_t offset,
+                       iovec_t *iov, int iovcnt, size_t len) {
+  devnode_t *dev = rd_direct.bd_node;
+  uio_t uio = UIO_VECTOR(op, map, iov, iovcnt, len);
+  int error;
+
+  uio.uio_offset = offset;
+  if (op == UIO_READ)
+    error = dev->ops->d_read(dev, &uio);
+  else
+    error = dev->ops->d_write(dev, &uio);
+  assert(uio.uio_resid == 0);
+  return error;
+}
+
+/* Returns kernel address of the page currently backing `va` in `map`. */
+static uint8_t *user_page(vm_map_t *map, vaddr_t va) {
+  vm_anon_t *anon;
+  assert(vm_map_loan(map, va, VM_PROT_READ, &anon) == 0);
+  uint8_t *data = phys_to_dmap(anon->page->paddr);
+  vm_anon_drop(anon);
+  return data;
+}
+
+static int test_bio_direct(void) {
+  buf_t *bp;
+
+  for (unsigned i = 0; i < sizeof(rd_data); i++)
+    rd_data[i] = i;
+
+  assert(blkdev_register(&rd_direct, "bio_direct") == 0);
+
+  /* Aligned request is served by a single device transfer. */
+  unsigned reads = rd_reads;
+  assert(rd_uio(UIO_READ, 3 * RD_BLKSIZE, rd_buf, sizeof(rd_buf)) == 0);
+  assert(rd_reads == reads + 1);
+  assert(memcmp(rd_buf, rd_data + 3 * RD_BLKSIZE, sizeof(rd_buf)) == 0);
+
+  /* Dirty cached data is written back before the device is read. */
+  assert(bread(&rd_direct, 0, &bp) == 0);
+  memset(bp->b_data, 0xaa, bp->b_bcount);
+  bdwrite(bp);
+  assert(rd_uio(UIO_READ, 0, rd_buf, sizeof(rd_buf)) == 0);
+  assert(rd_buf[0] == 0xaa && rd_data[0] == 0xaa);
+
+  /* Cached copy of blocks overwritten by the device is dropped. */
+  memset(rd_buf, 0x55, sizeof(rd_buf));
+  assert(rd_uio(UIO_WRITE, 0, rd_buf, sizeof(rd_buf)) == 0);
+  assert(rd_data[0] == 0x55);
+  assert(bread(&rd_direct, 0, &bp) == 0);
+  assert(((uint8_t *)bp->b_data)[0] == 0x55);
+  assert(((uint8_t *)bp->b_data)[sizeof(rd_buf)] == 0xaa);
+  brelse(bp);
+
+  /* Unaligned head and tail of the request go through the cache. */
+  memset(rd_buf, 0x33, sizeof(rd_buf));
+  assert(rd_uio(UIO_WRITE, 100, rd_buf + 100, 1000) == 0);
+  assert(bsync(&rd_direct) == 0);
+  assert(rd_data[99] == 0x55 && rd_data[100] == 0x33);
+  assert(rd_data[1099] == 0x33 && rd_data[1100] == 0x55);
+
+  vm_map_t *umap = vm_map_new();
+  vm_map_entry_t *ent = vm_map_entry_alloc(
+    USER_VA, USER_VA + 2 * PAGESIZE, VM_PROT_READ | VM_PROT_WRITE,
+    VM_ENT_PRIVATE);
+  assert(vm_map_insert(umap, ent, VM_FIXED) == 0);
+
+  /* Each io vector takes one transfer even if it spans many user pages. */
+  iovec_t iov[2] = {
+    {(void *)USER_VA, PAGESIZE + RD_BLKSIZE},
+    {(void *)USER_VA + PAGESIZE + RD_BLKSIZE, PAGESIZE - RD_BLKSIZE},
+  };
+  reads = rd_reads;
+  assert(rd_user_uio(UIO_READ, umap, 0, iov, 2, 2 * PAGESIZE) == 0);
+  assert(rd_reads == reads + 2);
+  assert(memcmp(user_page(umap, USER_VA), rd_data, PAGESIZE) == 0);
+  assert(memcmp(user_page(umap, USER_VA + PAGESIZE), rd_data + PAGESIZE,
+                PAGESIZE) == 0);
+
+  /* Pages shared copy-on-write after fork can be written to the device. */
+  vm_map_t *child = vm_map_clone(umap);
+  uint8_t *shared = user_page(umap, USER_VA);
+  assert(user_page(child, USER_VA) == shared);
+  iov[0] = (iovec_t){(void *)USER_VA, PAGESIZE};
+  assert(rd_user_uio(UIO_WRITE, child, PAGESIZE, iov, 1, PAGESIZE) == 0);
+  assert(memcmp(rd_data + PAGESIZE, shared, PAGESIZE) == 0);
+  assert(user_page(child, USER_VA) == shared);
+
+  /* Reading into such a page gives the reader its own copy. */
+  uint8_t old = shared[0];
+  memset(rd_buf, 0x77, sizeof(rd_buf));
+  assert(rd_uio(UIO_WRITE, 0, rd_buf, sizeof(rd_buf)) == 0);
+  assert(rd_user_uio(UIO_READ, child, 0, iov, 1, PAGESIZE) == 0);
+  assert(user_page(child, USER_VA) != shared);
+  assert(user_page(child, USER_VA)[0] == 0x77);
+  assert(user_page(umap, USER_VA) == shared && shared[0] == old);
+
+  vm_map_delete(child);
+  vm_map_delete(umap);
+
+  assert(blkdev_unregister(&rd_direct) == 0);
+  return KTEST_SUCCESS;
+}
+
+KTEST_ADD(bio_direct, test_bio_direct, 0);
@@ -0,0 +1,168 @@
+#include <sys/blkdev.h>
+#include <sys/buf.h>
+#include <sys/ext2fs.h>
+#include <sys/fcntl.h>
+#include <sys/file.h>
+#include <sys/ktest.h>
+#include <sys/libkern.h>
+#include <sys/proc.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/vfs.h>
+
+#define RD_BLKSIZE 512
+#define RD_NBLOCKS 128
+
+/* Layout of the filesystem created by `ext2_format`. */
+#define FS_BSIZE 1024
+#define FS_NBLOCKS (RD_NBLOCKS * RD_BLKSIZE / FS_BSIZE)
+#define FS_NINODES 16
+#define FS_GDBLOCK 2
+#define FS_BBITMAP 3
+#define FS_IBITMAP 4
+#define FS_ITABLE 5
+#define FS_ROOTDIR 7 /* last block in use */
+
+#define FILE_SIZE 3000
+
+static uint8_t rd_data[RD_NBLOCKS * RD_BLKSIZE];
+static uint8_t file_data[FILE_SIZE];
+static uint8_t read_data[FILE_SIZE];
+
+static int rd_read(blkdev_t *bd, uint64_t blkno, void *data, size_t nblks) {
+  memcpy(data, rd_data + blkno * RD_BLKSIZE, nblks * RD_BLKSIZE);
+  return 0;
+}
+
+static int rd_write(blkdev_t *bd, uint64_t blkno, const void *data,
+                    size_t nblks) {
+  memcpy(rd_data + blkno * RD_BLKSIZE, data, nblks * RD_BLKSIZE);
+  return 0;
+}
+
+static blkdev_ops_t rd_ops = {
+  .bd_read = rd_read,
+  .bd_write = rd_write,
+};
+
+static blkdev_t rd = {
+  .bd_ops = &rd_ops,
+  .bd_blksize = RD_BLKSIZE,
+  .bd_nblocks = RD_NBLOCKS,
+};
+
+static void *fs_block(uint32_t blkno) {
+  return rd_data + blkno * FS_BSIZE;
+}
+
+static void bitmap_fill(uint8_t *bm, unsigned nbits) {
+  for (unsigned i = 0; i < nbits; i++)
+    bm[i / 8] |= 1 << (i % 8);
+}
+
+/* Create a filesystem in original format with a single block group
+ * that contains an empty root directory. */
+static void ext2_format(void) {
+  bzero(rd_data, sizeof(rd_data));
+
+  ext2_superblock_t *sb = fs_block(1);
+  sb->s_inodes_count = FS_NINODES;
+  sb->s_blocks_count = FS_NBLOCKS;
+  sb->s_free_blocks_count = FS_NBLOCKS - FS_ROOTDIR - 1;
+  sb->s_free_inodes_count = FS_NINODES - EXT2_GOOD_OLD_FIRST_INO + 1;
+  sb->s_first_data_block = 1;
+  sb->s_blocks_per_group = 8192;
+  sb->s_frags_per_group = 8192;
+  sb->s_inodes_per_group = FS_NINODES;
+  sb->s_magic = EXT2_MAGIC;
+  sb->s_state = EXT2_VALID_FS;
+  sb->s_rev_level = EXT2_GOOD_OLD_REV;
+
+  ext2_gd_t *gd = fs_block(FS_GDBLOCK);
+  gd->bg_block_bitmap = FS_BBITMAP;
+  gd->bg_inode_bitmap = FS_IBITMAP;
+  gd->bg_inode_table = FS_ITABLE;
+  gd->bg_free_blocks_count = sb->s_free_blocks_count;
+  gd->bg_free_inodes_count = sb->s_free_inodes_count;
+  gd->bg_used_dirs_count = 1;
+
+  /* Bit 0 of block bitmap corresponds to the first data block. */
+  bitmap_fill(fs_block(FS_BBITMAP), FS_ROOTDIR);
+  bitmap_fill(fs_block(FS_IBITMAP), EXT2_GOOD_OLD_FIRST_INO - 1);
+
+  ext2_dinode_t *root = fs_block(FS_ITABLE) + (EXT2_ROOTINO - 1) *
+                                                EXT2_GOOD_OLD_INODE_SIZE;
+  root->i_mode = S_IFDIR | 0755;
+  root->i_size = FS_BSIZE;
+  root->i_links_count = 2;
+  root->i_blocks = FS_BSIZE / EXT2_SECTOR_SIZE;
+  root->i_block[0] = FS_ROOTDIR;
+
+  ext2_dirent_t *de = fs_block(FS_ROOTDIR);
+  de->d_ino = EXT2_ROOTINO;
+  de->d_reclen = EXT2_DIRENT_SIZE(1);
+  de->d_namelen = 1;
+  memcpy(de->d_name, ".", 1);
+
+  de = (void *)de + de->d_reclen;
+  de->d_ino = EXT2_ROOTINO;
+  de->d_reclen = FS_BSIZE - EXT2_DIRENT_SIZE(1);
+  de->d_namelen = 2;
+  memcpy(de->d_name, "..", 2);
+}
+
+static int file_io(proc_t *p, int fd, uio_op_t op, void *buf, size_t len) {
+  uio_t uio = UIO_SINGLE_KERNEL(op, 0, buf, len);
+  int error;
+
+  if (op == UIO_READ)
+    error = do_read(p, fd, &uio);
+  else
+    error = do_write(p, fd, &uio);
+  assert(uio.uio_resid == 0);
+  return error;
+}
+
+static int test_ext2(void) {
+  proc_t *p = proc_self();
+  off_t off;
+  int fd;
+
+  ext2_format();
+  for (unsigned i = 0; i < FILE_SIZE; i++)
+    file_data[i] = i * 7;
+
+  assert(blkdev_register(&rd, "ext2_test") == 0);
+  assert(do_mkdirat(p, AT_FDCWD, "/tmp/ext2", 0755) == 0);
+  assert(do_mount(p, "ext2", "/tmp/ext2", "/dev/ext2_test") == 0);
+
+  /* Mounted device can neither be mounted again nor go away. */
+  assert(do_mkdirat(p, AT_FDCWD, "/tmp/ext2-again", 0755) == 0);
+  assert(do_mount(p, "ext2", "/tmp/ext2-again", "/dev/ext2_test") == EBUSY);
+  assert(blkdev_unregister(&rd) == EBUSY);
+
+  /* Contents of a new file spanning a few blocks can be read back. */
+  assert(do_open(p, "/tmp/ext2/file", O_CREAT | O_RDWR, 0644, &fd) == 0);
+  assert(file_io(p, fd, UIO_WRITE, file_data, FILE_SIZE) == 0);
+  assert(do_lseek(p, fd, 0, SEEK_SET, &off) == 0);
+  assert(file_io(p, fd, UIO_READ, read_data, FILE_SIZE) == 0);
+  assert(memcmp(read_data, file_data, FILE_SIZE) == 0);
+  assert(do_close(p, fd) == 0);
+
+  /* Directories can be created and removed. */
+  assert(do_mkdirat(p, AT_FDCWD, "/tmp/ext2/dir", 0755) == 0);
+  assert(do_mkdirat(p, AT_FDCWD, "/tmp/ext2/dir/sub", 0755) == 0);
+  assert(do_unlinkat(p, AT_FDCWD, "/tmp/ext2/dir", AT_REMOVEDIR) == ENOTEMPTY);
+  assert(do_unlinkat(p, AT_FDCWD, "/tmp/ext2/dir/sub", AT_REMOVEDIR) == 0);
+  assert(do_unlinkat(p, AT_FDCWD, "/tmp/ext2/dir", AT_REMOVEDIR) == 0);
+
+  /* File data lands in first free blocks after synchronization. */
+  assert(bsync(&rd) == 0);
+  assert(memcmp(fs_block(FS_ROOTDIR + 1), file_data, FILE_SIZE) == 0);
+
+  /* There's no way to unmount a filesystem, so the device stays
+   * registered and mounted at /tmp/ext2. */
+  return KTEST_SUCCESS;
+}
+
+KTEST_ADD(ext2, test_ext2, 0);
@@ -55,3 +55,36 @@ static int test_thread_join(void) {
 }
 
 KTEST_ADD(thread_join, test_thread_join, 0);
+
+static void test_thread_nop(void *p) {
+}
+
+/* Checks that a reaped thread shell gets reused by thread_create. */
+static int test_thread_cache(void) {
+  thread_t *t1 = thread_create("test-thread-cache-1", test_thread_nop, NULL,
+                               prio_kthread(0));
+  tid_t t1_id = t1->td_tid;
+
+  sched_add(t1);
+  thread_join(t1);
+
+  /* thread_create reaps zombies first, so there's a shell in the cache.
+   * Other threads may be created concurrently, so we can't tell which one. */
+  unsigned hits = thread_cache_hits;
+  thread_t *t2 = thread_create("test-thread-cache-2", test_thread_nop, NULL,
+                               prio_kthread(0));
+
+  if (thread_cache_max > 0)
+    assert(thread_cache_hits > hits);
+  assert(t2->td_tid != t1_id);
+  assert(strcmp(t2->td_name, "test-thread-cache-2") == 0);
+  assert(t2->td_state == TDS_INACTIVE);
+
+  sched_add(t2);
+  thread_join(t2);
+  thread_reap();
+
+  return KTEST_SUCCESS;
+}
+
+KTEST_ADD(thread_cache, test_thread_cache, 0);
@@ -58,3 +58,63 @@ static int test_vfs(void) {
 }
 
 KTEST_ADD(vfs, test_vfs, 0);
+
+static int test_vfs_namecache(void) {
+  namecache_stats_t before = namecache_stats;
+  cred_t *cred = cred_self();
+  vnode_t *v1, *v2;
+  int error;
+
+  /* Second lookup of a missing name must hit a negative entry. */
+  error = vfs_namelookup("/dev/EGGS", &v1, cred);
+  assert(error == ENOENT);
+  error = vfs_namelookup("/dev/EGGS", &v1, cred);
+  assert(error == ENOENT);
+  assert(namecache_stats.ncs_neghits > before.ncs_neghits);
+
+  /* Positive hit must return the same vnode with usecnt incremented. */
+  error = vfs_namelookup("/dev/null", &v1, cred);
+  assert(error == 0);
+  error = vfs_namelookup("/dev/null", &v2, cred);
+  assert(error == 0);
+  assert(v1 == v2);
+  assert(namecache_stats.ncs_hits > before.ncs_hits);
+  vnode_drop(v1);
+  vnode_drop(v2);
+
+  return KTEST_SUCCESS;
+}
+
+KTEST_ADD(vfs_namecache, test_vfs_namecache, 0);
+
+static int test_vfs_vcache(void) {
+  vnode_stats_t before = vnode_stats;
+  cred_t *cred = cred_self();
+  vnode_t *v1, *v2;
+  vattr_t va;
+  int error;
+
+  /* Unused vnode must stay in the cache and be reused by the next lookup. */
+  error = vfs_namelookup("/bin", &v1, cred);
+  assert(error == 0);
+  vnode_drop(v1);
+  error = vfs_namelookup("/bin", &v2, cred);
+  assert(error == 0);
+  assert(v1 == v2);
+  assert(v2->v_usecnt == 1);
+  assert(vnode_stats.vs_reused > before.vs_reused);
+
+  /* Cached vnode can be found by its inode number. */
+  error = VOP_GETATTR(v2, &va);
+  assert(error == 0);
+  error = VFS_VGET(v2->v_mount, va.va_ino, &v1);
+  assert(error == 0);
+  assert(v1 == v2);
+  assert(v2->v_usecnt == 2);
+  vnode_drop(v1);
+  vnode_drop(v2);
+
+  return KTEST_SUCCESS;
+}
+
+KTEST_ADD(vfs_vcache, test_vfs_vcache, 0);
@@ -0,0 +1,141 @@
+/*
+ * Displays lock contention statistics gathered by the kernel compiled with
+ * LOCKSTAT=1 option. Lock classes are sorted by selected cost.
+ */
+
+#include <sys/lockstat.h>
+#include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PATH_LOCKSTAT "/dev/lockstat"
+
+typedef enum {
+  SORT_BLOCKED,
+  SORT_CONTENDED,
+  SORT_SPINS,
+  SORT_ACQUIRED,
+  SORT_HELD,
+  SORT_MAXHELD,
+} sort_key_t;
+
+static const char *sort_names[] = {
+  [SORT_BLOCKED] = "blocked",   [SORT_CONTENDED] = "contended",
+  [SORT_SPINS] = "spins",       [SORT_ACQUIRED] = "acquired",
+  [SORT_HELD] = "held",         [SORT_MAXHELD] = "maxheld",
+};
+
+static sort_key_t sort_key = SORT_BLOCKED;
+
+static uint64_t cost(const lockstat_info_t *ls) {
+  switch (sort_key) {
+    case SORT_CONTENDED:
+      return ls->ls_contended;
+    case SORT_SPINS:
+      return ls->ls_spins;
+    case SORT_ACQUIRED:
+      return ls->ls_acquired;
+    case SORT_HELD:
+      return ls->ls_held;
+    case SORT_MAXHELD:
+      return ls->ls_maxheld;
+    default:
+      return ls->ls_blocked;
+  }
+}
+
+/* Sort in descending order of cost. */
+static int lockstat_cmp(const void *a, const void *b) {
+  uint64_t ca = cost(a), cb = cost(b);
+  return (ca < cb) - (ca > cb);
+}
+
+static lockstat_info_t *lockstat_read(int fd, size_t *np) {
+  lockstat_info_t *ls = NULL;
+  size_t size = 0, len = 0;
+  ssize_t nread;
+
+  do {
+    if (len == size) {
+      size = size ? size * 2 : 64 * sizeof(lockstat_info_t);
+      if ((ls = realloc(ls, size)) == NULL)
+        err(EXIT_FAILURE, "realloc");
+    }
+    if ((nread = read(fd, (char *)ls + len, size - len)) < 0)
+      err(EXIT_FAILURE, "read");
+    len += nread;
+  } while (nread > 0);
+
+  *np = len / sizeof(lockstat_info_t);
+  return ls;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: lockstat [-r] [-n count] [-s key]\n");
+  fprintf(stderr, "keys: blocked (default), contended, spins, acquired, "
+                  "held, maxheld\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  int reset = 0, ch, fd;
+  size_t limit = 0, n; /* 0 means no limit */
+
+  while ((ch = getopt(argc, argv, "rn:s:")) != -1) {
+    switch (ch) {
+      case 'r':
+        reset = 1;
+        break;
+      case 'n':
+        limit = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        for (sort_key = 0; sort_key <= SORT_MAXHELD; sort_key++)
+          if (!strcmp(optarg, sort_names[sort_key]))
+            break;
+        if (sort_key > SORT_MAXHELD)
+          usage();
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if ((fd = open(PATH_LOCKSTAT, reset ? O_WRONLY : O_RDONLY)) < 0)
+    err(EXIT_FAILURE, "%s (is kernel compiled with LOCKSTAT=1?)",
+        PATH_LOCKSTAT);
+
+  if (reset) {
+    if (write(fd, "", 1) < 0)
+      err(EXIT_FAILURE, "write");
+    close(fd);
+    return EXIT_SUCCESS;
+  }
+
+  lockstat_info_t *ls = lockstat_read(fd, &n);
+  close(fd);
+
+  qsort(ls, n, sizeof(lockstat_info_t), lockstat_cmp);
+
+  printf("%-24s %10s %10s %10s %12s %12s %10s %10s\n", "class", "acquired",
+         "contended", "spins", "blocked[us]", "held[us]", "max[us]",
+         "max-pc");
+  if (limit == 0 || limit > n)
+    limit = n;
+
+  for (size_t i = 0; i < limit; i++) {
+    lockstat_info_t *l = &ls[i];
+    printf("%-24.24s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12" PRIu64
+           " %12" PRIu64 " %10" PRIu64 " %#10" PRIx64 "\n",
+           l->ls_name, l->ls_acquired, l->ls_contended, l->ls_spins,
+           l->ls_blocked / 1000, l->ls_held / 1000, l->ls_maxheld / 1000,
+           l->ls_maxheld_pc);
+  }
+
+  free(ls);
+  return EXIT_SUCCESS;
+}
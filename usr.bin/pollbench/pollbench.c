@@ -0,0 +1,135 @@
+/*
+ * Measures the cost of a single poll(2) call over a set of pipes.
+ *
+ * Compares native poll(2) against the emulation that was previously done in
+ * libc, i.e. creating a kqueue, registering every descriptor with kevent(2),
+ * collecting events and closing the kqueue on each call.
+ *
+ * Usage: pollbench [-n npipes] [-i iterations]
+ */
+
+#include <sys/event.h>
+#include <sys/poll.h>
+#include <sys/time.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static int npipes = 16;
+static int iterations = 1000;
+
+static int *pipes;
+static struct pollfd *fds;
+
+/* Same as poll(2) used to be implemented on top of kqueue. */
+static int kqueue_poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+  struct timespec ts = {timeout / 1000, (timeout % 1000) * 1000000};
+  struct kevent *events;
+  int kq, nevents = 0, ret;
+
+  if ((kq = kqueue1(O_CLOEXEC)) < 0)
+    return -1;
+
+  if ((events = malloc(2 * nfds * sizeof(struct kevent))) == NULL)
+    err(EXIT_FAILURE, "malloc");
+
+  for (nfds_t i = 0; i < nfds; i++) {
+    if (fds[i].events & POLLIN)
+      EV_SET(&events[nevents++], fds[i].fd, EVFILT_READ, EV_ADD, 0, 0, &fds[i]);
+    if (fds[i].events & POLLOUT)
+      EV_SET(&events[nevents++], fds[i].fd, EVFILT_WRITE, EV_ADD, 0, 0,
+             &fds[i]);
+  }
+
+  ret = kevent(kq, events, nevents, events, nevents,
+               timeout < 0 ? NULL : &ts);
+
+  for (int i = 0; i < ret; i++) {
+    struct pollfd *pfd = events[i].udata;
+    if (events[i].flags & EV_ERROR)
+      pfd->revents |= POLLERR;
+    else if (events[i].filter == EVFILT_READ)
+      pfd->revents |= POLLIN;
+    else if (events[i].filter == EVFILT_WRITE)
+      pfd->revents |= POLLOUT;
+  }
+
+  free(events);
+  close(kq);
+  return ret;
+}
+
+typedef int poll_fn_t(struct pollfd *, nfds_t, int);
+
+/* Returns average time of a single call in microseconds. */
+static double bench(poll_fn_t *fn) {
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (int i = 0; i < iterations; i++) {
+    for (int j = 0; j < npipes; j++) {
+      fds[j].events = POLLIN;
+      fds[j].revents = 0;
+    }
+    /* Only the last pipe has data, so all knotes need to be checked. */
+    if (fn(fds, npipes, 0) != 1)
+      errx(EXIT_FAILURE, "unexpected number of ready descriptors");
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double elapsed =
+    (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+  return elapsed / iterations;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: pollbench [-n npipes] [-i iterations]\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  int ch;
+
+  while ((ch = getopt(argc, argv, "n:i:")) != -1) {
+    switch (ch) {
+      case 'n':
+        npipes = atoi(optarg);
+        break;
+      case 'i':
+        iterations = atoi(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (npipes <= 0 || iterations <= 0)
+    usage();
+
+  if ((pipes = calloc(2 * npipes, sizeof(int))) == NULL ||
+      (fds = calloc(npipes, sizeof(struct pollfd))) == NULL)
+    err(EXIT_FAILURE, "calloc");
+
+  for (int i = 0; i < npipes; i++) {
+    if (pipe(&pipes[2 * i]) < 0)
+      err(EXIT_FAILURE, "pipe");
+    fds[i].fd = pipes[2 * i];
+  }
+
+  if (write(pipes[2 * npipes - 1], "x", 1) != 1)
+    err(EXIT_FAILURE, "write");
+
+  double native = bench(poll);
+  double emulated = bench(kqueue_poll);
+
+  printf("%d pipes, %d iterations\n", npipes, iterations);
+  printf("poll:   %8.2f us/call\n", native);
+  printf("kqueue: %8.2f us/call\n", emulated);
+
+  return EXIT_SUCCESS;
+}
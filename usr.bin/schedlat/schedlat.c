@@ -0,0 +1,152 @@
+/*
+ * Displays scheduler latency statistics read from /dev/schedstat.
+ *
+ * By default prints a summary line per thread with median and 99th percentile
+ * of wakeup-to-run latency. With -H prints full histograms of the system
+ * or, if -t is given, of the selected thread.
+ */
+
+#include <sys/schedstat.h>
+#include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define PATH_SCHEDSTAT "/dev/schedstat"
+
+static schedstat_t *schedstat_read(size_t *np) {
+  schedstat_t *ss = NULL;
+  size_t size = 0, len = 0;
+  ssize_t nread;
+  int fd;
+
+  if ((fd = open(PATH_SCHEDSTAT, O_RDONLY)) < 0)
+    err(EXIT_FAILURE, "%s", PATH_SCHEDSTAT);
+
+  do {
+    if (len == size) {
+      size = size ? size * 2 : 32 * sizeof(schedstat_t);
+      if ((ss = realloc(ss, size)) == NULL)
+        err(EXIT_FAILURE, "realloc");
+    }
+    if ((nread = read(fd, (char *)ss + len, size - len)) < 0)
+      err(EXIT_FAILURE, "read");
+    len += nread;
+  } while (nread > 0);
+
+  close(fd);
+  *np = len / sizeof(schedstat_t);
+  return ss;
+}
+
+/* Upper bound of bucket's range in microseconds. */
+static uint64_t bucket_limit(int i) {
+  return (uint64_t)1 << i;
+}
+
+static uint64_t hist_total(const schedstat_hist_t *h) {
+  uint64_t total = 0;
+  for (int i = 0; i < SCHEDSTAT_NBUCKETS; i++)
+    total += h->h_count[i];
+  return total;
+}
+
+/* Returns upper bound of the bucket containing given percentile. */
+static uint64_t hist_percentile(const schedstat_hist_t *h, int pct) {
+  uint64_t total = hist_total(h), sum = 0;
+
+  if (total == 0)
+    return 0;
+
+  for (int i = 0; i < SCHEDSTAT_NBUCKETS; i++) {
+    sum += h->h_count[i];
+    if (sum * 100 >= total * pct)
+      return bucket_limit(i);
+  }
+  return bucket_limit(SCHEDSTAT_NBUCKETS - 1);
+}
+
+static void hist_print(const char *title, const schedstat_hist_t *h) {
+  uint64_t total = hist_total(h);
+
+  printf("%s (%" PRIu64 " samples):\n", title, total);
+  if (total == 0)
+    return;
+
+  for (int i = 0; i < SCHEDSTAT_NBUCKETS; i++) {
+    if (h->h_count[i] == 0)
+      continue;
+    int bar = (int)((uint64_t)h->h_count[i] * 40 / total);
+    printf("  < %10" PRIu64 "us %10" PRIu32 " |%.*s\n", bucket_limit(i),
+           h->h_count[i], bar, "########################################");
+  }
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: schedlat [-H] [-t tid]\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  int histograms = 0, ch;
+  long tid = -1;
+  size_t n;
+
+  while ((ch = getopt(argc, argv, "Ht:")) != -1) {
+    switch (ch) {
+      case 'H':
+        histograms = 1;
+        break;
+      case 't':
+        tid = strtol(optarg, NULL, 10);
+        break;
+      default:
+        usage();
+    }
+  }
+
+  schedstat_t *ss = schedstat_read(&n);
+  if (n == 0)
+    errx(EXIT_FAILURE, "no scheduler statistics available");
+
+  if (histograms) {
+    /* First record describes the whole system. */
+    schedstat_t *s = &ss[0];
+    if (tid >= 0) {
+      for (s = &ss[1]; s < &ss[n]; s++)
+        if (s->ss_tid == (tid_t)tid)
+          break;
+      if (s == &ss[n])
+        errx(EXIT_FAILURE, "thread %ld not found", tid);
+    }
+    printf("%s: %" PRIu32 " switches, %" PRIu32 " preemptions, "
+           "max latency %" PRIu64 "us\n",
+           s->ss_name, s->ss_nctxsw, s->ss_npreempt, s->ss_maxlatency);
+    hist_print("wakeup-to-run latency", &s->ss_latency);
+    hist_print("slice usage", &s->ss_slice);
+    free(ss);
+    return EXIT_SUCCESS;
+  }
+
+  printf("%5s %-20s %8s %8s %10s %10s %10s\n", "tid", "name", "ctxsw",
+         "preempt", "p50[us]", "p99[us]", "max[us]");
+  for (size_t i = 0; i < n; i++) {
+    schedstat_t *s = &ss[i];
+    if (i > 0 && tid >= 0 && s->ss_tid != (tid_t)tid)
+      continue;
+    if (i == 0)
+      printf("%5s ", "-");
+    else
+      printf("%5" PRIu32 " ", (uint32_t)s->ss_tid);
+    printf("%-20.20s %8" PRIu32 " %8" PRIu32 " %10" PRIu64 " %10" PRIu64
+           " %10" PRIu64 "\n",
+           s->ss_name, s->ss_nctxsw, s->ss_npreempt,
+           hist_percentile(&s->ss_latency, 50),
+           hist_percentile(&s->ss_latency, 99), s->ss_maxlatency);
+  }
+
+  free(ss);
+  return EXIT_SUCCESS;
+}